@@ -0,0 +1,128 @@
+/*
+ This example checks the accuracy of FFTCC with image pyramid and sub-pixel
+ peak fitting, using synthetic speckle images translated by known integer and
+ sub-pixel displacements. The pyramid should be as accurate as a single level.
+*/
+
+#include <cmath>
+#include <random>
+
+#include "opencorr.h"
+
+using namespace opencorr;
+using namespace std;
+
+//render a pattern of Gaussian speckles translated by (u, v), the speckles are evaluated at
+//each pixel, so that the translated images are exact
+void renderSpeckle(Image2D& image, vector<Point2D>& speckles, float u, float v)
+{
+	image.eg_mat.setConstant(20.f);
+	int support = 6;
+	for (int i = 0; i < (int)speckles.size(); i++)
+	{
+		float center_x = speckles[i].x + u;
+		float center_y = speckles[i].y + v;
+		int x_min = max(0, (int)floor(center_x) - support);
+		int y_min = max(0, (int)floor(center_y) - support);
+		int x_max = min(image.width - 1, (int)floor(center_x) + support);
+		int y_max = min(image.height - 1, (int)floor(center_y) + support);
+		for (int r = y_min; r <= y_max; r++)
+		{
+			for (int c = x_min; c <= x_max; c++)
+			{
+				float dx = c - center_x;
+				float dy = r - center_y;
+				image.eg_mat(r, c) += 150.f * expf(-(dx * dx + dy * dy) / 6.f);
+			}
+		}
+	}
+}
+
+//mean absolute error of the displacements estimated by FFTCC, the larger one of u and v
+float estimateError(FFTCC2D* fftcc, Image2D& ref_img, Image2D& tar_img, float u, float v)
+{
+	vector<POI2D> poi_queue;
+	for (int y = 64; y <= 192; y += 16)
+	{
+		for (int x = 64; x <= 192; x += 16)
+		{
+			poi_queue.push_back(POI2D(x, y));
+		}
+	}
+
+	fftcc->setImages(ref_img, tar_img);
+	fftcc->prepare();
+	fftcc->compute(poi_queue);
+
+	float error_u = 0.f;
+	float error_v = 0.f;
+	for (int i = 0; i < (int)poi_queue.size(); i++)
+	{
+		error_u += fabs(poi_queue[i].deformation.u - u);
+		error_v += fabs(poi_queue[i].deformation.v - v);
+	}
+	error_u /= poi_queue.size();
+	error_v /= poi_queue.size();
+
+	return max(error_u, error_v);
+}
+
+int main()
+{
+	//create the speckle pattern
+	int image_width = 256;
+	int image_height = 256;
+	int speckle_number = 3000;
+	mt19937 generator(1);
+	uniform_real_distribution<float> location(-20.f, 276.f);
+	vector<Point2D> speckles;
+	for (int i = 0; i < speckle_number; i++)
+	{
+		float x = location(generator);
+		float y = location(generator);
+		speckles.push_back(Point2D(x, y));
+	}
+
+	Image2D ref_img(image_width, image_height);
+	Image2D tar_img(image_width, image_height);
+	renderSpeckle(ref_img, speckles, 0.f, 0.f);
+
+	//set DIC parameters
+	int subset_radius_x = 16;
+	int subset_radius_y = 16;
+	int cpu_thread_number = omp_get_num_procs();
+	float max_error = 0.2f; //upper limit of mean absolute error, in pixels
+	float max_excess = 0.05f; //upper limit of the error of pyramid over the one of single level, in pixels
+
+	//integer and sub-pixel translations
+	float translation[2][2] = { { 8.f, 8.f }, { 6.4f, -3.3f } };
+	PeakFitting peak_fitting[2] = { PEAK_PARABOLIC, PEAK_GAUSSIAN };
+	string fitting_name[2] = { "parabolic", "Gaussian" };
+
+	FFTCC2D* fftcc = new FFTCC2D(subset_radius_x, subset_radius_y, cpu_thread_number);
+
+	int failure_number = 0;
+	for (int t = 0; t < 2; t++)
+	{
+		renderSpeckle(tar_img, speckles, translation[t][0], translation[t][1]);
+		for (int f = 0; f < 2; f++)
+		{
+			fftcc->setPeakFitting(peak_fitting[f]);
+
+			fftcc->setPyramid(0);
+			float single_error = estimateError(fftcc, ref_img, tar_img, translation[t][0], translation[t][1]);
+			fftcc->setPyramid(2);
+			float pyramid_error = estimateError(fftcc, ref_img, tar_img, translation[t][0], translation[t][1]);
+
+			bool passed = (pyramid_error < max_error && pyramid_error < single_error + max_excess);
+			failure_number += passed ? 0 : 1;
+			cout << "Translation (" << translation[t][0] << ", " << translation[t][1] << "), " << fitting_name[f]
+				<< " fitting: mean absolute error " << single_error << " with single level, " << pyramid_error
+				<< " with pyramid, " << (passed ? "passed." : "failed.") << std::endl;
+		}
+	}
+
+	delete fftcc;
+
+	return failure_number;
+}
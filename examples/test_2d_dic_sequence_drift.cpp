@@ -0,0 +1,127 @@
+/*
+ This example checks the accumulated displacements of an image sequence, using
+ synthetic speckle images translated by known sub-pixel displacements in each
+ frame. The reference image is updated every few frames, the small systematic
+ error of each increment is accumulated at the updates, but the displacements
+ w.r.t. the first reference should not drift further through the sequence.
+*/
+
+#include <cmath>
+#include <random>
+
+#include "opencorr.h"
+
+using namespace opencorr;
+using namespace std;
+
+//render a pattern of Gaussian speckles translated by (u, v), the speckles are evaluated at
+//each pixel, so that the translated images are exact
+void renderSpeckle(Image2D& image, vector<Point2D>& speckles, float u, float v)
+{
+	image.eg_mat.setConstant(20.f);
+	int support = 6;
+	for (int i = 0; i < (int)speckles.size(); i++)
+	{
+		float center_x = speckles[i].x + u;
+		float center_y = speckles[i].y + v;
+		int x_min = max(0, (int)floor(center_x) - support);
+		int y_min = max(0, (int)floor(center_y) - support);
+		int x_max = min(image.width - 1, (int)floor(center_x) + support);
+		int y_max = min(image.height - 1, (int)floor(center_y) + support);
+		for (int r = y_min; r <= y_max; r++)
+		{
+			for (int c = x_min; c <= x_max; c++)
+			{
+				float dx = c - center_x;
+				float dy = r - center_y;
+				image.eg_mat(r, c) += 150.f * expf(-(dx * dx + dy * dy) / 6.f);
+			}
+		}
+	}
+}
+
+int main()
+{
+	//create the speckle pattern
+	int image_width = 256;
+	int image_height = 256;
+	int speckle_number = 3000;
+	mt19937 generator(1);
+	uniform_real_distribution<float> location(-20.f, 276.f);
+	vector<Point2D> speckles;
+	for (int i = 0; i < speckle_number; i++)
+	{
+		float x = location(generator);
+		float y = location(generator);
+		speckles.push_back(Point2D(x, y));
+	}
+
+	Image2D ref_img(image_width, image_height);
+	Image2D tar_img(image_width, image_height);
+	renderSpeckle(ref_img, speckles, 0.f, 0.f);
+
+	//set DIC parameters
+	int subset_radius_x = 16;
+	int subset_radius_y = 16;
+	int max_iteration = 10;
+	float max_deformation_norm = 0.001f;
+	int cpu_thread_number = omp_get_num_procs();
+	int frame_number = 9;
+	int update_interval = 3;
+	float frame_translation_u = 1.37f; //translation between two frames, in pixels
+	float frame_translation_v = -0.71f;
+	float max_error = 0.02f; //upper limit of mean absolute error in each frame, in pixels, about 0.004 per update of reference is expected
+
+	//with the threshold of ZNCC over 1, FFTCC is called in each frame with the last displacement as initial guess
+	float zncc_threshold[2] = { 0.9f, 1.1f };
+	string case_name[2] = { "FFTCC for lost POIs", "FFTCC for all POIs" };
+
+	int failure_number = 0;
+	for (int t = 0; t < 2; t++)
+	{
+		vector<POI2D> poi_queue;
+		for (int y = 64; y <= 192; y += 8)
+		{
+			for (int x = 64; x <= 192; x += 8)
+			{
+				poi_queue.push_back(POI2D(x, y));
+			}
+		}
+
+		SequenceRunner2D* sequence = new SequenceRunner2D(subset_radius_x, subset_radius_y, max_deformation_norm, max_iteration, cpu_thread_number);
+		sequence->setThreshold(zncc_threshold[t]);
+		sequence->setUpdateInterval(update_interval);
+		sequence->setReference(ref_img, poi_queue);
+
+		float max_frame_error = 0.f;
+		for (int i = 1; i <= frame_number; i++)
+		{
+			float u = frame_translation_u * i;
+			float v = frame_translation_v * i;
+			renderSpeckle(tar_img, speckles, u, v);
+			sequence->compute(tar_img, poi_queue);
+
+			float error_u = 0.f;
+			float error_v = 0.f;
+			for (int j = 0; j < (int)poi_queue.size(); j++)
+			{
+				error_u += fabs(poi_queue[j].deformation.u - u);
+				error_v += fabs(poi_queue[j].deformation.v - v);
+			}
+			error_u /= poi_queue.size();
+			error_v /= poi_queue.size();
+			max_frame_error = max(max_frame_error, max(error_u, error_v));
+
+			cout << case_name[t] << ", frame " << i << ": mean absolute error " << error_u << " in u, " << error_v << " in v." << std::endl;
+		}
+
+		bool passed = (max_frame_error < max_error);
+		failure_number += passed ? 0 : 1;
+		cout << case_name[t] << ": maximum error " << max_frame_error << " through " << frame_number << " frames, "
+			<< (passed ? "passed." : "failed.") << std::endl;
+
+		delete sequence;
+	}
+
+	return failure_number;
+}
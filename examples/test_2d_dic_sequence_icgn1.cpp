@@ -0,0 +1,140 @@
+/*
+ This example demonstrates how to use OpenCorr to process an image sequence,
+ in which the deformation obtained in a frame serves as the initial guess for
+ the next one. FFT-CC algorithm is called only for the POIs not tracked well
+ in the last frame, and IC-GN algorithm (with the 1st order shape function)
+ reuses the data of reference image through the sequence.
+*/
+
+#include <fstream>
+
+#include "opencorr.h"
+
+using namespace opencorr;
+using namespace std;
+
+int main()
+{
+	//set files to process, the frames are named as oht_cfrp_0.bmp, oht_cfrp_1.bmp, ...
+	string image_path_prefix = "d:/dic_tests/2d_dic/oht_cfrp_"; //replace it with the path on your computer
+	string image_path_suffix = ".bmp";
+	int frame_number = 5; //number of target images
+	Image2D ref_img(image_path_prefix + "0" + image_path_suffix);
+	Image2D tar_img(image_path_prefix + "1" + image_path_suffix);
+
+	//initialize papameters for timing
+	double timer_tic, timer_toc, consumed_time;
+	vector<double> computation_time;
+
+	//get the time of start
+	timer_tic = omp_get_wtime();
+
+	//create instances to read and write csv files
+	string file_path;
+	string delimiter = ",";
+	ofstream csv_out; //instance for output calculation time
+	IO2D in_out; //instance for input and output DIC data
+	in_out.setDelimiter(delimiter);
+	in_out.setHeight(ref_img.height);
+	in_out.setWidth(ref_img.width);
+
+	//set OpenMP parameters
+	int cpu_thread_number = omp_get_num_procs() - 1;
+	omp_set_num_threads(cpu_thread_number);
+
+	//set DIC parameters
+	int subset_radius_x = 16;
+	int subset_radius_y = 16;
+	int max_iteration = 10;
+	float max_deformation_norm = 0.001f;
+
+	//set POIs
+	Point2D upper_left_point(30, 30);
+	vector<POI2D> poi_queue;
+	int poi_number_x = 100;
+	int poi_number_y = 300;
+	int grid_space = 2;
+
+	//store POIs in a queue
+	for (int i = 0; i < poi_number_y; i++)
+	{
+		for (int j = 0; j < poi_number_x; j++)
+		{
+			Point2D offset(j * grid_space, i * grid_space);
+			Point2D current_point = upper_left_point + offset;
+			POI2D current_poi(current_point);
+			poi_queue.push_back(current_poi);
+		}
+	}
+
+	//create the runner of sequence
+	SequenceRunner2D* sequence = new SequenceRunner2D(subset_radius_x, subset_radius_y, max_deformation_norm, max_iteration, cpu_thread_number);
+	sequence->setThreshold(0.9f); //POIs with lower ZNCC in the last frame are estimated again using FFTCC
+	sequence->setUpdateInterval(0); //set a positive interval to update the reference image for large deformation
+	sequence->setMemoryBudget((size_t)2 << 30); //cache the reference data of POIs if they take less than 2 GB
+	sequence->setReference(ref_img, poi_queue);
+
+	//get the time of end 
+	timer_toc = omp_get_wtime();
+	consumed_time = timer_toc - timer_tic;
+	computation_time.push_back(consumed_time); //0
+
+	//display the time of initialization on screen
+	cout << "Initialization with " << poi_queue.size() << " POIs takes " << consumed_time << " sec, " << cpu_thread_number << " CPU threads launched." << std::endl;
+
+	for (int i = 1; i <= frame_number; i++)
+	{
+		//load the next frame into the same image
+		string tar_image_path = image_path_prefix + to_string(i) + image_path_suffix;
+		if (i > 1)
+		{
+			tar_img.load(tar_image_path);
+		}
+
+		//get the time of start
+		timer_tic = omp_get_wtime();
+
+		sequence->compute(tar_img, poi_queue);
+
+		//get the time of end 
+		timer_toc = omp_get_wtime();
+		consumed_time = timer_toc - timer_tic;
+		computation_time.push_back(consumed_time); //i
+
+		//display the time of processing on screen
+		cout << "Frame " << i << " takes " << consumed_time << " sec." << std::endl;
+
+		//save the calculated dispalcements
+		file_path = tar_image_path.substr(0, tar_image_path.find_last_of(".")) + "_sequence_icgn1_r16.csv";
+		in_out.setPath(file_path);
+		in_out.saveTable2D(poi_queue);
+	}
+
+	//save the computation time
+	file_path = image_path_prefix + "sequence_icgn1_r16_time.csv";
+	csv_out.open(file_path);
+	if (csv_out.is_open())
+	{
+		csv_out << "POI number" << delimiter << "Initialization";
+		for (int i = 1; i <= frame_number; i++)
+		{
+			csv_out << delimiter << "Frame " << i;
+		}
+		csv_out << endl;
+		csv_out << poi_queue.size();
+		for (auto& frame_time : computation_time)
+		{
+			csv_out << delimiter << frame_time;
+		}
+		csv_out << endl;
+	}
+	csv_out.close();
+
+	//destroy the instance
+	delete sequence;
+
+	cout << "Press any key to exit..." << std::endl;
+	cin.get();
+
+	return 0;
+}
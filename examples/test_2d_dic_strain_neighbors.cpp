@@ -0,0 +1,106 @@
+/*
+ This example checks the selection of neighbor POIs in the calculation of
+ strain against a brute force search, on a dense grid of POIs where many of
+ them are not available, so that the subregions are topped up with the nearest
+ available POIs out of them.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "opencorr.h"
+
+using namespace opencorr;
+using namespace std;
+
+//select the available POIs in the subregion by brute force, topped up with the nearest available ones out of it,
+//then fit the displacement field and calculate the Cauchy strain
+StrainVector2D computeStrainBruteForce(POI2D& poi, vector<POI2D>& poi_queue, float subregion_radius, int min_neighbor_num, float zncc_threshold)
+{
+	int queue_size = (int)poi_queue.size();
+	vector<pair<float, int>> sorted_distance(queue_size);
+	for (int i = 0; i < queue_size; i++)
+	{
+		Point2D distance = poi_queue[i] - (Point2D)poi;
+		sorted_distance[i] = make_pair(distance.vectorNorm(), i);
+	}
+	sort(sorted_distance.begin(), sorted_distance.end());
+
+	Eigen::Matrix3d normal_matrix = Eigen::Matrix3d::Zero();
+	Eigen::Matrix<double, 3, 2> normal_vector = Eigen::Matrix<double, 3, 2>::Zero();
+	int neighbor_num = 0;
+	for (int i = 0; i < queue_size && (sorted_distance[i].first < subregion_radius || neighbor_num < min_neighbor_num); i++)
+	{
+		POI2D* neighbor_poi = &poi_queue[sorted_distance[i].second];
+		if (neighbor_poi->result.zncc >= zncc_threshold)
+		{
+			Eigen::Vector3d coefficient(1., neighbor_poi->x - poi.x, neighbor_poi->y - poi.y);
+			normal_matrix += coefficient * coefficient.transpose();
+			normal_vector.col(0) += coefficient * neighbor_poi->deformation.u;
+			normal_vector.col(1) += coefficient * neighbor_poi->deformation.v;
+			neighbor_num++;
+		}
+	}
+
+	Eigen::Matrix<double, 3, 2> gradient = normal_matrix.colPivHouseholderQr().solve(normal_vector);
+	StrainVector2D strain;
+	strain.exx = (float)gradient(1, 0);
+	strain.eyy = (float)gradient(2, 1);
+	strain.exy = (float)(0.5 * (gradient(2, 0) + gradient(1, 1)));
+	return strain;
+}
+
+int main()
+{
+	//dense grid of POIs with jittered locations, so that the distances between POIs do not tie,
+	//a smooth displacement field with noise is assigned to them, and 70% of them are not available
+	mt19937 generator(3);
+	uniform_real_distribution<float> jitter(-0.3f, 0.3f);
+	uniform_real_distribution<float> probability(0.f, 1.f);
+	normal_distribution<float> noise(0.f, 0.01f);
+	vector<POI2D> poi_queue;
+	for (int i = 0; i < 60; i++)
+	{
+		for (int j = 0; j < 60; j++)
+		{
+			POI2D poi(j * 2.f + jitter(generator), i * 2.f + jitter(generator));
+			poi.deformation.u = 0.002f * poi.x + 0.00005f * poi.x * poi.y + noise(generator);
+			poi.deformation.v = -0.001f * poi.y + 0.00003f * poi.x * poi.x + noise(generator);
+			poi.result.zncc = probability(generator) < 0.3f ? 0.95f : 0.5f;
+			poi_queue.push_back(poi);
+		}
+	}
+
+	//set strain parameters, about 40 POIs lie in a subregion, the available ones are fewer than required
+	float subregion_radius = 7.f;
+	int min_neighbor_num = 16;
+	float zncc_threshold = 0.9f;
+	int cpu_thread_number = omp_get_num_procs();
+	float max_difference = 1e-4f;
+
+	Strain* strain = new Strain(subregion_radius, min_neighbor_num, cpu_thread_number);
+	strain->setZnccThreshold(zncc_threshold);
+	strain->setDescription(1);
+	strain->setApproximation(1);
+	strain->prepare(poi_queue);
+	strain->compute(poi_queue);
+
+	float difference = 0.f;
+	for (int i = 0; i < (int)poi_queue.size(); i++)
+	{
+		StrainVector2D reference = computeStrainBruteForce(poi_queue[i], poi_queue, subregion_radius, min_neighbor_num, zncc_threshold);
+		for (int j = 0; j < 3; j++)
+		{
+			difference = max(difference, fabs(poi_queue[i].strain.e[j] - reference.e[j]));
+		}
+	}
+
+	bool passed = (difference < max_difference);
+	cout << "Max difference of strain to the brute force selection of neighbors: " << difference
+		<< (passed ? ", passed." : ", failed.") << std::endl;
+
+	delete strain;
+
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,124 @@
+/*
+ This example checks the DVC processed brick by brick against the one processed
+ on the whole volume, using synthetic speckle volumes. Several bricks are
+ processed at the same time with nested parallelism enabled, so that the
+ threads of each brick are active.
+*/
+
+#include <cmath>
+#include <random>
+
+#include "opencorr.h"
+
+using namespace opencorr;
+using namespace std;
+
+//render Gaussian speckles, the ones in target volume are deformed by a known displacement field
+void renderSpeckle(Image3D& ref_img, Image3D& tar_img, int speckle_number)
+{
+	mt19937 generator(5);
+	uniform_real_distribution<float> location(-10.f, ref_img.dim_x + 10.f);
+	Image3D* image[2] = { &ref_img, &tar_img };
+	int support = 3;
+	for (int n = 0; n < speckle_number; n++)
+	{
+		float x = location(generator);
+		float y = location(generator);
+		float z = location(generator);
+		float center[2][3] = { { x, y, z }, { x + 3.4f + 0.01f * (x - 48.f), y - 2.2f, z + 1.6f } };
+		for (int m = 0; m < 2; m++)
+		{
+			for (int i = (int)center[m][2] - support; i <= (int)center[m][2] + support; i++)
+			{
+				for (int j = (int)center[m][1] - support; j <= (int)center[m][1] + support; j++)
+				{
+					for (int k = (int)center[m][0] - support; k <= (int)center[m][0] + support; k++)
+					{
+						if (i < 0 || j < 0 || k < 0 || i >= image[m]->dim_z || j >= image[m]->dim_y || k >= image[m]->dim_x)
+						{
+							continue;
+						}
+						float dx = k - center[m][0];
+						float dy = j - center[m][1];
+						float dz = i - center[m][2];
+						image[m]->vol_mat[i][j][k] += 100.f * expf(-(dx * dx + dy * dy + dz * dz) / 3.f);
+					}
+				}
+			}
+		}
+	}
+}
+
+int main()
+{
+	//create the speckle volumes
+	int dimension = 96;
+	Image3D ref_img(dimension, dimension, dimension);
+	Image3D tar_img(dimension, dimension, dimension);
+	renderSpeckle(ref_img, tar_img, 30000);
+
+	//set OpenMP parameters, nested parallelism lets each brick in process use its share of threads
+	int cpu_thread_number = 4;
+	omp_set_num_threads(cpu_thread_number);
+	omp_set_nested(1);
+
+	//set DIC parameters
+	int subset_radius = 10;
+	int max_iteration = 10;
+	float max_deformation_norm = 0.001f;
+	float max_difference = 0.01f; //upper limit of the difference to the whole volume, in voxels
+
+	//set POIs
+	vector<POI3D> poi_queue;
+	for (int i = 20; i <= 76; i += 8)
+	{
+		for (int j = 20; j <= 76; j += 8)
+		{
+			for (int k = 20; k <= 76; k += 8)
+			{
+				poi_queue.push_back(POI3D(k, j, i));
+			}
+		}
+	}
+	int queue_length = (int)poi_queue.size();
+
+	//FFTCC and ICGN on the whole volume
+	vector<POI3D> whole_queue = poi_queue;
+	FFTCC3D* fftcc = new FFTCC3D(subset_radius, subset_radius, subset_radius, cpu_thread_number);
+	fftcc->setImages(ref_img, tar_img);
+	fftcc->compute(whole_queue);
+	ICGN3D1* icgn1 = new ICGN3D1(subset_radius, subset_radius, subset_radius, max_deformation_norm, max_iteration, cpu_thread_number);
+	icgn1->setImages(ref_img, tar_img);
+	icgn1->prepare();
+	icgn1->compute(whole_queue);
+
+	//bricks of 32^3 voxels, processed one at a time and three at a time
+	int failure_number = 0;
+	for (int pool_size = 1; pool_size <= 3; pool_size += 2)
+	{
+		vector<POI3D> brick_queue = poi_queue;
+		BrickRunner3D* brick_runner = new BrickRunner3D(subset_radius, subset_radius, subset_radius, max_deformation_norm, max_iteration, cpu_thread_number);
+		brick_runner->setBrick(32, 8, pool_size);
+		brick_runner->setImages(ref_img, tar_img);
+		brick_runner->compute(brick_queue);
+		delete brick_runner;
+
+		float difference = 0.f;
+		for (int i = 0; i < queue_length; i++)
+		{
+			difference = max(difference, fabs(brick_queue[i].deformation.u - whole_queue[i].deformation.u));
+			difference = max(difference, fabs(brick_queue[i].deformation.v - whole_queue[i].deformation.v));
+			difference = max(difference, fabs(brick_queue[i].deformation.w - whole_queue[i].deformation.w));
+		}
+
+		bool passed = (difference < max_difference);
+		failure_number += passed ? 0 : 1;
+		cout << pool_size << " brick(s) in process: max difference of displacement " << difference
+			<< (passed ? ", passed." : ", failed.") << std::endl;
+	}
+
+	delete fftcc;
+	delete icgn1;
+
+	return failure_number;
+}
@@ -16,8 +16,8 @@ int main()
 	//set files to process
 	string ref_image_path = "d:/dic_tests/dvc/al_foam4_0.bin"; //replace it with the path on your computer
 	string tar_image_path = "d:/dic_tests/dvc/al_foam4_1.bin"; //replace it with the path on your computer
-	Image3D ref_img(ref_image_path);
-	Image3D tar_img(tar_image_path);
+	Image3D ref_img(ref_image_path, PAGE_IN_WILLNEED); //bin files are mapped to memory instead of being copied
+	Image3D tar_img(tar_image_path, PAGE_IN_WILLNEED);
 
 	//initialize papameters for timing
 	double timer_tic, timer_toc, consumed_time;
@@ -82,10 +82,14 @@ int main()
 	//get the time of start
 	timer_tic = omp_get_wtime();
 
-	//FFTCC
+	//FFTCC, the subsets are transformed in batches with plans measured once and saved as wisdom for the next run
+	string wisdom_path = ref_image_path.substr(0, ref_image_path.find_last_of("/") + 1) + "fftw_wisdom.txt";
+	FFTW::importWisdom(wisdom_path);
 	FFTCC3D* fftcc = new FFTCC3D(subset_radius_x, subset_radius_y, subset_radius_z, cpu_thread_number);
+	fftcc->setBatch(8, FFTW_MEASURE);
 	fftcc->setImages(ref_img, tar_img);
 	fftcc->compute(poi_queue);
+	FFTW::exportWisdom(wisdom_path);
 
 	//get the time of end 
 	timer_toc = omp_get_wtime();
@@ -100,6 +104,7 @@ int main()
 
 	//ICGN with the 1st order shape function
 	ICGN3D1* icgn1 = new ICGN3D1(subset_radius_x, subset_radius_y, subset_radius_z, max_deformation_norm, max_iteration, cpu_thread_number);
+	icgn1->setLazyGradient(true); //gradients are calculated only in the subsets of POIs
 	icgn1->setImages(ref_img, tar_img);
 	icgn1->prepare();
 	icgn1->compute(poi_queue);
@@ -85,12 +85,12 @@ int main()
 	ref_img_gpu.dim_x = ref_img.dim_x;
 	ref_img_gpu.dim_y = ref_img.dim_y;
 	ref_img_gpu.dim_z = ref_img.dim_z;
-	ref_img_gpu.data = &ref_img.vol_mat[0][0][0];
+	ref_img_gpu.data = ref_img.vol_mat.data; //voxels of Image3D are contiguous
 
 	tar_img_gpu.dim_x = tar_img.dim_x;
 	tar_img_gpu.dim_y = tar_img.dim_y;
 	tar_img_gpu.dim_z = tar_img.dim_z;
-	tar_img_gpu.data = &tar_img.vol_mat[0][0][0];
+	tar_img_gpu.data = tar_img.vol_mat.data;
 
 	icgn1_gpu->setImages(ref_img_gpu, tar_img_gpu);
 
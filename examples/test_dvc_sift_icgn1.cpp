@@ -80,6 +80,8 @@ int main()
 	//SIFT extraction and matching
 	SIFT3D* sift = new SIFT3D();
 	sift->setImages(ref_img, tar_img);
+	//approximate matching in a kd-tree of PCA-reduced descriptors, for large amounts of keypoints
+	//sift->setMatchingMethod(MATCHING_KDTREE);
 	sift->prepare();
 	sift->compute();
 
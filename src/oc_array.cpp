@@ -12,6 +12,23 @@
  * More information about OpenCorr can be found at https://www.opencorr.org/
  */
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "oc_array.h"
 
 namespace opencorr
@@ -55,5 +72,254 @@ namespace opencorr
 		destroyPtr(ptr);
 	}
 
+	float* newAligned1D(size_t length)
+	{
+		//over-allocate and keep the address returned by malloc just ahead of the aligned block
+		const size_t alignment = 64;
+		void* raw = malloc(length * sizeof(float) + alignment + sizeof(void*));
+		if (raw == nullptr) return nullptr;
+
+		uintptr_t address = ((uintptr_t)raw + sizeof(void*) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+		float* ptr = (float*)address;
+		((void**)ptr)[-1] = raw;
+		memset(ptr, 0, length * sizeof(float));
+
+		return ptr;
+	}
+
+	void deleteAligned1D(float*& ptr)
+	{
+		if (ptr == nullptr) return;
+		free(((void**)ptr)[-1]);
+		ptr = nullptr;
+	}
+
+	//read one byte in each page of a block, so that the whole block is in memory
+	static void touchPages(const char* address, size_t length)
+	{
+#ifdef _WIN32
+		SYSTEM_INFO system_info;
+		GetSystemInfo(&system_info);
+		const size_t page_size = (size_t)system_info.dwPageSize;
+#else
+		const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+#endif
+		int page_number = (int)((length + page_size - 1) / page_size);
+		long long checksum = 0;
+
+#pragma omp parallel for reduction(+:checksum)
+		for (int i = 0; i < page_number; i++)
+		{
+			checksum += address[(size_t)i * page_size];
+		}
+
+		//keep the reads from being optimized away
+		volatile long long sink = checksum;
+		(void)sink;
+	}
+
+	Volume3D::Volume3D(int dim_x, int dim_y, int dim_z, int halo, bool aligned_rows)
+	{
+		allocate(dim_x, dim_y, dim_z, halo, aligned_rows);
+	}
+
+	Volume3D::Volume3D(Volume3D&& volume) noexcept
+	{
+		*this = std::move(volume);
+	}
+
+	Volume3D& Volume3D::operator=(Volume3D&& volume) noexcept
+	{
+		if (this != &volume)
+		{
+			release();
+			dim_x = volume.dim_x;
+			dim_y = volume.dim_y;
+			dim_z = volume.dim_z;
+			halo = volume.halo;
+			row_stride = volume.row_stride;
+			slice_stride = volume.slice_stride;
+			buffer_length = volume.buffer_length;
+			data = volume.data;
+			buffer = volume.buffer;
+			mapping = volume.mapping;
+			mapping_length = volume.mapping_length;
+
+			volume.buffer = nullptr;
+			volume.data = nullptr;
+			volume.mapping = nullptr;
+			volume.release();
+		}
+		return *this;
+	}
+
+	Volume3D::~Volume3D()
+	{
+		release();
+	}
+
+	void Volume3D::allocate(int dim_x, int dim_y, int dim_z, int halo, bool aligned_rows)
+	{
+		//with aligned rows, the first voxel of each row is put on the boundary of cache line
+		const long long floats_per_line = 16;
+		long long front_x = halo;
+		long long row_length = (long long)dim_x + 2 * halo;
+		if (aligned_rows)
+		{
+			front_x = (halo + floats_per_line - 1) / floats_per_line * floats_per_line;
+			row_length = (front_x + dim_x + halo + floats_per_line - 1) / floats_per_line * floats_per_line;
+		}
+		long long slice_length = row_length * ((long long)dim_y + 2 * halo);
+		size_t length = (size_t)slice_length * ((size_t)dim_z + 2 * halo);
+
+		if (buffer != nullptr && mapping == nullptr && length == buffer_length && row_length == row_stride
+			&& dim_x == this->dim_x && dim_y == this->dim_y && dim_z == this->dim_z && halo == this->halo)
+		{
+			fill(0.f);
+			return;
+		}
+
+		release();
+		buffer = newAligned1D(length);
+		if (buffer == nullptr)
+		{
+			std::cerr << "Failed to allocate volume:" << dim_x << ", " << dim_y << ", " << dim_z << std::endl;
+			return;
+		}
+
+		this->dim_x = dim_x;
+		this->dim_y = dim_y;
+		this->dim_z = dim_z;
+		this->halo = halo;
+		row_stride = row_length;
+		slice_stride = slice_length;
+		buffer_length = length;
+		data = buffer + halo * slice_stride + halo * row_stride + front_x;
+	}
+
+	void Volume3D::release()
+	{
+		if (mapping != nullptr)
+		{
+#ifdef _WIN32
+			UnmapViewOfFile(mapping);
+#else
+			munmap(mapping, mapping_length);
+#endif
+			mapping = nullptr;
+			mapping_length = 0;
+			buffer = nullptr;
+		}
+		else
+		{
+			deleteAligned1D(buffer);
+		}
+		data = nullptr;
+		dim_x = dim_y = dim_z = 0;
+		halo = 0;
+		row_stride = slice_stride = 0;
+		buffer_length = 0;
+	}
+
+	void Volume3D::fill(float value)
+	{
+		std::fill(buffer, buffer + buffer_length, value);
+	}
+
+	bool Volume3D::map(std::string file_path, size_t offset, int dim_x, int dim_y, int dim_z, PageInPolicy policy)
+	{
+		release();
+
+		//voxels must be aligned to the size of float
+		if (offset % sizeof(float) != 0)
+		{
+			return false;
+		}
+
+		//map the whole file with copy-on-write pages, the voxels follow the header in it
+		size_t data_length = (size_t)dim_x * dim_y * dim_z * sizeof(float);
+		size_t file_length = 0;
+		void* address = nullptr;
+#ifdef _WIN32
+		HANDLE file = CreateFileA(file_path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+
+		LARGE_INTEGER file_size;
+		if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0 && (size_t)file_size.QuadPart >= offset + data_length)
+		{
+			file_length = (size_t)file_size.QuadPart;
+			HANDLE file_mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+			if (file_mapping != NULL)
+			{
+				address = MapViewOfFile(file_mapping, FILE_MAP_COPY, 0, 0, 0);
+				CloseHandle(file_mapping);
+			}
+		}
+		CloseHandle(file);
+#else
+		int file = open(file_path.c_str(), O_RDONLY);
+		if (file < 0)
+		{
+			return false;
+		}
+
+		struct stat file_status;
+		if (fstat(file, &file_status) == 0 && file_status.st_size > 0 && (size_t)file_status.st_size >= offset + data_length)
+		{
+			file_length = (size_t)file_status.st_size;
+			address = mmap(nullptr, file_length, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+			if (address == MAP_FAILED)
+			{
+				address = nullptr;
+			}
+		}
+		close(file);
+#endif
+		if (address == nullptr)
+		{
+			return false;
+		}
+
+		mapping = address;
+		mapping_length = file_length;
+		this->dim_x = dim_x;
+		this->dim_y = dim_y;
+		this->dim_z = dim_z;
+		halo = 0;
+		row_stride = dim_x;
+		slice_stride = (long long)dim_x * dim_y;
+		buffer_length = (size_t)dim_x * dim_y * dim_z;
+		data = (float*)((char*)address + offset);
+		buffer = data;
+
+		//advice on paging, which is not available on Windows, where the pages are read on first access
+#ifndef _WIN32
+		switch (policy)
+		{
+		case PAGE_IN_SEQUENTIAL:
+			posix_madvise(mapping, mapping_length, POSIX_MADV_SEQUENTIAL);
+			break;
+		case PAGE_IN_RANDOM:
+			posix_madvise(mapping, mapping_length, POSIX_MADV_RANDOM);
+			break;
+		case PAGE_IN_WILLNEED:
+		case PAGE_IN_TOUCH:
+			posix_madvise(mapping, mapping_length, POSIX_MADV_WILLNEED);
+			break;
+		default:
+			break;
+		}
+#endif
+		if (policy == PAGE_IN_TOUCH)
+		{
+			touchPages((const char*)mapping, mapping_length);
+		}
+
+		return true;
+	}
+
 }//namespace opencorr
 
@@ -17,12 +17,23 @@
 #ifndef _ARRAY_H_
 #define _ARRAY_H_
 
+#include <cstddef>
+#include <string>
 #include <Eigen/Eigen>
 
 typedef Eigen::Matrix<float, 6, 6> Matrix6f;
 typedef Eigen::Matrix<float, 12, 12> Matrix12f;
+typedef Eigen::Matrix<float, 10, 10> Matrix10f;
+typedef Eigen::Matrix<float, 30, 30> Matrix30f;
 typedef Eigen::Matrix<float, 6, 1> Vector6f;
 typedef Eigen::Matrix<float, 4, 1> Vector4f;
+typedef Eigen::Matrix<float, 12, 1> Vector12f;
+typedef Eigen::Matrix<float, 10, 1> Vector10f;
+typedef Eigen::Matrix<float, 30, 1> Vector30f;
+typedef Eigen::Matrix<float, Eigen::Dynamic, 6, Eigen::RowMajor> RowMatrixX6f;
+typedef Eigen::Matrix<float, Eigen::Dynamic, 12, Eigen::RowMajor> RowMatrixX12f;
+typedef Eigen::Matrix<float, Eigen::Dynamic, 30, Eigen::RowMajor> RowMatrixX30f;
+typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> RowMatrixXf;
 
 namespace opencorr
 {
@@ -38,6 +49,85 @@ namespace opencorr
 	float**** new4D(int dimension1, int dimension2, int dimension3, int dimension4); //array[dimension1][dimension2][dimension3][dimension4]
 	void delete4D(float****& ptr);
 
+	//new and delete 1d array aligned to the boundary of cache line (64 bytes), initialized with zero
+	float* newAligned1D(size_t length);
+	void deleteAligned1D(float*& ptr);
+
+	//policy of paging in a volume mapped from file
+	enum PageInPolicy
+	{
+		PAGE_IN_LAZY, //pages are read from file on first access
+		PAGE_IN_SEQUENTIAL, //hint of sequential access, pages are read ahead aggressively
+		PAGE_IN_RANDOM, //hint of random access, no read-ahead
+		PAGE_IN_WILLNEED, //the whole file is read into page cache in background
+		PAGE_IN_TOUCH //the whole file is read before return, using multiple threads
+	};
+
+	//contiguous 3d array of float stored in the order of [z][y][x], voxel (z, y, x) is located at
+	//data[z * slice_stride + y * row_stride + x]. an allocated block is aligned to the boundary of cache line,
+	//the rows can be padded to a multiple of cache line, and a halo of voxels can be reserved around
+	//the volume, which is accessed with negative indices or the ones beyond the dimensions
+	class Volume3D
+	{
+	public:
+		//pointer of rows in a slice, so that a voxel can be accessed as volume[z][y][x]
+		struct Slice
+		{
+			float* ptr;
+			long long row_stride;
+
+			float* operator[](int y) const { return ptr + y * row_stride; }
+		};
+
+		int dim_x = 0, dim_y = 0, dim_z = 0;
+		int halo = 0; //number of voxels reserved on each side
+		long long row_stride = 0; //number of floats between two adjacent rows
+		long long slice_stride = 0; //number of floats between two adjacent slices
+		size_t buffer_length = 0; //number of floats allocated, including padding and halo
+
+		float* data = nullptr; //address of voxel (0, 0, 0)
+		float* buffer = nullptr; //address of the allocated block
+
+		//the block may be a copy-on-write mapping of a file instead of allocated memory
+		void* mapping = nullptr; //address of the mapped file
+		size_t mapping_length = 0; //length of the mapped file in bytes
+
+		Volume3D() = default;
+		Volume3D(int dim_x, int dim_y, int dim_z, int halo = 0, bool aligned_rows = false);
+		Volume3D(Volume3D&& volume) noexcept;
+		Volume3D& operator=(Volume3D&& volume) noexcept;
+		Volume3D(const Volume3D&) = delete;
+		Volume3D& operator=(const Volume3D&) = delete;
+		~Volume3D();
+
+		//allocate the block and initialize it with zero, the block is reused if its layout does not change
+		void allocate(int dim_x, int dim_y, int dim_z, int halo = 0, bool aligned_rows = false);
+		void release();
+		void fill(float value); //fill the whole block, including padding and halo
+
+		//map the voxels stored contiguously in a file from the given offset in bytes, modification of voxels
+		//is kept in private pages and never written back to file. false is returned if the file can not be mapped.
+		//a mapped volume has no padding and halo, and its data is aligned only as the offset in file allows
+		bool map(std::string file_path, size_t offset, int dim_x, int dim_y, int dim_z, PageInPolicy policy = PAGE_IN_LAZY);
+		bool isMapped() const { return mapping != nullptr; }
+
+		bool empty() const { return data == nullptr; }
+
+		//voxels are stored one after another without padding and halo, e.g. for bulk IO
+		bool isContiguous() const { return halo == 0 && row_stride == dim_x; }
+		size_t size() const { return (size_t)dim_x * dim_y * dim_z; }
+
+		long long index(int z, int y, int x) const { return z * slice_stride + y * row_stride + x; }
+		float* row(int z, int y) const { return data + z * slice_stride + y * row_stride; }
+		float& operator()(int z, int y, int x) const { return data[index(z, y, x)]; }
+
+		Slice operator[](int z) const
+		{
+			Slice slice = { data + z * slice_stride, row_stride };
+			return slice;
+		}
+	};
+
 	//allocate memory for 2d, 3d, and 4d arrays
 	template <class Real>
 	void createPtr(Real*& ptr, int dimension1)
@@ -48,38 +138,38 @@ namespace opencorr
 	template <class Real>
 	void createPtr(Real**& ptr, int dimension1, int dimension2)
 	{
-		Real* ptr1d = (Real*)calloc(dimension1 * dimension2, sizeof(Real));
+		Real* ptr1d = (Real*)calloc((size_t)dimension1 * dimension2, sizeof(Real));
 		ptr = (Real**)malloc(dimension1 * sizeof(Real*));
 
 		for (int i = 0; i < dimension1; i++)
 		{
-			ptr[i] = ptr1d + i * dimension2;
+			ptr[i] = ptr1d + (size_t)i * dimension2;
 		}
 	}
 
 	template <class Real>
 	void createPtr(Real***& ptr, int dimension1, int dimension2, int dimension3)
 	{
-		Real* ptr1d = (Real*)calloc(dimension1 * dimension2 * dimension3, sizeof(Real));
-		Real** ptr2d = (Real**)malloc(dimension1 * dimension2 * sizeof(Real*));
+		Real* ptr1d = (Real*)calloc((size_t)dimension1 * dimension2 * dimension3, sizeof(Real));
+		Real** ptr2d = (Real**)malloc((size_t)dimension1 * dimension2 * sizeof(Real*));
 		ptr = (Real***)malloc(dimension1 * sizeof(Real**));
 
 		for (int i = 0; i < dimension1; i++)
 		{
 			for (int j = 0; j < dimension2; j++)
 			{
-				ptr2d[i * dimension2 + j] = ptr1d + (i * dimension2 + j) * dimension3;
+				ptr2d[(size_t)i * dimension2 + j] = ptr1d + ((size_t)i * dimension2 + j) * dimension3;
 			}
-			ptr[i] = ptr2d + i * dimension2;
+			ptr[i] = ptr2d + (size_t)i * dimension2;
 		}
 	}
 
 	template <class Real>
 	void createPtr(Real****& ptr, int dimension1, int dimension2, int dimension3, int dimension4)
 	{
-		Real* ptr1d = (Real*)calloc(dimension1 * dimension2 * dimension3 * dimension4, sizeof(Real));
-		Real** ptr2d = (Real**)malloc(dimension1 * dimension2 * dimension3 * sizeof(Real*));
-		Real*** ptr3d = (Real***)malloc(dimension1 * dimension2 * sizeof(Real**));
+		Real* ptr1d = (Real*)calloc((size_t)dimension1 * dimension2 * dimension3 * dimension4, sizeof(Real));
+		Real** ptr2d = (Real**)malloc((size_t)dimension1 * dimension2 * dimension3 * sizeof(Real*));
+		Real*** ptr3d = (Real***)malloc((size_t)dimension1 * dimension2 * sizeof(Real**));
 		ptr = (Real****)malloc(dimension1 * sizeof(Real***));
 
 		for (int i = 0; i < dimension1; i++)
@@ -88,11 +178,11 @@ namespace opencorr
 			{
 				for (int k = 0; k < dimension3; k++)
 				{
-					ptr2d[(i * dimension2 + j) * dimension3 + k] = ptr1d + ((i * dimension2 + j) * dimension3 + k) * dimension4;
+					ptr2d[((size_t)i * dimension2 + j) * dimension3 + k] = ptr1d + (((size_t)i * dimension2 + j) * dimension3 + k) * dimension4;
 				}
-				ptr3d[i * dimension2 + j] = ptr2d + (i * dimension2 + j) * dimension3;
+				ptr3d[(size_t)i * dimension2 + j] = ptr2d + ((size_t)i * dimension2 + j) * dimension3;
 			}
-			ptr[i] = ptr3d + i * dimension2;
+			ptr[i] = ptr3d + (size_t)i * dimension2;
 		}
 	}
 
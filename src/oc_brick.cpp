@@ -0,0 +1,293 @@
+/*
+ * This file is part of OpenCorr, an open source C++ library for
+ * study and development of 2D, 3D/stereo and volumetric
+ * digital image correlation.
+ *
+ * Copyright (C) 2021-2024, Zhenyu Jiang <zhenyujiang@scut.edu.cn>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one from http://mozilla.org/MPL/2.0/.
+ *
+ * More information about OpenCorr can be found at https://www.opencorr.org/
+ */
+
+
+#include <algorithm>
+
+#include "oc_brick.h"
+
+namespace opencorr
+{
+	BrickRunner3D_* BrickRunner3D_::allocate(int subset_radius_x, int subset_radius_y, int subset_radius_z,
+		float conv_criterion, float stop_condition, int thread_number)
+	{
+		BrickRunner3D_* instance = new BrickRunner3D_;
+		instance->ref_brick = new Image3D(1, 1, 1);
+		instance->tar_brick = new Image3D(1, 1, 1);
+		instance->fftcc = new FFTCC3D(subset_radius_x, subset_radius_y, subset_radius_z, thread_number);
+		instance->icgn = new ICGN3D1(subset_radius_x, subset_radius_y, subset_radius_z, conv_criterion, stop_condition, thread_number);
+
+		return instance;
+	}
+
+	void BrickRunner3D_::release(BrickRunner3D_* instance)
+	{
+		delete instance->fftcc;
+		delete instance->icgn;
+		delete instance->ref_brick;
+		delete instance->tar_brick;
+		std::vector<POI3D>().swap(instance->poi_queue);
+		std::vector<int>().swap(instance->poi_idx);
+	}
+
+	BrickRunner3D::BrickRunner3D(int subset_radius_x, int subset_radius_y, int subset_radius_z,
+		float conv_criterion, float stop_condition, int thread_number)
+		: brick_size(128), search_margin(16), pool_size(1), fftcc_enabled(true)
+	{
+		this->subset_radius_x = subset_radius_x;
+		this->subset_radius_y = subset_radius_y;
+		this->subset_radius_z = subset_radius_z;
+		this->conv_criterion = conv_criterion;
+		this->stop_condition = stop_condition;
+		this->thread_number = thread_number;
+	}
+
+	BrickRunner3D::~BrickRunner3D()
+	{
+		for (auto& instance : instance_pool)
+		{
+			BrickRunner3D_::release(instance);
+			delete instance;
+		}
+		instance_pool.clear();
+	}
+
+	BrickRunner3D_* BrickRunner3D::getInstance(int tid)
+	{
+		if (tid >= (int)instance_pool.size())
+		{
+			throw std::string("CPU thread ID over limit");
+		}
+		return instance_pool[tid];
+	}
+
+	void BrickRunner3D::setIteration(float conv_criterion, float stop_condition)
+	{
+		this->conv_criterion = conv_criterion;
+		this->stop_condition = stop_condition;
+
+		for (auto& instance : instance_pool)
+		{
+			instance->icgn->setIteration(conv_criterion, stop_condition);
+		}
+	}
+
+	void BrickRunner3D::setBrick(int brick_size, int search_margin, int pool_size)
+	{
+		this->brick_size = brick_size;
+		this->search_margin = search_margin;
+		this->pool_size = pool_size > 0 ? pool_size : 1;
+	}
+
+	void BrickRunner3D::setFFTCC(bool fftcc_enabled)
+	{
+		this->fftcc_enabled = fftcc_enabled;
+	}
+
+	int BrickRunner3D::getHalo() const
+	{
+		//the coefficients of B-spline from the FIR prefilter are exact only 7 voxels away from the border of
+		//sub-volume, and the interpolation reads 2 more voxels
+		int max_radius = std::max(subset_radius_x, std::max(subset_radius_y, subset_radius_z));
+		return max_radius + search_margin + 9;
+	}
+
+	int BrickRunner3D::getBrickThreadNumber() const
+	{
+		//the threads are shared by the bricks in process
+		return std::max(1, thread_number / pool_size);
+	}
+
+	void BrickRunner3D::prepare()
+	{
+		for (auto& instance : instance_pool)
+		{
+			BrickRunner3D_::release(instance);
+			delete instance;
+		}
+		instance_pool.clear();
+
+		int brick_thread_number = getBrickThreadNumber();
+		for (int i = 0; i < pool_size; i++)
+		{
+			BrickRunner3D_* instance = BrickRunner3D_::allocate(subset_radius_x, subset_radius_y, subset_radius_z,
+				conv_criterion, stop_condition, brick_thread_number);
+			instance_pool.push_back(instance);
+		}
+	}
+
+	void BrickRunner3D::extract(Image3D* image, Image3D* brick, int origin[3], int dimension[3])
+	{
+		brick->dim_x = dimension[0];
+		brick->dim_y = dimension[1];
+		brick->dim_z = dimension[2];
+		brick->size = (unsigned long long)dimension[0] * dimension[1] * dimension[2];
+		brick->vol_mat.allocate(dimension[0], dimension[1], dimension[2]);
+
+#pragma omp parallel for
+		for (int i = 0; i < dimension[2]; i++)
+		{
+			for (int j = 0; j < dimension[1]; j++)
+			{
+				const float* image_row = image->vol_mat.row(origin[2] + i, origin[1] + j) + origin[0];
+				std::copy(image_row, image_row + dimension[0], brick->vol_mat.row(i, j));
+			}
+		}
+	}
+
+	void BrickRunner3D::computeBrick(BrickRunner3D_* instance, std::vector<POI3D>& poi_queue, int brick_xyz[3])
+	{
+		//sub-volume covering the brick and its halo, clipped by the border of image
+		int halo = getHalo();
+		int image_dimension[3] = { ref_img->dim_x, ref_img->dim_y, ref_img->dim_z };
+		int origin[3], dimension[3];
+		for (int d = 0; d < 3; d++)
+		{
+			int start = std::max(0, brick_xyz[d] * brick_size - halo);
+			int end = std::min(image_dimension[d], (brick_xyz[d] + 1) * brick_size + halo);
+			origin[d] = start;
+			dimension[d] = end - start;
+		}
+
+		//locate the POIs in the sub-volumes, the ones whose subsets run out of the sub-volumes are marked as invalid
+		instance->poi_queue.clear();
+		int valid_number = 0;
+		for (int i = 0; i < (int)instance->poi_idx.size(); i++)
+		{
+			int idx = instance->poi_idx[i];
+			POI3D local_poi = poi_queue[idx];
+			local_poi.x -= origin[0];
+			local_poi.y -= origin[1];
+			local_poi.z -= origin[2];
+
+			int x_min = (int)local_poi.x - subset_radius_x;
+			int y_min = (int)local_poi.y - subset_radius_y;
+			int z_min = (int)local_poi.z - subset_radius_z;
+			int x_max = (int)local_poi.x + subset_radius_x;
+			int y_max = (int)local_poi.y + subset_radius_y;
+			int z_max = (int)local_poi.z + subset_radius_z;
+			//the initial guess is rounded to integer voxels by FFTCC, either way is covered
+			int u_low = (int)floor(local_poi.deformation.u), u_high = (int)ceil(local_poi.deformation.u);
+			int v_low = (int)floor(local_poi.deformation.v), v_high = (int)ceil(local_poi.deformation.v);
+			int w_low = (int)floor(local_poi.deformation.w), w_high = (int)ceil(local_poi.deformation.w);
+			if (x_min < 0 || y_min < 0 || z_min < 0 || x_max > dimension[0] - 1 || y_max > dimension[1] - 1 || z_max > dimension[2] - 1
+				|| x_min + u_low < 0 || y_min + v_low < 0 || z_min + w_low < 0
+				|| x_max + u_high > dimension[0] - 1 || y_max + v_high > dimension[1] - 1 || z_max + w_high > dimension[2] - 1)
+			{
+				poi_queue[idx].result.zncc = -1;
+				continue;
+			}
+
+			instance->poi_queue.push_back(local_poi);
+			instance->poi_idx[valid_number++] = idx;
+		}
+		instance->poi_idx.resize(valid_number);
+		if (valid_number == 0)
+		{
+			return;
+		}
+
+		extract(ref_img, instance->ref_brick, origin, dimension);
+		extract(tar_img, instance->tar_brick, origin, dimension);
+
+		if (fftcc_enabled)
+		{
+			instance->fftcc->setImages(*instance->ref_brick, *instance->tar_brick);
+			instance->fftcc->prepare();
+			instance->fftcc->compute(instance->poi_queue);
+		}
+
+		instance->icgn->setImages(*instance->ref_brick, *instance->tar_brick);
+		instance->icgn->prepare();
+		instance->icgn->compute(instance->poi_queue);
+
+		//store the results with the locations in image
+		for (int i = 0; i < valid_number; i++)
+		{
+			POI3D* poi = &poi_queue[instance->poi_idx[i]];
+			Point3D location(poi->x, poi->y, poi->z);
+			*poi = instance->poi_queue[i];
+			poi->x = location.x;
+			poi->y = location.y;
+			poi->z = location.z;
+		}
+	}
+
+	void BrickRunner3D::compute(POI3D* poi)
+	{
+		std::vector<POI3D> poi_queue(1, *poi);
+		compute(poi_queue);
+		*poi = poi_queue[0];
+	}
+
+	void BrickRunner3D::compute(std::vector<POI3D>& poi_queue)
+	{
+		if ((int)instance_pool.size() != pool_size)
+		{
+			prepare();
+		}
+
+		//sort the POIs by the bricks they belong to, the bricks are ordered along x, y, and then z,
+		//following the layout of image
+		int brick_number_x = (ref_img->dim_x + brick_size - 1) / brick_size;
+		int brick_number_y = (ref_img->dim_y + brick_size - 1) / brick_size;
+		int brick_number_z = (ref_img->dim_z + brick_size - 1) / brick_size;
+		int queue_length = (int)poi_queue.size();
+		std::vector<std::pair<long long, int>> brick_key(queue_length);
+		for (int i = 0; i < queue_length; i++)
+		{
+			int brick_x = std::min(std::max((int)floor(poi_queue[i].x / brick_size), 0), brick_number_x - 1);
+			int brick_y = std::min(std::max((int)floor(poi_queue[i].y / brick_size), 0), brick_number_y - 1);
+			int brick_z = std::min(std::max((int)floor(poi_queue[i].z / brick_size), 0), brick_number_z - 1);
+			brick_key[i] = std::make_pair(((long long)brick_z * brick_number_y + brick_y) * brick_number_x + brick_x, i);
+		}
+		std::sort(brick_key.begin(), brick_key.end());
+
+		//position of the first POI of each brick in the sorted queue
+		std::vector<int> brick_start;
+		for (int i = 0; i < queue_length; i++)
+		{
+			if (i == 0 || brick_key[i].first != brick_key[i - 1].first)
+			{
+				brick_start.push_back(i);
+			}
+		}
+		brick_start.push_back(queue_length);
+		int brick_number = (int)brick_start.size() - 1;
+
+		//each brick in process has its own instance, with pool_size of 1 the threads of the instance process the POIs in the brick,
+		//otherwise they are active only if nested parallelism is enabled. the teams of the nested loops are limited to the
+		//number of threads the instances are allocated for
+		int brick_thread_number = getBrickThreadNumber();
+#pragma omp parallel for num_threads(pool_size) schedule(dynamic)
+		for (int b = 0; b < brick_number; b++)
+		{
+			omp_set_num_threads(brick_thread_number);
+			BrickRunner3D_* instance = getInstance(omp_get_thread_num());
+			instance->poi_idx.clear();
+			for (int i = brick_start[b]; i < brick_start[b + 1]; i++)
+			{
+				instance->poi_idx.push_back(brick_key[i].second);
+			}
+
+			long long key = brick_key[brick_start[b]].first;
+			int brick_xyz[3];
+			brick_xyz[0] = (int)(key % brick_number_x);
+			brick_xyz[1] = (int)((key / brick_number_x) % brick_number_y);
+			brick_xyz[2] = (int)(key / ((long long)brick_number_x * brick_number_y));
+			computeBrick(instance, poi_queue, brick_xyz);
+		}
+	}
+
+}//namespace opencorr
@@ -0,0 +1,101 @@
+/*
+ * This file is part of OpenCorr, an open source C++ library for
+ * study and development of 2D, 3D/stereo and volumetric
+ * digital image correlation.
+ *
+ * Copyright (C) 2021-2024, Zhenyu Jiang <zhenyujiang@scut.edu.cn>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one from http://mozilla.org/MPL/2.0/.
+ *
+ * More information about OpenCorr can be found at https://www.opencorr.org/
+ */
+
+
+#pragma once
+
+#ifndef _BRICK_H_
+#define _BRICK_H_
+
+#include <vector>
+
+#include "oc_dic.h"
+#include "oc_fftcc.h"
+#include "oc_icgn.h"
+#include "oc_image.h"
+#include "oc_poi.h"
+#include "oc_point.h"
+
+namespace opencorr
+{
+	//data of a brick in process, including the sub-volumes copied from ref and tar images,
+	//and the engines holding gradient and interpolation data of the sub-volumes
+	class BrickRunner3D_
+	{
+	public:
+		Image3D* ref_brick;
+		Image3D* tar_brick;
+		FFTCC3D* fftcc;
+		ICGN3D1* icgn;
+		std::vector<POI3D> poi_queue; //POIs in the brick, located in the sub-volumes
+		std::vector<int> poi_idx; //indices of the POIs in the input queue
+
+		static BrickRunner3D_* allocate(int subset_radius_x, int subset_radius_y, int subset_radius_z,
+			float conv_criterion, float stop_condition, int thread_number);
+		static void release(BrickRunner3D_* instance);
+	};
+
+	//out-of-core DVC, the volume is divided into bricks and the POIs are processed brick by brick.
+	//for each brick, only the sub-volumes of ref and tar images covering the brick and a halo are copied
+	//and prepared, thus the memory footprint is bounded by the size and number of bricks in process.
+	//images mapped from file (see Image3D::mapBin) are paged in as the bricks are processed.
+	//the halo is sized for the FIR prefilter of B-spline (PREFILTER_FIR), which ICGN3D1 uses. the recursive
+	//prefilter reaches farther and would give coefficients different from the ones of a whole-volume run
+	class BrickRunner3D : public DVC
+	{
+	private:
+		float conv_criterion; //convergence criterion of ICGN
+		float stop_condition; //stop condition of ICGN
+
+		int brick_size; //edge length of bricks, in voxels
+		int search_margin; //upper limit of displacement, in voxels
+		int pool_size; //number of bricks in process at the same time
+		bool fftcc_enabled; //FFTCC estimates initial guess, otherwise the deformation of POIs is taken
+
+		std::vector<BrickRunner3D_*> instance_pool; //one instance for each brick in process
+		BrickRunner3D_* getInstance(int tid);
+
+		//width of the halo around a brick, covering the subsets, their displacement and the support of B-spline prefilter
+		int getHalo() const;
+
+		//number of threads working on each brick in process, the instances are allocated for it
+		int getBrickThreadNumber() const;
+
+		//copy a sub-volume of image, whose origin is set as the first voxel
+		void extract(Image3D* image, Image3D* brick, int origin[3], int dimension[3]);
+
+		//process the POIs in a brick with the indices given in the instance
+		void computeBrick(BrickRunner3D_* instance, std::vector<POI3D>& poi_queue, int brick_xyz[3]);
+
+	public:
+		BrickRunner3D(int subset_radius_x, int subset_radius_y, int subset_radius_z,
+			float conv_criterion, float stop_condition, int thread_number);
+		~BrickRunner3D();
+
+		void setIteration(float conv_criterion, float stop_condition);
+
+		//pool_size bricks are processed concurrently, each by thread_number / pool_size threads,
+		//set pool_size as 1 to process one brick with all the threads and keep the least memory
+		void setBrick(int brick_size, int search_margin, int pool_size);
+		void setFFTCC(bool fftcc_enabled);
+
+		void prepare(); //create the instances of bricks in process
+
+		void compute(POI3D* poi);
+		void compute(std::vector<POI3D>& poi_queue);
+	};
+
+}//namespace opencorr
+
+#endif //_BRICK_H_
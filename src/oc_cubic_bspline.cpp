@@ -12,6 +12,10 @@
  * More information about OpenCorr can be found at https://www.opencorr.org/
  */
 
+#include <cfloat>
+#include <climits>
+#include <vector>
+
 #include "oc_cubic_bspline.h"
 
 namespace opencorr
@@ -29,6 +33,10 @@ namespace opencorr
 		return x > y ? x : y;
 	}
 
+	//number of adjacent voxels in the tile of x-lines filtered together by the tricubic prefilter,
+	//128 floats take 8 cache lines
+	static const int TRICUBIC_PREFILTER_TILE = 128;
+
 	//Four cubic B-spline basis functions when input falls in different range
 	static float basis0(float coor_decimal)
 	{
@@ -50,8 +58,77 @@ namespace opencorr
 		return (1.f / 6.f) * (coor_decimal * coor_decimal * coor_decimal); //(1/6)*(2-(2-x))^3 for x-2
 	}
 
+	//coefficients of the quadratic polynomial of y_local along a column of warped subset,
+	//warp holds the coefficients of (x^2, xy, y^2, x, y, 1) in local coordinates
+	static void getColumnPolynomial(const float warp[6], float center, float x_local, float column[3])
+	{
+		column[0] = center + warp[5] + x_local * (warp[3] + x_local * warp[0]);
+		column[1] = warp[4] + x_local * warp[1];
+		column[2] = warp[2];
+	}
+
+	//helpers of sampling, written with scalars and indexed loads to keep the batched loops vectorizable
+	static inline float cubicPolynomial(const float bc_matrix[4][4], int m, float decimal)
+	{
+		return bc_matrix[3][m] + decimal * (bc_matrix[2][m] + decimal * (bc_matrix[1][m] + decimal * bc_matrix[0][m]));
+	}
+
+	static inline float hornerPolynomial(const float* base, int offset, float decimal)
+	{
+		return base[offset] + decimal * (base[offset + 1] + decimal * (base[offset + 2] + decimal * base[offset + 3]));
+	}
+
+	static inline float dotProduct4(const float* base, int offset, float w0, float w1, float w2, float w3)
+	{
+		return base[offset] * w0 + base[offset + 1] * w1 + base[offset + 2] * w2 + base[offset + 3] * w3;
+	}
+
+	//coefficients of the quadratic polynomial of x_local along an x-line of warped subvolume,
+	//warp holds the coefficients of (x^2, xy, xz, y^2, yz, z^2, x, y, z, 1) in local coordinates
+	static void getLinePolynomial(const float warp[10], float center, float y_local, float z_local, float line[3])
+	{
+		line[0] = center + warp[9] + y_local * (warp[7] + y_local * warp[3] + z_local * warp[4]) + z_local * (warp[8] + z_local * warp[5]);
+		line[1] = warp[6] + y_local * warp[1] + z_local * warp[2];
+		line[2] = warp[0];
+	}
+
+	//integral parts and basis weights of the samples at origin + step * (n - radius), n = 0, 1, ..., 2 * radius,
+	//the integral parts minus 1 are counted from the lowest one, which is returned, the weights are stored in 4 blocks
+	static int getSeparableWeights(float origin, float step, int radius, int* start, float* weight)
+	{
+		int sample_number = 2 * radius + 1;
+		int lowest = INT_MAX;
+		for (int n = 0; n < sample_number; n++)
+		{
+			float coor = origin + step * (float)(n - radius);
+			int integral = (int)coor;
+			float decimal = coor - integral;
+			start[n] = integral - 1;
+			weight[n] = basis0(decimal);
+			weight[sample_number + n] = basis1(decimal);
+			weight[2 * sample_number + n] = basis2(decimal);
+			weight[3 * sample_number + n] = basis3(decimal);
+			lowest = start[n] < lowest ? start[n] : lowest;
+		}
+		for (int n = 0; n < sample_number; n++)
+		{
+			start[n] -= lowest;
+		}
+		return lowest;
+	}
+
+	//combine the 4x4 coefficients in a slice of the neighborhood, with the weights along x and y
+	static inline float sliceProduct4(const float* base, int offset, int row_stride,
+		float wx0, float wx1, float wx2, float wx3, float wy0, float wy1, float wy2, float wy3)
+	{
+		return wy0 * dotProduct4(base, offset, wx0, wx1, wx2, wx3)
+			+ wy1 * dotProduct4(base, offset + row_stride, wx0, wx1, wx2, wx3)
+			+ wy2 * dotProduct4(base, offset + 2 * row_stride, wx0, wx1, wx2, wx3)
+			+ wy3 * dotProduct4(base, offset + 3 * row_stride, wx0, wx1, wx2, wx3);
+	}
+
 	//bicubic B-spline interpolation
-	BicubicBspline::BicubicBspline(Image2D& image) :coefficient(nullptr)
+	BicubicBspline::BicubicBspline(Image2D& image) :coefficient(nullptr), lattice(nullptr)
 	{
 		if (image.height < 5 || image.width < 5)
 		{
@@ -65,10 +142,8 @@ namespace opencorr
 
 	BicubicBspline::~BicubicBspline()
 	{
-		if (coefficient != nullptr)
-		{
-			delete4D(coefficient);
-		}
+		deleteAligned1D(coefficient);
+		deleteAligned1D(lattice);
 	}
 
 	void BicubicBspline::setImage(Image2D& image)
@@ -83,18 +158,57 @@ namespace opencorr
 		}
 	}
 
+	void BicubicBspline::setLatticeMode(bool lattice_mode)
+	{
+		this->lattice_mode = lattice_mode;
+	}
+
 	void BicubicBspline::prepare()
 	{
-		if (coefficient != nullptr)
+		//the buffers are kept for an image of the same dimensions, e.g. the next frame of a sequence
+		bool reuse_buffer = (interp_img->width == width && interp_img->height == height);
+		if (!reuse_buffer || lattice_mode)
 		{
-			delete4D(coefficient);
+			deleteAligned1D(coefficient);
+		}
+		if (!reuse_buffer || !lattice_mode)
+		{
+			deleteAligned1D(lattice);
+		}
+
+		width = interp_img->width;
+		height = interp_img->height;
+
+		if (lattice_mode)
+		{
+			//keep a row-major copy of the image as control lattice, so that the 4x4 grid of a sample spans 4 short runs in memory
+			if (lattice == nullptr)
+			{
+				lattice = newAligned1D((size_t)height * width);
+			}
+
+#pragma omp parallel for
+			for (int r = 0; r < height; r++)
+			{
+				float* lattice_row = lattice + (size_t)r * width;
+				for (int c = 0; c < width; c++)
+				{
+					lattice_row[c] = interp_img->eg_mat(r, c);
+				}
+			}
+			return;
+		}
+
+		//the borders of table are never written, thus they remain zero in a reused buffer
+		if (coefficient == nullptr)
+		{
+			coefficient = newAligned1D((size_t)height * width * 16);
 		}
-		coefficient = new4D(interp_img->height, interp_img->width, 4, 4);
 
 #pragma omp parallel for
-		for (int r = 1; r < interp_img->height - 2; r++)
+		for (int r = 1; r < height - 2; r++)
 		{
-			for (int c = 1; c < interp_img->width - 2; c++)
+			for (int c = 1; c < width - 2; c++)
 			{
 				//fill grayscale values into 4x4 grid
 				float mat_q[4][4] = { 0.f };
@@ -105,7 +219,19 @@ namespace opencorr
 					}
 				}
 
-				//calculate interpolation coefficient matrix
+				//calculate interpolation coefficient matrix, P = BC * Q * BC^T, in two passes
+				float mat_t[4][4] = { 0.f };
+				for (int k = 0; k < 4; k++)
+				{
+					for (int m = 0; m < 4; m++)
+					{
+						for (int n = 0; n < 4; n++)
+						{
+							mat_t[k][m] += BC_MATRIX[k][n] * mat_q[n][m];
+						}
+					}
+				}
+
 				float mat_p[4][4] = { 0.f };
 				for (int k = 0; k < 4; k++)
 				{
@@ -113,31 +239,61 @@ namespace opencorr
 					{
 						for (int m = 0; m < 4; m++)
 						{
-							for (int n = 0; n < 4; n++)
-							{
-								mat_p[k][l] += BC_MATRIX[l][m] * BC_MATRIX[k][n] * mat_q[n][m];
-							}
+							mat_p[k][l] += mat_t[k][m] * BC_MATRIX[l][m];
 						}
 					}
 				}
 
 				//rearrange the order of coefficient matrix
+				float* local_coefficient = coefficient + ((size_t)r * width + c) * 16;
 				for (int k = 0; k < 4; k++)
 				{
 					for (int l = 0; l < 4; l++)
 					{
-						coefficient[r][c][k][l] = mat_p[3 - k][3 - l];
+						local_coefficient[k * 4 + l] = mat_p[3 - k][3 - l];
 					}
 				}
 			}
 		}
 	}
 
+	float BicubicBspline::computeFromTable(int x_integral, int y_integral, float x_decimal, float y_decimal) const
+	{
+		const float* local_coefficient = coefficient + ((size_t)y_integral * width + x_integral) * 16;
+
+		//evaluate the polynomial along x for each power of y, then combine along y
+		float row0 = hornerPolynomial(local_coefficient, 0, x_decimal);
+		float row1 = hornerPolynomial(local_coefficient, 4, x_decimal);
+		float row2 = hornerPolynomial(local_coefficient, 8, x_decimal);
+		float row3 = hornerPolynomial(local_coefficient, 12, x_decimal);
+
+		return row0 + y_decimal * (row1 + y_decimal * (row2 + y_decimal * row3));
+	}
+
+	float BicubicBspline::computeFromLattice(int x_integral, int y_integral, float x_decimal, float y_decimal) const
+	{
+		//weights of the 4 lattice nodes along x, w[m] = sum_k BC[k][m] * x^(3-k)
+		float weight_x0 = cubicPolynomial(BC_MATRIX, 0, x_decimal);
+		float weight_x1 = cubicPolynomial(BC_MATRIX, 1, x_decimal);
+		float weight_x2 = cubicPolynomial(BC_MATRIX, 2, x_decimal);
+		float weight_x3 = cubicPolynomial(BC_MATRIX, 3, x_decimal);
+
+		//combine the 4x4 lattice nodes around the location
+		const float* lattice_corner = lattice + ((size_t)(y_integral - 1) * width + x_integral - 1);
+		float row0 = dotProduct4(lattice_corner, 0, weight_x0, weight_x1, weight_x2, weight_x3);
+		float row1 = dotProduct4(lattice_corner, width, weight_x0, weight_x1, weight_x2, weight_x3);
+		float row2 = dotProduct4(lattice_corner, 2 * width, weight_x0, weight_x1, weight_x2, weight_x3);
+		float row3 = dotProduct4(lattice_corner, 3 * width, weight_x0, weight_x1, weight_x2, weight_x3);
+
+		return row0 * cubicPolynomial(BC_MATRIX, 0, y_decimal) + row1 * cubicPolynomial(BC_MATRIX, 1, y_decimal)
+			+ row2 * cubicPolynomial(BC_MATRIX, 2, y_decimal) + row3 * cubicPolynomial(BC_MATRIX, 3, y_decimal);
+	}
+
 	float BicubicBspline::compute(Point2D& location)
 	{
 		float value = 0.f;
 		if (location.x < 1 || location.y < 1
-			|| location.x >= interp_img->width - 2 || location.y >= interp_img->height - 2
+			|| location.x >= width - 2 || location.y >= height - 2
 			|| std::isnan(location.x) || std::isnan(location.y))
 		{
 			value = -1.f;
@@ -150,41 +306,187 @@ namespace opencorr
 			float x_decimal = location.x - x_integral;
 			float y_decimal = location.y - y_integral;
 
-			float x2_decimal = x_decimal * x_decimal;
-			float y2_decimal = y_decimal * y_decimal;
+			if (lattice_mode)
+			{
+				value = computeFromLattice(x_integral, y_integral, x_decimal, y_decimal);
+			}
+			else
+			{
+				value = computeFromTable(x_integral, y_integral, x_decimal, y_decimal);
+			}
+		}
 
-			float x3_decimal = x2_decimal * x_decimal;
-			float y3_decimal = y2_decimal * y_decimal;
+		return value;
+	}
 
-			float**& local_coefficient = coefficient[y_integral][x_integral];
 
-			value = local_coefficient[0][0]
-				+ local_coefficient[0][1] * x_decimal
-				+ local_coefficient[0][2] * x2_decimal
-				+ local_coefficient[0][3] * x3_decimal
+	void BicubicBspline::computeSubset(Deformation2D1& deformation, Point2D& center, int radius_x, int radius_y, Eigen::MatrixXf& subset)
+	{
+		if (!deformation.warp_matrix.allFinite())
+		{
+			Interpolation2D::computeSubset(deformation, center, radius_x, radius_y, subset);
+			return;
+		}
 
-				+ local_coefficient[1][0] * y_decimal
-				+ local_coefficient[1][1] * y_decimal * x_decimal
-				+ local_coefficient[1][2] * y_decimal * x2_decimal
-				+ local_coefficient[1][3] * y_decimal * x3_decimal
+		Eigen::Matrix3f& warp_matrix = deformation.warp_matrix;
+		float warp_x[6] = { 0.f, 0.f, 0.f, warp_matrix(0, 0), warp_matrix(0, 1), warp_matrix(0, 2) };
+		float warp_y[6] = { 0.f, 0.f, 0.f, warp_matrix(1, 0), warp_matrix(1, 1), warp_matrix(1, 2) };
 
-				+ local_coefficient[2][0] * y2_decimal
-				+ local_coefficient[2][1] * y2_decimal * x_decimal
-				+ local_coefficient[2][2] * y2_decimal * x2_decimal
-				+ local_coefficient[2][3] * y2_decimal * x3_decimal
+		computeWarpedSubset(warp_x, warp_y, center, radius_x, radius_y, subset);
+	}
 
-				+ local_coefficient[3][0] * y3_decimal
-				+ local_coefficient[3][1] * y3_decimal * x_decimal
-				+ local_coefficient[3][2] * y3_decimal * x2_decimal
-				+ local_coefficient[3][3] * y3_decimal * x3_decimal;
+	void BicubicBspline::computeSubset(Deformation2D2& deformation, Point2D& center, int radius_x, int radius_y, Eigen::MatrixXf& subset)
+	{
+		if (!deformation.warp_matrix.allFinite())
+		{
+			Interpolation2D::computeSubset(deformation, center, radius_x, radius_y, subset);
+			return;
 		}
 
-		return value;
+		Matrix6f& warp_matrix = deformation.warp_matrix;
+		float warp_x[6], warp_y[6];
+		for (int i = 0; i < 6; i++)
+		{
+			warp_x[i] = warp_matrix(3, i);
+			warp_y[i] = warp_matrix(4, i);
+		}
+
+		computeWarpedSubset(warp_x, warp_y, center, radius_x, radius_y, subset);
+	}
+
+	void BicubicBspline::computeWarpedSubset(const float warp_x[6], const float warp_y[6], Point2D& center, int radius_x, int radius_y, Eigen::MatrixXf& subset)
+	{
+		int subset_width = 2 * radius_x + 1;
+		int subset_height = 2 * radius_y + 1;
+
+		//along each column of subset, the warped coordinates are quadratic polynomials of y_local,
+		//x = column_x[0] + column_x[1] * y_local + column_x[2] * y_local^2, the same for y
+		float column_x[3], column_y[3];
+
+		//get the bounding box of warped subset, an affine warp maps the subset onto a parallelogram,
+		//thus its four corners are enough, otherwise all the sampling points are visited
+		bool affine = warp_x[0] == 0.f && warp_x[1] == 0.f && warp_x[2] == 0.f
+			&& warp_y[0] == 0.f && warp_y[1] == 0.f && warp_y[2] == 0.f;
+		int row_step = affine && subset_height > 1 ? subset_height - 1 : 1;
+		int col_step = affine && subset_width > 1 ? subset_width - 1 : 1;
+		float min_x = FLT_MAX, max_x = -FLT_MAX, min_y = FLT_MAX, max_y = -FLT_MAX;
+		for (int c = 0; c < subset_width; c += col_step)
+		{
+			getColumnPolynomial(warp_x, center.x, (float)(c - radius_x), column_x);
+			getColumnPolynomial(warp_y, center.y, (float)(c - radius_x), column_y);
+			for (int r = 0; r < subset_height; r += row_step)
+			{
+				float y_local = (float)(r - radius_y);
+				float x = column_x[0] + y_local * (column_x[1] + y_local * column_x[2]);
+				float y = column_y[0] + y_local * (column_y[1] + y_local * column_y[2]);
+				min_x = x < min_x ? x : min_x;
+				max_x = x > max_x ? x : max_x;
+				min_y = y < min_y ? y : min_y;
+				max_y = y > max_y ? y : max_y;
+			}
+		}
+
+		//fall back to the pixel-wise bounds check if the subset touches the border, a small margin absorbs round-off
+		const float margin = 0.01f;
+		if (!(min_x >= 1.f + margin && min_y >= 1.f + margin
+			&& max_x < width - 2 - margin && max_y < height - 2 - margin))
+		{
+			Point2D global_coor;
+			for (int c = 0; c < subset_width; c++)
+			{
+				getColumnPolynomial(warp_x, center.x, (float)(c - radius_x), column_x);
+				getColumnPolynomial(warp_y, center.y, (float)(c - radius_x), column_y);
+				for (int r = 0; r < subset_height; r++)
+				{
+					float y_local = (float)(r - radius_y);
+					global_coor.x = column_x[0] + y_local * (column_x[1] + y_local * column_x[2]);
+					global_coor.y = column_y[0] + y_local * (column_y[1] + y_local * column_y[2]);
+					subset(r, c) = BicubicBspline::compute(global_coor);
+				}
+			}
+			return;
+		}
+
+		//all the sampling points are inside, walk down the columns without any check,
+		//offsets are counted from the corner of bounding box so that they fit in 32-bit integers for gather loads
+		int x_base = (int)min_x - 1;
+		int y_base = (int)min_y - 1;
+		float bc_matrix[4][4];
+		for (int i = 0; i < 4; i++)
+		{
+			for (int j = 0; j < 4; j++)
+			{
+				bc_matrix[i][j] = BC_MATRIX[i][j];
+			}
+		}
+		int stride = width;
+
+		for (int c = 0; c < subset_width; c++)
+		{
+			getColumnPolynomial(warp_x, center.x, (float)(c - radius_x), column_x);
+			getColumnPolynomial(warp_y, center.y, (float)(c - radius_x), column_y);
+			float* subset_column = subset.col(c).data();
+			if (lattice_mode)
+			{
+				const float* lattice_base = lattice + (size_t)y_base * stride + x_base;
+#pragma omp simd
+				for (int r = 0; r < subset_height; r++)
+				{
+					float y_local = (float)(r - radius_y);
+					float x = column_x[0] + y_local * (column_x[1] + y_local * column_x[2]);
+					float y = column_y[0] + y_local * (column_y[1] + y_local * column_y[2]);
+					int x_integral = (int)x;
+					int y_integral = (int)y;
+
+					float x_decimal = x - x_integral;
+					float y_decimal = y - y_integral;
+
+					//weights of lattice nodes are kept in scalars, so that the compiler maps them onto vector registers
+					float weight_x0 = cubicPolynomial(bc_matrix, 0, x_decimal);
+					float weight_x1 = cubicPolynomial(bc_matrix, 1, x_decimal);
+					float weight_x2 = cubicPolynomial(bc_matrix, 2, x_decimal);
+					float weight_x3 = cubicPolynomial(bc_matrix, 3, x_decimal);
+
+					int offset = (y_integral - 1 - y_base) * stride + (x_integral - 1 - x_base);
+					float row0 = dotProduct4(lattice_base, offset, weight_x0, weight_x1, weight_x2, weight_x3);
+					float row1 = dotProduct4(lattice_base, offset + stride, weight_x0, weight_x1, weight_x2, weight_x3);
+					float row2 = dotProduct4(lattice_base, offset + 2 * stride, weight_x0, weight_x1, weight_x2, weight_x3);
+					float row3 = dotProduct4(lattice_base, offset + 3 * stride, weight_x0, weight_x1, weight_x2, weight_x3);
+
+					subset_column[r] = row0 * cubicPolynomial(bc_matrix, 0, y_decimal) + row1 * cubicPolynomial(bc_matrix, 1, y_decimal)
+						+ row2 * cubicPolynomial(bc_matrix, 2, y_decimal) + row3 * cubicPolynomial(bc_matrix, 3, y_decimal);
+				}
+			}
+			else
+			{
+				const float* coefficient_base = coefficient + ((size_t)y_base * stride + x_base) * 16;
+#pragma omp simd
+				for (int r = 0; r < subset_height; r++)
+				{
+					float y_local = (float)(r - radius_y);
+					float x = column_x[0] + y_local * (column_x[1] + y_local * column_x[2]);
+					float y = column_y[0] + y_local * (column_y[1] + y_local * column_y[2]);
+					int x_integral = (int)x;
+					int y_integral = (int)y;
+
+					float x_decimal = x - x_integral;
+					float y_decimal = y - y_integral;
+
+					int offset = ((y_integral - y_base) * stride + (x_integral - x_base)) * 16;
+					float row0 = hornerPolynomial(coefficient_base, offset, x_decimal);
+					float row1 = hornerPolynomial(coefficient_base, offset + 4, x_decimal);
+					float row2 = hornerPolynomial(coefficient_base, offset + 8, x_decimal);
+					float row3 = hornerPolynomial(coefficient_base, offset + 12, x_decimal);
+
+					subset_column[r] = row0 + y_decimal * (row1 + y_decimal * (row2 + y_decimal * row3));
+				}
+			}
+		}
 	}
 
 
 	//tricubic B-spline interpolation
-	TricubicBspline::TricubicBspline(Image3D& image) :coefficient(nullptr)
+	TricubicBspline::TricubicBspline(Image3D& image)
 	{
 		if (image.dim_x < 15 || image.dim_y < 15 || image.dim_z < 15)
 		{
@@ -198,10 +500,7 @@ namespace opencorr
 
 	TricubicBspline::~TricubicBspline()
 	{
-		if (coefficient != nullptr)
-		{
-			delete3D(coefficient);
-		}
+		coefficient.release();
 	}
 
 	void TricubicBspline::setImage(Image3D& image)
@@ -216,143 +515,212 @@ namespace opencorr
 		}
 	}
 
-	void TricubicBspline::prepare()
+	void TricubicBspline::setPrefilter(BsplinePrefilter prefilter)
 	{
-		if (coefficient != nullptr)
+		this->prefilter = prefilter;
+	}
+
+	void TricubicBspline::filterLinesFIR(float* origin, long long stride, int length, int width, float* buffer) const
+	{
+		//the preceding lines are overwritten before they are used, thus the 15 lines around the current one are kept
+		//in a ring buffer, where line r (clamped into the volume) takes slot (r + 7) & 15
+		for (int r = -7; r < 7; r++)
 		{
-			delete3D(coefficient);
+			const float* line = origin + getHigh(getLow(r, length - 1), 0) * stride;
+			float* slot = buffer + ((r + 7) & 15) * TRICUBIC_PREFILTER_TILE;
+			for (int x = 0; x < width; x++)
+			{
+				slot[x] = line[x];
+			}
 		}
-		coefficient = new3D(interp_img->dim_z, interp_img->dim_y, interp_img->dim_x);
-		float*** conv_buffer = new3D(interp_img->dim_z, interp_img->dim_y, interp_img->dim_x);
 
-		//convolution along x-axis
+		for (int r = 0; r < length; r++)
+		{
+			const float* line = origin + getLow(r + 7, length - 1) * stride;
+			float* slot = buffer + ((r + 14) & 15) * TRICUBIC_PREFILTER_TILE;
+			for (int x = 0; x < width; x++)
+			{
+				slot[x] = line[x];
+			}
+
+			const float* center = buffer + ((r + 7) & 15) * TRICUBIC_PREFILTER_TILE;
+			const float* low[7];
+			const float* high[7];
+			for (int t = 0; t < 7; t++)
+			{
+				low[t] = buffer + ((r + 6 - t) & 15) * TRICUBIC_PREFILTER_TILE;
+				high[t] = buffer + ((r + 8 + t) & 15) * TRICUBIC_PREFILTER_TILE;
+			}
+
+			float* output = origin + r * stride;
+			for (int x = 0; x < width; x++)
+			{
+				output[x] = BSPLINE_PREFILTER[0] * center[x]
+					+ BSPLINE_PREFILTER[1] * (low[0][x] + high[0][x])
+					+ BSPLINE_PREFILTER[2] * (low[1][x] + high[1][x])
+					+ BSPLINE_PREFILTER[3] * (low[2][x] + high[2][x])
+					+ BSPLINE_PREFILTER[4] * (low[3][x] + high[3][x])
+					+ BSPLINE_PREFILTER[5] * (low[4][x] + high[4][x])
+					+ BSPLINE_PREFILTER[6] * (low[5][x] + high[5][x])
+					+ BSPLINE_PREFILTER[7] * (low[6][x] + high[6][x]);
+			}
+		}
+	}
+
+	void TricubicBspline::filterLinesRecursive(float* origin, long long stride, int length, int width, float* buffer) const
+	{
+		const float pole = BSPLINE_POLE;
+		const float gain = (1.f - pole) * (1.f - 1.f / pole);
+
+		//a single sample is mirrored into a constant line, whose coefficients equal the sample
+		if (length < 2)
+		{
+			return;
+		}
+
+		//initial causal coefficient, the sum of samples weighted by the powers of pole, truncated when they drop below
+		//the float precision
+		int horizon = getLow(length, (int)ceil(log(FLT_EPSILON) / log(fabs(pole))));
+		for (int x = 0; x < width; x++)
+		{
+			buffer[x] = origin[x];
+		}
+		float weight = pole;
+		for (int r = 1; r < horizon; r++)
+		{
+			const float* line = origin + r * stride;
+			for (int x = 0; x < width; x++)
+			{
+				buffer[x] += weight * line[x];
+			}
+			weight *= pole;
+		}
+		for (int x = 0; x < width; x++)
+		{
+			origin[x] = gain * buffer[x];
+		}
+
+		//causal recursion, c+(r) = gain * s(r) + pole * c+(r-1)
+		for (int r = 1; r < length; r++)
+		{
+			const float* previous = origin + (r - 1) * stride;
+			float* line = origin + r * stride;
+			for (int x = 0; x < width; x++)
+			{
+				line[x] = gain * line[x] + pole * previous[x];
+			}
+		}
+
+		//anti-causal recursion, c-(r) = pole * (c-(r+1) - c+(r)), initialized with mirror boundary
+		float* last = origin + (length - 1) * stride;
+		const float* second_last = origin + (length - 2) * stride;
+		for (int x = 0; x < width; x++)
+		{
+			last[x] = pole / (pole * pole - 1.f) * (last[x] + pole * second_last[x]);
+		}
+		for (int r = length - 2; r >= 0; r--)
+		{
+			const float* next = origin + (r + 1) * stride;
+			float* line = origin + r * stride;
+			for (int x = 0; x < width; x++)
+			{
+				line[x] = pole * (next[x] - line[x]);
+			}
+		}
+	}
+
+	void TricubicBspline::prepare()
+	{
+		coefficient.allocate(interp_img->dim_x, interp_img->dim_y, interp_img->dim_z, 2, true);
+
+		int dim_x = interp_img->dim_x;
+		int dim_y = interp_img->dim_y;
+		int dim_z = interp_img->dim_z;
+		int tile_number = (dim_x + TRICUBIC_PREFILTER_TILE - 1) / TRICUBIC_PREFILTER_TILE;
+
+		//convolution along x-axis, each row is copied into a line buffer padded by the nearest voxels
 #pragma omp parallel for
-		for (int i = 0; i < interp_img->dim_z; i++)
+		for (int i = 0; i < dim_z; i++)
 		{
-			for (int j = 0; j < interp_img->dim_y; j++)
+			std::vector<float> line_buffer(prefilter == PREFILTER_FIR ? dim_x + 14 : 16);
+			for (int j = 0; j < dim_y; j++)
 			{
-				for (int k = 7; k < interp_img->dim_x - 7; k++)
+				const float* voxel_row = interp_img->vol_mat.row(i, j);
+				float* coefficient_row = coefficient.row(i, j);
+				if (prefilter == PREFILTER_RECURSIVE)
 				{
-					coefficient[i][j][k] = BSPLINE_PREFILTER[0] * interp_img->vol_mat[i][j][k]
-						+ BSPLINE_PREFILTER[1] * (interp_img->vol_mat[i][j][k - 1] + interp_img->vol_mat[i][j][k + 1])
-						+ BSPLINE_PREFILTER[2] * (interp_img->vol_mat[i][j][k - 2] + interp_img->vol_mat[i][j][k + 2])
-						+ BSPLINE_PREFILTER[3] * (interp_img->vol_mat[i][j][k - 3] + interp_img->vol_mat[i][j][k + 3])
-						+ BSPLINE_PREFILTER[4] * (interp_img->vol_mat[i][j][k - 4] + interp_img->vol_mat[i][j][k + 4])
-						+ BSPLINE_PREFILTER[5] * (interp_img->vol_mat[i][j][k - 5] + interp_img->vol_mat[i][j][k + 5])
-						+ BSPLINE_PREFILTER[6] * (interp_img->vol_mat[i][j][k - 6] + interp_img->vol_mat[i][j][k + 6])
-						+ BSPLINE_PREFILTER[7] * (interp_img->vol_mat[i][j][k - 7] + interp_img->vol_mat[i][j][k + 7]);
+					for (int k = 0; k < dim_x; k++)
+					{
+						coefficient_row[k] = voxel_row[k];
+					}
+					filterLinesRecursive(coefficient_row, 1, dim_x, 1, line_buffer.data());
+					continue;
 				}
+
+				float* line = line_buffer.data() + 7;
 				for (int k = 0; k < 7; k++)
 				{
-					coefficient[i][j][k] = BSPLINE_PREFILTER[0] * interp_img->vol_mat[i][j][k]
-						+ BSPLINE_PREFILTER[1] * (interp_img->vol_mat[i][j][getHigh(k - 1, 0)] + interp_img->vol_mat[i][j][k + 1])
-						+ BSPLINE_PREFILTER[2] * (interp_img->vol_mat[i][j][getHigh(k - 2, 0)] + interp_img->vol_mat[i][j][k + 2])
-						+ BSPLINE_PREFILTER[3] * (interp_img->vol_mat[i][j][getHigh(k - 3, 0)] + interp_img->vol_mat[i][j][k + 3])
-						+ BSPLINE_PREFILTER[4] * (interp_img->vol_mat[i][j][getHigh(k - 4, 0)] + interp_img->vol_mat[i][j][k + 4])
-						+ BSPLINE_PREFILTER[5] * (interp_img->vol_mat[i][j][getHigh(k - 5, 0)] + interp_img->vol_mat[i][j][k + 5])
-						+ BSPLINE_PREFILTER[6] * (interp_img->vol_mat[i][j][getHigh(k - 6, 0)] + interp_img->vol_mat[i][j][k + 6])
-						+ BSPLINE_PREFILTER[7] * (interp_img->vol_mat[i][j][getHigh(k - 7, 0)] + interp_img->vol_mat[i][j][k + 7]);
+					line[k - 7] = voxel_row[0];
+					line[dim_x + k] = voxel_row[dim_x - 1];
+				}
+				for (int k = 0; k < dim_x; k++)
+				{
+					line[k] = voxel_row[k];
 				}
-				for (int k = interp_img->dim_x - 7; k < interp_img->dim_x; k++)
+				for (int k = 0; k < dim_x; k++)
 				{
-					coefficient[i][j][k] = BSPLINE_PREFILTER[0] * interp_img->vol_mat[i][j][k]
-						+ BSPLINE_PREFILTER[1] * (interp_img->vol_mat[i][j][k - 1] + interp_img->vol_mat[i][j][getLow(k + 1, interp_img->dim_x - 1)])
-						+ BSPLINE_PREFILTER[2] * (interp_img->vol_mat[i][j][k - 2] + interp_img->vol_mat[i][j][getLow(k + 2, interp_img->dim_x - 1)])
-						+ BSPLINE_PREFILTER[3] * (interp_img->vol_mat[i][j][k - 3] + interp_img->vol_mat[i][j][getLow(k + 3, interp_img->dim_x - 1)])
-						+ BSPLINE_PREFILTER[4] * (interp_img->vol_mat[i][j][k - 4] + interp_img->vol_mat[i][j][getLow(k + 4, interp_img->dim_x - 1)])
-						+ BSPLINE_PREFILTER[5] * (interp_img->vol_mat[i][j][k - 5] + interp_img->vol_mat[i][j][getLow(k + 5, interp_img->dim_x - 1)])
-						+ BSPLINE_PREFILTER[6] * (interp_img->vol_mat[i][j][k - 6] + interp_img->vol_mat[i][j][getLow(k + 6, interp_img->dim_x - 1)])
-						+ BSPLINE_PREFILTER[7] * (interp_img->vol_mat[i][j][k - 7] + interp_img->vol_mat[i][j][getLow(k + 7, interp_img->dim_x - 1)]);
+					coefficient_row[k] = BSPLINE_PREFILTER[0] * line[k]
+						+ BSPLINE_PREFILTER[1] * (line[k - 1] + line[k + 1])
+						+ BSPLINE_PREFILTER[2] * (line[k - 2] + line[k + 2])
+						+ BSPLINE_PREFILTER[3] * (line[k - 3] + line[k + 3])
+						+ BSPLINE_PREFILTER[4] * (line[k - 4] + line[k + 4])
+						+ BSPLINE_PREFILTER[5] * (line[k - 5] + line[k + 5])
+						+ BSPLINE_PREFILTER[6] * (line[k - 6] + line[k + 6])
+						+ BSPLINE_PREFILTER[7] * (line[k - 7] + line[k + 7]);
 				}
 			}
 		}
 
-		//convolution along y-axis
+		//convolution along y-axis in place, the x-lines of a slice are processed tile by tile,
+		//so that the inner loops run over consecutive voxels
 #pragma omp parallel for
-		for (int k = 0; k < interp_img->dim_x; k++)
+		for (int i = 0; i < dim_z; i++)
 		{
-			for (int i = 0; i < interp_img->dim_z; i++)
+			std::vector<float> ring_buffer(16 * TRICUBIC_PREFILTER_TILE);
+			for (int t = 0; t < tile_number; t++)
 			{
-				for (int j = 7; j < interp_img->dim_y - 7; j++)
+				int x_start = t * TRICUBIC_PREFILTER_TILE;
+				int width = getLow(TRICUBIC_PREFILTER_TILE, dim_x - x_start);
+				if (prefilter == PREFILTER_FIR)
 				{
-					conv_buffer[i][j][k] = BSPLINE_PREFILTER[0] * coefficient[i][j][k]
-						+ BSPLINE_PREFILTER[1] * (coefficient[i][j - 1][k] + coefficient[i][j + 1][k])
-						+ BSPLINE_PREFILTER[2] * (coefficient[i][j - 2][k] + coefficient[i][j + 2][k])
-						+ BSPLINE_PREFILTER[3] * (coefficient[i][j - 3][k] + coefficient[i][j + 3][k])
-						+ BSPLINE_PREFILTER[4] * (coefficient[i][j - 4][k] + coefficient[i][j + 4][k])
-						+ BSPLINE_PREFILTER[5] * (coefficient[i][j - 5][k] + coefficient[i][j + 5][k])
-						+ BSPLINE_PREFILTER[6] * (coefficient[i][j - 6][k] + coefficient[i][j + 6][k])
-						+ BSPLINE_PREFILTER[7] * (coefficient[i][j - 7][k] + coefficient[i][j + 7][k]);
+					filterLinesFIR(coefficient.row(i, 0) + x_start, coefficient.row_stride, dim_y, width, ring_buffer.data());
 				}
-				for (int j = 0; j < 7; j++)
+				else
 				{
-					conv_buffer[i][j][k] = BSPLINE_PREFILTER[0] * coefficient[i][j][k]
-						+ BSPLINE_PREFILTER[1] * (coefficient[i][getHigh(j - 1, 0)][k] + coefficient[i][j + 1][k])
-						+ BSPLINE_PREFILTER[2] * (coefficient[i][getHigh(j - 2, 0)][k] + coefficient[i][j + 2][k])
-						+ BSPLINE_PREFILTER[3] * (coefficient[i][getHigh(j - 3, 0)][k] + coefficient[i][j + 3][k])
-						+ BSPLINE_PREFILTER[4] * (coefficient[i][getHigh(j - 4, 0)][k] + coefficient[i][j + 4][k])
-						+ BSPLINE_PREFILTER[5] * (coefficient[i][getHigh(j - 5, 0)][k] + coefficient[i][j + 5][k])
-						+ BSPLINE_PREFILTER[6] * (coefficient[i][getHigh(j - 6, 0)][k] + coefficient[i][j + 6][k])
-						+ BSPLINE_PREFILTER[7] * (coefficient[i][getHigh(j - 7, 0)][k] + coefficient[i][j + 7][k]);
-				}
-				for (int j = interp_img->dim_y - 7; j < interp_img->dim_y; j++)
-				{
-					conv_buffer[i][j][k] = BSPLINE_PREFILTER[0] * coefficient[i][j][k]
-						+ BSPLINE_PREFILTER[1] * (coefficient[i][j - 1][k] + coefficient[i][getLow(j + 1, interp_img->dim_y - 1)][k])
-						+ BSPLINE_PREFILTER[2] * (coefficient[i][j - 2][k] + coefficient[i][getLow(j + 2, interp_img->dim_y - 1)][k])
-						+ BSPLINE_PREFILTER[3] * (coefficient[i][j - 3][k] + coefficient[i][getLow(j + 3, interp_img->dim_y - 1)][k])
-						+ BSPLINE_PREFILTER[4] * (coefficient[i][j - 4][k] + coefficient[i][getLow(j + 4, interp_img->dim_y - 1)][k])
-						+ BSPLINE_PREFILTER[5] * (coefficient[i][j - 5][k] + coefficient[i][getLow(j + 5, interp_img->dim_y - 1)][k])
-						+ BSPLINE_PREFILTER[6] * (coefficient[i][j - 6][k] + coefficient[i][getLow(j + 6, interp_img->dim_y - 1)][k])
-						+ BSPLINE_PREFILTER[7] * (coefficient[i][j - 7][k] + coefficient[i][getLow(j + 7, interp_img->dim_y - 1)][k]);
+					filterLinesRecursive(coefficient.row(i, 0) + x_start, coefficient.row_stride, dim_y, width, ring_buffer.data());
 				}
 			}
 		}
 
-
-		//convolution along z-axis
+		//convolution along z-axis in place, in the same way
 #pragma omp parallel for
-		for (int j = 0; j < interp_img->dim_y; j++)
+		for (int j = 0; j < dim_y; j++)
 		{
-			for (int k = 0; k < interp_img->dim_x; k++)
+			std::vector<float> ring_buffer(16 * TRICUBIC_PREFILTER_TILE);
+			for (int t = 0; t < tile_number; t++)
 			{
-				for (int i = 7; i < interp_img->dim_z - 7; i++)
-				{
-					coefficient[i][j][k] = BSPLINE_PREFILTER[0] * conv_buffer[i][j][k]
-						+ BSPLINE_PREFILTER[1] * (conv_buffer[i - 1][j][k] + conv_buffer[i + 1][j][k])
-						+ BSPLINE_PREFILTER[2] * (conv_buffer[i - 2][j][k] + conv_buffer[i + 2][j][k])
-						+ BSPLINE_PREFILTER[3] * (conv_buffer[i - 3][j][k] + conv_buffer[i + 3][j][k])
-						+ BSPLINE_PREFILTER[4] * (conv_buffer[i - 4][j][k] + conv_buffer[i + 4][j][k])
-						+ BSPLINE_PREFILTER[5] * (conv_buffer[i - 5][j][k] + conv_buffer[i + 5][j][k])
-						+ BSPLINE_PREFILTER[6] * (conv_buffer[i - 6][j][k] + conv_buffer[i + 6][j][k])
-						+ BSPLINE_PREFILTER[7] * (conv_buffer[i - 7][j][k] + conv_buffer[i + 7][j][k]);
-				}
-				for (int i = 0; i < 7; i++)
+				int x_start = t * TRICUBIC_PREFILTER_TILE;
+				int width = getLow(TRICUBIC_PREFILTER_TILE, dim_x - x_start);
+				if (prefilter == PREFILTER_FIR)
 				{
-					coefficient[i][j][k] = BSPLINE_PREFILTER[0] * conv_buffer[i][j][k] +
-						+BSPLINE_PREFILTER[1] * (conv_buffer[getHigh(i - 1, 0)][j][k] + conv_buffer[i + 1][j][k])
-						+ BSPLINE_PREFILTER[2] * (conv_buffer[getHigh(i - 2, 0)][j][k] + conv_buffer[i + 2][j][k])
-						+ BSPLINE_PREFILTER[3] * (conv_buffer[getHigh(i - 3, 0)][j][k] + conv_buffer[i + 3][j][k])
-						+ BSPLINE_PREFILTER[4] * (conv_buffer[getHigh(i - 4, 0)][j][k] + conv_buffer[i + 4][j][k])
-						+ BSPLINE_PREFILTER[5] * (conv_buffer[getHigh(i - 5, 0)][j][k] + conv_buffer[i + 5][j][k])
-						+ BSPLINE_PREFILTER[6] * (conv_buffer[getHigh(i - 6, 0)][j][k] + conv_buffer[i + 6][j][k])
-						+ BSPLINE_PREFILTER[7] * (conv_buffer[getHigh(i - 7, 0)][j][k] + conv_buffer[i + 7][j][k]);
+					filterLinesFIR(coefficient.row(0, j) + x_start, coefficient.slice_stride, dim_z, width, ring_buffer.data());
 				}
-				for (int i = interp_img->dim_z - 7; i < interp_img->dim_z; i++)
+				else
 				{
-					coefficient[i][j][k] = BSPLINE_PREFILTER[0] * conv_buffer[i][j][k]
-						+ BSPLINE_PREFILTER[1] * (conv_buffer[i - 1][j][k] + conv_buffer[getLow(i + 1, interp_img->dim_z - 1)][j][k])
-						+ BSPLINE_PREFILTER[2] * (conv_buffer[i - 2][j][k] + conv_buffer[getLow(i + 2, interp_img->dim_z - 1)][j][k])
-						+ BSPLINE_PREFILTER[3] * (conv_buffer[i - 3][j][k] + conv_buffer[getLow(i + 3, interp_img->dim_z - 1)][j][k])
-						+ BSPLINE_PREFILTER[4] * (conv_buffer[i - 4][j][k] + conv_buffer[getLow(i + 4, interp_img->dim_z - 1)][j][k])
-						+ BSPLINE_PREFILTER[5] * (conv_buffer[i - 5][j][k] + conv_buffer[getLow(i + 5, interp_img->dim_z - 1)][j][k])
-						+ BSPLINE_PREFILTER[6] * (conv_buffer[i - 6][j][k] + conv_buffer[getLow(i + 6, interp_img->dim_z - 1)][j][k])
-						+ BSPLINE_PREFILTER[7] * (conv_buffer[i - 7][j][k] + conv_buffer[getLow(i + 7, interp_img->dim_z - 1)][j][k]);
+					filterLinesRecursive(coefficient.row(0, j) + x_start, coefficient.slice_stride, dim_z, width, ring_buffer.data());
 				}
 			}
 		}
-
-		delete3D(conv_buffer);
 	}
 
 	float TricubicBspline::compute(Point3D& location)
@@ -392,14 +760,17 @@ namespace opencorr
 			basis_z[2] = basis2(z_decimal);
 			basis_z[3] = basis3(z_decimal);
 
+			//walk through the 4x4x4 neighborhood with flat index from its first voxel
+			const float* corner = coefficient.data + coefficient.index(z_integral - 1, y_integral - 1, x_integral - 1);
 			for (int i = 0; i < 4; i++)
 			{
 				for (int j = 0; j < 4; j++)
 				{
-					sum_x[j] = basis_x[0] * coefficient[z_integral + i - 1][y_integral + j - 1][x_integral - 1]
-						+ basis_x[1] * coefficient[z_integral + i - 1][y_integral + j - 1][x_integral]
-						+ basis_x[2] * coefficient[z_integral + i - 1][y_integral + j - 1][x_integral + 1]
-						+ basis_x[3] * coefficient[z_integral + i - 1][y_integral + j - 1][x_integral + 2];
+					const float* coefficient_row = corner + i * coefficient.slice_stride + j * coefficient.row_stride;
+					sum_x[j] = basis_x[0] * coefficient_row[0]
+						+ basis_x[1] * coefficient_row[1]
+						+ basis_x[2] * coefficient_row[2]
+						+ basis_x[3] * coefficient_row[3];
 				}
 				sum_y[i] = basis_y[0] * sum_x[0] + basis_y[1] * sum_x[1] + basis_y[2] * sum_x[2] + basis_y[3] * sum_x[3];
 			}
@@ -409,4 +780,245 @@ namespace opencorr
 		return value;
 	}
 
+	void TricubicBspline::computeSubset(Deformation3D1& deformation, Point3D& center, int radius_x, int radius_y, int radius_z, Volume3D& subset)
+	{
+		if (!deformation.warp_matrix.allFinite())
+		{
+			Interpolation3D::computeSubset(deformation, center, radius_x, radius_y, radius_z, subset);
+			return;
+		}
+
+		Eigen::Matrix4f& warp_matrix = deformation.warp_matrix;
+		float warp_x[10] = { 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, warp_matrix(0, 0), warp_matrix(0, 1), warp_matrix(0, 2), warp_matrix(0, 3) };
+		float warp_y[10] = { 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, warp_matrix(1, 0), warp_matrix(1, 1), warp_matrix(1, 2), warp_matrix(1, 3) };
+		float warp_z[10] = { 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, warp_matrix(2, 0), warp_matrix(2, 1), warp_matrix(2, 2), warp_matrix(2, 3) };
+
+		computeWarpedSubset(warp_x, warp_y, warp_z, center, radius_x, radius_y, radius_z, subset);
+	}
+
+	void TricubicBspline::computeSubset(Deformation3D2& deformation, Point3D& center, int radius_x, int radius_y, int radius_z, Volume3D& subset)
+	{
+		if (!deformation.warp_matrix.allFinite())
+		{
+			Interpolation3D::computeSubset(deformation, center, radius_x, radius_y, radius_z, subset);
+			return;
+		}
+
+		Matrix10f& warp_matrix = deformation.warp_matrix;
+		float warp_x[10], warp_y[10], warp_z[10];
+		for (int i = 0; i < 10; i++)
+		{
+			warp_x[i] = warp_matrix(6, i);
+			warp_y[i] = warp_matrix(7, i);
+			warp_z[i] = warp_matrix(8, i);
+		}
+
+		computeWarpedSubset(warp_x, warp_y, warp_z, center, radius_x, radius_y, radius_z, subset);
+	}
+
+	void TricubicBspline::computeWarpedSubset(const float warp_x[10], const float warp_y[10], const float warp_z[10],
+		Point3D& center, int radius_x, int radius_y, int radius_z, Volume3D& subset)
+	{
+		int subset_dim_x = 2 * radius_x + 1;
+		int subset_dim_y = 2 * radius_y + 1;
+		int subset_dim_z = 2 * radius_z + 1;
+
+		//along each x-line of subset, the warped coordinates are quadratic polynomials of x_local,
+		//x = line_x[0] + line_x[1] * x_local + line_x[2] * x_local^2, the same for y and z
+		float line_x[3], line_y[3], line_z[3];
+
+		//get the bounding box of warped subset, an affine warp maps the subset onto a parallelepiped,
+		//thus its eight corners are enough, otherwise all the sampling points are visited
+		bool affine = true;
+		for (int i = 0; i < 6; i++)
+		{
+			affine = affine && warp_x[i] == 0.f && warp_y[i] == 0.f && warp_z[i] == 0.f;
+		}
+		int slice_step = affine && subset_dim_z > 1 ? subset_dim_z - 1 : 1;
+		int row_step = affine && subset_dim_y > 1 ? subset_dim_y - 1 : 1;
+		int col_step = affine && subset_dim_x > 1 ? subset_dim_x - 1 : 1;
+		float min_x = FLT_MAX, max_x = -FLT_MAX, min_y = FLT_MAX, max_y = -FLT_MAX, min_z = FLT_MAX, max_z = -FLT_MAX;
+		for (int i = 0; i < subset_dim_z; i += slice_step)
+		{
+			for (int j = 0; j < subset_dim_y; j += row_step)
+			{
+				getLinePolynomial(warp_x, center.x, (float)(j - radius_y), (float)(i - radius_z), line_x);
+				getLinePolynomial(warp_y, center.y, (float)(j - radius_y), (float)(i - radius_z), line_y);
+				getLinePolynomial(warp_z, center.z, (float)(j - radius_y), (float)(i - radius_z), line_z);
+				for (int k = 0; k < subset_dim_x; k += col_step)
+				{
+					float x_local = (float)(k - radius_x);
+					float x = line_x[0] + x_local * (line_x[1] + x_local * line_x[2]);
+					float y = line_y[0] + x_local * (line_y[1] + x_local * line_y[2]);
+					float z = line_z[0] + x_local * (line_z[1] + x_local * line_z[2]);
+					min_x = x < min_x ? x : min_x;
+					max_x = x > max_x ? x : max_x;
+					min_y = y < min_y ? y : min_y;
+					max_y = y > max_y ? y : max_y;
+					min_z = z < min_z ? z : min_z;
+					max_z = z > max_z ? z : max_z;
+				}
+			}
+		}
+
+		//fall back to the voxel-wise bounds check if the subset touches the border, a small margin absorbs round-off,
+		//the halo of coefficient keeps the neighborhood of the voxels at border within the block,
+		//offsets are counted from the corner of bounding box, so that they fit in 32-bit integers for gather loads
+		const float margin = 0.01f;
+		bool inside = min_x >= margin && min_y >= margin && min_z >= margin
+			&& max_x < interp_img->dim_x - margin && max_y < interp_img->dim_y - margin && max_z < interp_img->dim_z - margin;
+		int x_base = (int)min_x - 1;
+		int y_base = (int)min_y - 1;
+		int z_base = (int)min_z - 1;
+		inside = inside && ((double)max_z - z_base + 3) * coefficient.slice_stride < (double)INT_MAX;
+		if (!inside)
+		{
+			Point3D global_coor;
+			for (int i = 0; i < subset_dim_z; i++)
+			{
+				for (int j = 0; j < subset_dim_y; j++)
+				{
+					getLinePolynomial(warp_x, center.x, (float)(j - radius_y), (float)(i - radius_z), line_x);
+					getLinePolynomial(warp_y, center.y, (float)(j - radius_y), (float)(i - radius_z), line_y);
+					getLinePolynomial(warp_z, center.z, (float)(j - radius_y), (float)(i - radius_z), line_z);
+					for (int k = 0; k < subset_dim_x; k++)
+					{
+						float x_local = (float)(k - radius_x);
+						global_coor.x = line_x[0] + x_local * (line_x[1] + x_local * line_x[2]);
+						global_coor.y = line_y[0] + x_local * (line_y[1] + x_local * line_y[2]);
+						global_coor.z = line_z[0] + x_local * (line_z[1] + x_local * line_z[2]);
+						subset[i][j][k] = TricubicBspline::compute(global_coor);
+					}
+				}
+			}
+			return;
+		}
+
+		//x, y and z depend only on x_local, y_local and z_local respectively, e.g. the translation in the first iteration
+		if (affine && warp_x[7] == 0.f && warp_x[8] == 0.f && warp_y[6] == 0.f
+			&& warp_y[8] == 0.f && warp_z[6] == 0.f && warp_z[7] == 0.f)
+		{
+			computeAlignedSubset(warp_x, warp_y, warp_z, center, radius_x, radius_y, radius_z, subset);
+			return;
+		}
+
+		//all the sampling points are inside, walk along the x-lines of subset without any check
+		const float* coefficient_base = coefficient.data + coefficient.index(z_base, y_base, x_base);
+		int row_stride = (int)coefficient.row_stride;
+		int slice_stride = (int)coefficient.slice_stride;
+		for (int i = 0; i < subset_dim_z; i++)
+		{
+			for (int j = 0; j < subset_dim_y; j++)
+			{
+				getLinePolynomial(warp_x, center.x, (float)(j - radius_y), (float)(i - radius_z), line_x);
+				getLinePolynomial(warp_y, center.y, (float)(j - radius_y), (float)(i - radius_z), line_y);
+				getLinePolynomial(warp_z, center.z, (float)(j - radius_y), (float)(i - radius_z), line_z);
+
+				float* subset_row = subset.row(i, j);
+#pragma omp simd
+				for (int k = 0; k < subset_dim_x; k++)
+				{
+					float x_local = (float)(k - radius_x);
+					float x = line_x[0] + x_local * (line_x[1] + x_local * line_x[2]);
+					float y = line_y[0] + x_local * (line_y[1] + x_local * line_y[2]);
+					float z = line_z[0] + x_local * (line_z[1] + x_local * line_z[2]);
+					int x_integral = (int)x;
+					int y_integral = (int)y;
+					int z_integral = (int)z;
+
+					float x_decimal = x - x_integral;
+					float y_decimal = y - y_integral;
+					float z_decimal = z - z_integral;
+
+					//weights are kept in scalars, so that the compiler maps them onto vector registers
+					float wx0 = basis0(x_decimal), wx1 = basis1(x_decimal), wx2 = basis2(x_decimal), wx3 = basis3(x_decimal);
+					float wy0 = basis0(y_decimal), wy1 = basis1(y_decimal), wy2 = basis2(y_decimal), wy3 = basis3(y_decimal);
+
+					int offset = (z_integral - 1 - z_base) * slice_stride + (y_integral - 1 - y_base) * row_stride + (x_integral - 1 - x_base);
+					float slice0 = sliceProduct4(coefficient_base, offset, row_stride, wx0, wx1, wx2, wx3, wy0, wy1, wy2, wy3);
+					float slice1 = sliceProduct4(coefficient_base, offset + slice_stride, row_stride, wx0, wx1, wx2, wx3, wy0, wy1, wy2, wy3);
+					float slice2 = sliceProduct4(coefficient_base, offset + 2 * slice_stride, row_stride, wx0, wx1, wx2, wx3, wy0, wy1, wy2, wy3);
+					float slice3 = sliceProduct4(coefficient_base, offset + 3 * slice_stride, row_stride, wx0, wx1, wx2, wx3, wy0, wy1, wy2, wy3);
+
+					subset_row[k] = basis0(z_decimal) * slice0 + basis1(z_decimal) * slice1 + basis2(z_decimal) * slice2 + basis3(z_decimal) * slice3;
+				}
+			}
+		}
+	}
+
+	void TricubicBspline::computeAlignedSubset(const float warp_x[10], const float warp_y[10], const float warp_z[10],
+		Point3D& center, int radius_x, int radius_y, int radius_z, Volume3D& subset)
+	{
+		int subset_dim_x = 2 * radius_x + 1;
+		int subset_dim_y = 2 * radius_y + 1;
+		int subset_dim_z = 2 * radius_z + 1;
+
+		//the integral parts and weights along x and y are shared by the lines of subset, thus calculated once,
+		//the integral parts are counted from the lowest one minus 1
+		std::vector<int> x_start(subset_dim_x), y_start(subset_dim_y);
+		std::vector<float> x_weight(4 * subset_dim_x), y_weight(4 * subset_dim_y);
+		int x_min = getSeparableWeights(center.x + warp_x[9], warp_x[6], radius_x, x_start.data(), x_weight.data());
+		int y_min = getSeparableWeights(center.y + warp_y[9], warp_y[7], radius_y, y_start.data(), y_weight.data());
+		int line_length = x_start[0] > x_start[subset_dim_x - 1] ? x_start[0] + 4 : x_start[subset_dim_x - 1] + 4;
+		int plane_height = y_start[0] > y_start[subset_dim_y - 1] ? y_start[0] + 4 : y_start[subset_dim_y - 1] + 4;
+
+		//coefficients combined over the neighborhood along z, then along y
+		std::vector<float> plane_buffer((size_t)plane_height * line_length);
+		std::vector<float> line_buffer(line_length);
+		float* plane = plane_buffer.data();
+		float* line = line_buffer.data();
+		const float* weight_x0 = x_weight.data();
+		const float* weight_x1 = weight_x0 + subset_dim_x;
+		const float* weight_x2 = weight_x1 + subset_dim_x;
+		const float* weight_x3 = weight_x2 + subset_dim_x;
+		const int* start_x = x_start.data();
+
+		for (int i = 0; i < subset_dim_z; i++)
+		{
+			float z = center.z + warp_z[9] + warp_z[8] * (float)(i - radius_z);
+			int z_integral = (int)z;
+			float z_decimal = z - z_integral;
+			float weight_z0 = basis0(z_decimal);
+			float weight_z1 = basis1(z_decimal);
+			float weight_z2 = basis2(z_decimal);
+			float weight_z3 = basis3(z_decimal);
+
+			for (int r = 0; r < plane_height; r++)
+			{
+				const float* slice0 = coefficient.row(z_integral - 1, y_min + r) + x_min;
+				const float* slice1 = slice0 + coefficient.slice_stride;
+				const float* slice2 = slice1 + coefficient.slice_stride;
+				const float* slice3 = slice2 + coefficient.slice_stride;
+				float* plane_row = plane + (size_t)r * line_length;
+				for (int n = 0; n < line_length; n++)
+				{
+					plane_row[n] = weight_z0 * slice0[n] + weight_z1 * slice1[n] + weight_z2 * slice2[n] + weight_z3 * slice3[n];
+				}
+			}
+
+			for (int j = 0; j < subset_dim_y; j++)
+			{
+				const float* row0 = plane + (size_t)y_start[j] * line_length;
+				const float* row1 = row0 + line_length;
+				const float* row2 = row1 + line_length;
+				const float* row3 = row2 + line_length;
+				float weight_y0 = y_weight[j];
+				float weight_y1 = y_weight[subset_dim_y + j];
+				float weight_y2 = y_weight[2 * subset_dim_y + j];
+				float weight_y3 = y_weight[3 * subset_dim_y + j];
+				for (int n = 0; n < line_length; n++)
+				{
+					line[n] = weight_y0 * row0[n] + weight_y1 * row1[n] + weight_y2 * row2[n] + weight_y3 * row3[n];
+				}
+
+				float* subset_row = subset.row(i, j);
+#pragma omp simd
+				for (int k = 0; k < subset_dim_x; k++)
+				{
+					subset_row[k] = dotProduct4(line, start_x[k], weight_x0[k], weight_x1[k], weight_x2[k], weight_x3[k]);
+				}
+			}
+		}
+	}
+
 }//namespace opencorr
@@ -32,12 +32,31 @@ namespace opencorr
 		~BicubicBspline();
 
 		void setImage(Image2D& image); //set image to process
+		void setLatticeMode(bool lattice_mode); //store only the control lattice and evaluate the 4x4 tensor product on the fly
 
 		void prepare();
 		float compute(Point2D& location);
 
+		//reconstruct the warped subset in one call, the bounds check is made once on the bounding box of subset
+		void computeSubset(Deformation2D1& deformation, Point2D& center, int radius_x, int radius_y, Eigen::MatrixXf& subset);
+		void computeSubset(Deformation2D2& deformation, Point2D& center, int radius_x, int radius_y, Eigen::MatrixXf& subset);
+
 	private:
-		float**** coefficient = nullptr;
+		int width = 0, height = 0; //dimensions of the image used in prepare()
+		bool lattice_mode = false;
+
+		//coefficient table, 16 floats (one cache line) per pixel stored row by row, [y][x][k][l]
+		float* coefficient = nullptr;
+
+		//control lattice in the lattice mode, one float per pixel stored row by row, [y][x]
+		float* lattice = nullptr;
+
+		float computeFromTable(int x_integral, int y_integral, float x_decimal, float y_decimal) const;
+		float computeFromLattice(int x_integral, int y_integral, float x_decimal, float y_decimal) const;
+
+		//sample the subset warped by x = sum(warp_x[i] * m[i]) and y = sum(warp_y[i] * m[i]) around center,
+		//where m = (x^2, xy, y^2, x, y, 1) in local coordinates
+		void computeWarpedSubset(const float warp_x[6], const float warp_y[6], Point2D& center, int radius_x, int radius_y, Eigen::MatrixXf& subset);
 
 		//B
 		const float FUNCTION_MATRIX[4][4] =
@@ -71,6 +90,16 @@ namespace opencorr
 	//the 3D part of module is the implementation of
 	//J. Yang et al, Optics and Lasers in Engineering (2021) 136: 106323.
 	//https://doi.org/10.1016/j.optlaseng.2020.106323
+	//the recursive prefilter follows
+	//M. Unser et al, IEEE Transactions on Signal Processing (1993) 41(2): 834-848.
+	//https://doi.org/10.1109/78.193221
+
+	//methods to compute the B-spline coefficients from voxels
+	enum BsplinePrefilter
+	{
+		PREFILTER_FIR, //15-tap truncated filter, voxels out of the volume are replaced by the nearest ones
+		PREFILTER_RECURSIVE //exact causal and anti-causal recursion, with mirror boundary
+	};
 
 	class TricubicBspline : public Interpolation3D
 	{
@@ -79,12 +108,21 @@ namespace opencorr
 		~TricubicBspline();
 
 		void setImage(Image3D& image); //set image to process
+		void setPrefilter(BsplinePrefilter prefilter);
 
 		void prepare();
 		float compute(Point3D& location);
 
+		//reconstruct the warped subset in one call, the bounds check is made once on the bounding box of subset
+		void computeSubset(Deformation3D1& deformation, Point3D& center, int radius_x, int radius_y, int radius_z, Volume3D& subset);
+		void computeSubset(Deformation3D2& deformation, Point3D& center, int radius_x, int radius_y, int radius_z, Volume3D& subset);
+
 	private:
-		float*** coefficient = nullptr;
+		BsplinePrefilter prefilter = PREFILTER_FIR;
+
+		//coefficient volume with rows aligned to cache line and a halo of 2 voxels, so that the 4x4x4
+		//neighborhood of a location at the border is read within the block
+		Volume3D coefficient;
 
 		//B-spline prefilter
 		const float BSPLINE_PREFILTER[8] =
@@ -99,6 +137,24 @@ namespace opencorr
 			-0.000171774749350f, //b7
 		};
 
+		//pole of the recursive prefilter, sqrt(3) - 2
+		const float BSPLINE_POLE = -0.267949192431123f;
+
+		//filter in place along the direction of stride, for a tile of "width" adjacent voxels in each of the
+		//"length" x-lines starting from origin, buffer holds 16 x-lines of the tile
+		void filterLinesFIR(float* origin, long long stride, int length, int width, float* buffer) const;
+		void filterLinesRecursive(float* origin, long long stride, int length, int width, float* buffer) const;
+
+		//sample the subset warped by x = sum(warp_x[i] * m[i]), the same for y and z, around center,
+		//where m = (x^2, xy, xz, y^2, yz, z^2, x, y, z, 1) in local coordinates
+		void computeWarpedSubset(const float warp_x[10], const float warp_y[10], const float warp_z[10],
+			Point3D& center, int radius_x, int radius_y, int radius_z, Volume3D& subset);
+
+		//sample the subset warped by an axis-aligned affine transform, i.e. x, y and z depend only on x_local,
+		//y_local and z_local respectively, the neighborhood is reduced along z, then y, before sampling along x
+		void computeAlignedSubset(const float warp_x[10], const float warp_y[10], const float warp_z[10],
+			Point3D& center, int radius_x, int radius_y, int radius_z, Volume3D& subset);
+
 	};
 
 }//namespace opencorr
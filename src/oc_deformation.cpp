@@ -16,6 +16,28 @@
 
 namespace opencorr
 {
+	//product of two polynomials on the monomials (x^2, xy, xz, y^2, yz, z^2, x, y, z, 1), the terms of order
+	//higher than 2 are dropped
+	static void multiplyQuadratic(const float p[10], const float q[10], float product[10])
+	{
+		//constant term times the others
+		for (int k = 0; k < 9; k++)
+		{
+			product[k] = p[9] * q[k] + p[k] * q[9];
+		}
+		product[9] = p[9] * q[9];
+
+		//products of linear terms, which fall on the quadratic monomials
+		const int quadratic_index[3][3] = { { 0, 1, 2 }, { 1, 3, 4 }, { 2, 4, 5 } };
+		for (int a = 0; a < 3; a++)
+		{
+			for (int b = 0; b < 3; b++)
+			{
+				product[quadratic_index[a][b]] += p[6 + a] * q[6 + b];
+			}
+		}
+	}
+
 	//2D deformation with the 1st order shape function
 	Deformation2D1::Deformation2D1()
 	{
@@ -529,4 +551,293 @@ namespace opencorr
 		return new_location;
 	}
 
+	//3D deformation with the 2nd order shape function
+	Deformation3D2::Deformation3D2()
+	{
+		u = 0.f;
+		ux = 0.f;
+		uy = 0.f;
+		uz = 0.f;
+		uxx = 0.f;
+		uxy = 0.f;
+		uxz = 0.f;
+		uyy = 0.f;
+		uyz = 0.f;
+		uzz = 0.f;
+
+		v = 0.f;
+		vx = 0.f;
+		vy = 0.f;
+		vz = 0.f;
+		vxx = 0.f;
+		vxy = 0.f;
+		vxz = 0.f;
+		vyy = 0.f;
+		vyz = 0.f;
+		vzz = 0.f;
+
+		w = 0.f;
+		wx = 0.f;
+		wy = 0.f;
+		wz = 0.f;
+		wxx = 0.f;
+		wxy = 0.f;
+		wxz = 0.f;
+		wyy = 0.f;
+		wyz = 0.f;
+		wzz = 0.f;
+
+		setWarp();
+	}
+
+	Deformation3D2::Deformation3D2(float p[30])
+	{
+		u = p[0];
+		ux = p[1];
+		uy = p[2];
+		uz = p[3];
+		uxx = p[4];
+		uxy = p[5];
+		uxz = p[6];
+		uyy = p[7];
+		uyz = p[8];
+		uzz = p[9];
+
+		v = p[10];
+		vx = p[11];
+		vy = p[12];
+		vz = p[13];
+		vxx = p[14];
+		vxy = p[15];
+		vxz = p[16];
+		vyy = p[17];
+		vyz = p[18];
+		vzz = p[19];
+
+		w = p[20];
+		wx = p[21];
+		wy = p[22];
+		wz = p[23];
+		wxx = p[24];
+		wxy = p[25];
+		wxz = p[26];
+		wyy = p[27];
+		wyz = p[28];
+		wzz = p[29];
+
+		setWarp();
+	}
+
+	Deformation3D2::~Deformation3D2() {}
+
+	void Deformation3D2::setDeformation(float p[30])
+	{
+		u = p[0];
+		ux = p[1];
+		uy = p[2];
+		uz = p[3];
+		uxx = p[4];
+		uxy = p[5];
+		uxz = p[6];
+		uyy = p[7];
+		uyz = p[8];
+		uzz = p[9];
+
+		v = p[10];
+		vx = p[11];
+		vy = p[12];
+		vz = p[13];
+		vxx = p[14];
+		vxy = p[15];
+		vxz = p[16];
+		vyy = p[17];
+		vyz = p[18];
+		vzz = p[19];
+
+		w = p[20];
+		wx = p[21];
+		wy = p[22];
+		wz = p[23];
+		wxx = p[24];
+		wxy = p[25];
+		wxz = p[26];
+		wyy = p[27];
+		wyz = p[28];
+		wzz = p[29];
+
+		setWarp();
+	}
+
+	void Deformation3D2::setDeformation(Deformation3D2& another_deformation)
+	{
+		u = another_deformation.u;
+		ux = another_deformation.ux;
+		uy = another_deformation.uy;
+		uz = another_deformation.uz;
+		uxx = another_deformation.uxx;
+		uxy = another_deformation.uxy;
+		uxz = another_deformation.uxz;
+		uyy = another_deformation.uyy;
+		uyz = another_deformation.uyz;
+		uzz = another_deformation.uzz;
+
+		v = another_deformation.v;
+		vx = another_deformation.vx;
+		vy = another_deformation.vy;
+		vz = another_deformation.vz;
+		vxx = another_deformation.vxx;
+		vxy = another_deformation.vxy;
+		vxz = another_deformation.vxz;
+		vyy = another_deformation.vyy;
+		vyz = another_deformation.vyz;
+		vzz = another_deformation.vzz;
+
+		w = another_deformation.w;
+		wx = another_deformation.wx;
+		wy = another_deformation.wy;
+		wz = another_deformation.wz;
+		wxx = another_deformation.wxx;
+		wxy = another_deformation.wxy;
+		wxz = another_deformation.wxz;
+		wyy = another_deformation.wyy;
+		wyz = another_deformation.wyz;
+		wzz = another_deformation.wzz;
+
+		setWarp();
+	}
+
+	void Deformation3D2::setDeformation(Deformation3D1& another_deformation)
+	{
+		u = another_deformation.u;
+		ux = another_deformation.ux;
+		uy = another_deformation.uy;
+		uz = another_deformation.uz;
+		uxx = 0.f;
+		uxy = 0.f;
+		uxz = 0.f;
+		uyy = 0.f;
+		uyz = 0.f;
+		uzz = 0.f;
+
+		v = another_deformation.v;
+		vx = another_deformation.vx;
+		vy = another_deformation.vy;
+		vz = another_deformation.vz;
+		vxx = 0.f;
+		vxy = 0.f;
+		vxz = 0.f;
+		vyy = 0.f;
+		vyz = 0.f;
+		vzz = 0.f;
+
+		w = another_deformation.w;
+		wx = another_deformation.wx;
+		wy = another_deformation.wy;
+		wz = another_deformation.wz;
+		wxx = 0.f;
+		wxy = 0.f;
+		wxz = 0.f;
+		wyy = 0.f;
+		wyz = 0.f;
+		wzz = 0.f;
+
+		setWarp();
+	}
+
+	void Deformation3D2::setDeformation()
+	{
+		u = warp_matrix(6, 9);
+		ux = warp_matrix(6, 6) - 1.f;
+		uy = warp_matrix(6, 7);
+		uz = warp_matrix(6, 8);
+		uxx = warp_matrix(6, 0) * 2.f;
+		uxy = warp_matrix(6, 1);
+		uxz = warp_matrix(6, 2);
+		uyy = warp_matrix(6, 3) * 2.f;
+		uyz = warp_matrix(6, 4);
+		uzz = warp_matrix(6, 5) * 2.f;
+
+		v = warp_matrix(7, 9);
+		vx = warp_matrix(7, 6);
+		vy = warp_matrix(7, 7) - 1.f;
+		vz = warp_matrix(7, 8);
+		vxx = warp_matrix(7, 0) * 2.f;
+		vxy = warp_matrix(7, 1);
+		vxz = warp_matrix(7, 2);
+		vyy = warp_matrix(7, 3) * 2.f;
+		vyz = warp_matrix(7, 4);
+		vzz = warp_matrix(7, 5) * 2.f;
+
+		w = warp_matrix(8, 9);
+		wx = warp_matrix(8, 6);
+		wy = warp_matrix(8, 7);
+		wz = warp_matrix(8, 8) - 1.f;
+		wxx = warp_matrix(8, 0) * 2.f;
+		wxy = warp_matrix(8, 1);
+		wxz = warp_matrix(8, 2);
+		wyy = warp_matrix(8, 3) * 2.f;
+		wyz = warp_matrix(8, 4);
+		wzz = warp_matrix(8, 5) * 2.f;
+	}
+
+	void Deformation3D2::setWarp()
+	{
+		//coefficients of the warped coordinates on the monomials, x' = x + u + ux * x + ... + 0.5 * uzz * z^2
+		float warp_x[10] = { 0.5f * uxx, uxy, uxz, 0.5f * uyy, uyz, 0.5f * uzz, 1.f + ux, uy, uz, u };
+		float warp_y[10] = { 0.5f * vxx, vxy, vxz, 0.5f * vyy, vyz, 0.5f * vzz, vx, 1.f + vy, vz, v };
+		float warp_z[10] = { 0.5f * wxx, wxy, wxz, 0.5f * wyy, wyz, 0.5f * wzz, wx, wy, 1.f + wz, w };
+		const float* warped[3] = { warp_x, warp_y, warp_z };
+
+		//rows 0 - 5, products of the warped coordinates in the order of quadratic monomials
+		int row = 0;
+		for (int a = 0; a < 3; a++)
+		{
+			for (int b = a; b < 3; b++)
+			{
+				float product[10];
+				multiplyQuadratic(warped[a], warped[b], product);
+				for (int c = 0; c < 10; c++)
+				{
+					warp_matrix(row, c) = product[c];
+				}
+				row++;
+			}
+		}
+
+		//rows 6 - 8, the warped coordinates
+		for (int c = 0; c < 10; c++)
+		{
+			warp_matrix(6, c) = warp_x[c];
+			warp_matrix(7, c) = warp_y[c];
+			warp_matrix(8, c) = warp_z[c];
+		}
+
+		//row 9
+		for (int c = 0; c < 9; c++)
+		{
+			warp_matrix(9, c) = 0.f;
+		}
+		warp_matrix(9, 9) = 1.f;
+	}
+
+	Point3D Deformation3D2::warp(Point3D& location)
+	{
+		Vector10f point_vector;
+		point_vector(0) = location.x * location.x;
+		point_vector(1) = location.x * location.y;
+		point_vector(2) = location.x * location.z;
+		point_vector(3) = location.y * location.y;
+		point_vector(4) = location.y * location.z;
+		point_vector(5) = location.z * location.z;
+		point_vector(6) = location.x;
+		point_vector(7) = location.y;
+		point_vector(8) = location.z;
+		point_vector(9) = 1.f;
+
+		Eigen::Vector3f warped_vector = warp_matrix.block<3, 10>(6, 0) * point_vector;
+
+		Point3D new_location(warped_vector(0), warped_vector(1), warped_vector(2));
+		return new_location;
+	}
+
 }//namespace opencorr
\ No newline at end of file
@@ -96,6 +96,31 @@ namespace opencorr
 		Point3D warp(Point3D& point);
 	};
 
+	//3D deformation with the 2nd order shape function, warp_matrix acts on the vector of monomials
+	//(x^2, xy, xz, y^2, yz, z^2, x, y, z, 1), the products of higher order are dropped
+	class Deformation3D2
+	{
+	public:
+		float u, ux, uy, uz, uxx, uxy, uxz, uyy, uyz, uzz;
+		float v, vx, vy, vz, vxx, vxy, vxz, vyy, vyz, vzz;
+		float w, wx, wy, wz, wxx, wxy, wxz, wyy, wyz, wzz;
+		Matrix10f warp_matrix;
+
+		Deformation3D2();
+		Deformation3D2(float p[30]);
+		~Deformation3D2();
+
+		void setDeformation(); //set deformation according to warp_matrix
+		void setDeformation(float p[30]); //order: u ux uy uz uxx uxy uxz uyy uyz uzz, then the same for v and w
+		void setDeformation(Deformation3D2& another_deformation);
+		void setDeformation(Deformation3D1& another_deformation);
+
+		void setWarp(); //update warp_matrix according to deformation
+		Point3D warp(Point3D& point);
+
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+	};
+
 }//namespace opencorr
 
 #endif // _DEFORMATION_H_
\ No newline at end of file
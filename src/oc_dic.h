@@ -20,6 +20,7 @@
 #include "oc_array.h"
 #include "oc_image.h"
 #include "oc_poi.h"
+#include "oc_schedule.h"
 #include "oc_subset.h"
 
 namespace opencorr
@@ -31,7 +32,7 @@ namespace opencorr
 		float distance; //Euclidean distance to the POI
 	};
 
-	class DIC
+	class DIC : public PoiSchedule
 	{
 	public:
 		Image2D* ref_img = nullptr;
@@ -52,7 +53,7 @@ namespace opencorr
 
 	};
 
-	class DVC
+	class DVC : public PoiSchedule
 	{
 	public:
 		Image3D* ref_img = nullptr;
@@ -19,16 +19,6 @@
 namespace opencorr
 {
 	//2D implementation
-	NearestNeighbor* FeatureAffine2D::getInstance(int tid)
-	{
-		if (tid >= (int)instance_pool.size())
-		{
-			throw std::string("CPU thread ID over limit");
-		}
-
-		return instance_pool[tid];
-	}
-
 	FeatureAffine2D::FeatureAffine2D(int radius_x, int radius_y, int thread_number)
 	{
 		this->subset_radius_x = radius_x;
@@ -40,20 +30,12 @@ namespace opencorr
 		ransac_config.trial_number = 20;
 
 		this->thread_number = thread_number;
-		for (int i = 0; i < thread_number; i++)
-		{
-			NearestNeighbor* instance = new NearestNeighbor();
-			instance_pool.push_back(instance);
-		}
+		neighbor_search = new NearestNeighbor();
 	}
 
 	FeatureAffine2D::~FeatureAffine2D()
 	{
-		for (auto& instance : instance_pool)
-		{
-			delete instance;
-		}
-		instance_pool.clear();
+		delete neighbor_search;
 	}
 
 	RansacConfig FeatureAffine2D::getRansacConfig() const
@@ -90,21 +72,14 @@ namespace opencorr
 
 	void FeatureAffine2D::prepare()
 	{
-#pragma omp parallel for
-		for (int i = 0; i < thread_number; i++)
-		{
-			instance_pool[i]->assignPoints(ref_kp);
-			instance_pool[i]->setSearchRadius(neighbor_search_radius);
-			instance_pool[i]->setSearchK(min_neighbor_num);
-			instance_pool[i]->constructKdTree();
-		}
+		neighbor_search->assignPoints(ref_kp);
+		neighbor_search->setSearchRadius(neighbor_search_radius);
+		neighbor_search->setSearchK(min_neighbor_num);
+		neighbor_search->constructKdTree();
 	}
 
 	void FeatureAffine2D::compute(POI2D* poi)
 	{
-		//set instance w.r.t. thread id 
-		NearestNeighbor* neighbor_search = getInstance(omp_get_thread_num());
-
 		Point3D current_point(poi->x, poi->y, 0.f);
 		std::vector<Point2D> ref_candidates, tar_candidates;
 
@@ -291,7 +266,8 @@ namespace opencorr
 	void FeatureAffine2D::compute(std::vector<POI2D>& poi_queue)
 	{
 		int queue_length = (int)poi_queue.size();
-#pragma omp parallel for
+		ScheduleScope schedule_scope(schedule_mode, schedule_chunk, queue_length);
+#pragma omp parallel for schedule(runtime)
 		for (int i = 0; i < queue_length; i++)
 		{
 			compute(&poi_queue[i]);
@@ -301,9 +277,6 @@ namespace opencorr
 	//functions for self-adaptive subset
 	void FeatureAffine2D::compute(POI2D* poi, int neighbor_k, int min_radius)
 	{
-		//set instance w.r.t. thread id 
-		NearestNeighbor* neighbor_search = getInstance(omp_get_thread_num());
-
 		Point3D current_point(poi->x, poi->y, 0.f);
 		std::vector<Point2D> ref_candidates, tar_candidates;
 
@@ -477,16 +450,6 @@ namespace opencorr
 
 	
 	//3D implementation
-	NearestNeighbor* FeatureAffine3D::getInstance(int tid)
-	{
-		if (tid >= (int)instance_pool.size())
-		{
-			throw std::string("CPU thread ID over limit");
-		}
-
-		return instance_pool[tid];
-	}
-
 	FeatureAffine3D::FeatureAffine3D(int radius_x, int radius_y, int radius_z, int thread_number)
 	{
 		this->subset_radius_x = radius_x;
@@ -498,39 +461,24 @@ namespace opencorr
 		ransac_config.trial_number = 32;
 
 		this->thread_number = thread_number;
-		for (int i = 0; i < thread_number; i++)
-		{
-			NearestNeighbor* instance = new NearestNeighbor();
-			instance_pool.push_back(instance);
-		}
+		neighbor_search = new NearestNeighbor();
 	}
 
 	FeatureAffine3D::~FeatureAffine3D()
 	{
-		for (auto& instance : instance_pool)
-		{
-			delete instance;
-		}
-		instance_pool.clear();
+		delete neighbor_search;
 	}
 
 	void FeatureAffine3D::prepare()
 	{
-#pragma omp parallel for
-		for (int i = 0; i < thread_number; i++)
-		{
-			instance_pool[i]->assignPoints(ref_kp);
-			instance_pool[i]->setSearchRadius(neighbor_search_radius);
-			instance_pool[i]->setSearchK(min_neighbor_num);
-			instance_pool[i]->constructKdTree();
-		}
+		neighbor_search->assignPoints(ref_kp);
+		neighbor_search->setSearchRadius(neighbor_search_radius);
+		neighbor_search->setSearchK(min_neighbor_num);
+		neighbor_search->constructKdTree();
 	}
 
 	void FeatureAffine3D::compute(POI3D* poi)
 	{
-		//set instance w.r.t. thread id 
-		NearestNeighbor* neighbor_search = getInstance(omp_get_thread_num());
-
 		Point3D current_point(poi->x, poi->y, poi->z);
 		std::vector<Point3D> ref_candidates, tar_candidates;
 
@@ -727,7 +675,8 @@ namespace opencorr
 	void FeatureAffine3D::compute(std::vector<POI3D>& poi_queue)
 	{
 		int queue_length = (int)poi_queue.size();
-#pragma omp parallel for
+		ScheduleScope schedule_scope(schedule_mode, schedule_chunk, queue_length);
+#pragma omp parallel for schedule(runtime)
 		for (int i = 0; i < queue_length; i++)
 		{
 			compute(&poi_queue[i]);
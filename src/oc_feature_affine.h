@@ -41,8 +41,7 @@ namespace opencorr
 	class FeatureAffine2D : public DIC
 	{
 	private:
-		std::vector<NearestNeighbor*> instance_pool;
-		NearestNeighbor* getInstance(int tid);
+		NearestNeighbor* neighbor_search; //kd-tree shared by all the CPU threads
 
 	protected:
 		float neighbor_search_radius; //seaching radius for mached keypoints around a POI
@@ -81,8 +80,7 @@ namespace opencorr
 	class FeatureAffine3D : public DVC
 	{
 	private:
-		std::vector<NearestNeighbor*> instance_pool;
-		NearestNeighbor* getInstance(int tid);
+		NearestNeighbor* neighbor_search; //kd-tree shared by all the CPU threads
 
 	protected:
 		float neighbor_search_radius; //seaching radius for mached keypoints around a POI
@@ -12,10 +12,89 @@
  * More information about OpenCorr can be found at https://www.opencorr.org/
  */
 
+#include <algorithm>
+#include <cfloat>
+
 #include "oc_fftcc.h"
 
 namespace opencorr
 {
+	//downsample an image by averaging each block of 2x2 pixels
+	static Image2D* halveImage(Image2D* image)
+	{
+		int width = image->width / 2;
+		int height = image->height / 2;
+		Image2D* half_image = new Image2D(width, height);
+
+#pragma omp parallel for
+		for (int c = 0; c < width; c++)
+		{
+			for (int r = 0; r < height; r++)
+			{
+				half_image->eg_mat(r, c) = 0.25f * (image->eg_mat(2 * r, 2 * c) + image->eg_mat(2 * r + 1, 2 * c)
+					+ image->eg_mat(2 * r, 2 * c + 1) + image->eg_mat(2 * r + 1, 2 * c + 1));
+			}
+		}
+
+		return half_image;
+	}
+
+	//downsample an image by averaging each block of 2x2x2 voxels
+	static Image3D* halveImage(Image3D* image)
+	{
+		int dim_x = image->dim_x / 2;
+		int dim_y = image->dim_y / 2;
+		int dim_z = image->dim_z / 2;
+		Image3D* half_image = new Image3D(dim_x, dim_y, dim_z);
+
+#pragma omp parallel for
+		for (int i = 0; i < dim_z; i++)
+		{
+			for (int j = 0; j < dim_y; j++)
+			{
+				for (int k = 0; k < dim_x; k++)
+				{
+					float sum = 0.f;
+					for (int n = 0; n < 8; n++)
+					{
+						sum += image->vol_mat[2 * i + (n >> 2)][2 * j + ((n >> 1) & 1)][2 * k + (n & 1)];
+					}
+					half_image->vol_mat[i][j][k] = 0.125f * sum;
+				}
+			}
+		}
+
+		return half_image;
+	}
+
+	//cross-power spectrum of reference and target subsets
+	static void crossPower(fftwf_complex* ref_freq, fftwf_complex* tar_freq, fftwf_complex* zncc_freq, int buffer_length)
+	{
+		for (int n = 0; n < buffer_length; n++)
+		{
+			zncc_freq[n][0] = (ref_freq[n][0] * tar_freq[n][0]) + (ref_freq[n][1] * tar_freq[n][1]);
+			zncc_freq[n][1] = (ref_freq[n][0] * tar_freq[n][1]) - (ref_freq[n][1] * tar_freq[n][0]);
+		}
+	}
+
+	//offset of peak from the middle one of three equally spaced samples, fitted with a parabola or a Gaussian
+	static float fitThreePoints(float left, float middle, float right, bool gaussian)
+	{
+		if (gaussian && left > 0.f && middle > 0.f && right > 0.f)
+		{
+			left = log(left);
+			middle = log(middle);
+			right = log(right);
+		}
+
+		float denominator = left - 2.f * middle + right;
+		if (denominator >= 0.f) //not a maximum
+		{
+			return 0.f;
+		}
+		return 0.5f * (left - right) / denominator;
+	}
+
 	FFTW* FFTW::allocate(int subset_radius_x, int subset_radius_y)
 	{
 		int width = 2 * subset_radius_x;
@@ -24,6 +103,7 @@ namespace opencorr
 		unsigned int subset_size = width * height;
 
 		FFTW* FFTW_instance = new FFTW;
+		FFTW_instance->batch_size = 0;
 
 		FFTW_instance->ref_freq = (fftwf_complex*)fftw_malloc(sizeof(fftwf_complex) * buffer_length);
 		FFTW_instance->tar_freq = (fftwf_complex*)fftw_malloc(sizeof(fftwf_complex) * buffer_length);
@@ -52,6 +132,7 @@ namespace opencorr
 		unsigned int subset_size = dim_x * dim_y * dim_z;
 
 		FFTW* FFTW_instance = new FFTW;
+		FFTW_instance->batch_size = 0;
 
 		FFTW_instance->ref_freq = (fftwf_complex*)fftw_malloc(sizeof(fftwf_complex) * buffer_length);
 		FFTW_instance->tar_freq = (fftwf_complex*)fftw_malloc(sizeof(fftwf_complex) * buffer_length);
@@ -82,6 +163,72 @@ namespace opencorr
 		fftwf_destroy_plan(instance->ref_plan);
 		fftwf_destroy_plan(instance->tar_plan);
 		fftwf_destroy_plan(instance->zncc_plan);
+
+		releaseBatch(instance);
+	}
+
+	void FFTW::allocateBatch(FFTW* instance, int rank, const int* dim, int batch_size, unsigned int plan_flag)
+	{
+		releaseBatch(instance);
+
+		//layout of a subset follows the single plans, the last dimension is halved in frequency domain
+		int subset_size = 1;
+		for (int i = 0; i < rank; i++)
+		{
+			subset_size *= dim[i];
+		}
+		int buffer_length = subset_size / dim[rank - 1] * (dim[rank - 1] / 2 + 1);
+
+		instance->batch_size = batch_size;
+		instance->batch_cache_idx.resize(batch_size);
+		instance->batch_ref_norm.resize(batch_size);
+		instance->batch_tar_norm.resize(batch_size);
+		instance->ref_batch = (float*)fftwf_malloc(sizeof(float) * subset_size * batch_size);
+		instance->tar_batch = (float*)fftwf_malloc(sizeof(float) * subset_size * batch_size);
+		instance->zncc_batch = (float*)fftwf_malloc(sizeof(float) * subset_size * batch_size);
+		instance->ref_batch_freq = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * buffer_length * batch_size);
+		instance->tar_batch_freq = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * buffer_length * batch_size);
+		instance->zncc_batch_freq = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * buffer_length * batch_size);
+
+		//the planner is not thread-safe, planning with FFTW_MEASURE overwrites the buffers
+#pragma omp critical
+		{
+			instance->ref_batch_plan = fftwf_plan_many_dft_r2c(rank, dim, batch_size, instance->ref_batch, nullptr, 1, subset_size,
+				instance->ref_batch_freq, nullptr, 1, buffer_length, plan_flag);
+			instance->tar_batch_plan = fftwf_plan_many_dft_r2c(rank, dim, batch_size, instance->tar_batch, nullptr, 1, subset_size,
+				instance->tar_batch_freq, nullptr, 1, buffer_length, plan_flag);
+			instance->zncc_batch_plan = fftwf_plan_many_dft_c2r(rank, dim, batch_size, instance->zncc_batch_freq, nullptr, 1, buffer_length,
+				instance->zncc_batch, nullptr, 1, subset_size, plan_flag);
+		}
+	}
+
+	void FFTW::releaseBatch(FFTW* instance)
+	{
+		if (instance->batch_size == 0)
+		{
+			return;
+		}
+
+		fftwf_free(instance->ref_batch);
+		fftwf_free(instance->tar_batch);
+		fftwf_free(instance->zncc_batch);
+		fftwf_free(instance->ref_batch_freq);
+		fftwf_free(instance->tar_batch_freq);
+		fftwf_free(instance->zncc_batch_freq);
+		fftwf_destroy_plan(instance->ref_batch_plan);
+		fftwf_destroy_plan(instance->tar_batch_plan);
+		fftwf_destroy_plan(instance->zncc_batch_plan);
+		instance->batch_size = 0;
+	}
+
+	bool FFTW::importWisdom(std::string file_path)
+	{
+		return fftwf_import_wisdom_from_filename(file_path.c_str()) != 0;
+	}
+
+	bool FFTW::exportWisdom(std::string file_path)
+	{
+		return fftwf_export_wisdom_to_filename(file_path.c_str()) != 0;
 	}
 
 	void FFTW::reallocate(FFTW* instance, int subset_radius_x, int subset_radius_y)
@@ -137,6 +284,7 @@ namespace opencorr
 
 	//FFT accelerated cross correlation 2D
 	FFTCC2D::FFTCC2D(int subset_radius_x, int subset_radius_y, int thread_number)
+		: pyramid_level(0), ref_cache_freq(nullptr), batch_size(1), peak_fitting(PEAK_INTEGER), max_peak_ratio(1.f)
 	{
 		this->subset_radius_x = subset_radius_x;
 		this->subset_radius_y = subset_radius_y;
@@ -157,9 +305,100 @@ namespace opencorr
 			delete instance;
 		}
 		instance_pool.clear();
+
+		releasePyramid();
+		releaseReference();
+	}
+
+	void FFTCC2D::setPyramid(int pyramid_level)
+	{
+		this->pyramid_level = pyramid_level;
+		releasePyramid();
 	}
 
-	void FFTCC2D::prepare() {}
+	void FFTCC2D::setPeakFitting(PeakFitting peak_fitting)
+	{
+		this->peak_fitting = peak_fitting;
+	}
+
+	void FFTCC2D::setPeakRatio(float max_peak_ratio)
+	{
+		this->max_peak_ratio = max_peak_ratio;
+	}
+
+	void FFTCC2D::setBatch(int batch_size, unsigned int plan_flag)
+	{
+		this->batch_size = batch_size;
+
+		//same dimensions as the single plans
+		int dim[2] = { subset_radius_x * 2, subset_radius_y * 2 };
+		for (auto& instance : instance_pool)
+		{
+			if (batch_size > 1)
+			{
+				FFTW::allocateBatch(instance, 2, dim, batch_size, plan_flag);
+			}
+			else
+			{
+				FFTW::releaseBatch(instance);
+			}
+		}
+	}
+
+	void FFTCC2D::releasePyramid()
+	{
+		pyramid_ref_img = nullptr;
+		pyramid_tar_img = nullptr;
+
+		for (auto& level : ref_pyramid)
+		{
+			delete level;
+		}
+		for (auto& level : tar_pyramid)
+		{
+			delete level;
+		}
+		ref_pyramid.clear();
+		tar_pyramid.clear();
+	}
+
+	void FFTCC2D::prepare()
+	{
+		releasePyramid();
+
+		//the levels are built until the images become smaller than subset
+		Image2D* ref_level = ref_img;
+		Image2D* tar_level = tar_img;
+		for (int l = 0; l < pyramid_level; l++)
+		{
+			if (ref_level->width / 2 < 2 * subset_radius_x || ref_level->height / 2 < 2 * subset_radius_y
+				|| tar_level->width / 2 < 2 * subset_radius_x || tar_level->height / 2 < 2 * subset_radius_y)
+			{
+				break;
+			}
+
+			ref_level = halveImage(ref_level);
+			tar_level = halveImage(tar_level);
+			ref_pyramid.push_back(ref_level);
+			tar_pyramid.push_back(tar_level);
+		}
+
+		pyramid_ref_img = ref_img;
+		pyramid_tar_img = tar_img;
+	}
+
+	bool FFTCC2D::isInside(POI2D* poi)
+	{
+		//subset covers the pixels from center - radius to center + radius - 1
+		int x_min = (int)poi->x - subset_radius_x;
+		int y_min = (int)poi->y - subset_radius_y;
+		int x_max = (int)poi->x + subset_radius_x - 1;
+		int y_max = (int)poi->y + subset_radius_y - 1;
+
+		return x_min >= 0 && y_min >= 0 && x_max <= ref_img->width - 1 && y_max <= ref_img->height - 1
+			&& x_min + floor(poi->deformation.u) >= 0 && y_min + floor(poi->deformation.v) >= 0
+			&& x_max + ceil(poi->deformation.u) <= tar_img->width - 1 && y_max + ceil(poi->deformation.v) <= tar_img->height - 1;
+	}
 
 	FFTW* FFTCC2D::getInstance(int tid)
 	{
@@ -171,80 +410,140 @@ namespace opencorr
 		return instance_pool[tid];
 	}
 
-	void FFTCC2D::compute(POI2D* poi)
+	float FFTCC2D::fillReference(POI2D* poi, float* ref_subset)
 	{
-		//set instance w.r.t. thread id 
-		FFTW* current_instance = getInstance(omp_get_thread_num());
-
 		int subset_width = subset_radius_x * 2;
 		int subset_height = subset_radius_y * 2;
 		int subset_size = subset_width * subset_height;
 
-		//set initial guess of displacement
-		Point2D initial_displacement(poi->deformation.u, poi->deformation.v);
-
-		//initialize mean and norm in subsets
 		float ref_mean = 0.f;
-		float tar_mean = 0.f;
 		float ref_norm = 0.f;
-		float tar_norm = 0.f;
-
 		for (int r = 0; r < subset_height; r++)
 		{
 			for (int c = 0; c < subset_width; c++)
 			{
-				//fill reference subset
 				Point2D ref_point(poi->x + c - subset_radius_x, poi->y + r - subset_radius_y);
 				float value = ref_img->eg_mat((int)ref_point.y, (int)ref_point.x);
-				current_instance->ref_subset[r * subset_width + c] = value;
+				ref_subset[r * subset_width + c] = value;
 				ref_mean += value;
-
-				//fill the target subset with initial guess of displacement
-				Point2D tar_point = ref_point + initial_displacement;
-				value = tar_img->eg_mat((int)tar_point.y, (int)tar_point.x);
-				current_instance->tar_subset[r * subset_width + c] = value;
-				tar_mean += value;
 			}
 		}
 		ref_mean /= subset_size;
-		tar_mean /= subset_size;
 
-		//zero-mean operation of gray-scale values in the two subsets
+		//zero-mean operation of gray-scale values in the reference subset
 		for (int i = 0; i < subset_size; i++)
 		{
-			current_instance->ref_subset[i] -= ref_mean;
-			current_instance->tar_subset[i] -= tar_mean;
-			ref_norm += current_instance->ref_subset[i] * current_instance->ref_subset[i];
-			tar_norm += current_instance->tar_subset[i] * current_instance->tar_subset[i];
+			ref_subset[i] -= ref_mean;
+			ref_norm += ref_subset[i] * ref_subset[i];
 		}
 
-		fftwf_execute(current_instance->ref_plan);
-		fftwf_execute(current_instance->tar_plan);
+		return ref_norm;
+	}
 
-		int buffer_length = subset_width * (subset_radius_y + 1);
-		for (int n = 0; n < buffer_length; n++)
+	float FFTCC2D::fillTarget(POI2D* poi, float* tar_subset)
+	{
+		int subset_width = subset_radius_x * 2;
+		int subset_height = subset_radius_y * 2;
+		int subset_size = subset_width * subset_height;
+
+		//fill the target subset shifted by the initial guess of displacement, rounded to integer pixels.
+		//getPeak adds the same shift to the correlation peak
+		float shift_x = round(poi->deformation.u);
+		float shift_y = round(poi->deformation.v);
+		float tar_mean = 0.f;
+		float tar_norm = 0.f;
+		for (int r = 0; r < subset_height; r++)
+		{
+			for (int c = 0; c < subset_width; c++)
+			{
+				Point2D tar_point(poi->x + c - subset_radius_x + shift_x, poi->y + r - subset_radius_y + shift_y);
+				float value = tar_img->eg_mat((int)tar_point.y, (int)tar_point.x);
+				tar_subset[r * subset_width + c] = value;
+				tar_mean += value;
+			}
+		}
+		tar_mean /= subset_size;
+
+		//zero-mean operation of gray-scale values in the target subset
+		for (int i = 0; i < subset_size; i++)
 		{
-			current_instance->zncc_freq[n][0] = (current_instance->ref_freq[n][0] * current_instance->tar_freq[n][0])
-				+ (current_instance->ref_freq[n][1] * current_instance->tar_freq[n][1]);
-			current_instance->zncc_freq[n][1] = (current_instance->ref_freq[n][0] * current_instance->tar_freq[n][1])
-				- (current_instance->ref_freq[n][1] * current_instance->tar_freq[n][0]);
+			tar_subset[i] -= tar_mean;
+			tar_norm += tar_subset[i] * tar_subset[i];
 		}
 
-		fftwf_execute(current_instance->zncc_plan);
+		return tar_norm;
+	}
+
+	void FFTCC2D::getPeak(POI2D* poi, float* zncc, float ref_norm, float tar_norm)
+	{
+		int subset_width = subset_radius_x * 2;
+		int subset_height = subset_radius_y * 2;
+		int subset_size = subset_width * subset_height;
 
 		//search for max ZCC
 		float max_zncc = -2.f;
 		int max_zncc_index = 0;
 		for (int i = 0; i < subset_size; i++)
 		{
-			if (current_instance->zncc[i] > max_zncc)
+			if (zncc[i] > max_zncc)
 			{
-				max_zncc = current_instance->zncc[i];
+				max_zncc = zncc[i];
 				max_zncc_index = i;
 			}
 		}
-		int local_displacement_u = max_zncc_index % subset_width;
-		int local_displacement_v = max_zncc_index / subset_width;
+		int peak_x = max_zncc_index % subset_width;
+		int peak_y = max_zncc_index / subset_width;
+
+		//search for the second peak, i.e. the highest local maximum out of the 3x3 neighborhood of max ZCC,
+		//the map of ZCC is periodic
+		bool ambiguous = false;
+		if (max_peak_ratio < 1.f)
+		{
+			float second_zncc = -FLT_MAX;
+			for (int r = 0; r < subset_height; r++)
+			{
+				int distance_y = abs(r - peak_y);
+				distance_y = std::min(distance_y, subset_height - distance_y);
+				int up = (r + subset_height - 1) % subset_height;
+				int down = (r + 1) % subset_height;
+				for (int c = 0; c < subset_width; c++)
+				{
+					int distance_x = abs(c - peak_x);
+					distance_x = std::min(distance_x, subset_width - distance_x);
+					float value = zncc[r * subset_width + c];
+					if ((distance_x <= 1 && distance_y <= 1) || value <= second_zncc)
+					{
+						continue;
+					}
+
+					int left = (c + subset_width - 1) % subset_width;
+					int right = (c + 1) % subset_width;
+					if (value >= zncc[r * subset_width + left] && value >= zncc[r * subset_width + right]
+						&& value >= zncc[up * subset_width + c] && value >= zncc[down * subset_width + c])
+					{
+						second_zncc = value;
+					}
+				}
+			}
+			ambiguous = (max_zncc <= 0.f || second_zncc > max_peak_ratio * max_zncc);
+		}
+
+		//fit the peak along each axis with its neighbors
+		float subpixel_x = 0.f;
+		float subpixel_y = 0.f;
+		if (peak_fitting != PEAK_INTEGER)
+		{
+			bool gaussian = (peak_fitting == PEAK_GAUSSIAN);
+			int left = (peak_x + subset_width - 1) % subset_width;
+			int right = (peak_x + 1) % subset_width;
+			int up = (peak_y + subset_height - 1) % subset_height;
+			int down = (peak_y + 1) % subset_height;
+			subpixel_x = fitThreePoints(zncc[peak_y * subset_width + left], max_zncc, zncc[peak_y * subset_width + right], gaussian);
+			subpixel_y = fitThreePoints(zncc[up * subset_width + peak_x], max_zncc, zncc[down * subset_width + peak_x], gaussian);
+		}
+
+		int local_displacement_u = peak_x;
+		int local_displacement_v = peak_y;
 
 		if (local_displacement_u > subset_radius_x)
 		{
@@ -255,22 +554,300 @@ namespace opencorr
 			local_displacement_v -= subset_height;
 		}
 
-		//store the final results
-		poi->deformation.u = (float)local_displacement_u + initial_displacement.x;
-		poi->deformation.v = (float)local_displacement_v + initial_displacement.y;
+		//store the final results, the deformation of POI serves as initial guess, which shifts the target subset
+		//by integer pixels in fillTarget
+		Point2D initial_displacement(poi->deformation.u, poi->deformation.v);
+		poi->deformation.u = (float)local_displacement_u + subpixel_x + round(initial_displacement.x);
+		poi->deformation.v = (float)local_displacement_v + subpixel_y + round(initial_displacement.y);
 
 		poi->result.u0 = initial_displacement.x;
 		poi->result.v0 = initial_displacement.y;
 		poi->result.zncc = max_zncc / (sqrt(ref_norm * tar_norm) * subset_size); //convert ZCC to ZNCC
+
+		//POIs with ambiguous peak are marked to be skipped by the following registration
+		if (ambiguous)
+		{
+			poi->result.zncc = -3;
+		}
 	}
 
-	void FFTCC2D::compute(std::vector<POI2D>& poi_queue)
+	int FFTCC2D::getCacheIndex(int poi_idx, POI2D* poi)
+	{
+		if (ref_cache_img != ref_img || poi_idx >= (int)ref_cache_norm.size() || ref_cache_norm[poi_idx] < 0
+			|| ref_cache_location[poi_idx].x != poi->x || ref_cache_location[poi_idx].y != poi->y)
+		{
+			return -1;
+		}
+		return poi_idx;
+	}
+
+	bool FFTCC2D::precomputeReference(std::vector<POI2D>& poi_queue, size_t memory_budget)
 	{
+		releaseReference();
+
+		//estimate the memory occupied by cache, i.e. spectrum, norm and location of reference subset of each POI
 		int queue_length = (int)poi_queue.size();
+		size_t buffer_length = (size_t)subset_radius_x * 2 * (subset_radius_y + 1);
+		size_t ref_size = buffer_length * sizeof(fftwf_complex) + sizeof(float) + sizeof(Point2D);
+		if (queue_length == 0 || ref_size * queue_length > memory_budget)
+		{
+			return false;
+		}
+
+		ref_cache_freq = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * buffer_length * queue_length);
+		ref_cache_norm.assign(queue_length, -1.f);
+		ref_cache_location.resize(queue_length);
+		ref_cache_img = ref_img;
+
 #pragma omp parallel for
 		for (int i = 0; i < queue_length; i++)
 		{
-			compute(&poi_queue[i]);
+			POI2D* poi = &poi_queue[i];
+			ref_cache_location[i] = (Point2D)*poi;
+
+			//POIs with subset out of reference image are not cached, a negative norm marks them
+			if (poi->x - subset_radius_x < 0 || poi->y - subset_radius_y < 0
+				|| poi->x + subset_radius_x > ref_img->width || poi->y + subset_radius_y > ref_img->height)
+			{
+				continue;
+			}
+
+			FFTW* current_instance = getInstance(omp_get_thread_num());
+			ref_cache_norm[i] = fillReference(poi, current_instance->ref_subset);
+			fftwf_execute(current_instance->ref_plan);
+			std::copy(&current_instance->ref_freq[0][0], &current_instance->ref_freq[0][0] + buffer_length * 2, &ref_cache_freq[buffer_length * i][0]);
+		}
+
+		return true;
+	}
+
+	void FFTCC2D::releaseReference()
+	{
+		if (ref_cache_freq != nullptr)
+		{
+			fftwf_free(ref_cache_freq);
+			ref_cache_freq = nullptr;
+		}
+		ref_cache_norm.clear();
+		ref_cache_location.clear();
+		ref_cache_img = nullptr;
+	}
+
+	void FFTCC2D::compute(POI2D* poi)
+	{
+		computeWithReference(poi, -1);
+	}
+
+	void FFTCC2D::computeWithReference(POI2D* poi, int cache_idx)
+	{
+		//set instance w.r.t. thread id 
+		FFTW* current_instance = getInstance(omp_get_thread_num());
+
+		int buffer_length = subset_radius_x * 2 * (subset_radius_y + 1);
+
+		//take the spectrum of reference subset from cache if available
+		fftwf_complex* ref_freq = current_instance->ref_freq;
+		float ref_norm = 0.f;
+		if (cache_idx >= 0)
+		{
+			ref_freq = ref_cache_freq + (size_t)cache_idx * buffer_length;
+			ref_norm = ref_cache_norm[cache_idx];
+		}
+		else
+		{
+			ref_norm = fillReference(poi, current_instance->ref_subset);
+			fftwf_execute(current_instance->ref_plan);
+		}
+
+		float tar_norm = fillTarget(poi, current_instance->tar_subset);
+		fftwf_execute(current_instance->tar_plan);
+
+		crossPower(ref_freq, current_instance->tar_freq, current_instance->zncc_freq, buffer_length);
+		fftwf_execute(current_instance->zncc_plan);
+
+		getPeak(poi, current_instance->zncc, ref_norm, tar_norm);
+	}
+
+	void FFTCC2D::computeBatch(std::vector<POI2D>& poi_queue, int begin, int end)
+	{
+		//set instance w.r.t. thread id 
+		FFTW* current_instance = getInstance(omp_get_thread_num());
+
+		int subset_size = subset_radius_x * 2 * subset_radius_y * 2;
+		int buffer_length = subset_radius_x * 2 * (subset_radius_y + 1);
+
+		//fill the subsets of the block, the slots beyond the end of queue are left as they are
+		bool ref_needed = false;
+		for (int i = begin; i < end; i++)
+		{
+			int slot = i - begin;
+			current_instance->batch_cache_idx[slot] = getCacheIndex(i, &poi_queue[i]);
+			if (current_instance->batch_cache_idx[slot] < 0)
+			{
+				current_instance->batch_ref_norm[slot] = fillReference(&poi_queue[i], current_instance->ref_batch + (size_t)slot * subset_size);
+				ref_needed = true;
+			}
+			else
+			{
+				current_instance->batch_ref_norm[slot] = ref_cache_norm[current_instance->batch_cache_idx[slot]];
+			}
+			current_instance->batch_tar_norm[slot] = fillTarget(&poi_queue[i], current_instance->tar_batch + (size_t)slot * subset_size);
+		}
+
+		if (ref_needed)
+		{
+			fftwf_execute(current_instance->ref_batch_plan);
+		}
+		fftwf_execute(current_instance->tar_batch_plan);
+
+		for (int i = begin; i < end; i++)
+		{
+			int slot = i - begin;
+			int cache_idx = current_instance->batch_cache_idx[slot];
+			fftwf_complex* ref_freq = cache_idx < 0 ? current_instance->ref_batch_freq + (size_t)slot * buffer_length
+				: ref_cache_freq + (size_t)cache_idx * buffer_length;
+			crossPower(ref_freq, current_instance->tar_batch_freq + (size_t)slot * buffer_length,
+				current_instance->zncc_batch_freq + (size_t)slot * buffer_length, buffer_length);
+		}
+
+		fftwf_execute(current_instance->zncc_batch_plan);
+
+		for (int i = begin; i < end; i++)
+		{
+			int slot = i - begin;
+			getPeak(&poi_queue[i], current_instance->zncc_batch + (size_t)slot * subset_size,
+				current_instance->batch_ref_norm[slot], current_instance->batch_tar_norm[slot]);
+		}
+	}
+
+	void FFTCC2D::compute(std::vector<POI2D>& poi_queue)
+	{
+		if (pyramid_level > 0)
+		{
+			computePyramid(poi_queue);
+			return;
+		}
+
+		int queue_length = (int)poi_queue.size();
+		if (batch_size > 1)
+		{
+			int block_number = (queue_length + batch_size - 1) / batch_size;
+			ScheduleScope schedule_scope(schedule_mode, (schedule_chunk + batch_size - 1) / batch_size, block_number);
+#pragma omp parallel for schedule(runtime)
+			for (int i = 0; i < block_number; i++)
+			{
+				computeBatch(poi_queue, i * batch_size, std::min((i + 1) * batch_size, queue_length));
+			}
+			return;
+		}
+
+		ScheduleScope schedule_scope(schedule_mode, schedule_chunk, queue_length);
+#pragma omp parallel for schedule(runtime)
+		for (int i = 0; i < queue_length; i++)
+		{
+			computeWithReference(&poi_queue[i], getCacheIndex(i, &poi_queue[i]));
+		}
+	}
+
+	void FFTCC2D::computePyramid(std::vector<POI2D>& poi_queue)
+	{
+		//the pyramids are built from the current images
+		if (pyramid_ref_img != ref_img || pyramid_tar_img != tar_img)
+		{
+			prepare();
+		}
+
+		int queue_length = (int)poi_queue.size();
+		int level_number = (int)ref_pyramid.size();
+		Image2D* ref_original = ref_img;
+		Image2D* tar_original = tar_img;
+
+		std::vector<POI2D> parent_nodes; //nodes processed at the coarser level
+		std::vector<int> parent_idx; //index of the node at the coarser level for each POI
+
+		for (int l = level_number; l > 0; l--)
+		{
+			float scale = (float)(1 << l);
+
+			//group the POIs into the nodes of a coarse grid, so that the POIs close to each other are processed only once
+			long long key_width = (long long)ref_pyramid[l - 1]->width + 1;
+			std::vector<std::pair<long long, int>> grid_key(queue_length);
+			for (int i = 0; i < queue_length; i++)
+			{
+				long long x = (long long)round(poi_queue[i].x / scale);
+				long long y = (long long)round(poi_queue[i].y / scale);
+				grid_key[i] = std::make_pair(y * key_width + x, i);
+			}
+			std::sort(grid_key.begin(), grid_key.end());
+
+			std::vector<POI2D> nodes;
+			std::vector<int> node_idx(queue_length);
+			for (int i = 0; i < queue_length; i++)
+			{
+				POI2D* poi = &poi_queue[grid_key[i].second];
+				if (i == 0 || grid_key[i].first != grid_key[i - 1].first)
+				{
+					POI2D node((float)round(poi->x / scale), (float)round(poi->y / scale));
+
+					//the initial guess is taken from the coarser level, or scaled from the POI at the coarsest level.
+					//fillTarget rounds it to an integer shift, the sub-pixel part is recovered by peak fitting
+					if (parent_nodes.empty())
+					{
+						node.deformation.u = poi->deformation.u / scale;
+						node.deformation.v = poi->deformation.v / scale;
+					}
+					else
+					{
+						POI2D* parent = &parent_nodes[parent_idx[grid_key[i].second]];
+						node.deformation.u = 2.f * parent->deformation.u;
+						node.deformation.v = 2.f * parent->deformation.v;
+					}
+					nodes.push_back(node);
+				}
+				node_idx[grid_key[i].second] = (int)nodes.size() - 1;
+			}
+
+			//nodes out of the images keep their initial guess
+			ref_img = ref_pyramid[l - 1];
+			tar_img = tar_pyramid[l - 1];
+			int node_number = (int)nodes.size();
+			ScheduleScope schedule_scope(schedule_mode, schedule_chunk, node_number);
+#pragma omp parallel for schedule(runtime)
+			for (int i = 0; i < node_number; i++)
+			{
+				if (isInside(&nodes[i]))
+				{
+					compute(&nodes[i]);
+				}
+			}
+
+			parent_nodes.swap(nodes);
+			parent_idx.swap(node_idx);
+		}
+
+		//refine the estimation in the original images
+		ref_img = ref_original;
+		tar_img = tar_original;
+		ScheduleScope schedule_scope(schedule_mode, schedule_chunk, queue_length);
+#pragma omp parallel for schedule(runtime)
+		for (int i = 0; i < queue_length; i++)
+		{
+			POI2D* poi = &poi_queue[i];
+			if (level_number > 0)
+			{
+				POI2D* parent = &parent_nodes[parent_idx[i]];
+				poi->deformation.u = 2.f * parent->deformation.u;
+				poi->deformation.v = 2.f * parent->deformation.v;
+			}
+
+			if (isInside(poi))
+			{
+				computeWithReference(poi, getCacheIndex(i, poi));
+			}
+			else
+			{
+				poi->result.zncc = -1;
+			}
 		}
 	}
 
@@ -278,6 +855,7 @@ namespace opencorr
 
 	//FFT accelerated cross correlation 3D
 	FFTCC3D::FFTCC3D(int subset_radius_x, int subset_radius_y, int subset_radius_z, int thread_number)
+		: pyramid_level(0), ref_cache_freq(nullptr), batch_size(1), peak_fitting(PEAK_INTEGER), max_peak_ratio(1.f)
 	{
 		this->subset_radius_x = subset_radius_x;
 		this->subset_radius_y = subset_radius_y;
@@ -299,9 +877,104 @@ namespace opencorr
 			delete instance;
 		}
 		instance_pool.clear();
+
+		releasePyramid();
+		releaseReference();
+	}
+
+	void FFTCC3D::setPyramid(int pyramid_level)
+	{
+		this->pyramid_level = pyramid_level;
+		releasePyramid();
+	}
+
+	void FFTCC3D::setPeakFitting(PeakFitting peak_fitting)
+	{
+		this->peak_fitting = peak_fitting;
+	}
+
+	void FFTCC3D::setPeakRatio(float max_peak_ratio)
+	{
+		this->max_peak_ratio = max_peak_ratio;
+	}
+
+	void FFTCC3D::setBatch(int batch_size, unsigned int plan_flag)
+	{
+		this->batch_size = batch_size;
+
+		//same dimensions as the single plans
+		int dim[3] = { subset_radius_x * 2, subset_radius_y * 2, subset_radius_z * 2 };
+		for (auto& instance : instance_pool)
+		{
+			if (batch_size > 1)
+			{
+				FFTW::allocateBatch(instance, 3, dim, batch_size, plan_flag);
+			}
+			else
+			{
+				FFTW::releaseBatch(instance);
+			}
+		}
+	}
+
+	void FFTCC3D::releasePyramid()
+	{
+		pyramid_ref_img = nullptr;
+		pyramid_tar_img = nullptr;
+
+		for (auto& level : ref_pyramid)
+		{
+			delete level;
+		}
+		for (auto& level : tar_pyramid)
+		{
+			delete level;
+		}
+		ref_pyramid.clear();
+		tar_pyramid.clear();
+	}
+
+	void FFTCC3D::prepare()
+	{
+		releasePyramid();
+
+		//the levels are built until the images become smaller than subset
+		Image3D* ref_level = ref_img;
+		Image3D* tar_level = tar_img;
+		for (int l = 0; l < pyramid_level; l++)
+		{
+			if (ref_level->dim_x / 2 < 2 * subset_radius_x || ref_level->dim_y / 2 < 2 * subset_radius_y || ref_level->dim_z / 2 < 2 * subset_radius_z
+				|| tar_level->dim_x / 2 < 2 * subset_radius_x || tar_level->dim_y / 2 < 2 * subset_radius_y || tar_level->dim_z / 2 < 2 * subset_radius_z)
+			{
+				break;
+			}
+
+			ref_level = halveImage(ref_level);
+			tar_level = halveImage(tar_level);
+			ref_pyramid.push_back(ref_level);
+			tar_pyramid.push_back(tar_level);
+		}
+
+		pyramid_ref_img = ref_img;
+		pyramid_tar_img = tar_img;
 	}
 
-	void FFTCC3D::prepare() {}
+	bool FFTCC3D::isInside(POI3D* poi)
+	{
+		//subset covers the voxels from center - radius to center + radius - 1
+		int x_min = (int)poi->x - subset_radius_x;
+		int y_min = (int)poi->y - subset_radius_y;
+		int z_min = (int)poi->z - subset_radius_z;
+		int x_max = (int)poi->x + subset_radius_x - 1;
+		int y_max = (int)poi->y + subset_radius_y - 1;
+		int z_max = (int)poi->z + subset_radius_z - 1;
+
+		return x_min >= 0 && y_min >= 0 && z_min >= 0
+			&& x_max <= ref_img->dim_x - 1 && y_max <= ref_img->dim_y - 1 && z_max <= ref_img->dim_z - 1
+			&& x_min + floor(poi->deformation.u) >= 0 && y_min + floor(poi->deformation.v) >= 0 && z_min + floor(poi->deformation.w) >= 0
+			&& x_max + ceil(poi->deformation.u) <= tar_img->dim_x - 1 && y_max + ceil(poi->deformation.v) <= tar_img->dim_y - 1
+			&& z_max + ceil(poi->deformation.w) <= tar_img->dim_z - 1;
+	}
 
 	FFTW* FFTCC3D::getInstance(int tid)
 	{
@@ -313,85 +986,172 @@ namespace opencorr
 		return instance_pool[tid];
 	}
 
-	void FFTCC3D::compute(POI3D* poi)
+	float FFTCC3D::fillReference(POI3D* poi, float* ref_subset)
 	{
-		//set instance w.r.t. thread id 
-		FFTW* current_instance = getInstance(omp_get_thread_num());
-
 		int subset_dim_x = subset_radius_x * 2;
 		int subset_dim_y = subset_radius_y * 2;
 		int subset_dim_z = subset_radius_z * 2;
 		int subset_size = subset_dim_x * subset_dim_y * subset_dim_z;
 
-		//set initial guess of displacement
-		Point3D initial_displacement(poi->deformation.u, poi->deformation.v, poi->deformation.w);
-
-		//initialize mean and norm in subsets
 		float ref_mean = 0.f;
-		float tar_mean = 0.f;
 		float ref_norm = 0.f;
-		float tar_norm = 0.f;
-
 		for (int i = 0; i < subset_dim_z; i++)
 		{
 			for (int j = 0; j < subset_dim_y; j++)
 			{
 				for (int k = 0; k < subset_dim_x; k++)
 				{
-					//fill the reference subset
 					Point3D ref_point(poi->x + k - subset_radius_x, poi->y + j - subset_radius_y, poi->z + i - subset_radius_z);
 					float value = ref_img->vol_mat[(int)ref_point.z][(int)ref_point.y][(int)ref_point.x];
-					current_instance->ref_subset[(i * subset_dim_y + j) * subset_dim_x + k] = value;
+					ref_subset[(i * subset_dim_y + j) * subset_dim_x + k] = value;
 					ref_mean += value;
-
-					//fill the target subset with initial guess of displacement
-					Point3D tar_point = ref_point + initial_displacement;
-					value = tar_img->vol_mat[(int)tar_point.z][(int)tar_point.y][(int)tar_point.x];
-					current_instance->tar_subset[(i * subset_dim_y + j) * subset_dim_x + k] = value;
-					tar_mean += value;
 				}
 			}
 		}
 		ref_mean /= subset_size;
-		tar_mean /= subset_size;
 
-		//zero-mean operation of gray-scale values in the two subsets
+		//zero-mean operation of gray-scale values in the reference subset
 		for (int i = 0; i < subset_size; i++)
 		{
-			current_instance->ref_subset[i] -= ref_mean;
-			current_instance->tar_subset[i] -= tar_mean;
-			ref_norm += current_instance->ref_subset[i] * current_instance->ref_subset[i];
-			tar_norm += current_instance->tar_subset[i] * current_instance->tar_subset[i];
+			ref_subset[i] -= ref_mean;
+			ref_norm += ref_subset[i] * ref_subset[i];
 		}
 
-		fftwf_execute(current_instance->ref_plan);
-		fftwf_execute(current_instance->tar_plan);
+		return ref_norm;
+	}
+
+	float FFTCC3D::fillTarget(POI3D* poi, float* tar_subset)
+	{
+		int subset_dim_x = subset_radius_x * 2;
+		int subset_dim_y = subset_radius_y * 2;
+		int subset_dim_z = subset_radius_z * 2;
+		int subset_size = subset_dim_x * subset_dim_y * subset_dim_z;
+
+		//fill the target subset shifted by the initial guess of displacement, rounded to integer voxels.
+		//getPeak adds the same shift to the correlation peak
+		float shift_x = round(poi->deformation.u);
+		float shift_y = round(poi->deformation.v);
+		float shift_z = round(poi->deformation.w);
+		float tar_mean = 0.f;
+		float tar_norm = 0.f;
+		for (int i = 0; i < subset_dim_z; i++)
+		{
+			for (int j = 0; j < subset_dim_y; j++)
+			{
+				for (int k = 0; k < subset_dim_x; k++)
+				{
+					Point3D tar_point(poi->x + k - subset_radius_x + shift_x,
+						poi->y + j - subset_radius_y + shift_y,
+						poi->z + i - subset_radius_z + shift_z);
+					float value = tar_img->vol_mat[(int)tar_point.z][(int)tar_point.y][(int)tar_point.x];
+					tar_subset[(i * subset_dim_y + j) * subset_dim_x + k] = value;
+					tar_mean += value;
+				}
+			}
+		}
+		tar_mean /= subset_size;
 
-		unsigned int buffer_length = subset_dim_x * subset_dim_y * (subset_radius_z + 1);
-		for (unsigned int n = 0; n < buffer_length; n++)
+		//zero-mean operation of gray-scale values in the target subset
+		for (int i = 0; i < subset_size; i++)
 		{
-			current_instance->zncc_freq[n][0] = (current_instance->ref_freq[n][0] * current_instance->tar_freq[n][0])
-				+ (current_instance->ref_freq[n][1] * current_instance->tar_freq[n][1]);
-			current_instance->zncc_freq[n][1] = (current_instance->ref_freq[n][0] * current_instance->tar_freq[n][1])
-				- (current_instance->ref_freq[n][1] * current_instance->tar_freq[n][0]);
+			tar_subset[i] -= tar_mean;
+			tar_norm += tar_subset[i] * tar_subset[i];
 		}
 
-		fftwf_execute(current_instance->zncc_plan);
+		return tar_norm;
+	}
+
+	void FFTCC3D::getPeak(POI3D* poi, float* zncc, float ref_norm, float tar_norm)
+	{
+		int subset_dim_x = subset_radius_x * 2;
+		int subset_dim_y = subset_radius_y * 2;
+		int subset_dim_z = subset_radius_z * 2;
+		int subset_size = subset_dim_x * subset_dim_y * subset_dim_z;
 
 		//search for max ZCC
 		float max_zncc = -2.f;
 		int max_zncc_index = 0;
 		for (int i = 0; i < subset_size; i++)
 		{
-			if (current_instance->zncc[i] > max_zncc)
+			if (zncc[i] > max_zncc)
 			{
-				max_zncc = current_instance->zncc[i];
+				max_zncc = zncc[i];
 				max_zncc_index = i;
 			}
 		}
-		int local_displacement_u = max_zncc_index % subset_dim_x;
-		int local_displacement_v = (max_zncc_index / subset_dim_x) % subset_dim_y;
-		int local_displacement_w = max_zncc_index / (subset_dim_x * subset_dim_y);
+		int peak_x = max_zncc_index % subset_dim_x;
+		int peak_y = (max_zncc_index / subset_dim_x) % subset_dim_y;
+		int peak_z = max_zncc_index / (subset_dim_x * subset_dim_y);
+
+		//search for the second peak, i.e. the highest local maximum out of the 3x3x3 neighborhood of max ZCC,
+		//the map of ZCC is periodic
+		bool ambiguous = false;
+		if (max_peak_ratio < 1.f)
+		{
+			float second_zncc = -FLT_MAX;
+			for (int i = 0; i < subset_dim_z; i++)
+			{
+				int distance_z = abs(i - peak_z);
+				distance_z = std::min(distance_z, subset_dim_z - distance_z);
+				int front = (i + subset_dim_z - 1) % subset_dim_z;
+				int back = (i + 1) % subset_dim_z;
+				for (int j = 0; j < subset_dim_y; j++)
+				{
+					int distance_y = abs(j - peak_y);
+					distance_y = std::min(distance_y, subset_dim_y - distance_y);
+					int up = (j + subset_dim_y - 1) % subset_dim_y;
+					int down = (j + 1) % subset_dim_y;
+					for (int k = 0; k < subset_dim_x; k++)
+					{
+						int distance_x = abs(k - peak_x);
+						distance_x = std::min(distance_x, subset_dim_x - distance_x);
+						float value = zncc[(i * subset_dim_y + j) * subset_dim_x + k];
+						if ((distance_x <= 1 && distance_y <= 1 && distance_z <= 1) || value <= second_zncc)
+						{
+							continue;
+						}
+
+						int left = (k + subset_dim_x - 1) % subset_dim_x;
+						int right = (k + 1) % subset_dim_x;
+						if (value >= zncc[(i * subset_dim_y + j) * subset_dim_x + left]
+							&& value >= zncc[(i * subset_dim_y + j) * subset_dim_x + right]
+							&& value >= zncc[(i * subset_dim_y + up) * subset_dim_x + k]
+							&& value >= zncc[(i * subset_dim_y + down) * subset_dim_x + k]
+							&& value >= zncc[(front * subset_dim_y + j) * subset_dim_x + k]
+							&& value >= zncc[(back * subset_dim_y + j) * subset_dim_x + k])
+						{
+							second_zncc = value;
+						}
+					}
+				}
+			}
+			ambiguous = (max_zncc <= 0.f || second_zncc > max_peak_ratio * max_zncc);
+		}
+
+		//fit the peak with its 3x3x3 neighborhood
+		Point3D subpixel(0.f, 0.f, 0.f);
+		if (peak_fitting != PEAK_INTEGER)
+		{
+			float neighborhood[3][3][3];
+			for (int i = 0; i < 3; i++)
+			{
+				int z = (peak_z + i - 1 + subset_dim_z) % subset_dim_z;
+				for (int j = 0; j < 3; j++)
+				{
+					int y = (peak_y + j - 1 + subset_dim_y) % subset_dim_y;
+					for (int k = 0; k < 3; k++)
+					{
+						int x = (peak_x + k - 1 + subset_dim_x) % subset_dim_x;
+						neighborhood[i][j][k] = zncc[(z * subset_dim_y + y) * subset_dim_x + x];
+					}
+				}
+			}
+			subpixel = fitPeak(neighborhood);
+		}
+
+		int local_displacement_u = peak_x;
+		int local_displacement_v = peak_y;
+		int local_displacement_w = peak_z;
 
 		if (local_displacement_u > subset_radius_x)
 		{
@@ -406,24 +1166,369 @@ namespace opencorr
 			local_displacement_w -= subset_dim_z;
 		}
 
-		//store the final results
-		poi->deformation.u = (float)local_displacement_u + initial_displacement.x;
-		poi->deformation.v = (float)local_displacement_v + initial_displacement.y;
-		poi->deformation.w = (float)local_displacement_w + initial_displacement.z;
+		//store the final results, the deformation of POI serves as initial guess, which shifts the target subset
+		//by integer voxels in fillTarget
+		Point3D initial_displacement(poi->deformation.u, poi->deformation.v, poi->deformation.w);
+		poi->deformation.u = (float)local_displacement_u + subpixel.x + round(initial_displacement.x);
+		poi->deformation.v = (float)local_displacement_v + subpixel.y + round(initial_displacement.y);
+		poi->deformation.w = (float)local_displacement_w + subpixel.z + round(initial_displacement.z);
 
 		poi->result.u0 = initial_displacement.x;
 		poi->result.v0 = initial_displacement.y;
 		poi->result.w0 = initial_displacement.z;
 		poi->result.zncc = max_zncc / (sqrt(ref_norm * tar_norm) * subset_size); //convert ZCC to ZNCC
+
+		//POIs with ambiguous peak are marked to be skipped by the following registration
+		if (ambiguous)
+		{
+			poi->result.zncc = -3;
+		}
 	}
 
-	void FFTCC3D::compute(std::vector<POI3D>& poi_queue)
+	Point3D FFTCC3D::fitPeak(float neighborhood[3][3][3])
 	{
+		bool gaussian = (peak_fitting == PEAK_GAUSSIAN);
+
+		//fit each axis separately, i.e. three points through the peak
+		Point3D subpixel(fitThreePoints(neighborhood[1][1][0], neighborhood[1][1][1], neighborhood[1][1][2], gaussian),
+			fitThreePoints(neighborhood[1][0][1], neighborhood[1][1][1], neighborhood[1][2][1], gaussian),
+			fitThreePoints(neighborhood[0][1][1], neighborhood[1][1][1], neighborhood[2][1][1], gaussian));
+		if (gaussian)
+		{
+			return subpixel;
+		}
+
+		//least squares fitting of f = a0 + a1*x + a2*y + a3*z + a4*x^2 + a5*y^2 + a6*z^2 + a7*xy + a8*xz + a9*yz,
+		//the terms are orthogonal on the 3x3x3 grid, thus each coefficient is solved independently
+		Eigen::Vector3f gradient = Eigen::Vector3f::Zero();
+		Eigen::Matrix3f hessian = Eigen::Matrix3f::Zero();
+		for (int i = 0; i < 3; i++)
+		{
+			for (int j = 0; j < 3; j++)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					float value = neighborhood[i][j][k];
+					float x = (float)(k - 1), y = (float)(j - 1), z = (float)(i - 1);
+					gradient(0) += x * value;
+					gradient(1) += y * value;
+					gradient(2) += z * value;
+					hessian(0, 0) += (x * x - 2.f / 3.f) * value;
+					hessian(1, 1) += (y * y - 2.f / 3.f) * value;
+					hessian(2, 2) += (z * z - 2.f / 3.f) * value;
+					hessian(0, 1) += x * y * value;
+					hessian(0, 2) += x * z * value;
+					hessian(1, 2) += y * z * value;
+				}
+			}
+		}
+		gradient /= 18.f; //a1, a2, a3
+		hessian.diagonal() *= 2.f / 6.f; //2 * a4, 2 * a5, 2 * a6
+		hessian(0, 1) /= 12.f; //a7
+		hessian(0, 2) /= 12.f; //a8
+		hessian(1, 2) /= 12.f; //a9
+		hessian(1, 0) = hessian(0, 1);
+		hessian(2, 0) = hessian(0, 2);
+		hessian(2, 1) = hessian(1, 2);
+
+		//the stationary point of a negative definite quadric close to the center is taken as the peak
+		Eigen::LLT<Eigen::Matrix3f> llt(-hessian);
+		if (llt.info() == Eigen::Success)
+		{
+			Eigen::Vector3f offset = llt.solve(gradient);
+			if (offset.cwiseAbs().maxCoeff() <= 1.f)
+			{
+				subpixel.x = offset(0);
+				subpixel.y = offset(1);
+				subpixel.z = offset(2);
+			}
+		}
+
+		return subpixel;
+	}
+
+	int FFTCC3D::getCacheIndex(int poi_idx, POI3D* poi)
+	{
+		if (ref_cache_img != ref_img || poi_idx >= (int)ref_cache_norm.size() || ref_cache_norm[poi_idx] < 0
+			|| ref_cache_location[poi_idx].x != poi->x || ref_cache_location[poi_idx].y != poi->y || ref_cache_location[poi_idx].z != poi->z)
+		{
+			return -1;
+		}
+		return poi_idx;
+	}
+
+	bool FFTCC3D::precomputeReference(std::vector<POI3D>& poi_queue, size_t memory_budget)
+	{
+		releaseReference();
+
+		//estimate the memory occupied by cache, i.e. spectrum, norm and location of reference subset of each POI
 		int queue_length = (int)poi_queue.size();
+		size_t buffer_length = (size_t)subset_radius_x * 2 * subset_radius_y * 2 * (subset_radius_z + 1);
+		size_t ref_size = buffer_length * sizeof(fftwf_complex) + sizeof(float) + sizeof(Point3D);
+		if (queue_length == 0 || ref_size * queue_length > memory_budget)
+		{
+			return false;
+		}
+
+		ref_cache_freq = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * buffer_length * queue_length);
+		ref_cache_norm.assign(queue_length, -1.f);
+		ref_cache_location.resize(queue_length);
+		ref_cache_img = ref_img;
+
 #pragma omp parallel for
 		for (int i = 0; i < queue_length; i++)
 		{
-			compute(&poi_queue[i]);
+			POI3D* poi = &poi_queue[i];
+			ref_cache_location[i] = (Point3D)*poi;
+
+			//POIs with subset out of reference image are not cached, a negative norm marks them
+			if (poi->x - subset_radius_x < 0 || poi->y - subset_radius_y < 0 || poi->z - subset_radius_z < 0
+				|| poi->x + subset_radius_x > ref_img->dim_x || poi->y + subset_radius_y > ref_img->dim_y || poi->z + subset_radius_z > ref_img->dim_z)
+			{
+				continue;
+			}
+
+			FFTW* current_instance = getInstance(omp_get_thread_num());
+			ref_cache_norm[i] = fillReference(poi, current_instance->ref_subset);
+			fftwf_execute(current_instance->ref_plan);
+			std::copy(&current_instance->ref_freq[0][0], &current_instance->ref_freq[0][0] + buffer_length * 2, &ref_cache_freq[buffer_length * i][0]);
+		}
+
+		return true;
+	}
+
+	void FFTCC3D::releaseReference()
+	{
+		if (ref_cache_freq != nullptr)
+		{
+			fftwf_free(ref_cache_freq);
+			ref_cache_freq = nullptr;
+		}
+		ref_cache_norm.clear();
+		ref_cache_location.clear();
+		ref_cache_img = nullptr;
+	}
+
+	void FFTCC3D::compute(POI3D* poi)
+	{
+		computeWithReference(poi, -1);
+	}
+
+	void FFTCC3D::computeWithReference(POI3D* poi, int cache_idx)
+	{
+		//set instance w.r.t. thread id 
+		FFTW* current_instance = getInstance(omp_get_thread_num());
+
+		int buffer_length = subset_radius_x * 2 * subset_radius_y * 2 * (subset_radius_z + 1);
+
+		//take the spectrum of reference subset from cache if available
+		fftwf_complex* ref_freq = current_instance->ref_freq;
+		float ref_norm = 0.f;
+		if (cache_idx >= 0)
+		{
+			ref_freq = ref_cache_freq + (size_t)cache_idx * buffer_length;
+			ref_norm = ref_cache_norm[cache_idx];
+		}
+		else
+		{
+			ref_norm = fillReference(poi, current_instance->ref_subset);
+			fftwf_execute(current_instance->ref_plan);
+		}
+
+		float tar_norm = fillTarget(poi, current_instance->tar_subset);
+		fftwf_execute(current_instance->tar_plan);
+
+		crossPower(ref_freq, current_instance->tar_freq, current_instance->zncc_freq, buffer_length);
+		fftwf_execute(current_instance->zncc_plan);
+
+		getPeak(poi, current_instance->zncc, ref_norm, tar_norm);
+	}
+
+	void FFTCC3D::computeBatch(std::vector<POI3D>& poi_queue, int begin, int end)
+	{
+		//set instance w.r.t. thread id 
+		FFTW* current_instance = getInstance(omp_get_thread_num());
+
+		int subset_size = subset_radius_x * 2 * subset_radius_y * 2 * subset_radius_z * 2;
+		int buffer_length = subset_radius_x * 2 * subset_radius_y * 2 * (subset_radius_z + 1);
+
+		//fill the subsets of the block, the slots beyond the end of queue are left as they are
+		bool ref_needed = false;
+		for (int i = begin; i < end; i++)
+		{
+			int slot = i - begin;
+			current_instance->batch_cache_idx[slot] = getCacheIndex(i, &poi_queue[i]);
+			if (current_instance->batch_cache_idx[slot] < 0)
+			{
+				current_instance->batch_ref_norm[slot] = fillReference(&poi_queue[i], current_instance->ref_batch + (size_t)slot * subset_size);
+				ref_needed = true;
+			}
+			else
+			{
+				current_instance->batch_ref_norm[slot] = ref_cache_norm[current_instance->batch_cache_idx[slot]];
+			}
+			current_instance->batch_tar_norm[slot] = fillTarget(&poi_queue[i], current_instance->tar_batch + (size_t)slot * subset_size);
+		}
+
+		if (ref_needed)
+		{
+			fftwf_execute(current_instance->ref_batch_plan);
+		}
+		fftwf_execute(current_instance->tar_batch_plan);
+
+		for (int i = begin; i < end; i++)
+		{
+			int slot = i - begin;
+			int cache_idx = current_instance->batch_cache_idx[slot];
+			fftwf_complex* ref_freq = cache_idx < 0 ? current_instance->ref_batch_freq + (size_t)slot * buffer_length
+				: ref_cache_freq + (size_t)cache_idx * buffer_length;
+			crossPower(ref_freq, current_instance->tar_batch_freq + (size_t)slot * buffer_length,
+				current_instance->zncc_batch_freq + (size_t)slot * buffer_length, buffer_length);
+		}
+
+		fftwf_execute(current_instance->zncc_batch_plan);
+
+		for (int i = begin; i < end; i++)
+		{
+			int slot = i - begin;
+			getPeak(&poi_queue[i], current_instance->zncc_batch + (size_t)slot * subset_size,
+				current_instance->batch_ref_norm[slot], current_instance->batch_tar_norm[slot]);
+		}
+	}
+
+	void FFTCC3D::compute(std::vector<POI3D>& poi_queue)
+	{
+		if (pyramid_level > 0)
+		{
+			computePyramid(poi_queue);
+			return;
+		}
+
+		int queue_length = (int)poi_queue.size();
+		if (batch_size > 1)
+		{
+			int block_number = (queue_length + batch_size - 1) / batch_size;
+			ScheduleScope schedule_scope(schedule_mode, (schedule_chunk + batch_size - 1) / batch_size, block_number);
+#pragma omp parallel for schedule(runtime)
+			for (int i = 0; i < block_number; i++)
+			{
+				computeBatch(poi_queue, i * batch_size, std::min((i + 1) * batch_size, queue_length));
+			}
+			return;
+		}
+
+		ScheduleScope schedule_scope(schedule_mode, schedule_chunk, queue_length);
+#pragma omp parallel for schedule(runtime)
+		for (int i = 0; i < queue_length; i++)
+		{
+			computeWithReference(&poi_queue[i], getCacheIndex(i, &poi_queue[i]));
+		}
+	}
+
+	void FFTCC3D::computePyramid(std::vector<POI3D>& poi_queue)
+	{
+		//the pyramids are built from the current images
+		if (pyramid_ref_img != ref_img || pyramid_tar_img != tar_img)
+		{
+			prepare();
+		}
+
+		int queue_length = (int)poi_queue.size();
+		int level_number = (int)ref_pyramid.size();
+		Image3D* ref_original = ref_img;
+		Image3D* tar_original = tar_img;
+
+		std::vector<POI3D> parent_nodes; //nodes processed at the coarser level
+		std::vector<int> parent_idx; //index of the node at the coarser level for each POI
+
+		for (int l = level_number; l > 0; l--)
+		{
+			float scale = (float)(1 << l);
+
+			//group the POIs into the nodes of a coarse grid, so that the POIs close to each other are processed only once
+			long long key_dim_x = (long long)ref_pyramid[l - 1]->dim_x + 1;
+			long long key_dim_y = (long long)ref_pyramid[l - 1]->dim_y + 1;
+			std::vector<std::pair<long long, int>> grid_key(queue_length);
+			for (int i = 0; i < queue_length; i++)
+			{
+				long long x = (long long)round(poi_queue[i].x / scale);
+				long long y = (long long)round(poi_queue[i].y / scale);
+				long long z = (long long)round(poi_queue[i].z / scale);
+				grid_key[i] = std::make_pair((z * key_dim_y + y) * key_dim_x + x, i);
+			}
+			std::sort(grid_key.begin(), grid_key.end());
+
+			std::vector<POI3D> nodes;
+			std::vector<int> node_idx(queue_length);
+			for (int i = 0; i < queue_length; i++)
+			{
+				POI3D* poi = &poi_queue[grid_key[i].second];
+				if (i == 0 || grid_key[i].first != grid_key[i - 1].first)
+				{
+					POI3D node((float)round(poi->x / scale), (float)round(poi->y / scale), (float)round(poi->z / scale));
+
+					//the initial guess is taken from the coarser level, or scaled from the POI at the coarsest level.
+					//fillTarget rounds it to an integer shift, the sub-pixel part is recovered by peak fitting
+					if (parent_nodes.empty())
+					{
+						node.deformation.u = poi->deformation.u / scale;
+						node.deformation.v = poi->deformation.v / scale;
+						node.deformation.w = poi->deformation.w / scale;
+					}
+					else
+					{
+						POI3D* parent = &parent_nodes[parent_idx[grid_key[i].second]];
+						node.deformation.u = 2.f * parent->deformation.u;
+						node.deformation.v = 2.f * parent->deformation.v;
+						node.deformation.w = 2.f * parent->deformation.w;
+					}
+					nodes.push_back(node);
+				}
+				node_idx[grid_key[i].second] = (int)nodes.size() - 1;
+			}
+
+			//nodes out of the images keep their initial guess
+			ref_img = ref_pyramid[l - 1];
+			tar_img = tar_pyramid[l - 1];
+			int node_number = (int)nodes.size();
+			ScheduleScope schedule_scope(schedule_mode, schedule_chunk, node_number);
+#pragma omp parallel for schedule(runtime)
+			for (int i = 0; i < node_number; i++)
+			{
+				if (isInside(&nodes[i]))
+				{
+					compute(&nodes[i]);
+				}
+			}
+
+			parent_nodes.swap(nodes);
+			parent_idx.swap(node_idx);
+		}
+
+		//refine the estimation in the original images
+		ref_img = ref_original;
+		tar_img = tar_original;
+		ScheduleScope schedule_scope(schedule_mode, schedule_chunk, queue_length);
+#pragma omp parallel for schedule(runtime)
+		for (int i = 0; i < queue_length; i++)
+		{
+			POI3D* poi = &poi_queue[i];
+			if (level_number > 0)
+			{
+				POI3D* parent = &parent_nodes[parent_idx[i]];
+				poi->deformation.u = 2.f * parent->deformation.u;
+				poi->deformation.v = 2.f * parent->deformation.v;
+				poi->deformation.w = 2.f * parent->deformation.w;
+			}
+
+			if (isInside(poi))
+			{
+				computeWithReference(poi, getCacheIndex(i, poi));
+			}
+			else
+			{
+				poi->result.zncc = -1;
+			}
 		}
 	}
 
@@ -17,6 +17,7 @@
 #ifndef _FFTCC_H_
 #define _FFTCC_H_
 
+#include <string>
 #include <vector>
 #include "fftw3.h"
 
@@ -29,6 +30,14 @@
 
 namespace opencorr
 {
+	//methods to locate the peak of ZCC
+	enum PeakFitting
+	{
+		PEAK_INTEGER, //pixel with max ZCC
+		PEAK_PARABOLIC, //parabola through three points along each axis in 2D, quadric fitted to 3x3x3 neighborhood in 3D
+		PEAK_GAUSSIAN //Gaussian through three points along each axis, parabola is used if any of them is not positive
+	};
+
 	class FFTW
 	{
 	public:
@@ -42,6 +51,21 @@ namespace opencorr
 		fftwf_plan tar_plan;
 		fftwf_plan zncc_plan;
 
+		//buffers and plans for a batch of subsets, stored one after another
+		int batch_size; //0 if the batch is not allocated
+		float* ref_batch;
+		float* tar_batch;
+		float* zncc_batch;
+		fftwf_complex* ref_batch_freq;
+		fftwf_complex* tar_batch_freq;
+		fftwf_complex* zncc_batch_freq;
+		fftwf_plan ref_batch_plan;
+		fftwf_plan tar_batch_plan;
+		fftwf_plan zncc_batch_plan;
+		std::vector<int> batch_cache_idx; //index of cached reference spectrum of each subset in batch, -1 if not cached
+		std::vector<float> batch_ref_norm;
+		std::vector<float> batch_tar_norm;
+
 		static FFTW* allocate(int subset_radius_x, int subset_radius_y);
 		static FFTW* allocate(int subset_radius_x, int subset_radius_y, int subset_radius_z);
 
@@ -49,6 +73,14 @@ namespace opencorr
 
 		static void reallocate(FFTW* instance, int subset_radius_x, int subset_radius_y);
 		static void reallocate(FFTW* instance, int subset_radius_x, int subset_radius_y, int subset_radius_z);
+
+		//create the plans transforming batch_size subsets of dimensions dim at once, plan_flag can be FFTW_ESTIMATE, FFTW_MEASURE, etc.
+		static void allocateBatch(FFTW* instance, int rank, const int* dim, int batch_size, unsigned int plan_flag);
+		static void releaseBatch(FFTW* instance);
+
+		//wisdom accumulated by the planner, importing it before creating plans saves the time of planning with FFTW_MEASURE
+		static bool importWisdom(std::string file_path);
+		static bool exportWisdom(std::string file_path);
 	};
 
 
@@ -62,14 +94,62 @@ namespace opencorr
 		std::vector<FFTW*> instance_pool; //pool of FFTW instances for multi-thread processing
 		FFTW* getInstance(int tid); //get an instance according to the number of current thread id
 
+		int pyramid_level; //number of downsampled levels for coarse-to-fine estimation, 0 for the original images only
+		std::vector<Image2D*> ref_pyramid; //downsampled reference images, each level is half the size of the previous one
+		std::vector<Image2D*> tar_pyramid; //downsampled target images
+		Image2D* pyramid_ref_img = nullptr; //reference image the pyramids are built from
+		Image2D* pyramid_tar_img = nullptr; //target image the pyramids are built from
+
+		void releasePyramid();
+		bool isInside(POI2D* poi); //check if both subsets are inside the images
+		void computePyramid(std::vector<POI2D>& poi_queue); //estimate the displacements from the coarsest level to the original images
+
+		fftwf_complex* ref_cache_freq; //cached spectra of reference subsets, one block of buffer_length per POI
+		std::vector<float> ref_cache_norm; //norm of zero-mean reference subsets, negative for the POIs not cached
+		std::vector<Point2D> ref_cache_location; //locations of cached POIs
+		Image2D* ref_cache_img = nullptr; //reference image the cache is built from
+
+		float fillReference(POI2D* poi, float* ref_subset); //fill zero-mean reference subset, return its norm
+		float fillTarget(POI2D* poi, float* tar_subset); //fill zero-mean target subset with initial guess, return its norm
+		void getPeak(POI2D* poi, float* zncc, float ref_norm, float tar_norm); //locate the peak of ZCC and store the results in POI
+		int getCacheIndex(int poi_idx, POI2D* poi); //index of cached reference for the POI, -1 if not available
+		void computeWithReference(POI2D* poi, int cache_idx);
+
+		int batch_size; //number of subsets transformed at once in compute(poi_queue)
+		void computeBatch(std::vector<POI2D>& poi_queue, int begin, int end); //process the POIs from begin to end - 1 as a batch
+
+		PeakFitting peak_fitting; //method to locate the peak of ZCC
+		float max_peak_ratio; //max ratio of the second peak to the main peak of ZCC
+
 	public:
 		FFTCC2D(int subset_radius_x, int subset_radius_y, int thread_number);
 		~FFTCC2D();
 
+		//the search range of displacement is extended to about subset_radius * (2^(pyramid_level + 1) - 1)
+		void setPyramid(int pyramid_level);
+
+		//transform batch_size subsets at once in compute(poi_queue), 1 to transform them one by one
+		//the plans are created with plan_flag, FFTW_MEASURE takes time unless wisdom is imported, see FFTW::importWisdom()
+		void setBatch(int batch_size, unsigned int plan_flag);
+
+		void setPeakFitting(PeakFitting peak_fitting);
+
+		//POIs whose second peak of ZCC exceeds max_peak_ratio times the main peak are marked with ZNCC of -3,
+		//thus skipped by IC-GN, the second peak is searched out of the 3x3(x3) neighborhood of main peak; 1 to disable
+		void setPeakRatio(float max_peak_ratio);
+
+		//build the image pyramids if pyramid_level > 0, compute(poi_queue) rebuilds them if the images are replaced by setImages(),
+		//call it again if the data of the same images are modified
 		void prepare();
 
 		void compute(POI2D* poi);
 		void compute(std::vector<POI2D>& poi_queue);
+
+		//functions for multiple target images or passes, the spectra of reference subsets are cached for compute(poi_queue)
+		//only if they fit in the memory budget (in bytes), return true if the cache is built. the cache is ignored once another
+		//reference image is set, rebuild it for the new one or if the data of the same reference image are modified
+		bool precomputeReference(std::vector<POI2D>& poi_queue, size_t memory_budget);
+		void releaseReference();
 	};
 
 
@@ -83,14 +163,63 @@ namespace opencorr
 		std::vector<FFTW*> instance_pool; //pool of FFTW instances for multi-thread processing
 		FFTW* getInstance(int tid); //get an instance according to the number of current thread id
 
+		int pyramid_level; //number of downsampled levels for coarse-to-fine estimation, 0 for the original images only
+		std::vector<Image3D*> ref_pyramid; //downsampled reference images, each level is half the size of the previous one
+		std::vector<Image3D*> tar_pyramid; //downsampled target images
+		Image3D* pyramid_ref_img = nullptr; //reference image the pyramids are built from
+		Image3D* pyramid_tar_img = nullptr; //target image the pyramids are built from
+
+		void releasePyramid();
+		bool isInside(POI3D* poi); //check if both subsets are inside the images
+		void computePyramid(std::vector<POI3D>& poi_queue); //estimate the displacements from the coarsest level to the original images
+
+		fftwf_complex* ref_cache_freq; //cached spectra of reference subsets, one block of buffer_length per POI
+		std::vector<float> ref_cache_norm; //norm of zero-mean reference subsets, negative for the POIs not cached
+		std::vector<Point3D> ref_cache_location; //locations of cached POIs
+		Image3D* ref_cache_img = nullptr; //reference image the cache is built from
+
+		float fillReference(POI3D* poi, float* ref_subset); //fill zero-mean reference subset, return its norm
+		float fillTarget(POI3D* poi, float* tar_subset); //fill zero-mean target subset with initial guess, return its norm
+		void getPeak(POI3D* poi, float* zncc, float ref_norm, float tar_norm); //locate the peak of ZCC and store the results in POI
+		int getCacheIndex(int poi_idx, POI3D* poi); //index of cached reference for the POI, -1 if not available
+		void computeWithReference(POI3D* poi, int cache_idx);
+
+		int batch_size; //number of subsets transformed at once in compute(poi_queue)
+		void computeBatch(std::vector<POI3D>& poi_queue, int begin, int end); //process the POIs from begin to end - 1 as a batch
+
+		PeakFitting peak_fitting; //method to locate the peak of ZCC
+		float max_peak_ratio; //max ratio of the second peak to the main peak of ZCC
+		Point3D fitPeak(float neighborhood[3][3][3]); //offset of the peak from the center of its 3x3x3 neighborhood
+
 	public:
 		FFTCC3D(int subset_radius_x, int subset_radius_y, int subset_radius_z, int thread_number);
 		~FFTCC3D();
 
+		//the search range of displacement is extended to about subset_radius * (2^(pyramid_level + 1) - 1)
+		void setPyramid(int pyramid_level);
+
+		//transform batch_size subsets at once in compute(poi_queue), 1 to transform them one by one
+		//the plans are created with plan_flag, FFTW_MEASURE takes time unless wisdom is imported, see FFTW::importWisdom()
+		void setBatch(int batch_size, unsigned int plan_flag);
+
+		void setPeakFitting(PeakFitting peak_fitting);
+
+		//POIs whose second peak of ZCC exceeds max_peak_ratio times the main peak are marked with ZNCC of -3,
+		//thus skipped by IC-GN, the second peak is searched out of the 3x3(x3) neighborhood of main peak; 1 to disable
+		void setPeakRatio(float max_peak_ratio);
+
+		//build the image pyramids if pyramid_level > 0, compute(poi_queue) rebuilds them if the images are replaced by setImages(),
+		//call it again if the data of the same images are modified
 		void prepare();
 
 		void compute(POI3D* poi);
 		void compute(std::vector<POI3D>& poi_queue);
+
+		//functions for multiple target images or passes, the spectra of reference subsets are cached for compute(poi_queue)
+		//only if they fit in the memory budget (in bytes), return true if the cache is built. the cache is ignored once another
+		//reference image is set, rebuild it for the new one or if the data of the same reference image are modified
+		bool precomputeReference(std::vector<POI3D>& poi_queue, size_t memory_budget);
+		void releaseReference();
 	};
 
 }//namespace opencorr
@@ -114,20 +114,9 @@ namespace opencorr
 
 	void Gradient3D4::clear()
 	{
-		if (gradient_x != nullptr)
-		{
-			delete3D(gradient_x);
-		}
-
-		if (gradient_y != nullptr)
-		{
-			delete3D(gradient_y);
-		}
-
-		if (gradient_z != nullptr)
-		{
-			delete3D(gradient_z);
-		}
+		gradient_x.release();
+		gradient_y.release();
+		gradient_z.release();
 	}
 
 	void Gradient3D4::setImage(Image3D& image)
@@ -141,25 +130,23 @@ namespace opencorr
 		int dim_y = grad_img->dim_y;
 		int dim_z = grad_img->dim_z;
 
-		if (gradient_x != nullptr)
-		{
-			delete3D(gradient_x);
-		}
-		gradient_x = new3D(dim_z, dim_y, dim_x);
+		gradient_x.allocate(dim_x, dim_y, dim_z);
 
 #pragma omp parallel for
 		for (int i = 0; i < dim_z; i++)
 		{
 			for (int j = 0; j < dim_y; j++)
 			{
+				const float* img_row = grad_img->vol_mat.row(i, j);
+				float* gradient_row = gradient_x.row(i, j);
 				for (int k = 2; k < dim_x - 2; k++)
 				{
 					float result = 0.0f;
-					result -= grad_img->vol_mat[i][j][k + 2] / 12.f;
-					result += grad_img->vol_mat[i][j][k + 1] * (2.f / 3.f);
-					result -= grad_img->vol_mat[i][j][k - 1] * (2.f / 3.f);
-					result += grad_img->vol_mat[i][j][k - 2] / 12.f;
-					gradient_x[i][j][k] = result;
+					result -= img_row[k + 2] / 12.f;
+					result += img_row[k + 1] * (2.f / 3.f);
+					result -= img_row[k - 1] * (2.f / 3.f);
+					result += img_row[k - 2] / 12.f;
+					gradient_row[k] = result;
 				}
 			}
 		}
@@ -171,25 +158,25 @@ namespace opencorr
 		int dim_y = grad_img->dim_y;
 		int dim_z = grad_img->dim_z;
 
-		if (gradient_y != nullptr)
-		{
-			delete3D(gradient_y);
-		}
-		gradient_y = new3D(dim_z, dim_y, dim_x);
+		gradient_y.allocate(dim_x, dim_y, dim_z);
+		long long row_stride = grad_img->vol_mat.row_stride;
 
+		//the stencil spans neighboring rows, the inner loop still runs along x to stay in cache
 #pragma omp parallel for
-		for (int k = 0; k < dim_x; k++)
+		for (int i = 0; i < dim_z; i++)
 		{
-			for (int i = 0; i < dim_z; i++)
+			for (int j = 2; j < dim_y - 2; j++)
 			{
-				for (int j = 2; j < dim_y - 2; j++)
+				const float* img_row = grad_img->vol_mat.row(i, j);
+				float* gradient_row = gradient_y.row(i, j);
+				for (int k = 0; k < dim_x; k++)
 				{
 					float result = 0.0f;
-					result -= grad_img->vol_mat[i][j + 2][k] / 12.f;
-					result += grad_img->vol_mat[i][j + 1][k] * (2.f / 3.f);
-					result -= grad_img->vol_mat[i][j - 1][k] * (2.f / 3.f);
-					result += grad_img->vol_mat[i][j - 2][k] / 12.f;
-					gradient_y[i][j][k] = result;
+					result -= img_row[k + 2 * row_stride] / 12.f;
+					result += img_row[k + row_stride] * (2.f / 3.f);
+					result -= img_row[k - row_stride] * (2.f / 3.f);
+					result += img_row[k - 2 * row_stride] / 12.f;
+					gradient_row[k] = result;
 				}
 			}
 		}
@@ -201,25 +188,25 @@ namespace opencorr
 		int dim_y = grad_img->dim_y;
 		int dim_z = grad_img->dim_z;
 
-		if (gradient_z != nullptr)
-		{
-			delete3D(gradient_z);
-		}
-		gradient_z = new3D(dim_z, dim_y, dim_x);
+		gradient_z.allocate(dim_x, dim_y, dim_z);
+		long long slice_stride = grad_img->vol_mat.slice_stride;
 
+		//the stencil spans neighboring slices, the inner loop still runs along x to stay in cache
 #pragma omp parallel for
-		for (int j = 0; j < dim_y; j++)
+		for (int i = 2; i < dim_z - 2; i++)
 		{
-			for (int k = 0; k < dim_x; k++)
+			for (int j = 0; j < dim_y; j++)
 			{
-				for (int i = 2; i < dim_z - 2; i++)
+				const float* img_row = grad_img->vol_mat.row(i, j);
+				float* gradient_row = gradient_z.row(i, j);
+				for (int k = 0; k < dim_x; k++)
 				{
 					float result = 0.0f;
-					result -= grad_img->vol_mat[i + 2][j][k] / 12.f;
-					result += grad_img->vol_mat[i + 1][j][k] * (2.f / 3.f);
-					result -= grad_img->vol_mat[i - 1][j][k] * (2.f / 3.f);
-					result += grad_img->vol_mat[i - 2][j][k] / 12.f;
-					gradient_z[i][j][k] = result;
+					result -= img_row[k + 2 * slice_stride] / 12.f;
+					result += img_row[k + slice_stride] * (2.f / 3.f);
+					result -= img_row[k - slice_stride] * (2.f / 3.f);
+					result += img_row[k - 2 * slice_stride] / 12.f;
+					gradient_row[k] = result;
 				}
 			}
 		}
@@ -52,9 +52,9 @@ namespace opencorr
 		Image3D* grad_img = nullptr;
 
 	public:
-		float*** gradient_x = nullptr;
-		float*** gradient_y = nullptr;
-		float*** gradient_z = nullptr;
+		Volume3D gradient_x;
+		Volume3D gradient_y;
+		Volume3D gradient_z;
 
 		Gradient3D4(Image3D& image);
 		~Gradient3D4();
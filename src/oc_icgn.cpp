@@ -26,26 +26,19 @@ namespace opencorr
 		ICGN_instance->ref_subset = new Subset2D(subset_center, subset_radius_x, subset_radius_y);
 		ICGN_instance->tar_subset = new Subset2D(subset_center, subset_radius_x, subset_radius_y);
 		ICGN_instance->error_img = Eigen::MatrixXf::Zero(subset_height, subset_width);
-		ICGN_instance->sd_img = new3D(subset_height, subset_width, 6);
+		ICGN_instance->sd_img = RowMatrixX6f::Zero(subset_height * subset_width, 6);
 
 		return ICGN_instance;
 	}
 
 	void ICGN2D1_::release(ICGN2D1_* instance)
 	{
-		delete3D(instance->sd_img);
 		delete instance->ref_subset;
 		delete instance->tar_subset;
 	}
 
 	void ICGN2D1_::update(ICGN2D1_* instance, int subset_radius_x, int subset_radius_y)
 	{
-		if (instance->sd_img != nullptr)
-		{
-			delete3D(instance->sd_img);
-			instance->sd_img = nullptr;
-		}
-
 		if (instance->ref_subset != nullptr)
 		{
 			delete instance->ref_subset;
@@ -65,7 +58,7 @@ namespace opencorr
 		instance->ref_subset = new Subset2D(subset_center, subset_radius_x, subset_radius_y);
 		instance->tar_subset = new Subset2D(subset_center, subset_radius_x, subset_radius_y);
 		instance->error_img.resize(subset_height, subset_width);
-		instance->sd_img = new3D(subset_height, subset_width, 6);
+		instance->sd_img.resize(subset_height * subset_width, 6);
 	}
 
 	ICGN2D1_* ICGN2D1::getInstance(int tid)
@@ -99,6 +92,8 @@ namespace opencorr
 		delete ref_gradient;
 		delete tar_interp;
 
+		releaseReference();
+
 		for (auto& instance : instance_pool)
 		{
 			ICGN2D1_::release(instance);
@@ -121,26 +116,32 @@ namespace opencorr
 
 	void ICGN2D1::prepareRef()
 	{
-		if (ref_gradient != nullptr)
+		//the cached reference data become invalid with a new reference image
+		releaseReference();
+
+		//keep the objects alive across frames of a sequence, only their data are updated
+		if (ref_gradient == nullptr)
 		{
-			delete ref_gradient;
-			ref_gradient = nullptr;
+			ref_gradient = new Gradient2D4(*ref_img);
+		}
+		else
+		{
+			ref_gradient->setImage(*ref_img);
 		}
-
-		ref_gradient = new Gradient2D4(*ref_img);
 		ref_gradient->getGradientX();
 		ref_gradient->getGradientY();
 	}
 
 	void ICGN2D1::prepareTar()
 	{
-		if (tar_interp != nullptr)
+		if (tar_interp == nullptr)
 		{
-			delete tar_interp;
-			tar_interp = nullptr;
+			tar_interp = new BicubicBspline(*tar_img);
+		}
+		else
+		{
+			tar_interp->setImage(*tar_img);
 		}
-
-		tar_interp = new BicubicBspline(*tar_img);
 		tar_interp->prepare();
 	}
 
@@ -150,7 +151,55 @@ namespace opencorr
 		prepareTar();
 	}
 
+	float ICGN2D1::setReference(POI2D* poi, ICGN2D1_* instance)
+	{
+		int subset_width = 2 * subset_radius_x + 1;
+		int subset_height = 2 * subset_radius_y + 1;
+
+		//set reference subset
+		instance->ref_subset->center = (Point2D)*poi;
+		instance->ref_subset->fill(ref_img);
+		float ref_mean_norm = instance->ref_subset->zeroMeanNorm();
+
+		//build the steepest descent image, one row per pixel taken column by column as in error_img
+		for (int c = 0; c < subset_width; c++)
+		{
+			for (int r = 0; r < subset_height; r++)
+			{
+				int x_local = c - subset_radius_x;
+				int y_local = r - subset_radius_y;
+				int x_global = (int)poi->x + x_local;
+				int y_global = (int)poi->y + y_local;
+				float ref_gradient_x = ref_gradient->gradient_x(y_global, x_global);
+				float ref_gradient_y = ref_gradient->gradient_y(y_global, x_global);
+
+				int pixel_index = c * subset_height + r;
+				instance->sd_img(pixel_index, 0) = ref_gradient_x;
+				instance->sd_img(pixel_index, 1) = ref_gradient_x * x_local;
+				instance->sd_img(pixel_index, 2) = ref_gradient_x * y_local;
+				instance->sd_img(pixel_index, 3) = ref_gradient_y;
+				instance->sd_img(pixel_index, 4) = ref_gradient_y * x_local;
+				instance->sd_img(pixel_index, 5) = ref_gradient_y * y_local;
+			}
+		}
+
+		//build the Hessian matrix with a rank-k update
+		instance->hessian.setZero();
+		instance->hessian.selfadjointView<Eigen::Lower>().rankUpdate(instance->sd_img.transpose());
+		instance->hessian.triangularView<Eigen::StrictlyUpper>() = instance->hessian.transpose();
+
+		//calculate the inversed Hessian matrix
+		instance->inv_hessian = instance->hessian.inverse();
+
+		return ref_mean_norm;
+	}
+
 	void ICGN2D1::compute(POI2D* poi)
+	{
+		computeWithReference(poi, nullptr);
+	}
+
+	void ICGN2D1::computeWithReference(POI2D* poi, ICGN2D1Ref* poi_ref)
 	{
 		//set instance w.r.t. thread id 
 		ICGN2D1_* cur_instance = getInstance(omp_get_thread_num());
@@ -164,47 +213,25 @@ namespace opencorr
 		}
 		else
 		{
-			int subset_width = 2 * subset_radius_x + 1;
-			int subset_height = 2 * subset_radius_y + 1;
-
-			//set reference subset
-			cur_instance->ref_subset->center = (Point2D)*poi;
-			cur_instance->ref_subset->fill(ref_img);
-			float ref_mean_norm = cur_instance->ref_subset->zeroMeanNorm();
-
-			//build the Hessian matrix
-			cur_instance->hessian.setZero();
-			for (int r = 0; r < subset_height; r++)
+			//take the reference data from cache if available, otherwise build them in the instance
+			float ref_mean_norm;
+			Eigen::MatrixXf* ref_subset;
+			RowMatrixX6f* sd_img;
+			Matrix6f* inv_hessian;
+			if (poi_ref != nullptr)
 			{
-				for (int c = 0; c < subset_width; c++)
-				{
-					int x_local = c - subset_radius_x;
-					int y_local = r - subset_radius_y;
-					int x_global = (int)poi->x + x_local;
-					int y_global = (int)poi->y + y_local;
-					float ref_gradient_x = ref_gradient->gradient_x(y_global, x_global);
-					float ref_gradient_y = ref_gradient->gradient_y(y_global, x_global);
-
-					cur_instance->sd_img[r][c][0] = ref_gradient_x;
-					cur_instance->sd_img[r][c][1] = ref_gradient_x * x_local;
-					cur_instance->sd_img[r][c][2] = ref_gradient_x * y_local;
-					cur_instance->sd_img[r][c][3] = ref_gradient_y;
-					cur_instance->sd_img[r][c][4] = ref_gradient_y * x_local;
-					cur_instance->sd_img[r][c][5] = ref_gradient_y * y_local;
-
-					for (int i = 0; i < 6; i++)
-					{
-						for (int j = 0; j < i + 1; j++)
-						{
-							cur_instance->hessian(i, j) += (cur_instance->sd_img[r][c][i] * cur_instance->sd_img[r][c][j]);
-							cur_instance->hessian(j, i) = cur_instance->hessian(i, j);
-						}
-					}
-				}
+				ref_mean_norm = poi_ref->ref_mean_norm;
+				ref_subset = &poi_ref->ref_subset;
+				sd_img = &poi_ref->sd_img;
+				inv_hessian = &poi_ref->inv_hessian;
+			}
+			else
+			{
+				ref_mean_norm = setReference(poi, cur_instance);
+				ref_subset = &cur_instance->ref_subset->eg_mat;
+				sd_img = &cur_instance->sd_img;
+				inv_hessian = &cur_instance->inv_hessian;
 			}
-
-			//calculate the inversed Hessian matrix
-			cur_instance->inv_hessian = cur_instance->hessian.inverse();
 
 			//set target subset
 			cur_instance->tar_subset->center = (Point2D)*poi;
@@ -217,59 +244,29 @@ namespace opencorr
 			Deformation2D1 p_current, p_increment;
 			p_current.setDeformation(p_initial);
 			float dp_norm_max, znssd;
-			Point2D local_coor, warped_coor, global_coor;
-
 			do
 			{
 				iteration_counter++;
 
 				//reconstruct target subset
-				for (int r = 0; r < subset_height; r++)
-				{
-					for (int c = 0; c < subset_width; c++)
-					{
-						int x_local = c - subset_radius_x;
-						int y_local = r - subset_radius_y;
-						local_coor.x = x_local;
-						local_coor.y = y_local;
-						warped_coor = p_current.warp(local_coor);
-						global_coor = cur_instance->tar_subset->center + warped_coor;
-						cur_instance->tar_subset->eg_mat(r, c) = tar_interp->compute(global_coor);
-					}
-				}
+				tar_interp->computeSubset(p_current, cur_instance->tar_subset->center, subset_radius_x, subset_radius_y, cur_instance->tar_subset->eg_mat);
 
 				float tar_mean_norm = cur_instance->tar_subset->zeroMeanNorm();
 
 				//calculate error image
 				cur_instance->error_img = cur_instance->tar_subset->eg_mat * (ref_mean_norm / tar_mean_norm)
-					- (cur_instance->ref_subset->eg_mat);
+					- (*ref_subset);
 
 				//calculate ZNSSD
 				znssd = cur_instance->error_img.squaredNorm() / (ref_mean_norm * ref_mean_norm);
 
 				//calculate numerator
-				float numerator[6] = { 0.f };
-				for (int r = 0; r < subset_height; r++)
-				{
-					for (int c = 0; c < subset_width; c++)
-					{
-						for (int i = 0; i < 6; i++)
-						{
-							numerator[i] += (cur_instance->sd_img[r][c][i] * cur_instance->error_img(r, c));
-						}
-					}
-				}
+				Eigen::Map<Eigen::VectorXf> error_vector(cur_instance->error_img.data(), cur_instance->error_img.size());
+				Vector6f numerator = sd_img->transpose() * error_vector;
 
 				//calculate dp
-				float dp[6] = { 0.f };
-				for (int i = 0; i < 6; i++)
-				{
-					for (int j = 0; j < 6; j++)
-					{
-						dp[i] += (cur_instance->inv_hessian(i, j) * numerator[j]);
-					}
-				}
-				p_increment.setDeformation(dp);
+				Vector6f dp = (*inv_hessian) * numerator;
+				p_increment.setDeformation(dp.data());
 
 				//update warp
 				p_current.warp_matrix = p_current.warp_matrix * p_increment.warp_matrix.inverse();
@@ -319,11 +316,69 @@ namespace opencorr
 	void ICGN2D1::compute(std::vector<POI2D>& poi_queue)
 	{
 		int queue_length = (int)poi_queue.size();
+
+		//the cached reference data are used only if they are precomputed for the same queue
+		bool use_cache = ((int)ref_cache.size() == queue_length);
+		ScheduleScope schedule_scope(schedule_mode, schedule_chunk, queue_length);
+#pragma omp parallel for schedule(runtime)
+		for (int i = 0; i < queue_length; i++)
+		{
+			ICGN2D1Ref* poi_ref = use_cache ? ref_cache[i] : nullptr;
+			if (poi_ref != nullptr && (poi_ref->location.x != poi_queue[i].x || poi_ref->location.y != poi_queue[i].y))
+			{
+				poi_ref = nullptr;
+			}
+			computeWithReference(&poi_queue[i], poi_ref);
+		}
+	}
+
+	bool ICGN2D1::precomputeReference(std::vector<POI2D>& poi_queue, size_t memory_budget)
+	{
+		releaseReference();
+
+		//estimate the memory occupied by cache, i.e. reference subset, steepest descent image and inversed Hessian matrix of each POI
+		int queue_length = (int)poi_queue.size();
+		size_t subset_size = (size_t)(2 * subset_radius_x + 1) * (2 * subset_radius_y + 1);
+		size_t ref_size = sizeof(ICGN2D1Ref) + subset_size * 7 * sizeof(float);
+		if (queue_length == 0 || ref_size * queue_length > memory_budget)
+		{
+			return false;
+		}
+
+		ref_cache.assign(queue_length, nullptr);
+
 #pragma omp parallel for
 		for (int i = 0; i < queue_length; i++)
 		{
-			compute(&poi_queue[i]);
+			POI2D* poi = &poi_queue[i];
+
+			//POIs with subset out of reference image are left to compute(), which marks them as invalid
+			if (poi->y - subset_radius_y < 0 || poi->x - subset_radius_x < 0
+				|| poi->y + subset_radius_y > ref_img->height - 1 || poi->x + subset_radius_x > ref_img->width - 1)
+			{
+				continue;
+			}
+
+			ICGN2D1_* cur_instance = getInstance(omp_get_thread_num());
+			ICGN2D1Ref* poi_ref = new ICGN2D1Ref;
+			poi_ref->location = (Point2D)*poi;
+			poi_ref->ref_mean_norm = setReference(poi, cur_instance);
+			poi_ref->ref_subset = cur_instance->ref_subset->eg_mat;
+			poi_ref->sd_img = cur_instance->sd_img;
+			poi_ref->inv_hessian = cur_instance->inv_hessian;
+			ref_cache[i] = poi_ref;
+		}
+
+		return true;
+	}
+
+	void ICGN2D1::releaseReference()
+	{
+		for (auto& poi_ref : ref_cache)
+		{
+			delete poi_ref;
 		}
+		ref_cache.clear();
 	}
 
 
@@ -353,11 +408,10 @@ namespace opencorr
 			cur_instance->ref_subset->fill(ref_img);
 			float ref_mean_norm = cur_instance->ref_subset->zeroMeanNorm();
 
-			//build the hessian matrix
-			cur_instance->hessian.setZero();
-			for (int r = 0; r < subset_height; r++)
+			//build the steepest descent image, one row per pixel taken column by column as in error_img
+			for (int c = 0; c < subset_width; c++)
 			{
-				for (int c = 0; c < subset_width; c++)
+				for (int r = 0; r < subset_height; r++)
 				{
 					int x_local = c - poi->subset_radius.x;
 					int y_local = r - poi->subset_radius.y;
@@ -366,24 +420,21 @@ namespace opencorr
 					float ref_gradient_x = ref_gradient->gradient_x(y_global, x_global);
 					float ref_gradient_y = ref_gradient->gradient_y(y_global, x_global);
 
-					cur_instance->sd_img[r][c][0] = ref_gradient_x;
-					cur_instance->sd_img[r][c][1] = ref_gradient_x * x_local;
-					cur_instance->sd_img[r][c][2] = ref_gradient_x * y_local;
-					cur_instance->sd_img[r][c][3] = ref_gradient_y;
-					cur_instance->sd_img[r][c][4] = ref_gradient_y * x_local;
-					cur_instance->sd_img[r][c][5] = ref_gradient_y * y_local;
-
-					for (int i = 0; i < 6; i++)
-					{
-						for (int j = 0; j < i + 1; j++)
-						{
-							cur_instance->hessian(i, j) += (cur_instance->sd_img[r][c][i] * cur_instance->sd_img[r][c][j]);
-							cur_instance->hessian(j, i) = cur_instance->hessian(i, j);
-						}
-					}
+					int pixel_index = c * subset_height + r;
+					cur_instance->sd_img(pixel_index, 0) = ref_gradient_x;
+					cur_instance->sd_img(pixel_index, 1) = ref_gradient_x * x_local;
+					cur_instance->sd_img(pixel_index, 2) = ref_gradient_x * y_local;
+					cur_instance->sd_img(pixel_index, 3) = ref_gradient_y;
+					cur_instance->sd_img(pixel_index, 4) = ref_gradient_y * x_local;
+					cur_instance->sd_img(pixel_index, 5) = ref_gradient_y * y_local;
 				}
 			}
 
+			//build the Hessian matrix with a rank-k update
+			cur_instance->hessian.setZero();
+			cur_instance->hessian.selfadjointView<Eigen::Lower>().rankUpdate(cur_instance->sd_img.transpose());
+			cur_instance->hessian.triangularView<Eigen::StrictlyUpper>() = cur_instance->hessian.transpose();
+
 			//compute inversed hessian matrix
 			cur_instance->inv_hessian = cur_instance->hessian.inverse();
 
@@ -399,24 +450,11 @@ namespace opencorr
 			Deformation2D1 p_current, p_increment;
 			p_current.setDeformation(p_initial);
 			float dp_norm_max, znssd;
-			Point2D local_coor, warped_coor, global_coor;
 			do
 			{
 				iteration++;
 				//reconstruct target subset
-				for (int r = 0; r < subset_height; r++)
-				{
-					for (int c = 0; c < subset_width; c++)
-					{
-						int x_local = c - poi->subset_radius.x;
-						int y_local = r - poi->subset_radius.y;
-						local_coor.x = x_local;
-						local_coor.y = y_local;
-						warped_coor = p_current.warp(local_coor);
-						global_coor = cur_instance->tar_subset->center + warped_coor;
-						cur_instance->tar_subset->eg_mat(r, c) = tar_interp->compute(global_coor);
-					}
-				}
+				tar_interp->computeSubset(p_current, cur_instance->tar_subset->center, (int)poi->subset_radius.x, (int)poi->subset_radius.y, cur_instance->tar_subset->eg_mat);
 				float tar_mean_norm = cur_instance->tar_subset->zeroMeanNorm();
 
 				//compute error image
@@ -427,28 +465,12 @@ namespace opencorr
 				znssd = cur_instance->error_img.squaredNorm() / (ref_mean_norm * ref_mean_norm);
 
 				//compute numerator
-				float numerator[6] = { 0 };
-				for (int r = 0; r < subset_height; r++)
-				{
-					for (int c = 0; c < subset_width; c++)
-					{
-						for (int i = 0; i < 6; i++)
-						{
-							numerator[i] += (cur_instance->sd_img[r][c][i] * cur_instance->error_img(r, c));
-						}
-					}
-				}
+				Eigen::Map<Eigen::VectorXf> error_vector(cur_instance->error_img.data(), cur_instance->error_img.size());
+				Vector6f numerator = cur_instance->sd_img.transpose() * error_vector;
 
 				//compute dp
-				float dp[6] = { 0 };
-				for (int i = 0; i < 6; i++)
-				{
-					for (int j = 0; j < 6; j++)
-					{
-						dp[i] += (cur_instance->inv_hessian(i, j) * numerator[j]);
-					}
-				}
-				p_increment.setDeformation(dp);
+				Vector6f dp = cur_instance->inv_hessian * numerator;
+				p_increment.setDeformation(dp.data());
 
 				//update warp
 				p_current.warp_matrix = p_current.warp_matrix * p_increment.warp_matrix.inverse();
@@ -490,7 +512,8 @@ namespace opencorr
 	void ICGN2D1::compute(std::vector<POI2D>& poi_queue, Point2D subset_radius)
 	{
 		int queue_length = (int)poi_queue.size();
-#pragma omp parallel for
+		ScheduleScope schedule_scope(schedule_mode, schedule_chunk, queue_length);
+#pragma omp parallel for schedule(runtime)
 		for (int i = 0; i < queue_length; i++)
 		{
 			compute(&poi_queue[i], subset_radius);
@@ -509,26 +532,19 @@ namespace opencorr
 		ICGN_instance->ref_subset = new Subset2D(subset_center, subset_radius_x, subset_radius_y);
 		ICGN_instance->tar_subset = new Subset2D(subset_center, subset_radius_x, subset_radius_y);
 		ICGN_instance->error_img = Eigen::MatrixXf::Zero(subset_height, subset_width);
-		ICGN_instance->sd_img = new3D(subset_height, subset_width, 12);
+		ICGN_instance->sd_img = RowMatrixX12f::Zero(subset_height * subset_width, 12);
 
 		return ICGN_instance;
 	}
 
 	void ICGN2D2_::release(ICGN2D2_* instance)
 	{
-		delete3D(instance->sd_img);
 		delete instance->ref_subset;
 		delete instance->tar_subset;
 	}
 
 	void ICGN2D2_::update(ICGN2D2_* instance, int subset_radius_x, int subset_radius_y)
 	{
-		if (instance->sd_img != nullptr)
-		{
-			delete3D(instance->sd_img);
-			instance->sd_img = nullptr;
-		}
-
 		if (instance->ref_subset != nullptr)
 		{
 			delete instance->ref_subset;
@@ -548,7 +564,7 @@ namespace opencorr
 		instance->ref_subset = new Subset2D(subset_center, subset_radius_x, subset_radius_y);
 		instance->tar_subset = new Subset2D(subset_center, subset_radius_x, subset_radius_y);
 		instance->error_img.resize(subset_height, subset_width);
-		instance->sd_img = new3D(subset_height, subset_width, 12);
+		instance->sd_img.resize(subset_height * subset_width, 12);
 	}
 
 	ICGN2D2_* ICGN2D2::getInstance(int tid)
@@ -655,11 +671,10 @@ namespace opencorr
 			cur_instance->ref_subset->fill(ref_img);
 			float ref_mean_norm = cur_instance->ref_subset->zeroMeanNorm();
 
-			//build the Hessian matrix
-			cur_instance->hessian.setZero();
-			for (int r = 0; r < subset_height; r++)
+			//build the steepest descent image, one row per pixel taken column by column as in error_img
+			for (int c = 0; c < subset_width; c++)
 			{
-				for (int c = 0; c < subset_width; c++)
+				for (int r = 0; r < subset_height; r++)
 				{
 					int x_local = c - subset_radius_x;
 					int y_local = r - subset_radius_y;
@@ -671,31 +686,28 @@ namespace opencorr
 					float ref_gradient_x = ref_gradient->gradient_x(y_global, x_global);
 					float ref_gradient_y = ref_gradient->gradient_y(y_global, x_global);
 
-					cur_instance->sd_img[r][c][0] = ref_gradient_x;
-					cur_instance->sd_img[r][c][1] = ref_gradient_x * x_local;
-					cur_instance->sd_img[r][c][2] = ref_gradient_x * y_local;
-					cur_instance->sd_img[r][c][3] = ref_gradient_x * xx_local;
-					cur_instance->sd_img[r][c][4] = ref_gradient_x * xy_local;
-					cur_instance->sd_img[r][c][5] = ref_gradient_x * yy_local;
-
-					cur_instance->sd_img[r][c][6] = ref_gradient_y;
-					cur_instance->sd_img[r][c][7] = ref_gradient_y * x_local;
-					cur_instance->sd_img[r][c][8] = ref_gradient_y * y_local;
-					cur_instance->sd_img[r][c][9] = ref_gradient_y * xx_local;
-					cur_instance->sd_img[r][c][10] = ref_gradient_y * xy_local;
-					cur_instance->sd_img[r][c][11] = ref_gradient_y * yy_local;
-
-					for (int i = 0; i < 12; i++)
-					{
-						for (int j = 0; j < i + 1; j++)
-						{
-							cur_instance->hessian(i, j) += (cur_instance->sd_img[r][c][i] * cur_instance->sd_img[r][c][j]);
-							cur_instance->hessian(j, i) = cur_instance->hessian(i, j);
-						}
-					}
+					int pixel_index = c * subset_height + r;
+					cur_instance->sd_img(pixel_index, 0) = ref_gradient_x;
+					cur_instance->sd_img(pixel_index, 1) = ref_gradient_x * x_local;
+					cur_instance->sd_img(pixel_index, 2) = ref_gradient_x * y_local;
+					cur_instance->sd_img(pixel_index, 3) = ref_gradient_x * xx_local;
+					cur_instance->sd_img(pixel_index, 4) = ref_gradient_x * xy_local;
+					cur_instance->sd_img(pixel_index, 5) = ref_gradient_x * yy_local;
+
+					cur_instance->sd_img(pixel_index, 6) = ref_gradient_y;
+					cur_instance->sd_img(pixel_index, 7) = ref_gradient_y * x_local;
+					cur_instance->sd_img(pixel_index, 8) = ref_gradient_y * y_local;
+					cur_instance->sd_img(pixel_index, 9) = ref_gradient_y * xx_local;
+					cur_instance->sd_img(pixel_index, 10) = ref_gradient_y * xy_local;
+					cur_instance->sd_img(pixel_index, 11) = ref_gradient_y * yy_local;
 				}
 			}
 
+			//build the Hessian matrix with a rank-k update
+			cur_instance->hessian.setZero();
+			cur_instance->hessian.selfadjointView<Eigen::Lower>().rankUpdate(cur_instance->sd_img.transpose());
+			cur_instance->hessian.triangularView<Eigen::StrictlyUpper>() = cur_instance->hessian.transpose();
+
 			//calculate the inversed Hessian matrix
 			cur_instance->inv_hessian = cur_instance->hessian.inverse();
 
@@ -711,24 +723,11 @@ namespace opencorr
 			Deformation2D2 p_current, p_increment;
 			p_current.setDeformation(p_initial);
 			float dp_norm_max, znssd;
-			Point2D local_coor, warped_coor, global_coor;
 			do
 			{
 				iteration_counter++;
 				//reconstruct target subset
-				for (int r = 0; r < subset_height; r++)
-				{
-					for (int c = 0; c < subset_width; c++)
-					{
-						int x_local = c - subset_radius_x;
-						int y_local = r - subset_radius_y;
-						local_coor.x = x_local;
-						local_coor.y = y_local;
-						warped_coor = p_current.warp(local_coor);
-						global_coor = cur_instance->tar_subset->center + warped_coor;
-						cur_instance->tar_subset->eg_mat(r, c) = tar_interp->compute(global_coor);
-					}
-				}
+				tar_interp->computeSubset(p_current, cur_instance->tar_subset->center, subset_radius_x, subset_radius_y, cur_instance->tar_subset->eg_mat);
 				float tar_mean_norm = cur_instance->tar_subset->zeroMeanNorm();
 
 				//calculate error image
@@ -739,28 +738,12 @@ namespace opencorr
 				znssd = cur_instance->error_img.squaredNorm() / (ref_mean_norm * ref_mean_norm);
 
 				//calculate numerator
-				float numerator[12] = { 0.f };
-				for (int r = 0; r < subset_height; r++)
-				{
-					for (int c = 0; c < subset_width; c++)
-					{
-						for (int i = 0; i < 12; i++)
-						{
-							numerator[i] += (cur_instance->sd_img[r][c][i] * cur_instance->error_img(r, c));
-						}
-					}
-				}
+				Eigen::Map<Eigen::VectorXf> error_vector(cur_instance->error_img.data(), cur_instance->error_img.size());
+				Vector12f numerator = cur_instance->sd_img.transpose() * error_vector;
 
 				//calculate dp
-				float dp[12] = { 0.f };
-				for (int i = 0; i < 12; i++)
-				{
-					for (int j = 0; j < 12; j++)
-					{
-						dp[i] += (cur_instance->inv_hessian(i, j) * numerator[j]);
-					}
-				}
-				p_increment.setDeformation(dp);
+				Vector12f dp = cur_instance->inv_hessian * numerator;
+				p_increment.setDeformation(dp.data());
 
 				//update warp
 				p_current.warp_matrix = p_current.warp_matrix * p_increment.warp_matrix.inverse();
@@ -824,7 +807,8 @@ namespace opencorr
 	void ICGN2D2::compute(std::vector<POI2D>& poi_queue)
 	{
 		int queue_length = (int)poi_queue.size();
-#pragma omp parallel for
+		ScheduleScope schedule_scope(schedule_mode, schedule_chunk, queue_length);
+#pragma omp parallel for schedule(runtime)
 		for (int i = 0; i < queue_length; i++)
 		{
 			compute(&poi_queue[i]);
@@ -834,6 +818,67 @@ namespace opencorr
 
 
 
+	//1st order derivative with 4th order of accuracy, the same stencil as Gradient3D4
+	static inline float centralDifference(const float* voxel, long long stride)
+	{
+		float result = 0.0f;
+		result -= voxel[2 * stride] / 12.f;
+		result += voxel[stride] * (2.f / 3.f);
+		result -= voxel[-stride] * (2.f / 3.f);
+		result += voxel[-2 * stride] / 12.f;
+		return result;
+	}
+
+	//gradients along x, y and z of the row of ref subset starting from voxel (x_start, y_global, z_global), read from
+	//the gradient volumes, or calculated into gradient_row if ref_gradient is nullptr (lazy mode), which are zero
+	//within 2 voxels from the border of ref image as in Gradient3D4
+	static void getGradientRow(Image3D* ref_img, Gradient3D4* ref_gradient, int x_start, int y_global, int z_global, int length,
+		float* gradient_row, const float* gradient[3])
+	{
+		//the gradient volumes share the layout of ref image, thus one flat index locates the row in all of them
+		long long row_index = ref_img->vol_mat.index(z_global, y_global, x_start);
+		if (ref_gradient != nullptr)
+		{
+			gradient[0] = ref_gradient->gradient_x.data + row_index;
+			gradient[1] = ref_gradient->gradient_y.data + row_index;
+			gradient[2] = ref_gradient->gradient_z.data + row_index;
+			return;
+		}
+
+		const float* img_row = ref_img->vol_mat.data + row_index;
+		bool y_inside = (y_global >= 2 && y_global < ref_img->dim_y - 2);
+		bool z_inside = (z_global >= 2 && z_global < ref_img->dim_z - 2);
+		for (int k = 0; k < length; k++)
+		{
+			int x_global = x_start + k;
+			bool x_inside = (x_global >= 2 && x_global < ref_img->dim_x - 2);
+			gradient_row[k] = x_inside ? centralDifference(img_row + k, 1) : 0.f;
+			gradient_row[length + k] = y_inside ? centralDifference(img_row + k, ref_img->vol_mat.row_stride) : 0.f;
+			gradient_row[2 * length + k] = z_inside ? centralDifference(img_row + k, ref_img->vol_mat.slice_stride) : 0.f;
+		}
+		gradient[0] = gradient_row;
+		gradient[1] = gradient_row + length;
+		gradient[2] = gradient_row + 2 * length;
+	}
+
+	//kernels shared by the 3D IC-GN of different shape functions, where the steepest descent image J holds one row per voxel
+	//Hessian matrix J^T * J, assembled by a blocked rank-k update of its lower triangle
+	template <class HessianMatrix, class SteepestDescentMatrix>
+	static void getHessian(const SteepestDescentMatrix& sd_img, HessianMatrix& hessian)
+	{
+		hessian.setZero();
+		hessian.template selfadjointView<Eigen::Lower>().rankUpdate(sd_img.transpose());
+		hessian.template triangularView<Eigen::StrictlyUpper>() = hessian.transpose();
+	}
+
+	//numerator J^T * error, error is stored in the same order as the rows of J
+	template <class NumeratorVector, class SteepestDescentMatrix>
+	static void getNumerator(const SteepestDescentMatrix& sd_img, const float* error, NumeratorVector& numerator)
+	{
+		Eigen::Map<const Eigen::VectorXf> error_vector(error, sd_img.rows());
+		numerator.noalias() = sd_img.transpose() * error_vector;
+	}
+
 	ICGN3D1_* ICGN3D1_::allocate(int subset_radius_x, int subset_radius_y, int subset_radius_z)
 	{
 		int dim_x = 2 * subset_radius_x + 1;
@@ -844,34 +889,23 @@ namespace opencorr
 		ICGN3D1_* ICGN_instance = new ICGN3D1_;
 		ICGN_instance->ref_subset = new Subset3D(subset_center, subset_radius_x, subset_radius_y, subset_radius_z);
 		ICGN_instance->tar_subset = new Subset3D(subset_center, subset_radius_x, subset_radius_y, subset_radius_z);
-		ICGN_instance->error_img = new3D(dim_z, dim_y, dim_x);
-		ICGN_instance->sd_img = new4D(dim_z, dim_y, dim_x, 12);
+		ICGN_instance->error_img.allocate(dim_x, dim_y, dim_z);
+		ICGN_instance->sd_img.resize((long long)dim_x * dim_y * dim_z, 12);
+		ICGN_instance->gradient_row.assign(3 * dim_x, 0.f);
 
 		return ICGN_instance;
 	}
 
 	void ICGN3D1_::release(ICGN3D1_* instance)
 	{
-		delete3D(instance->error_img);
-		delete4D(instance->sd_img);
+		instance->error_img.release();
+		instance->sd_img.resize(0, 12);
 		delete instance->ref_subset;
 		delete instance->tar_subset;
 	}
 
 	void ICGN3D1_::update(ICGN3D1_* instance, int subset_radius_x, int subset_radius_y, int subset_radius_z)
 	{
-		if (instance->error_img != nullptr)
-		{
-			delete3D(instance->error_img);
-			instance->error_img = nullptr;
-		}
-
-		if (instance->sd_img != nullptr)
-		{
-			delete4D(instance->sd_img);
-			instance->sd_img = nullptr;
-		}
-
 		if (instance->ref_subset != nullptr)
 		{
 			delete instance->ref_subset;
@@ -891,8 +925,9 @@ namespace opencorr
 
 		instance->ref_subset = new Subset3D(subset_center, subset_radius_x, subset_radius_y, subset_radius_z);
 		instance->tar_subset = new Subset3D(subset_center, subset_radius_x, subset_radius_y, subset_radius_z);
-		instance->error_img = new3D(dim_z, dim_y, dim_x);
-		instance->sd_img = new4D(dim_z, dim_y, dim_x, 12);
+		instance->error_img.allocate(dim_x, dim_y, dim_z);
+		instance->sd_img.resize((long long)dim_x * dim_y * dim_z, 12);
+		instance->gradient_row.assign(3 * dim_x, 0.f);
 	}
 
 	ICGN3D1_* ICGN3D1::getInstance(int tid)
@@ -905,7 +940,7 @@ namespace opencorr
 	}
 
 	ICGN3D1::ICGN3D1(int subset_radius_x, int subset_radius_y, int subset_radius_z, float conv_criterion, float stop_condition, int thread_number)
-		: ref_gradient(nullptr), tar_interp(nullptr)
+		: ref_gradient(nullptr), tar_interp(nullptr), lazy_gradient(false)
 	{
 		this->subset_radius_x = subset_radius_x;
 		this->subset_radius_y = subset_radius_y;
@@ -946,15 +981,30 @@ namespace opencorr
 		stop_condition = (int)poi->result.iteration;
 	}
 
+	void ICGN3D1::setLazyGradient(bool lazy_gradient)
+	{
+		this->lazy_gradient = lazy_gradient;
+	}
+
 	void ICGN3D1::prepareRef()
 	{
-		if (ref_gradient != nullptr)
+		//the gradient volumes are not needed in lazy mode
+		if (lazy_gradient)
 		{
 			delete ref_gradient;
 			ref_gradient = nullptr;
+			return;
 		}
 
-		ref_gradient = new Gradient3D4(*ref_img);
+		//keep the objects alive across the bricks of a volume, their memory is reused if the dimensions do not change
+		if (ref_gradient == nullptr)
+		{
+			ref_gradient = new Gradient3D4(*ref_img);
+		}
+		else
+		{
+			ref_gradient->setImage(*ref_img);
+		}
 		ref_gradient->getGradientX();
 		ref_gradient->getGradientY();
 		ref_gradient->getGradientZ();
@@ -962,13 +1012,14 @@ namespace opencorr
 
 	void ICGN3D1::prepareTar()
 	{
-		if (tar_interp != nullptr)
+		if (tar_interp == nullptr)
 		{
-			delete tar_interp;
-			tar_interp = nullptr;
+			tar_interp = new TricubicBspline(*tar_img);
+		}
+		else
+		{
+			tar_interp->setImage(*tar_img);
 		}
-
-		tar_interp = new TricubicBspline(*tar_img);
 		tar_interp->prepare();
 	}
 
@@ -1001,48 +1052,40 @@ namespace opencorr
 			cur_instance->ref_subset->fill(ref_img);
 			float ref_mean_norm = cur_instance->ref_subset->zeroMeanNorm();
 
-			//build the hessian matrix
-			cur_instance->hessian.setZero();
+			//build the steepest descent image, one row per voxel in the order of subset
 			for (int i = 0; i < subset_dim_z; i++)
 			{
 				for (int j = 0; j < subset_dim_y; j++)
 				{
+					int x_start = (int)poi->x - subset_radius_x;
+					int y_global = (int)poi->y + j - subset_radius_y;
+					int z_global = (int)poi->z + i - subset_radius_z;
+					const float* gradient[3];
+					getGradientRow(ref_img, lazy_gradient ? nullptr : ref_gradient, x_start, y_global, z_global, subset_dim_x,
+						cur_instance->gradient_row.data(), gradient);
+
+					float y_local = (float)(j - subset_radius_y);
+					float z_local = (float)(i - subset_radius_z);
+					long long row_index = ((long long)i * subset_dim_y + j) * subset_dim_x;
 					for (int k = 0; k < subset_dim_x; k++)
 					{
-						int x_local = k - subset_radius_x;
-						int y_local = j - subset_radius_y;
-						int z_local = i - subset_radius_z;
-						int x_global = (int)poi->x + x_local;
-						int y_global = (int)poi->y + y_local;
-						int z_global = (int)poi->z + z_local;
-						float ref_gradient_x = ref_gradient->gradient_x[z_global][y_global][x_global];
-						float ref_gradient_y = ref_gradient->gradient_y[z_global][y_global][x_global];
-						float ref_gradient_z = ref_gradient->gradient_z[z_global][y_global][x_global];
-
-						cur_instance->sd_img[i][j][k][0] = ref_gradient_x;
-						cur_instance->sd_img[i][j][k][1] = ref_gradient_x * x_local;
-						cur_instance->sd_img[i][j][k][2] = ref_gradient_x * y_local;
-						cur_instance->sd_img[i][j][k][3] = ref_gradient_x * z_local;
-						cur_instance->sd_img[i][j][k][4] = ref_gradient_y;
-						cur_instance->sd_img[i][j][k][5] = ref_gradient_y * x_local;
-						cur_instance->sd_img[i][j][k][6] = ref_gradient_y * y_local;
-						cur_instance->sd_img[i][j][k][7] = ref_gradient_y * z_local;
-						cur_instance->sd_img[i][j][k][8] = ref_gradient_z;
-						cur_instance->sd_img[i][j][k][9] = ref_gradient_z * x_local;
-						cur_instance->sd_img[i][j][k][10] = ref_gradient_z * y_local;
-						cur_instance->sd_img[i][j][k][11] = ref_gradient_z * z_local;
-
-						for (int r = 0; r < 12; r++)
+						float x_local = (float)(k - subset_radius_x);
+						float* sd_row = cur_instance->sd_img.row(row_index + k).data();
+						for (int m = 0; m < 3; m++)
 						{
-							for (int c = 0; c < r + 1; c++)
-							{
-								cur_instance->hessian(r, c) += (cur_instance->sd_img[i][j][k][r] * cur_instance->sd_img[i][j][k][c]);
-								cur_instance->hessian(c, r) = cur_instance->hessian(r, c);
-							}
+							float ref_gradient_m = gradient[m][k];
+							sd_row[4 * m] = ref_gradient_m;
+							sd_row[4 * m + 1] = ref_gradient_m * x_local;
+							sd_row[4 * m + 2] = ref_gradient_m * y_local;
+							sd_row[4 * m + 3] = ref_gradient_m * z_local;
 						}
 					}
 				}
 			}
+
+			//build the Hessian matrix
+			getHessian(cur_instance->sd_img, cur_instance->hessian);
+
 			//calculate the inversed Hessian matrix
 			cur_instance->inv_hessian = cur_instance->hessian.inverse();
 
@@ -1059,75 +1102,354 @@ namespace opencorr
 			Deformation3D1 p_current, p_increment;
 			p_current.setDeformation(p_initial);
 			float dp_norm_max, znssd;
-			Point3D local_coor, warped_coor, global_coor;
 			do
 			{
 				iteration_counter++;
 				//reconstruct target subset
-				for (int i = 0; i < subset_dim_z; i++)
-				{
-					for (int j = 0; j < subset_dim_y; j++)
-					{
-						for (int k = 0; k < subset_dim_x; k++)
-						{
-							int x_local = k - subset_radius_x;
-							int y_local = j - subset_radius_y;
-							int z_local = i - subset_radius_z;
-							local_coor.x = x_local;
-							local_coor.y = y_local;
-							local_coor.z = z_local;
-							warped_coor = p_current.warp(local_coor);
-							global_coor = cur_instance->tar_subset->center + warped_coor;
-							cur_instance->tar_subset->vol_mat[i][j][k] = tar_interp->compute(global_coor);
-						}
-					}
-				}
+				tar_interp->computeSubset(p_current, cur_instance->tar_subset->center, subset_radius_x, subset_radius_y, subset_radius_z, cur_instance->tar_subset->vol_mat);
 				float tar_mean_norm = cur_instance->tar_subset->zeroMeanNorm();
 
 				//calculate error image
 				float error_factor = ref_mean_norm / tar_mean_norm;
 				float squared_sum = 0;
-				for (int i = 0; i < subset_dim_z; i++)
+				const float* tar_voxel = cur_instance->tar_subset->vol_mat.data;
+				const float* ref_voxel = cur_instance->ref_subset->vol_mat.data;
+				float* error_voxel = cur_instance->error_img.data;
+				int subset_size = cur_instance->ref_subset->size;
+				for (int i = 0; i < subset_size; i++)
 				{
-					for (int j = 0; j < subset_dim_y; j++)
-					{
-						for (int k = 0; k < subset_dim_x; k++)
-						{
-							cur_instance->error_img[i][j][k] = error_factor * cur_instance->tar_subset->vol_mat[i][j][k] - cur_instance->ref_subset->vol_mat[i][j][k];
-							squared_sum += (cur_instance->error_img[i][j][k] * cur_instance->error_img[i][j][k]);
-						}
-					}
+					error_voxel[i] = error_factor * tar_voxel[i] - ref_voxel[i];
+					squared_sum += (error_voxel[i] * error_voxel[i]);
 				}
 
 				//calculate ZNSSD
 				znssd = squared_sum / (ref_mean_norm * ref_mean_norm);
 
 				//calculate numerator
-				float numerator[12] = { 0.f };
-				for (int i = 0; i < subset_dim_z; i++)
+				Vector12f numerator;
+				getNumerator(cur_instance->sd_img, cur_instance->error_img.data, numerator);
+
+				//calculate dp
+				Vector12f dp = cur_instance->inv_hessian * numerator;
+				p_increment.setDeformation(dp.data());
+
+				//update warp
+				p_current.warp_matrix = p_current.warp_matrix * p_increment.warp_matrix.inverse();
+
+				//update p
+				p_current.setDeformation();
+
+				//check convergence
+				dp_norm_max = sqrt(p_increment.u * p_increment.u + p_increment.v * p_increment.v + p_increment.w * p_increment.w);
+
+			} while (iteration_counter < stop_condition && dp_norm_max >= conv_criterion);
+
+			//store the final results
+			poi->deformation.u = p_current.u;
+			poi->deformation.ux = p_current.ux;
+			poi->deformation.uy = p_current.uy;
+			poi->deformation.uz = p_current.uz;
+			poi->deformation.v = p_current.v;
+			poi->deformation.vx = p_current.vx;
+			poi->deformation.vy = p_current.vy;
+			poi->deformation.vz = p_current.vz;
+			poi->deformation.w = p_current.w;
+			poi->deformation.wx = p_current.wx;
+			poi->deformation.wy = p_current.wy;
+			poi->deformation.wz = p_current.wz;
+
+			//save the parameters for output
+			poi->result.u0 = p_initial.u;
+			poi->result.v0 = p_initial.v;
+			poi->result.w0 = p_initial.w;
+			poi->result.zncc = 0.5f * (2 - znssd);
+			poi->result.iteration = (float)iteration_counter;
+			poi->result.convergence = dp_norm_max;
+		}
+
+		//check if the case of NaN occurs for ZNCC or displacments
+		if (std::isnan(poi->result.zncc) || std::isnan(poi->deformation.u) || std::isnan(poi->deformation.v) || std::isnan(poi->deformation.w))
+		{
+			poi->deformation.u = poi->result.u0;
+			poi->deformation.v = poi->result.v0;
+			poi->deformation.w = poi->result.w0;
+			poi->result.zncc = -5;
+		}
+	}
+
+	void ICGN3D1::compute(std::vector<POI3D>& poi_queue)
+	{
+		int queue_length = (int)poi_queue.size();
+		ScheduleScope schedule_scope(schedule_mode, schedule_chunk, queue_length);
+#pragma omp parallel for schedule(runtime)
+		for (int i = 0; i < queue_length; i++)
+		{
+			compute(&poi_queue[i]);
+		}
+	}
+
+
+
+
+	ICGN3D2_* ICGN3D2_::allocate(int subset_radius_x, int subset_radius_y, int subset_radius_z)
+	{
+		int dim_x = 2 * subset_radius_x + 1;
+		int dim_y = 2 * subset_radius_y + 1;
+		int dim_z = 2 * subset_radius_z + 1;
+		Point3D subset_center(0, 0, 0);
+
+		ICGN3D2_* ICGN_instance = new ICGN3D2_;
+		ICGN_instance->ref_subset = new Subset3D(subset_center, subset_radius_x, subset_radius_y, subset_radius_z);
+		ICGN_instance->tar_subset = new Subset3D(subset_center, subset_radius_x, subset_radius_y, subset_radius_z);
+		ICGN_instance->error_img.allocate(dim_x, dim_y, dim_z);
+		ICGN_instance->sd_img.resize((long long)dim_x * dim_y * dim_z, 30);
+		ICGN_instance->gradient_row.assign(3 * dim_x, 0.f);
+
+		return ICGN_instance;
+	}
+
+	void ICGN3D2_::release(ICGN3D2_* instance)
+	{
+		instance->error_img.release();
+		instance->sd_img.resize(0, 30);
+		delete instance->ref_subset;
+		delete instance->tar_subset;
+	}
+
+	void ICGN3D2_::update(ICGN3D2_* instance, int subset_radius_x, int subset_radius_y, int subset_radius_z)
+	{
+		if (instance->ref_subset != nullptr)
+		{
+			delete instance->ref_subset;
+			instance->ref_subset = nullptr;
+		}
+
+		if (instance->tar_subset != nullptr)
+		{
+			delete instance->tar_subset;
+			instance->tar_subset = nullptr;
+		}
+
+		int dim_x = 2 * subset_radius_x + 1;
+		int dim_y = 2 * subset_radius_y + 1;
+		int dim_z = 2 * subset_radius_z + 1;
+		Point3D subset_center(0, 0, 0);
+
+		instance->ref_subset = new Subset3D(subset_center, subset_radius_x, subset_radius_y, subset_radius_z);
+		instance->tar_subset = new Subset3D(subset_center, subset_radius_x, subset_radius_y, subset_radius_z);
+		instance->error_img.allocate(dim_x, dim_y, dim_z);
+		instance->sd_img.resize((long long)dim_x * dim_y * dim_z, 30);
+		instance->gradient_row.assign(3 * dim_x, 0.f);
+	}
+
+	ICGN3D2_* ICGN3D2::getInstance(int tid)
+	{
+		if (tid >= (int)instance_pool.size())
+		{
+			throw std::string("CPU thread ID over limit");
+		}
+		return instance_pool[tid];
+	}
+
+	ICGN3D2::ICGN3D2(int subset_radius_x, int subset_radius_y, int subset_radius_z, float conv_criterion, float stop_condition, int thread_number)
+		: tar_interp(nullptr), ref_gradient(nullptr), lazy_gradient(false)
+	{
+		this->subset_radius_x = subset_radius_x;
+		this->subset_radius_y = subset_radius_y;
+		this->subset_radius_z = subset_radius_z;
+		this->conv_criterion = conv_criterion;
+		this->stop_condition = stop_condition;
+		this->thread_number = thread_number;
+
+		for (int i = 0; i < thread_number; i++)
+		{
+			ICGN3D2_* instance = ICGN3D2_::allocate(subset_radius_x, subset_radius_y, subset_radius_z);
+			instance_pool.push_back(instance);
+		}
+	}
+
+	ICGN3D2::~ICGN3D2()
+	{
+		delete ref_gradient;
+		delete tar_interp;
+
+		for (auto& instance : instance_pool)
+		{
+			ICGN3D2_::release(instance);
+			delete instance;
+		}
+		instance_pool.clear();
+	}
+
+	void ICGN3D2::setIteration(float conv_criterion, float stop_condition)
+	{
+		this->conv_criterion = conv_criterion;
+		this->stop_condition = stop_condition;
+	}
+
+	void ICGN3D2::setIteration(POI3D* poi)
+	{
+		conv_criterion = poi->result.convergence;
+		stop_condition = (int)poi->result.iteration;
+	}
+
+	void ICGN3D2::setLazyGradient(bool lazy_gradient)
+	{
+		this->lazy_gradient = lazy_gradient;
+	}
+
+	void ICGN3D2::prepareRef()
+	{
+		//the gradient volumes are not needed in lazy mode
+		if (lazy_gradient)
+		{
+			delete ref_gradient;
+			ref_gradient = nullptr;
+			return;
+		}
+
+		//keep the objects alive across successive calls, their memory is reused if the dimensions do not change
+		if (ref_gradient == nullptr)
+		{
+			ref_gradient = new Gradient3D4(*ref_img);
+		}
+		else
+		{
+			ref_gradient->setImage(*ref_img);
+		}
+		ref_gradient->getGradientX();
+		ref_gradient->getGradientY();
+		ref_gradient->getGradientZ();
+	}
+
+	void ICGN3D2::prepareTar()
+	{
+		if (tar_interp == nullptr)
+		{
+			tar_interp = new TricubicBspline(*tar_img);
+		}
+		else
+		{
+			tar_interp->setImage(*tar_img);
+		}
+		tar_interp->prepare();
+	}
+
+	void ICGN3D2::prepare()
+	{
+		prepareRef();
+		prepareTar();
+	}
+
+	void ICGN3D2::compute(POI3D* poi)
+	{
+		//set instance w.r.t. thread id 
+		ICGN3D2_* cur_instance = getInstance(omp_get_thread_num());
+
+		if ((poi->x - subset_radius_x) < 0 || (poi->y - subset_radius_y) < 0 || (poi->z - subset_radius_z) < 0
+			|| (poi->x + subset_radius_x) > (ref_img->dim_x - 1) || (poi->y + subset_radius_y) > (ref_img->dim_y - 1) || (poi->z + subset_radius_z) > (ref_img->dim_z - 1)
+			|| fabs(poi->deformation.u) >= ref_img->dim_x || fabs(poi->deformation.v) >= ref_img->dim_y || fabs(poi->deformation.w) >= ref_img->dim_z
+			|| poi->result.zncc < 0 || std::isnan(poi->deformation.u) || std::isnan(poi->deformation.v) || std::isnan(poi->deformation.w))
+		{
+			poi->result.zncc = poi->result.zncc < -1 ? poi->result.zncc : -1;
+		}
+		else
+		{
+			int subset_dim_x = 2 * subset_radius_x + 1;
+			int subset_dim_y = 2 * subset_radius_y + 1;
+			int subset_dim_z = 2 * subset_radius_z + 1;
+
+			//set reference subset
+			cur_instance->ref_subset->center = (Point3D)*poi;
+			cur_instance->ref_subset->fill(ref_img);
+			float ref_mean_norm = cur_instance->ref_subset->zeroMeanNorm();
+
+			//build the steepest descent image, one row per voxel in the order of subset
+			for (int i = 0; i < subset_dim_z; i++)
+			{
+				for (int j = 0; j < subset_dim_y; j++)
 				{
-					for (int j = 0; j < subset_dim_y; j++)
+					int x_start = (int)poi->x - subset_radius_x;
+					int y_global = (int)poi->y + j - subset_radius_y;
+					int z_global = (int)poi->z + i - subset_radius_z;
+					const float* gradient[3];
+					getGradientRow(ref_img, lazy_gradient ? nullptr : ref_gradient, x_start, y_global, z_global, subset_dim_x,
+						cur_instance->gradient_row.data(), gradient);
+
+					float y_local = (float)(j - subset_radius_y);
+					float z_local = (float)(i - subset_radius_z);
+					long long row_index = ((long long)i * subset_dim_y + j) * subset_dim_x;
+					for (int k = 0; k < subset_dim_x; k++)
 					{
-						for (int k = 0; k < subset_dim_x; k++)
+						float x_local = (float)(k - subset_radius_x);
+						float* sd_row = cur_instance->sd_img.row(row_index + k).data();
+						for (int m = 0; m < 3; m++)
 						{
-							for (int l = 0; l < 12; l++)
-							{
-								numerator[l] += (cur_instance->sd_img[i][j][k][l] * cur_instance->error_img[i][j][k]);
-							}
+							float ref_gradient_m = gradient[m][k];
+							sd_row[10 * m] = ref_gradient_m;
+							sd_row[10 * m + 1] = ref_gradient_m * x_local;
+							sd_row[10 * m + 2] = ref_gradient_m * y_local;
+							sd_row[10 * m + 3] = ref_gradient_m * z_local;
+							sd_row[10 * m + 4] = ref_gradient_m * x_local * x_local * 0.5f;
+							sd_row[10 * m + 5] = ref_gradient_m * x_local * y_local;
+							sd_row[10 * m + 6] = ref_gradient_m * x_local * z_local;
+							sd_row[10 * m + 7] = ref_gradient_m * y_local * y_local * 0.5f;
+							sd_row[10 * m + 8] = ref_gradient_m * y_local * z_local;
+							sd_row[10 * m + 9] = ref_gradient_m * z_local * z_local * 0.5f;
 						}
 					}
 				}
+			}
 
-				//calculate dp
-				float dp[12] = { 0.f };
-				for (int i = 0; i < 12; i++)
+			//build the Hessian matrix
+			getHessian(cur_instance->sd_img, cur_instance->hessian);
+
+			//calculate the inversed Hessian matrix
+			cur_instance->inv_hessian = cur_instance->hessian.inverse();
+
+			//set target subset
+			cur_instance->tar_subset->center = (Point3D)*poi;
+
+			//get initial guess
+			Deformation3D1 p_initial(poi->deformation.u, poi->deformation.ux, poi->deformation.uy, poi->deformation.uz,
+				poi->deformation.v, poi->deformation.vx, poi->deformation.vy, poi->deformation.vz,
+				poi->deformation.w, poi->deformation.wx, poi->deformation.wy, poi->deformation.wz);
+
+			//IC-GN iteration
+			int iteration_counter = 0; //initialize iteration counter
+			Deformation3D2 p_current, p_increment;
+			p_current.setDeformation(p_initial);
+			float dp_norm_max, znssd;
+			do
+			{
+				iteration_counter++;
+				//reconstruct target subset
+				tar_interp->computeSubset(p_current, cur_instance->tar_subset->center, subset_radius_x, subset_radius_y, subset_radius_z, cur_instance->tar_subset->vol_mat);
+				float tar_mean_norm = cur_instance->tar_subset->zeroMeanNorm();
+
+				//calculate error image
+				float error_factor = ref_mean_norm / tar_mean_norm;
+				float squared_sum = 0;
+				const float* tar_voxel = cur_instance->tar_subset->vol_mat.data;
+				const float* ref_voxel = cur_instance->ref_subset->vol_mat.data;
+				float* error_voxel = cur_instance->error_img.data;
+				int subset_size = cur_instance->ref_subset->size;
+				for (int i = 0; i < subset_size; i++)
 				{
-					for (int j = 0; j < 12; j++)
-					{
-						dp[i] += (cur_instance->inv_hessian(i, j) * numerator[j]);
-					}
+					error_voxel[i] = error_factor * tar_voxel[i] - ref_voxel[i];
+					squared_sum += (error_voxel[i] * error_voxel[i]);
 				}
-				p_increment.setDeformation(dp);
+
+				//calculate ZNSSD
+				znssd = squared_sum / (ref_mean_norm * ref_mean_norm);
+
+				//calculate numerator
+				Vector30f numerator;
+				getNumerator(cur_instance->sd_img, cur_instance->error_img.data, numerator);
+
+				//calculate dp
+				Vector30f dp = cur_instance->inv_hessian * numerator;
+				p_increment.setDeformation(dp.data());
 
 				//update warp
 				p_current.warp_matrix = p_current.warp_matrix * p_increment.warp_matrix.inverse();
@@ -1173,10 +1495,11 @@ namespace opencorr
 		}
 	}
 
-	void ICGN3D1::compute(std::vector<POI3D>& poi_queue)
+	void ICGN3D2::compute(std::vector<POI3D>& poi_queue)
 	{
 		int queue_length = (int)poi_queue.size();
-#pragma omp parallel for
+		ScheduleScope schedule_scope(schedule_mode, schedule_chunk, queue_length);
+#pragma omp parallel for schedule(runtime)
 		for (int i = 0; i < queue_length; i++)
 		{
 			compute(&poi_queue[i]);
@@ -39,11 +39,26 @@ namespace opencorr
 		Subset2D* tar_subset;
 		Eigen::MatrixXf error_img;
 		Matrix6f hessian, inv_hessian;
-		float*** sd_img; //steepest descent image
+		RowMatrixX6f sd_img; //steepest descent image, one row per pixel of subset
 
 		static ICGN2D1_* allocate(int subset_radius_x, int subset_radius_y);
 		static void release(ICGN2D1_* instance);
 		static void update(ICGN2D1_* instance, int subset_radius_x, int subset_radius_y);
+
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW //fixed-size members may require alignment beyond that of operator new
+	};
+
+	//reference data of a POI, which depend only on the reference image and thus can be reused by a sequence of target images
+	class ICGN2D1Ref
+	{
+	public:
+		Point2D location; //location of POI, the data are valid only for the POI at the same location
+		float ref_mean_norm;
+		Eigen::MatrixXf ref_subset; //zero-mean reference subset
+		RowMatrixX6f sd_img; //steepest descent image, one row per pixel of subset
+		Matrix6f inv_hessian;
+
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 	};
 
 	class ICGN2D1 : public DIC
@@ -58,6 +73,14 @@ namespace opencorr
 		std::vector<ICGN2D1_*> instance_pool; //pool of instances for multi-thread processing
 		ICGN2D1_* getInstance(int tid); //get an instance according to the number of current thread id
 
+		std::vector<ICGN2D1Ref*> ref_cache; //cached reference data of POIs in queue, empty if not precomputed
+
+		//fill reference subset, build steepest descent image and inversed Hessian matrix in instance, return the norm of reference subset
+		float setReference(POI2D* poi, ICGN2D1_* instance);
+
+		//IC-GN iteration of a POI, the reference data are taken from poi_ref if it is not nullptr
+		void computeWithReference(POI2D* poi, ICGN2D1Ref* poi_ref);
+
 	public:
 		ICGN2D1(int subset_radius_x, int subset_radius_y, float conv_criterion, float stop_condition, int thread_number);
 		~ICGN2D1();
@@ -72,6 +95,11 @@ namespace opencorr
 		void setIteration(float conv_criterion, float stop_condition);
 		void setIteration(POI2D* poi);
 
+		//functions for image sequence, call prepareRef() and precomputeReference() once, then prepareTar() and compute() for each target image
+		//the reference data of POIs are cached only if they fit in the memory budget (in bytes), return true if the cache is built
+		bool precomputeReference(std::vector<POI2D>& poi_queue, size_t memory_budget);
+		void releaseReference();
+
 		//functions for self-adaptive subset
 		void compute(POI2D* poi, Point2D subset_radius);
 		void compute(std::vector<POI2D>& poi_queue, Point2D subset_radius);
@@ -90,11 +118,13 @@ namespace opencorr
 		Subset2D* tar_subset;
 		Eigen::MatrixXf error_img;
 		Matrix12f hessian, inv_hessian;
-		float*** sd_img;
+		RowMatrixX12f sd_img;
 
 		static ICGN2D2_* allocate(int subset_radius_x, int subset_radius_y);
 		static void release(ICGN2D2_* instance);
 		static void update(ICGN2D2_* instance, int subset_radius_x, int subset_radius_y);
+
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 	};
 
 	class ICGN2D2 : public DIC
@@ -135,13 +165,16 @@ namespace opencorr
 	public:
 		Subset3D* ref_subset;
 		Subset3D* tar_subset;
-		float*** error_img;
+		Volume3D error_img;
 		Matrix12f hessian, inv_hessian;
-		float**** sd_img; //steepest descent image
+		RowMatrixX12f sd_img; //steepest descent image, one row per voxel of subset
+		std::vector<float> gradient_row; //gradients along x, y and z of a row in ref subset, used in lazy mode
 
 		static ICGN3D1_* allocate(int subset_radius_x, int subset_radius_y, int subset_radius_z);
 		static void release(ICGN3D1_* instance);
 		static void update(ICGN3D1_* instance, int subset_radius_x, int subset_radius_y, int subset_radius_z);
+
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 	};
 
 	class ICGN3D1 : public DVC
@@ -152,6 +185,7 @@ namespace opencorr
 
 		float conv_criterion; //convergence criterion: norm of maximum displacement increment in subset
 		float stop_condition; //stop condition: max iteration
+		bool lazy_gradient; //gradients of ref image are calculated for each subset instead of the whole image
 
 		std::vector<ICGN3D1_*> instance_pool; //pool of instances for multi-thread processing
 		ICGN3D1_* getInstance(int tid); //get an instance according to the number of current thread id
@@ -170,6 +204,65 @@ namespace opencorr
 
 		void setIteration(float conv_criterion, float stop_condition);
 		void setIteration(POI3D* poi);
+
+		//calculate the gradients of ref image within each subset on demand, which saves the memory and time
+		//of three gradient volumes in prepareRef(), preferred for the POIs sparsely distributed in a large volume
+		void setLazyGradient(bool lazy_gradient);
+	};
+
+
+
+	//3D IC-GN with the 2nd order shape function, following the 2D counterpart of
+	//Y. Gao et al, Optics and Lasers in Engineering (2015) 65: 73-80.
+	//https://doi.org/10.1016/j.optlaseng.2014.05.013
+
+	class ICGN3D2_
+	{
+	public:
+		Subset3D* ref_subset;
+		Subset3D* tar_subset;
+		Volume3D error_img;
+		Matrix30f hessian, inv_hessian;
+		RowMatrixX30f sd_img; //steepest descent image, one row per voxel of subset
+		std::vector<float> gradient_row; //gradients along x, y and z of a row in ref subset, used in lazy mode
+
+		static ICGN3D2_* allocate(int subset_radius_x, int subset_radius_y, int subset_radius_z);
+		static void release(ICGN3D2_* instance);
+		static void update(ICGN3D2_* instance, int subset_radius_x, int subset_radius_y, int subset_radius_z);
+
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+	};
+
+	class ICGN3D2 : public DVC
+	{
+	private:
+		Interpolation3D* tar_interp;
+		Gradient3D4* ref_gradient;
+
+		float conv_criterion;
+		float stop_condition;
+		bool lazy_gradient;
+
+		std::vector<ICGN3D2_*> instance_pool;
+		ICGN3D2_* getInstance(int tid);
+
+	public:
+		ICGN3D2(int subset_radius_x, int subset_radius_y, int subset_radius_z,
+			float conv_criterion, float stop_condition, int thread_number);
+		~ICGN3D2();
+
+		void prepareRef();
+		void prepareTar();
+		void prepare();
+
+		//the initial guess is taken from the 1st order deformation of POI, only the 1st order components of result
+		//are written back, as POI3D keeps 12 components
+		void compute(POI3D* poi);
+		void compute(std::vector<POI3D>& poi_queue);
+
+		void setIteration(float conv_criterion, float stop_condition);
+		void setIteration(POI3D* poi);
+		void setLazyGradient(bool lazy_gradient);
 	};
 
 }//namespace opencorr
@@ -71,11 +71,11 @@ namespace opencorr
 	//3D image
 	Image3D::Image3D(int dim_x, int dim_y, int dim_z)
 	{
-		vol_mat = new3D(dim_z, dim_y, dim_x);
+		vol_mat.allocate(dim_x, dim_y, dim_z);
 		this->dim_x = dim_x;
 		this->dim_y = dim_y;
 		this->dim_z = dim_z;
-		size = dim_z * dim_y * dim_x;
+		size = vol_mat.size();
 	}
 
 	Image3D::Image3D(std::string file_path)
@@ -97,21 +97,32 @@ namespace opencorr
 		}
 	}
 
-	Image3D::~Image3D()
+	Image3D::Image3D(std::string file_path, PageInPolicy policy)
 	{
-		if (vol_mat != nullptr)
+		//check if the file is a bin or tiff
+		size_t dot_pos = file_path.find_last_of(".");
+		std::string file_ext = file_path.substr(dot_pos + 1);
+		if (file_ext == "bin" || file_ext == "BIN")
+		{
+			mapBin(file_path, policy);
+		}
+		else if (file_ext == "tif" || file_ext == "TIF" || file_ext == "tiff" || file_ext == "TIFF")
+		{
+			loadTiff(file_path);
+		}
+		else
 		{
-			delete3D(vol_mat);
+			std::cerr << "Not binary file or multi-page tiff" << std::endl;
 		}
 	}
 
-	void Image3D::loadBin(std::string file_path)
+	Image3D::~Image3D()
 	{
-		if (vol_mat != nullptr)
-		{
-			delete3D(vol_mat);
-		}
+		vol_mat.release();
+	}
 
+	void Image3D::loadBin(std::string file_path)
+	{
 		std::ifstream file_in;
 		file_in.open(file_path, std::ios::in | std::ios::binary);
 
@@ -122,11 +133,11 @@ namespace opencorr
 
 		this->file_path = file_path;
 
-		//get the length of data
+		//get the length of data, which may exceed the range of int
 		file_in.seekg(0, file_in.end);
-		int file_length = file_in.tellg();
+		long long file_length = (long long)file_in.tellg();
 		file_in.seekg(0, file_in.beg);
-		int data_length = file_length - sizeof(int) * 3;
+		long long data_length = file_length - (long long)sizeof(int) * 3;
 
 		//head information is an array of int[3]: dimension of x, y, and z
 		int img_dimension[3];
@@ -134,22 +145,54 @@ namespace opencorr
 		dim_x = img_dimension[0];
 		dim_y = img_dimension[1];
 		dim_z = img_dimension[2];
-		size = dim_z * dim_y * dim_x;
+		size = (unsigned long long)dim_z * dim_y * dim_x;
+		if (data_length < (long long)(sizeof(float) * size))
+		{
+			std::cerr << "Incomplete bin file: " << file_path << std::endl;
+		}
 
-		//create a 3D matrix and fill it with the data (float) in binary file
-		vol_mat = new3D(dim_z, dim_y, dim_x);
-		file_in.read((char*)**vol_mat, sizeof(float) * size);
+		//create a 3D matrix and fill it with the data (float) in binary file, slice by slice
+		vol_mat.allocate(dim_x, dim_y, dim_z);
+		for (int i = 0; i < dim_z; i++)
+		{
+			file_in.read((char*)vol_mat.row(i, 0), (std::streamsize)sizeof(float) * dim_y * dim_x);
+		}
 
 		file_in.close();
 	}
 
-	void Image3D::loadTiff(std::string file_path)
+	void Image3D::mapBin(std::string file_path, PageInPolicy policy)
 	{
-		if (vol_mat != nullptr)
+		std::ifstream file_in;
+		file_in.open(file_path, std::ios::in | std::ios::binary);
+
+		if (!file_in.is_open())
+		{
+			std::cerr << "Failed to open bin file: " << file_path << std::endl;
+			return;
+		}
+
+		this->file_path = file_path;
+
+		//head information is an array of int[3]: dimension of x, y, and z
+		int img_dimension[3];
+		file_in.read((char*)img_dimension, sizeof(int) * 3);
+		file_in.close();
+		dim_x = img_dimension[0];
+		dim_y = img_dimension[1];
+		dim_z = img_dimension[2];
+		size = (unsigned long long)dim_z * dim_y * dim_x;
+
+		//the voxels (float) following the head are used in place, the file is copied only if it can not be mapped
+		if (!vol_mat.map(file_path, sizeof(int) * 3, dim_x, dim_y, dim_z, policy))
 		{
-			delete3D(vol_mat);
+			std::cerr << "Failed to map bin file, load it instead: " << file_path << std::endl;
+			loadBin(file_path);
 		}
+	}
 
+	void Image3D::loadTiff(std::string file_path)
+	{
 		//read a tiff image consisting of multiple pages and store it in a vector of cv::Mat
 		std::vector<cv::Mat> tiff_mat;
 		if (!cv::imreadmulti(file_path, tiff_mat, cv::IMREAD_GRAYSCALE))
@@ -161,18 +204,19 @@ namespace opencorr
 		dim_x = tiff_mat[0].cols;
 		dim_y = tiff_mat[0].rows;
 		dim_z = (int)tiff_mat.size();
-		size = dim_z * dim_y * dim_x;
+		size = (unsigned long long)dim_z * dim_y * dim_x;
 
 		//create a 3D matrix and fill it with the data ifnTIFF
-		vol_mat = new3D(dim_z, dim_y, dim_x);
+		vol_mat.allocate(dim_x, dim_y, dim_z);
 
 #pragma omp parallel for
 		for (int i = 0; i < dim_z; i++)
 		{
 			for (int j = 0; j < dim_y; j++)
 			{
+				float* vol_row = vol_mat.row(i, j);
 				for (int k = 0; k < dim_x; k++) {
-					vol_mat[i][j][k] = (float)tiff_mat[i].at<uchar>(j, k);
+					vol_row[k] = (float)tiff_mat[i].at<uchar>(j, k);
 				}
 			}
 		}
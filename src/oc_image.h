@@ -48,17 +48,19 @@ namespace opencorr
 	{
 	public:
 		int dim_x, dim_y, dim_z;
-		unsigned long size;
+		unsigned long long size;
 
 		std::string file_path;
 
-		float*** vol_mat = nullptr;
+		Volume3D vol_mat; //contiguous, voxel (x, y, z) is accessed as vol_mat[z][y][x]
 
 		Image3D(int dim_x, int dim_y, int dim_z);
 		Image3D(std::string file_path);
+		Image3D(std::string file_path, PageInPolicy policy); //bin file is mapped instead of loaded
 		~Image3D();
 
 		void loadBin(std::string file_path);
+		void mapBin(std::string file_path, PageInPolicy policy = PAGE_IN_LAZY); //map bin file to memory without copy
 		void loadTiff(std::string file_path);
 		void load(std::string file_path);
 	};
@@ -0,0 +1,105 @@
+/*
+ * This file is part of OpenCorr, an open source C++ library for
+ * study and development of 2D, 3D/stereo and volumetric
+ * digital image correlation.
+ *
+ * Copyright (C) 2021-2024, Zhenyu Jiang <zhenyujiang@scut.edu.cn>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one from http://mozilla.org/MPL/2.0/.
+ *
+ * More information about OpenCorr can be found at https://www.opencorr.org/
+ */
+
+#include "oc_interpolation.h"
+
+namespace opencorr
+{
+	void Interpolation2D::computeSubset(Deformation2D1& deformation, Point2D& center, int radius_x, int radius_y, Eigen::MatrixXf& subset)
+	{
+		int subset_width = 2 * radius_x + 1;
+		int subset_height = 2 * radius_y + 1;
+		Point2D local_coor, warped_coor, global_coor;
+
+		for (int r = 0; r < subset_height; r++)
+		{
+			for (int c = 0; c < subset_width; c++)
+			{
+				local_coor.x = c - radius_x;
+				local_coor.y = r - radius_y;
+				warped_coor = deformation.warp(local_coor);
+				global_coor = center + warped_coor;
+				subset(r, c) = compute(global_coor);
+			}
+		}
+	}
+
+	void Interpolation2D::computeSubset(Deformation2D2& deformation, Point2D& center, int radius_x, int radius_y, Eigen::MatrixXf& subset)
+	{
+		int subset_width = 2 * radius_x + 1;
+		int subset_height = 2 * radius_y + 1;
+		Point2D local_coor, warped_coor, global_coor;
+
+		for (int r = 0; r < subset_height; r++)
+		{
+			for (int c = 0; c < subset_width; c++)
+			{
+				local_coor.x = c - radius_x;
+				local_coor.y = r - radius_y;
+				warped_coor = deformation.warp(local_coor);
+				global_coor = center + warped_coor;
+				subset(r, c) = compute(global_coor);
+			}
+		}
+	}
+
+	void Interpolation3D::computeSubset(Deformation3D1& deformation, Point3D& center, int radius_x, int radius_y, int radius_z, Volume3D& subset)
+	{
+		int subset_dim_x = 2 * radius_x + 1;
+		int subset_dim_y = 2 * radius_y + 1;
+		int subset_dim_z = 2 * radius_z + 1;
+		Point3D local_coor, warped_coor, global_coor;
+
+		for (int i = 0; i < subset_dim_z; i++)
+		{
+			for (int j = 0; j < subset_dim_y; j++)
+			{
+				for (int k = 0; k < subset_dim_x; k++)
+				{
+					local_coor.x = k - radius_x;
+					local_coor.y = j - radius_y;
+					local_coor.z = i - radius_z;
+					warped_coor = deformation.warp(local_coor);
+					global_coor = center + warped_coor;
+					subset[i][j][k] = compute(global_coor);
+				}
+			}
+		}
+	}
+
+	void Interpolation3D::computeSubset(Deformation3D2& deformation, Point3D& center, int radius_x, int radius_y, int radius_z, Volume3D& subset)
+	{
+		int subset_dim_x = 2 * radius_x + 1;
+		int subset_dim_y = 2 * radius_y + 1;
+		int subset_dim_z = 2 * radius_z + 1;
+		Point3D local_coor, warped_coor, global_coor;
+
+		for (int i = 0; i < subset_dim_z; i++)
+		{
+			for (int j = 0; j < subset_dim_y; j++)
+			{
+				for (int k = 0; k < subset_dim_x; k++)
+				{
+					local_coor.x = k - radius_x;
+					local_coor.y = j - radius_y;
+					local_coor.z = i - radius_z;
+					warped_coor = deformation.warp(local_coor);
+					global_coor = center + warped_coor;
+					subset[i][j][k] = compute(global_coor);
+				}
+			}
+		}
+	}
+
+}//namespace opencorr
@@ -18,6 +18,7 @@
 #define _INTERPOLATION_H_
 
 #include "oc_array.h"
+#include "oc_deformation.h"
 #include "oc_image.h"
 #include "oc_point.h"
 
@@ -32,8 +33,14 @@ namespace opencorr
 	public:
 		virtual ~Interpolation2D() = default;
 
+		virtual void setImage(Image2D& image) = 0;
 		virtual void prepare() = 0;
 		virtual float compute(Point2D& location) = 0;
+
+		//reconstruct the warped subset around center in one call, the size of subset is (2 * radius_y + 1) x (2 * radius_x + 1)
+		//the default implementation samples the pixels one by one
+		virtual void computeSubset(Deformation2D1& deformation, Point2D& center, int radius_x, int radius_y, Eigen::MatrixXf& subset);
+		virtual void computeSubset(Deformation2D2& deformation, Point2D& center, int radius_x, int radius_y, Eigen::MatrixXf& subset);
 	};
 
 	//3D
@@ -45,8 +52,14 @@ namespace opencorr
 	public:
 		virtual ~Interpolation3D() = default;
 
+		virtual void setImage(Image3D& image) = 0;
 		virtual void prepare() = 0;
 		virtual float compute(Point3D& location) = 0;
+
+		//reconstruct the warped subset around center in one call, the size of subset is
+		//(2 * radius_z + 1) x (2 * radius_y + 1) x (2 * radius_x + 1), the default implementation samples the voxels one by one
+		virtual void computeSubset(Deformation3D1& deformation, Point3D& center, int radius_x, int radius_y, int radius_z, Volume3D& subset);
+		virtual void computeSubset(Deformation3D2& deformation, Point3D& center, int radius_x, int radius_y, int radius_z, Volume3D& subset);
 	};
 
 }//namespace opencorr
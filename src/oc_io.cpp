@@ -19,6 +19,87 @@
 
 namespace opencorr
 {
+	//write a map as a text table, one row of image per line
+	static void writeMap2D(string& file_path, string& delimiter, Eigen::MatrixXf& output_map)
+	{
+		std::ofstream file_out(file_path);
+		file_out.setf(std::ios::fixed);
+		file_out << std::setprecision(8);
+		if (file_out.is_open())
+		{
+			for (int r = 0; r < output_map.rows(); r++)
+			{
+				for (int c = 0; c < output_map.cols(); c++)
+				{
+					file_out << output_map(r, c) << delimiter;
+				}
+				file_out << std::endl;
+			}
+		}
+		file_out.close();
+	}
+
+	//write a map as a text table, one row of volume per line and an empty line after each slice
+	static void writeMap3D(string& file_path, string& delimiter, Volume3D& output_map)
+	{
+		std::ofstream file_out(file_path);
+		file_out.setf(std::ios::fixed);
+		file_out << std::setprecision(8);
+
+		if (file_out.is_open())
+		{
+			for (int i = 0; i < output_map.dim_z; i++)
+			{
+				for (int j = 0; j < output_map.dim_y; j++)
+				{
+					for (int k = 0; k < output_map.dim_x; k++)
+					{
+						file_out << output_map[i][j][k] << delimiter;
+					}
+					file_out << std::endl;
+				}
+				file_out << std::endl;
+			}
+		}
+		file_out.close();
+	}
+
+	//column of POI field holding the variable of map, -1 for an unknown variable
+	static int mapColumn2D(char variable)
+	{
+		switch (variable)
+		{
+		case 'u': return PoiField2D::deformation_column;
+		case 'v': return PoiField2D::deformation_column + 6;
+		case 'c': return PoiField2D::result_column + 2; //ZNCC value
+		case 'd': return PoiField2D::result_column + 4; //final ||delta_p||
+		case 'i': return PoiField2D::result_column + 3; //iteration steps
+		case 'f': return PoiField2D::result_column + 5; //number of neighbor features
+		case 'x': return PoiField2D::strain_column; //strain exx
+		case 'y': return PoiField2D::strain_column + 1; //strain eyy
+		case 'r': return PoiField2D::strain_column + 2; //strain exy
+		default: return -1;
+		}
+	}
+
+	static int mapColumn3D(char variable)
+	{
+		switch (variable)
+		{
+		case 'u': return PoiField3D::deformation_column;
+		case 'v': return PoiField3D::deformation_column + 4;
+		case 'w': return PoiField3D::deformation_column + 8;
+		case 'c': return PoiField3D::result_column + 3; //ZNCC value
+		case 'x': return PoiField3D::strain_column; //strain exx
+		case 'y': return PoiField3D::strain_column + 1; //strain eyy
+		case 'z': return PoiField3D::strain_column + 2; //strain ezz
+		case 'r': return PoiField3D::strain_column + 3; //strain exy
+		case 's': return PoiField3D::strain_column + 4; //strain eyz
+		case 't': return PoiField3D::strain_column + 5; //strain ezx
+		default: return -1;
+		}
+	}
+
 	IO2D::IO2D() {}
 
 	IO2D::~IO2D() {}
@@ -352,21 +433,28 @@ namespace opencorr
 			return;
 		}
 
-		std::ofstream file_out(file_path);
-		file_out.setf(std::ios::fixed);
-		file_out << std::setprecision(8);
-		if (file_out.is_open())
+		writeMap2D(file_path, delimiter, output_map);
+	}
+
+	void IO2D::saveMap2D(PoiField2D& field, char variable)
+	{
+		int col = mapColumn2D(variable);
+		if (col < 0)
 		{
-			for (int r = 0; r < height; r++)
-			{
-				for (int c = 0; c < width; c++)
-				{
-					file_out << output_map(r, c) << delimiter;
-				}
-				file_out << std::endl;
-			}
+			return;
 		}
-		file_out.close();
+
+		//only the columns of location and the variable are read
+		Eigen::MatrixXf output_map = Eigen::MatrixXf::Zero(getHeight(), getWidth());
+		const float* x = field.x();
+		const float* y = field.y();
+		const float* value = field.column(col);
+		for (int i = 0; i < field.size(); i++)
+		{
+			output_map((int)y[i], (int)x[i]) = value[i];
+		}
+
+		writeMap2D(file_path, delimiter, output_map);
 	}
 
 	vector<POI2DS> IO2D::loadTable2DS()
@@ -631,6 +719,82 @@ namespace opencorr
 		file_out.close();
 	}
 
+	void IO2D::saveFieldBin(PoiField2D& field)
+	{
+		std::ofstream file_out;
+		file_out.open(file_path, std::ios::out | std::ios::binary);
+
+		if (!file_out.is_open())
+		{
+			std::cerr << "failed to open file " << file_path << std::endl;
+			return;
+		}
+
+		//head information, including the number of POIs, the number of columns and the two dimensions of image
+		int head_info[4];
+		head_info[0] = field.size();
+		head_info[1] = PoiField2D::column_number;
+		head_info[2] = width;
+		head_info[3] = height;
+		file_out.write((char*)head_info, sizeof(head_info[0]) * 4);
+
+		//write the columns one after another, without padding
+		for (int i = 0; i < PoiField2D::column_number; i++)
+		{
+			file_out.write((char*)field.column(i), sizeof(float) * field.size());
+		}
+
+		file_out.close();
+	}
+
+	PoiField2D IO2D::loadFieldBin()
+	{
+		PoiField2D field;
+
+		std::ifstream file_in(file_path, std::ios::in | std::ios::binary);
+		if (!file_in)
+		{
+			std::cerr << "failed to open file " << file_path << std::endl;
+			return field;
+		}
+
+		//read head information
+		int head_info[4];
+		file_in.read((char*)head_info, sizeof(head_info[0]) * 4);
+		if (!file_in || head_info[0] < 0 || head_info[1] != PoiField2D::column_number)
+		{
+			std::cerr << "unrecognized POI field in file " << file_path << std::endl;
+			return field;
+		}
+
+		//the number of POIs must agree with the length of file
+		std::streamoff head_length = file_in.tellg();
+		file_in.seekg(0, std::ios::end);
+		std::streamoff column_length = (std::streamoff)sizeof(float) * head_info[0];
+		if (file_in.tellg() - head_length != column_length * PoiField2D::column_number)
+		{
+			std::cerr << "size of POI field does not match the length of file " << file_path << std::endl;
+			return field;
+		}
+		file_in.seekg(head_length, std::ios::beg);
+		setWidth(head_info[2]);
+		setHeight(head_info[3]);
+
+		field.allocate(head_info[0]);
+		for (int i = 0; i < PoiField2D::column_number; i++)
+		{
+			file_in.read((char*)field.column(i), sizeof(float) * field.size());
+		}
+		if (!file_in)
+		{
+			std::cerr << "failed to read POI field from file " << file_path << std::endl;
+			field.release();
+		}
+		file_in.close();
+
+		return field;
+	}
+
 
 	IO3D::IO3D() {}
 
@@ -926,7 +1090,7 @@ namespace opencorr
 	void IO3D::saveMap3D(vector<POI3D>& poi_queue, char variable)
 	{
 		int queue_length = (int)poi_queue.size();
-		float*** output_map = new3D(getDimZ(), getDimY(), getDimX());
+		Volume3D output_map(getDimX(), getDimY(), getDimZ());
 
 		switch (variable)
 		{
@@ -994,26 +1158,29 @@ namespace opencorr
 			return;
 		}
 
-		std::ofstream file_out(file_path);
-		file_out.setf(std::ios::fixed);
-		file_out << std::setprecision(8);
+		writeMap3D(file_path, delimiter, output_map);
+	}
 
-		if (file_out.is_open())
+	void IO3D::saveMap3D(PoiField3D& field, char variable)
+	{
+		int col = mapColumn3D(variable);
+		if (col < 0)
 		{
-			for (int i = 0; i < getDimZ(); i++)
-			{
-				for (int j = 0; j < getDimY(); j++)
-				{
-					for (int k = 0; k < getDimX(); k++)
-					{
-						file_out << output_map[i][j][k] << delimiter;
-					}
-					file_out << std::endl;
-				}
-				file_out << std::endl;
-			}
+			return;
 		}
-		file_out.close();
+
+		//only the columns of location and the variable are read
+		Volume3D output_map(getDimX(), getDimY(), getDimZ());
+		const float* x = field.x();
+		const float* y = field.y();
+		const float* z = field.z();
+		const float* value = field.column(col);
+		for (int i = 0; i < field.size(); i++)
+		{
+			output_map[(int)z[i]][(int)y[i]][(int)x[i]] = value[i];
+		}
+
+		writeMap3D(file_path, delimiter, output_map);
 	}
 
 	void IO3D::saveMatrixBin(vector<POI3D>& poi_queue)
@@ -1103,4 +1270,82 @@ namespace opencorr
 		return poi_queue;
 	}
 
+	void IO3D::saveFieldBin(PoiField3D& field)
+	{
+		std::ofstream file_out;
+		file_out.open(file_path, std::ios::out | std::ios::binary);
+
+		if (!file_out.is_open())
+		{
+			std::cerr << "failed to open file " << file_path << std::endl;
+			return;
+		}
+
+		//head information, including the number of POIs, the number of columns and the three dimensions of image
+		int head_info[5];
+		head_info[0] = field.size();
+		head_info[1] = PoiField3D::column_number;
+		head_info[2] = dim_x;
+		head_info[3] = dim_y;
+		head_info[4] = dim_z;
+		file_out.write((char*)head_info, sizeof(head_info[0]) * 5);
+
+		//write the columns one after another, without padding
+		for (int i = 0; i < PoiField3D::column_number; i++)
+		{
+			file_out.write((char*)field.column(i), sizeof(float) * field.size());
+		}
+
+		file_out.close();
+	}
+
+	PoiField3D IO3D::loadFieldBin()
+	{
+		PoiField3D field;
+
+		std::ifstream file_in(file_path, std::ios::in | std::ios::binary);
+		if (!file_in)
+		{
+			std::cerr << "failed to open file " << file_path << std::endl;
+			return field;
+		}
+
+		//read head information
+		int head_info[5];
+		file_in.read((char*)head_info, sizeof(head_info[0]) * 5);
+		if (!file_in || head_info[0] < 0 || head_info[1] != PoiField3D::column_number)
+		{
+			std::cerr << "unrecognized POI field in file " << file_path << std::endl;
+			return field;
+		}
+
+		//the number of POIs must agree with the length of file
+		std::streamoff head_length = file_in.tellg();
+		file_in.seekg(0, std::ios::end);
+		std::streamoff column_length = (std::streamoff)sizeof(float) * head_info[0];
+		if (file_in.tellg() - head_length != column_length * PoiField3D::column_number)
+		{
+			std::cerr << "size of POI field does not match the length of file " << file_path << std::endl;
+			return field;
+		}
+		file_in.seekg(head_length, std::ios::beg);
+		setDimX(head_info[2]);
+		setDimY(head_info[3]);
+		setDimZ(head_info[4]);
+
+		field.allocate(head_info[0]);
+		for (int i = 0; i < PoiField3D::column_number; i++)
+		{
+			file_in.read((char*)field.column(i), sizeof(float) * field.size());
+		}
+		if (!file_in)
+		{
+			std::cerr << "failed to read POI field from file " << file_path << std::endl;
+			field.release();
+		}
+		file_in.close();
+
+		return field;
+	}
+
 }//namespace opencorr
\ No newline at end of file
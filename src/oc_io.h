@@ -21,6 +21,7 @@
 #include <vector>
 
 #include "oc_poi.h"
+#include "oc_poi_field.h"
 
 using std::vector;
 using std::string;
@@ -59,6 +60,7 @@ namespace opencorr
 
 		//variable: 'u', 'v', 'c'(zncc), 'd'(convergence), 'i'(iteration), 'f'(feature), 'x' (exx), 'y' (eyy), 'r' (exy)
 		void saveMap2D(vector<POI2D>& poi_queue, char variable);
+		void saveMap2D(PoiField2D& field, char variable); //only the columns of location and the variable are read
 
 		//load deformation of POIs from saved date table
 		vector<POI2DS> loadTable2DS();
@@ -67,6 +69,10 @@ namespace opencorr
 
 		//variable: 'u', 'v', 'w', 'c'(r1r2_zncc), 'd'(r1t1_zncc), 'e'(r1t2_zncc), 'x' (exx), 'y' (eyy), 'z' (ezz), 'r' (exy) , 's' (eyz), 't' (ezx)
 		void saveMap2DS(vector<POI2DS>& poi_queue, char variable);
+
+		//save and load the columns of POI field into a binary file, the columns are written and read in place
+		void saveFieldBin(PoiField2D& field);
+		PoiField2D loadFieldBin();
 	};
 
 	class IO3D
@@ -102,11 +108,16 @@ namespace opencorr
 
 		//variable: 'u', 'v', 'w', 'c'(zncc), 'x' (exx), 'y' (eyy), 'z' (ezz), 'r' (exy) , 's' (eyz), 't' (ezx)
 		void saveMap3D(vector<POI3D>& poi_queue, char variable);
+		void saveMap3D(PoiField3D& field, char variable); //only the columns of location and the variable are read
 
 		//save and load deformation of POIs into a binary matrix
 		void saveMatrixBin(vector<POI3D>& poi_queue);
 		vector<POI3D> loadMatrixBin();
 
+		//save and load the columns of POI field into a binary file, the columns are written and read in place
+		void saveFieldBin(PoiField3D& field);
+		PoiField3D loadFieldBin();
+
 	};
 
 }//namespace opencorr
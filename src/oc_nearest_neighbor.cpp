@@ -100,19 +100,22 @@ namespace opencorr
 
 	void NearestNeighbor::constructKdTree()
 	{
-		// construct a kd-tree index
+		//construct a kd-tree index, the previous one is discarded
+		if (kdt_index != nullptr)
+		{
+			delete kdt_index;
+		}
+
 		using kdTree = nanoflann::KDTreeSingleIndexAdaptor<nanoflann::L2_Simple_Adaptor<float, PointCloud>, PointCloud, 3>;
 
 		kdt_index = new kdTree(3 /*dim*/, point_cloud, { 10 /* max leaf */ });
 	}
 
-	int NearestNeighbor::radiusSearch(Point3D query_point, std::vector<nanoflann::ResultItem<uint32_t, float>>& matches)
+	int NearestNeighbor::radiusSearch(Point3D query_point, std::vector<nanoflann::ResultItem<uint32_t, float>>& matches) const
 	{
 		float squared_radius = search_radius * search_radius;
 
-		query_coor[0] = query_point.x;
-		query_coor[1] = query_point.y;
-		query_coor[2] = query_point.z;
+		float query_coor[3] = { query_point.x, query_point.y, query_point.z };
 
 		nanoflann::SearchParameters params;
 		params.sorted = false;
@@ -122,13 +125,11 @@ namespace opencorr
 		return num_matches;
 	}
 
-	int NearestNeighbor::radiusSearch(Point3D query_point, float search_radius, std::vector<nanoflann::ResultItem<uint32_t, float>>& matches)
+	int NearestNeighbor::radiusSearch(Point3D query_point, float search_radius, std::vector<nanoflann::ResultItem<uint32_t, float>>& matches) const
 	{
 		float squared_radius = search_radius * search_radius;
 
-		query_coor[0] = query_point.x;
-		query_coor[1] = query_point.y;
-		query_coor[2] = query_point.z;
+		float query_coor[3] = { query_point.x, query_point.y, query_point.z };
 
 		nanoflann::SearchParameters params;
 		params.sorted = false;
@@ -138,14 +139,12 @@ namespace opencorr
 		return num_matches;
 	}
 
-	int NearestNeighbor::knnSearch(Point3D query_point, std::vector<uint32_t>& k_neighbors_idx, std::vector<float>& kp_squared_distance)
+	int NearestNeighbor::knnSearch(Point3D query_point, std::vector<uint32_t>& k_neighbors_idx, std::vector<float>& kp_squared_distance) const
 	{
 		k_neighbors_idx.resize(search_k);
 		kp_squared_distance.resize(search_k);
 
-		query_coor[0] = query_point.x;
-		query_coor[1] = query_point.y;
-		query_coor[2] = query_point.z;
+		float query_coor[3] = { query_point.x, query_point.y, query_point.z };
 
 		int num_matches = (int)kdt_index->knnSearch(&query_coor[0], search_k, &k_neighbors_idx[0], &kp_squared_distance[0]);
 
@@ -156,14 +155,12 @@ namespace opencorr
 		return num_matches;
 	}
 
-	int NearestNeighbor::knnSearch(Point3D query_point, int search_k, std::vector<uint32_t>& k_neighbors_idx, std::vector<float>& kp_squared_distance)
+	int NearestNeighbor::knnSearch(Point3D query_point, int search_k, std::vector<uint32_t>& k_neighbors_idx, std::vector<float>& kp_squared_distance) const
 	{
 		k_neighbors_idx.resize(search_k);
 		kp_squared_distance.resize(search_k);
 
-		query_coor[0] = query_point.x;
-		query_coor[1] = query_point.y;
-		query_coor[2] = query_point.z;
+		float query_coor[3] = { query_point.x, query_point.y, query_point.z };
 
 		int num_matches = (int)kdt_index->knnSearch(&query_coor[0], search_k, &k_neighbors_idx[0], &kp_squared_distance[0]);
 
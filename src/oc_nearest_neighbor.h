@@ -67,15 +67,15 @@ namespace opencorr
 		}
 	};
 
+	//the queries do not modify the instance, thus one kd-tree can be shared by all the CPU threads once it is constructed
 	class NearestNeighbor
 	{
 	protected:
 		PointCloud point_cloud;
 		float search_radius;
 		int search_k;
-		float query_coor[3] = { 0.f };
 
-		nanoflann::KDTreeSingleIndexAdaptor<nanoflann::L2_Simple_Adaptor<float, PointCloud>, PointCloud, 3 /* dim */>* kdt_index;
+		nanoflann::KDTreeSingleIndexAdaptor<nanoflann::L2_Simple_Adaptor<float, PointCloud>, PointCloud, 3 /* dim */>* kdt_index = nullptr;
 
 	public:
 		NearestNeighbor();
@@ -93,11 +93,12 @@ namespace opencorr
 
 		void constructKdTree();
 
-		int radiusSearch(Point3D query_point, std::vector<nanoflann::ResultItem<uint32_t, float>>& matches);
-		int radiusSearch(Point3D query_point, float search_radius, std::vector<nanoflann::ResultItem<uint32_t, float>>& matches);
+		//the results are written into the buffers provided by caller, e.g. local variables of each CPU thread
+		int radiusSearch(Point3D query_point, std::vector<nanoflann::ResultItem<uint32_t, float>>& matches) const;
+		int radiusSearch(Point3D query_point, float search_radius, std::vector<nanoflann::ResultItem<uint32_t, float>>& matches) const;
 
-		int knnSearch(Point3D query_point, std::vector<uint32_t>& k_neighbors_idx, std::vector<float>& kp_squared_distance);
-		int knnSearch(Point3D query_point, int search_k, std::vector<uint32_t>& k_neighbors_idx, std::vector<float>& kp_squared_distance);
+		int knnSearch(Point3D query_point, std::vector<uint32_t>& k_neighbors_idx, std::vector<float>& kp_squared_distance) const;
+		int knnSearch(Point3D query_point, int search_k, std::vector<uint32_t>& k_neighbors_idx, std::vector<float>& kp_squared_distance) const;
 	};
 
 }//namespace opencorr
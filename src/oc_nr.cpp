@@ -28,26 +28,19 @@ namespace opencorr
 		NR_instance->tar_gradient_x = Eigen::MatrixXf::Zero(subset_height, subset_width);
 		NR_instance->tar_gradient_y = Eigen::MatrixXf::Zero(subset_height, subset_width);
 		NR_instance->error_img = Eigen::MatrixXf::Zero(subset_height, subset_width);
-		NR_instance->sd_img = new3D(subset_height, subset_width, 6);
+		NR_instance->sd_img = RowMatrixX6f::Zero(subset_height * subset_width, 6);
 
 		return NR_instance;
 	}
 
 	void NR2D1_::release(NR2D1_* instance)
 	{
-		delete3D(instance->sd_img);
 		delete instance->ref_subset;
 		delete instance->tar_subset;
 	}
 
 	void NR2D1_::update(NR2D1_* instance, int subset_radius_x, int subset_radius_y)
 	{
-		if (instance->sd_img != nullptr)
-		{
-			delete3D(instance->sd_img);
-			instance->sd_img = nullptr;
-		}
-
 		if (instance->ref_subset != nullptr)
 		{
 			delete instance->ref_subset;
@@ -69,7 +62,7 @@ namespace opencorr
 		instance->tar_gradient_x.resize(subset_height, subset_width);
 		instance->tar_gradient_y.resize(subset_height, subset_width);
 		instance->error_img.resize(subset_height, subset_width);
-		instance->sd_img = new3D(subset_height, subset_width, 6);
+		instance->sd_img.resize(subset_height * subset_width, 6);
 	}
 
 	NR2D1_* NR2D1::getInstance(int tid)
@@ -137,16 +130,19 @@ namespace opencorr
 		tar_gradient->getGradientX();
 		tar_gradient->getGradientY();
 
-		//create interpolation coefficient table of tar image
+		//create interpolators of tar image and its gradients, each of them keeps only the control lattice
+		//(one float per pixel) instead of a full coefficient table (16 floats per pixel)
 		if (tar_interp != nullptr)
 		{
 			delete tar_interp;
 			tar_interp = nullptr;
 		}
-		tar_interp = new BicubicBspline(*tar_img);
-		tar_interp->prepare();
+		BicubicBspline* tar_interp_bspline = new BicubicBspline(*tar_img);
+		tar_interp_bspline->setLatticeMode(true);
+		tar_interp_bspline->prepare();
+		tar_interp = tar_interp_bspline;
 
-		//create interpolation coefficient table of gradient along x
+		//create interpolator of gradient along x
 		Image2D gradient_img(tar_img->width, tar_img->height);
 		gradient_img.eg_mat = tar_gradient->gradient_x;
 
@@ -155,10 +151,12 @@ namespace opencorr
 			delete tar_interp_x;
 			tar_interp_x = nullptr;
 		}
-		tar_interp_x = new BicubicBspline(gradient_img);
-		tar_interp_x->prepare();
+		BicubicBspline* tar_interp_x_bspline = new BicubicBspline(gradient_img);
+		tar_interp_x_bspline->setLatticeMode(true);
+		tar_interp_x_bspline->prepare();
+		tar_interp_x = tar_interp_x_bspline;
 
-		//create interpolation coefficient table of gradient along y
+		//create interpolator of gradient along y
 		gradient_img.eg_mat = tar_gradient->gradient_y;
 
 		if (tar_interp_y != nullptr)
@@ -166,8 +164,10 @@ namespace opencorr
 			delete tar_interp_y;
 			tar_interp_y = nullptr;
 		}
-		tar_interp_y = new BicubicBspline(gradient_img);
-		tar_interp_y->prepare();
+		BicubicBspline* tar_interp_y_bspline = new BicubicBspline(gradient_img);
+		tar_interp_y_bspline->setLatticeMode(true);
+		tar_interp_y_bspline->prepare();
+		tar_interp_y = tar_interp_y_bspline;
 	}
 
 	void NR2D1::compute(POI2D* poi)
@@ -208,51 +208,37 @@ namespace opencorr
 			{
 				iteration_counter++;
 				//reconstruct the subsets of warped target as well as the corresponding matrices of its gradients
-				for (int r = 0; r < subset_height; r++)
-				{
-					for (int c = 0; c < subset_width; c++)
-					{
-						int x_local = c - subset_radius_x;
-						int y_local = r - subset_radius_y;
-						Point2D local_coor(x_local, y_local);
-						Point2D warped_coor = p_current.warp(local_coor);
-						Point2D global_coor = cur_instance->tar_subset->center + warped_coor;
-
-						cur_instance->tar_subset->eg_mat(r, c) = tar_interp->compute(global_coor);
-						cur_instance->tar_gradient_x(r, c) = tar_interp_x->compute(global_coor);
-						cur_instance->tar_gradient_y(r, c) = tar_interp_y->compute(global_coor);
-					}
-				}
+				Point2D& center = cur_instance->tar_subset->center;
+				tar_interp->computeSubset(p_current, center, subset_radius_x, subset_radius_y, cur_instance->tar_subset->eg_mat);
+				tar_interp_x->computeSubset(p_current, center, subset_radius_x, subset_radius_y, cur_instance->tar_gradient_x);
+				tar_interp_y->computeSubset(p_current, center, subset_radius_x, subset_radius_y, cur_instance->tar_gradient_y);
 				float tar_mean_norm = cur_instance->tar_subset->zeroMeanNorm();
 
-				//build the Hessian matrix
-				cur_instance->hessian.setZero();
-				for (int r = 0; r < subset_height; r++)
+				//build the steepest descent image, one row per pixel taken column by column as in error_img
+				for (int c = 0; c < subset_width; c++)
 				{
-					for (int c = 0; c < subset_width; c++)
+					for (int r = 0; r < subset_height; r++)
 					{
 						int x_local = c - subset_radius_x;
 						int y_local = r - subset_radius_y;
 						float tar_grad_x = cur_instance->tar_gradient_x(r, c);
 						float tar_grad_y = cur_instance->tar_gradient_y(r, c);
 
-						cur_instance->sd_img[r][c][0] = tar_grad_x;
-						cur_instance->sd_img[r][c][1] = tar_grad_x * x_local;
-						cur_instance->sd_img[r][c][2] = tar_grad_x * y_local;
-						cur_instance->sd_img[r][c][3] = tar_grad_y;
-						cur_instance->sd_img[r][c][4] = tar_grad_y * x_local;
-						cur_instance->sd_img[r][c][5] = tar_grad_y * y_local;
-
-						for (int i = 0; i < 6; i++)
-						{
-							for (int j = 0; j < 6; j++)
-							{
-								cur_instance->hessian(i, j) += (cur_instance->sd_img[r][c][i] * cur_instance->sd_img[r][c][j]);
-							}
-						}
+						int pixel_index = c * subset_height + r;
+						cur_instance->sd_img(pixel_index, 0) = tar_grad_x;
+						cur_instance->sd_img(pixel_index, 1) = tar_grad_x * x_local;
+						cur_instance->sd_img(pixel_index, 2) = tar_grad_x * y_local;
+						cur_instance->sd_img(pixel_index, 3) = tar_grad_y;
+						cur_instance->sd_img(pixel_index, 4) = tar_grad_y * x_local;
+						cur_instance->sd_img(pixel_index, 5) = tar_grad_y * y_local;
 					}
 				}
 
+				//build the Hessian matrix with a rank-k update
+				cur_instance->hessian.setZero();
+				cur_instance->hessian.selfadjointView<Eigen::Lower>().rankUpdate(cur_instance->sd_img.transpose());
+				cur_instance->hessian.triangularView<Eigen::StrictlyUpper>() = cur_instance->hessian.transpose();
+
 				//calculate the inversed Hessian matrix
 				cur_instance->inv_hessian = cur_instance->hessian.inverse();
 
@@ -264,28 +250,12 @@ namespace opencorr
 				znssd = cur_instance->error_img.squaredNorm() / (tar_mean_norm * tar_mean_norm);
 
 				//calculate numerator
-				float numerator[6] = { 0.f };
-				for (int r = 0; r < subset_height; r++)
-				{
-					for (int c = 0; c < subset_width; c++)
-					{
-						for (int i = 0; i < 6; i++)
-						{
-							numerator[i] += (cur_instance->sd_img[r][c][i] * cur_instance->error_img(r, c));
-						}
-					}
-				}
+				Eigen::Map<Eigen::VectorXf> error_vector(cur_instance->error_img.data(), cur_instance->error_img.size());
+				Vector6f numerator = cur_instance->sd_img.transpose() * error_vector;
 
 				//calculate dp
-				float dp[6] = { 0.f };
-				for (int i = 0; i < 6; i++)
-				{
-					for (int j = 0; j < 6; j++)
-					{
-						dp[i] += (cur_instance->inv_hessian(i, j) * numerator[j]);
-					}
-				}
-				p_increment.setDeformation(dp);
+				Vector6f dp = cur_instance->inv_hessian * numerator;
+				p_increment.setDeformation(dp.data());
 
 				//update p
 				p_current.setDeformation(p_current.u + p_increment.u, p_current.ux + p_increment.ux, p_current.uy + p_increment.uy,
@@ -334,7 +304,8 @@ namespace opencorr
 	void NR2D1::compute(std::vector<POI2D>& poi_queue)
 	{
 		int queue_length = (int)poi_queue.size();
-#pragma omp parallel for
+		ScheduleScope schedule_scope(schedule_mode, schedule_chunk, queue_length);
+#pragma omp parallel for schedule(runtime)
 		for (int i = 0; i < queue_length; i++)
 		{
 			compute(&poi_queue[i]);
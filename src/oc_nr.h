@@ -41,11 +41,13 @@ namespace opencorr
 		Eigen::MatrixXf tar_gradient_y;
 		Eigen::MatrixXf error_img;
 		Matrix6f hessian, inv_hessian;
-		float*** sd_img; //steepest descent image
+		RowMatrixX6f sd_img; //steepest descent image, one row per pixel of subset
 
 		static NR2D1_* allocate(int subset_radius_x, int subset_radius_y);
 		static void release(NR2D1_* instance);
 		static void update(NR2D1_* instance, int subset_radius_x, int subset_radius_y);
+
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 	};
 
 	class NR2D1 : public DIC
@@ -0,0 +1,349 @@
+/*
+ * This file is part of OpenCorr, an open source C++ library for
+ * study and development of 2D, 3D/stereo and volumetric
+ * digital image correlation.
+ *
+ * Copyright (C) 2021-2024, Zhenyu Jiang <zhenyujiang@scut.edu.cn>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one from http://mozilla.org/MPL/2.0/.
+ *
+ * More information about OpenCorr can be found at https://www.opencorr.org/
+ */
+
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <utility>
+
+#include "oc_poi_field.h"
+
+namespace opencorr
+{
+	//number of floats in a column, padded to a multiple of cache line (64 bytes)
+	static size_t columnStride(int poi_number)
+	{
+		const size_t floats_per_line = 16;
+		return ((size_t)poi_number + floats_per_line - 1) / floats_per_line * floats_per_line;
+	}
+
+	//copy the data of a POI into row idx of the field, or the other way round
+	static void writeRow(PoiField2D& field, int idx, POI2D& poi)
+	{
+		field.x()[idx] = poi.x;
+		field.y()[idx] = poi.y;
+		for (int i = 0; i < 12; i++)
+		{
+			field.deformation(i)[idx] = poi.deformation.p[i];
+		}
+		for (int i = 0; i < 6; i++)
+		{
+			field.result(i)[idx] = poi.result.r[i];
+		}
+		for (int i = 0; i < 3; i++)
+		{
+			field.strain(i)[idx] = poi.strain.e[i];
+		}
+		field.subsetRadius(0)[idx] = poi.subset_radius.x;
+		field.subsetRadius(1)[idx] = poi.subset_radius.y;
+	}
+
+	static void readRow(const PoiField2D& field, int idx, POI2D& poi)
+	{
+		poi.x = field.x()[idx];
+		poi.y = field.y()[idx];
+		for (int i = 0; i < 12; i++)
+		{
+			poi.deformation.p[i] = field.deformation(i)[idx];
+		}
+		for (int i = 0; i < 6; i++)
+		{
+			poi.result.r[i] = field.result(i)[idx];
+		}
+		for (int i = 0; i < 3; i++)
+		{
+			poi.strain.e[i] = field.strain(i)[idx];
+		}
+		poi.subset_radius.x = field.subsetRadius(0)[idx];
+		poi.subset_radius.y = field.subsetRadius(1)[idx];
+	}
+
+	static void writeRow(PoiField3D& field, int idx, POI3D& poi)
+	{
+		field.x()[idx] = poi.x;
+		field.y()[idx] = poi.y;
+		field.z()[idx] = poi.z;
+		for (int i = 0; i < 12; i++)
+		{
+			field.deformation(i)[idx] = poi.deformation.p[i];
+		}
+		for (int i = 0; i < 7; i++)
+		{
+			field.result(i)[idx] = poi.result.r[i];
+		}
+		for (int i = 0; i < 6; i++)
+		{
+			field.strain(i)[idx] = poi.strain.e[i];
+		}
+		field.subsetRadius(0)[idx] = poi.subset_radius.x;
+		field.subsetRadius(1)[idx] = poi.subset_radius.y;
+		field.subsetRadius(2)[idx] = poi.subset_radius.z;
+	}
+
+	static void readRow(const PoiField3D& field, int idx, POI3D& poi)
+	{
+		poi.x = field.x()[idx];
+		poi.y = field.y()[idx];
+		poi.z = field.z()[idx];
+		for (int i = 0; i < 12; i++)
+		{
+			poi.deformation.p[i] = field.deformation(i)[idx];
+		}
+		for (int i = 0; i < 7; i++)
+		{
+			poi.result.r[i] = field.result(i)[idx];
+		}
+		for (int i = 0; i < 6; i++)
+		{
+			poi.strain.e[i] = field.strain(i)[idx];
+		}
+		poi.subset_radius.x = field.subsetRadius(0)[idx];
+		poi.subset_radius.y = field.subsetRadius(1)[idx];
+		poi.subset_radius.z = field.subsetRadius(2)[idx];
+	}
+
+
+	//PoiField2D
+	PoiField2D::PoiField2D(int poi_number)
+	{
+		allocate(poi_number);
+	}
+
+	PoiField2D::PoiField2D(std::vector<POI2D>& poi_queue)
+	{
+		importQueue(poi_queue);
+	}
+
+	PoiField2D::PoiField2D(PoiField2D&& field) noexcept
+	{
+		*this = std::move(field);
+	}
+
+	PoiField2D& PoiField2D::operator=(PoiField2D&& field) noexcept
+	{
+		if (this != &field)
+		{
+			release();
+			poi_number = field.poi_number;
+			column_stride = field.column_stride;
+			data = field.data;
+
+			field.data = nullptr;
+			field.release();
+		}
+		return *this;
+	}
+
+	PoiField2D::~PoiField2D()
+	{
+		release();
+	}
+
+	void PoiField2D::allocate(int poi_number)
+	{
+		if (data != nullptr && poi_number == this->poi_number)
+		{
+			std::fill(data, data + column_stride * column_number, 0.f);
+			return;
+		}
+
+		release();
+		size_t stride = columnStride(poi_number);
+		data = newAligned1D(stride * column_number);
+		if (data == nullptr)
+		{
+			std::cerr << "Failed to allocate POI field:" << poi_number << std::endl;
+			return;
+		}
+
+		this->poi_number = poi_number;
+		column_stride = stride;
+	}
+
+	void PoiField2D::release()
+	{
+		deleteAligned1D(data);
+		poi_number = 0;
+		column_stride = 0;
+	}
+
+	void PoiField2D::importQueue(std::vector<POI2D>& poi_queue)
+	{
+		int queue_length = (int)poi_queue.size();
+		allocate(queue_length);
+		if (data == nullptr)
+		{
+			return;
+		}
+
+#pragma omp parallel for
+		for (int i = 0; i < queue_length; i++)
+		{
+			writeRow(*this, i, poi_queue[i]);
+		}
+	}
+
+	void PoiField2D::exportQueue(std::vector<POI2D>& poi_queue) const
+	{
+		getBlock(0, poi_number, poi_queue);
+	}
+
+	void PoiField2D::getBlock(int begin, int length, std::vector<POI2D>& poi_block) const
+	{
+		if (begin < 0 || length < 0 || begin + length > poi_number)
+		{
+			throw std::string("Block out of POI field");
+		}
+
+		poi_block.resize(length, POI2D(0, 0));
+#pragma omp parallel for
+		for (int i = 0; i < length; i++)
+		{
+			readRow(*this, begin + i, poi_block[i]);
+		}
+	}
+
+	void PoiField2D::setBlock(int begin, std::vector<POI2D>& poi_block)
+	{
+		int length = (int)poi_block.size();
+		if (begin < 0 || begin + length > poi_number)
+		{
+			throw std::string("Block out of POI field");
+		}
+
+#pragma omp parallel for
+		for (int i = 0; i < length; i++)
+		{
+			writeRow(*this, begin + i, poi_block[i]);
+		}
+	}
+
+
+	//PoiField3D
+	PoiField3D::PoiField3D(int poi_number)
+	{
+		allocate(poi_number);
+	}
+
+	PoiField3D::PoiField3D(std::vector<POI3D>& poi_queue)
+	{
+		importQueue(poi_queue);
+	}
+
+	PoiField3D::PoiField3D(PoiField3D&& field) noexcept
+	{
+		*this = std::move(field);
+	}
+
+	PoiField3D& PoiField3D::operator=(PoiField3D&& field) noexcept
+	{
+		if (this != &field)
+		{
+			release();
+			poi_number = field.poi_number;
+			column_stride = field.column_stride;
+			data = field.data;
+
+			field.data = nullptr;
+			field.release();
+		}
+		return *this;
+	}
+
+	PoiField3D::~PoiField3D()
+	{
+		release();
+	}
+
+	void PoiField3D::allocate(int poi_number)
+	{
+		if (data != nullptr && poi_number == this->poi_number)
+		{
+			std::fill(data, data + column_stride * column_number, 0.f);
+			return;
+		}
+
+		release();
+		size_t stride = columnStride(poi_number);
+		data = newAligned1D(stride * column_number);
+		if (data == nullptr)
+		{
+			std::cerr << "Failed to allocate POI field:" << poi_number << std::endl;
+			return;
+		}
+
+		this->poi_number = poi_number;
+		column_stride = stride;
+	}
+
+	void PoiField3D::release()
+	{
+		deleteAligned1D(data);
+		poi_number = 0;
+		column_stride = 0;
+	}
+
+	void PoiField3D::importQueue(std::vector<POI3D>& poi_queue)
+	{
+		int queue_length = (int)poi_queue.size();
+		allocate(queue_length);
+		if (data == nullptr)
+		{
+			return;
+		}
+
+#pragma omp parallel for
+		for (int i = 0; i < queue_length; i++)
+		{
+			writeRow(*this, i, poi_queue[i]);
+		}
+	}
+
+	void PoiField3D::exportQueue(std::vector<POI3D>& poi_queue) const
+	{
+		getBlock(0, poi_number, poi_queue);
+	}
+
+	void PoiField3D::getBlock(int begin, int length, std::vector<POI3D>& poi_block) const
+	{
+		if (begin < 0 || length < 0 || begin + length > poi_number)
+		{
+			throw std::string("Block out of POI field");
+		}
+
+		poi_block.resize(length, POI3D(0, 0, 0));
+#pragma omp parallel for
+		for (int i = 0; i < length; i++)
+		{
+			readRow(*this, begin + i, poi_block[i]);
+		}
+	}
+
+	void PoiField3D::setBlock(int begin, std::vector<POI3D>& poi_block)
+	{
+		int length = (int)poi_block.size();
+		if (begin < 0 || begin + length > poi_number)
+		{
+			throw std::string("Block out of POI field");
+		}
+
+#pragma omp parallel for
+		for (int i = 0; i < length; i++)
+		{
+			writeRow(*this, begin + i, poi_block[i]);
+		}
+	}
+
+}//namespace opencorr
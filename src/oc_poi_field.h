@@ -0,0 +1,150 @@
+/*
+ * This file is part of OpenCorr, an open source C++ library for
+ * study and development of 2D, 3D/stereo and volumetric
+ * digital image correlation.
+ *
+ * Copyright (C) 2021-2024, Zhenyu Jiang <zhenyujiang@scut.edu.cn>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one from http://mozilla.org/MPL/2.0/.
+ *
+ * More information about OpenCorr can be found at https://www.opencorr.org/
+ */
+
+
+#pragma once
+
+#ifndef _POI_FIELD_H_
+#define _POI_FIELD_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "oc_array.h"
+#include "oc_poi.h"
+
+namespace opencorr
+{
+	//structure-of-arrays store of a POI queue, each variable of POIs is kept in a contiguous column. the engines
+	//still work on POI queues, the field serves the storage and IO of results, where only a few variables of many
+	//POIs are touched, e.g. IO2D::saveFieldBin and IO2D::saveMap2D. every column starts at the boundary
+	//of cache line, column c is located at data + c * column_stride. the order of columns follows POI2D:
+	//x, y, deformation.p[12], result.r[6], strain.e[3], subset_radius.x, subset_radius.y
+	class PoiField2D
+	{
+	public:
+		static const int deformation_column = 2; //first column of deformation
+		static const int result_column = 14; //first column of result
+		static const int strain_column = 20; //first column of strain
+		static const int subset_radius_column = 23; //first column of subset radius
+		static const int column_number = 25;
+
+		int poi_number = 0;
+		size_t column_stride = 0; //number of floats between two adjacent columns
+		float* data = nullptr;
+
+		PoiField2D() = default;
+		PoiField2D(int poi_number);
+		PoiField2D(std::vector<POI2D>& poi_queue);
+		PoiField2D(PoiField2D&& field) noexcept;
+		PoiField2D& operator=(PoiField2D&& field) noexcept;
+		PoiField2D(const PoiField2D&) = delete;
+		PoiField2D& operator=(const PoiField2D&) = delete;
+		~PoiField2D();
+
+		//allocate the columns and initialize them with zero, the block is reused if the number of POIs does not change
+		void allocate(int poi_number);
+		void release();
+
+		bool empty() const { return data == nullptr; }
+		int size() const { return poi_number; }
+
+		float* column(int col) { return data + col * column_stride; }
+		float* x() { return column(0); }
+		float* y() { return column(1); }
+		float* deformation(int i) { return column(deformation_column + i); } //i follows DeformationVector2D::p
+		float* result(int i) { return column(result_column + i); } //i follows Result2D::r
+		float* strain(int i) { return column(strain_column + i); } //i follows StrainVector2D::e
+		float* subsetRadius(int i) { return column(subset_radius_column + i); } //0 for x, 1 for y
+
+		const float* column(int col) const { return data + col * column_stride; }
+		const float* x() const { return column(0); }
+		const float* y() const { return column(1); }
+		const float* deformation(int i) const { return column(deformation_column + i); }
+		const float* result(int i) const { return column(result_column + i); }
+		const float* strain(int i) const { return column(strain_column + i); }
+		const float* subsetRadius(int i) const { return column(subset_radius_column + i); }
+
+		//conversion between the field and POI queue
+		void importQueue(std::vector<POI2D>& poi_queue);
+		void exportQueue(std::vector<POI2D>& poi_queue) const;
+
+		//copy a block of POIs into a POI queue, so that it can be processed by the modules working on POI queue,
+		//e.g. ICGN2D1::compute(std::vector<POI2D>&), and then copy it back. the queue is reused between blocks
+		void getBlock(int begin, int length, std::vector<POI2D>& poi_block) const;
+		void setBlock(int begin, std::vector<POI2D>& poi_block);
+	};
+
+	//the order of columns follows POI3D:
+	//x, y, z, deformation.p[12], result.r[7], strain.e[6], subset_radius.x, subset_radius.y, subset_radius.z
+	class PoiField3D
+	{
+	public:
+		static const int deformation_column = 3; //first column of deformation
+		static const int result_column = 15; //first column of result
+		static const int strain_column = 22; //first column of strain
+		static const int subset_radius_column = 28; //first column of subset radius
+		static const int column_number = 31;
+
+		int poi_number = 0;
+		size_t column_stride = 0; //number of floats between two adjacent columns
+		float* data = nullptr;
+
+		PoiField3D() = default;
+		PoiField3D(int poi_number);
+		PoiField3D(std::vector<POI3D>& poi_queue);
+		PoiField3D(PoiField3D&& field) noexcept;
+		PoiField3D& operator=(PoiField3D&& field) noexcept;
+		PoiField3D(const PoiField3D&) = delete;
+		PoiField3D& operator=(const PoiField3D&) = delete;
+		~PoiField3D();
+
+		//allocate the columns and initialize them with zero, the block is reused if the number of POIs does not change
+		void allocate(int poi_number);
+		void release();
+
+		bool empty() const { return data == nullptr; }
+		int size() const { return poi_number; }
+
+		float* column(int col) { return data + col * column_stride; }
+		float* x() { return column(0); }
+		float* y() { return column(1); }
+		float* z() { return column(2); }
+		float* deformation(int i) { return column(deformation_column + i); } //i follows DeformationVector3D::p
+		float* result(int i) { return column(result_column + i); } //i follows Result3D::r
+		float* strain(int i) { return column(strain_column + i); } //i follows StrainVector3D::e
+		float* subsetRadius(int i) { return column(subset_radius_column + i); } //0 for x, 1 for y, 2 for z
+
+		const float* column(int col) const { return data + col * column_stride; }
+		const float* x() const { return column(0); }
+		const float* y() const { return column(1); }
+		const float* z() const { return column(2); }
+		const float* deformation(int i) const { return column(deformation_column + i); }
+		const float* result(int i) const { return column(result_column + i); }
+		const float* strain(int i) const { return column(strain_column + i); }
+		const float* subsetRadius(int i) const { return column(subset_radius_column + i); }
+
+		//conversion between the field and POI queue
+		void importQueue(std::vector<POI3D>& poi_queue);
+		void exportQueue(std::vector<POI3D>& poi_queue) const;
+
+		//copy a block of POIs into a POI queue, so that it can be processed by the modules working on POI queue,
+		//e.g. ICGN3D1::compute(std::vector<POI3D>&), and then copy it back. the queue is reused between blocks
+		void getBlock(int begin, int length, std::vector<POI3D>& poi_block) const;
+		void setBlock(int begin, std::vector<POI3D>& poi_block);
+	};
+
+}//namespace opencorr
+
+#endif //_POI_FIELD_H_
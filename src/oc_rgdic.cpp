@@ -0,0 +1,286 @@
+/*
+ * This file is part of OpenCorr, an open source C++ library for
+ * study and development of 2D, 3D/stereo and volumetric
+ * digital image correlation.
+ *
+ * Copyright (C) 2021-2024, Zhenyu Jiang <zhenyujiang@scut.edu.cn>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one from http://mozilla.org/MPL/2.0/.
+ *
+ * More information about OpenCorr can be found at https://www.opencorr.org/
+ */
+
+#include <algorithm>
+#include <cfloat>
+
+#include "oc_rgdic.h"
+
+namespace opencorr
+{
+	bool operator<(const PropagationNode& node1, const PropagationNode& node2)
+	{
+		return node1.zncc < node2.zncc;
+	}
+
+	RGDIC2D1::RGDIC2D1(int subset_radius_x, int subset_radius_y, float conv_criterion, float stop_condition, int thread_number)
+		: zncc_threshold(0.9f)
+	{
+		this->subset_radius_x = subset_radius_x;
+		this->subset_radius_y = subset_radius_y;
+		this->thread_number = thread_number;
+
+		fftcc = new FFTCC2D(subset_radius_x, subset_radius_y, thread_number);
+		icgn = new ICGN2D1(subset_radius_x, subset_radius_y, conv_criterion, stop_condition, thread_number);
+	}
+
+	RGDIC2D1::~RGDIC2D1()
+	{
+		delete fftcc;
+		delete icgn;
+	}
+
+	void RGDIC2D1::setIteration(float conv_criterion, float stop_condition)
+	{
+		icgn->setIteration(conv_criterion, stop_condition);
+	}
+
+	void RGDIC2D1::setThreshold(float zncc_threshold)
+	{
+		this->zncc_threshold = zncc_threshold;
+	}
+
+	void RGDIC2D1::setSeeds(std::vector<Point2D>& seeds)
+	{
+		this->seeds = seeds;
+	}
+
+	void RGDIC2D1::prepare()
+	{
+		fftcc->setImages(*ref_img, *tar_img);
+		fftcc->prepare();
+
+		icgn->setImages(*ref_img, *tar_img);
+		icgn->prepare();
+	}
+
+	void RGDIC2D1::getNeighbors(std::vector<POI2D>& poi_queue, std::vector<int>& neighbor_idx)
+	{
+		int queue_length = (int)poi_queue.size();
+
+		//collect the distinct coordinates of POIs along x and y, which form the grid
+		std::vector<int> grid_x(queue_length), grid_y(queue_length);
+		for (int i = 0; i < queue_length; i++)
+		{
+			grid_x[i] = (int)round(poi_queue[i].x);
+			grid_y[i] = (int)round(poi_queue[i].y);
+		}
+		std::sort(grid_x.begin(), grid_x.end());
+		grid_x.erase(std::unique(grid_x.begin(), grid_x.end()), grid_x.end());
+		std::sort(grid_y.begin(), grid_y.end());
+		grid_y.erase(std::unique(grid_y.begin(), grid_y.end()), grid_y.end());
+		long long grid_width = (long long)grid_x.size();
+
+		//sort the POIs by their keys on grid, so that a node can be located by binary search
+		std::vector<int> col(queue_length), row(queue_length);
+		std::vector<std::pair<long long, int>> grid_key(queue_length);
+		for (int i = 0; i < queue_length; i++)
+		{
+			col[i] = (int)(std::lower_bound(grid_x.begin(), grid_x.end(), (int)round(poi_queue[i].x)) - grid_x.begin());
+			row[i] = (int)(std::lower_bound(grid_y.begin(), grid_y.end(), (int)round(poi_queue[i].y)) - grid_y.begin());
+			grid_key[i] = std::make_pair(row[i] * grid_width + col[i], i);
+		}
+		std::sort(grid_key.begin(), grid_key.end());
+
+		neighbor_idx.assign((size_t)queue_length * 4, -1);
+		const int offset_x[4] = { -1, 1, 0, 0 };
+		const int offset_y[4] = { 0, 0, -1, 1 };
+		for (int i = 0; i < queue_length; i++)
+		{
+			for (int k = 0; k < 4; k++)
+			{
+				int neighbor_col = col[i] + offset_x[k];
+				int neighbor_row = row[i] + offset_y[k];
+				if (neighbor_col < 0 || neighbor_col >= grid_width || neighbor_row < 0 || neighbor_row >= (int)grid_y.size())
+				{
+					continue;
+				}
+
+				std::pair<long long, int> key = std::make_pair(neighbor_row * grid_width + neighbor_col, -1);
+				auto node = std::lower_bound(grid_key.begin(), grid_key.end(), key);
+				if (node != grid_key.end() && node->first == key.first)
+				{
+					neighbor_idx[(size_t)i * 4 + k] = node->second;
+				}
+			}
+		}
+	}
+
+	void RGDIC2D1::getSeeds(std::vector<POI2D>& poi_queue, std::vector<int>& seed_idx)
+	{
+		int queue_length = (int)poi_queue.size();
+		seed_idx.clear();
+
+		if (seeds.empty())
+		{
+			//one seed for each front, spread evenly over the queue
+			for (int i = 0; i < thread_number; i++)
+			{
+				seed_idx.push_back((int)(((long long)queue_length * (2 * i + 1)) / (2 * thread_number)));
+			}
+			return;
+		}
+
+		//take the POIs closest to the given locations
+		for (auto& seed : seeds)
+		{
+			int closest_idx = 0;
+			float closest_distance = FLT_MAX;
+			for (int i = 0; i < queue_length; i++)
+			{
+				Point2D offset = (Point2D)poi_queue[i] - seed;
+				float distance = offset.x * offset.x + offset.y * offset.y;
+				if (distance < closest_distance)
+				{
+					closest_distance = distance;
+					closest_idx = i;
+				}
+			}
+			seed_idx.push_back(closest_idx);
+		}
+	}
+
+	void RGDIC2D1::compute(POI2D* poi)
+	{
+		//FFTCC reads the subsets without bounds check, thus check them here
+		int x_min = (int)poi->x - subset_radius_x;
+		int y_min = (int)poi->y - subset_radius_y;
+		int x_max = (int)poi->x + subset_radius_x;
+		int y_max = (int)poi->y + subset_radius_y;
+		int u = (int)poi->deformation.u;
+		int v = (int)poi->deformation.v;
+		if (x_min < 0 || y_min < 0 || x_max > ref_img->width - 1 || y_max > ref_img->height - 1
+			|| x_min + u < 0 || y_min + v < 0 || x_max + u > tar_img->width - 1 || y_max + v > tar_img->height - 1)
+		{
+			poi->result.zncc = -1;
+			return;
+		}
+
+		fftcc->compute(poi);
+		icgn->compute(poi);
+	}
+
+	void RGDIC2D1::compute(std::vector<POI2D>& poi_queue)
+	{
+		int queue_length = (int)poi_queue.size();
+
+		std::vector<int> neighbor_idx;
+		getNeighbors(poi_queue, neighbor_idx);
+
+		std::vector<int> seed_idx;
+		getSeeds(poi_queue, seed_idx);
+
+		//flags of the POIs taken by a front, shared by all the threads
+		std::vector<char> claimed(queue_length, 0);
+		int seed_counter = 0; //next seed to start a front
+		int scan_counter = 0; //next POI to check when the seeds are used up
+
+#pragma omp parallel num_threads(thread_number)
+		{
+			std::priority_queue<PropagationNode> front;
+
+			while (true)
+			{
+				if (front.empty())
+				{
+					//start a new front from the next seed, then from the POIs not reached by any front,
+					//e.g. the ones isolated by POIs with low ZNCC
+					int new_seed = -1;
+#pragma omp critical
+					{
+						while (new_seed < 0 && seed_counter < (int)seed_idx.size())
+						{
+							int i = seed_idx[seed_counter++];
+							if (!claimed[i])
+							{
+								claimed[i] = 1;
+								new_seed = i;
+							}
+						}
+						while (new_seed < 0 && scan_counter < queue_length)
+						{
+							int i = scan_counter++;
+							if (!claimed[i])
+							{
+								claimed[i] = 1;
+								new_seed = i;
+							}
+						}
+					}
+
+					if (new_seed < 0)
+					{
+						break;
+					}
+
+					compute(&poi_queue[new_seed]);
+					if (poi_queue[new_seed].result.zncc >= zncc_threshold)
+					{
+						PropagationNode node = { new_seed, poi_queue[new_seed].result.zncc };
+						front.push(node);
+					}
+					continue;
+				}
+
+				//process the unclaimed neighbors of the most reliable POI in front
+				PropagationNode current_node = front.top();
+				front.pop();
+				POI2D* current_poi = &poi_queue[current_node.poi_idx];
+
+				for (int k = 0; k < 4; k++)
+				{
+					int i = neighbor_idx[(size_t)current_node.poi_idx * 4 + k];
+					if (i < 0)
+					{
+						continue;
+					}
+
+					bool available = false;
+#pragma omp critical
+					{
+						if (!claimed[i])
+						{
+							claimed[i] = 1;
+							available = true;
+						}
+					}
+					if (!available)
+					{
+						continue;
+					}
+
+					//initial guess is transferred from the current POI with its displacement gradients
+					POI2D* neighbor_poi = &poi_queue[i];
+					float dx = neighbor_poi->x - current_poi->x;
+					float dy = neighbor_poi->y - current_poi->y;
+					neighbor_poi->deformation.u = current_poi->deformation.u + current_poi->deformation.ux * dx + current_poi->deformation.uy * dy;
+					neighbor_poi->deformation.ux = current_poi->deformation.ux;
+					neighbor_poi->deformation.uy = current_poi->deformation.uy;
+					neighbor_poi->deformation.v = current_poi->deformation.v + current_poi->deformation.vx * dx + current_poi->deformation.vy * dy;
+					neighbor_poi->deformation.vx = current_poi->deformation.vx;
+					neighbor_poi->deformation.vy = current_poi->deformation.vy;
+					neighbor_poi->result.zncc = 0.f;
+
+					icgn->compute(neighbor_poi);
+					if (neighbor_poi->result.zncc >= zncc_threshold)
+					{
+						PropagationNode node = { i, neighbor_poi->result.zncc };
+						front.push(node);
+					}
+				}
+			}
+		}
+	}
+
+}//namespace opencorr
@@ -0,0 +1,76 @@
+/*
+ * This file is part of OpenCorr, an open source C++ library for
+ * study and development of 2D, 3D/stereo and volumetric
+ * digital image correlation.
+ *
+ * Copyright (C) 2021-2024, Zhenyu Jiang <zhenyujiang@scut.edu.cn>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one from http://mozilla.org/MPL/2.0/.
+ *
+ * More information about OpenCorr can be found at https://www.opencorr.org/
+ */
+
+#pragma once
+
+#ifndef _RGDIC_H_
+#define _RGDIC_H_
+
+#include <queue>
+#include <vector>
+
+#include "oc_dic.h"
+#include "oc_fftcc.h"
+#include "oc_icgn.h"
+#include "oc_image.h"
+#include "oc_poi.h"
+#include "oc_point.h"
+
+namespace opencorr
+{
+	//this part of module is the implementation of
+	//B. Pan, Applied Optics (2009) 48(8): 1535-1542.
+	//https://doi.org/10.1364/AO.48.001535
+
+	//structure for the queue of propagation front
+	struct PropagationNode
+	{
+		int poi_idx; //index in POI queue
+		float zncc; //ZNCC of the POI, the higher the earlier its neighbors are processed
+	};
+
+	bool operator<(const PropagationNode& node1, const PropagationNode& node2);
+
+	class RGDIC2D1 : public DIC
+	{
+	private:
+		FFTCC2D* fftcc; //estimation of initial guess at seeds
+		ICGN2D1* icgn; //registration of seeds and the POIs reached by propagation
+
+		float zncc_threshold; //POIs with lower ZNCC are computed but not used to guide their neighbors
+		std::vector<Point2D> seeds; //locations of seeds, the POIs closest to them are used
+
+		//find the four neighbors of each POI on grid, -1 stands for no neighbor
+		void getNeighbors(std::vector<POI2D>& poi_queue, std::vector<int>& neighbor_idx);
+
+		//indices of seeds in the POI queue, spread over the queue if no seed is set
+		void getSeeds(std::vector<POI2D>& poi_queue, std::vector<int>& seed_idx);
+
+	public:
+		RGDIC2D1(int subset_radius_x, int subset_radius_y, float conv_criterion, float stop_condition, int thread_number);
+		~RGDIC2D1();
+
+		void setIteration(float conv_criterion, float stop_condition);
+		void setThreshold(float zncc_threshold);
+		void setSeeds(std::vector<Point2D>& seeds);
+
+		void prepare(); //prepare FFTCC and ICGN with the images
+
+		void compute(POI2D* poi); //process a seed, FFTCC followed by ICGN
+		void compute(std::vector<POI2D>& poi_queue); //propagate from seeds, each CPU thread grows its own front
+	};
+
+}//namespace opencorr
+
+#endif //_RGDIC_H_
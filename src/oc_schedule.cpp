@@ -0,0 +1,72 @@
+/*
+ * This file is part of OpenCorr, an open source C++ library for
+ * study and development of 2D, 3D/stereo and volumetric
+ * digital image correlation.
+ *
+ * Copyright (C) 2021-2024, Zhenyu Jiang <zhenyujiang@scut.edu.cn>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one from http://mozilla.org/MPL/2.0/.
+ *
+ * More information about OpenCorr can be found at https://www.opencorr.org/
+ */
+
+
+#include <omp.h>
+
+#include "oc_schedule.h"
+
+namespace opencorr
+{
+	int getScheduleChunk(ScheduleMode schedule_mode, int chunk_size, int queue_length)
+	{
+		if (schedule_mode == SCHEDULE_DYNAMIC && chunk_size > 0)
+		{
+			return chunk_size;
+		}
+
+		int thread_number = omp_get_max_threads();
+		int chunk = (queue_length + thread_number - 1) / thread_number;
+		if (schedule_mode == SCHEDULE_DYNAMIC)
+		{
+			chunk = (chunk + 7) / 8;
+		}
+
+		return chunk > 0 ? chunk : 1;
+	}
+
+	void PoiSchedule::setSchedule(ScheduleMode schedule_mode, int chunk_size)
+	{
+		this->schedule_mode = schedule_mode;
+		schedule_chunk = chunk_size;
+	}
+
+	ScheduleScope::ScheduleScope(ScheduleMode schedule_mode, int chunk_size, int queue_length)
+		: previous_kind(0), previous_chunk(0)
+	{
+#if _OPENMP >= 200805
+		omp_sched_t kind;
+		omp_get_schedule(&kind, &previous_chunk);
+		previous_kind = (int)kind;
+
+		//chunk size 0 of static schedule gives one chunk for each thread, as schedule(static)
+		if (schedule_mode == SCHEDULE_DYNAMIC)
+		{
+			omp_set_schedule(omp_sched_dynamic, getScheduleChunk(schedule_mode, chunk_size, queue_length));
+		}
+		else
+		{
+			omp_set_schedule(omp_sched_static, 0);
+		}
+#endif
+	}
+
+	ScheduleScope::~ScheduleScope()
+	{
+#if _OPENMP >= 200805
+		omp_set_schedule((omp_sched_t)previous_kind, previous_chunk);
+#endif
+	}
+
+}//namespace opencorr
@@ -0,0 +1,64 @@
+/*
+ * This file is part of OpenCorr, an open source C++ library for
+ * study and development of 2D, 3D/stereo and volumetric
+ * digital image correlation.
+ *
+ * Copyright (C) 2021-2024, Zhenyu Jiang <zhenyujiang@scut.edu.cn>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one from http://mozilla.org/MPL/2.0/.
+ *
+ * More information about OpenCorr can be found at https://www.opencorr.org/
+ */
+
+
+#pragma once
+
+#ifndef _SCHEDULE_H_
+#define _SCHEDULE_H_
+
+namespace opencorr
+{
+	//scheduling of the POIs in a queue among CPU threads, the POIs are dealt out in chunks of successive POIs,
+	//which are usually neighbors in space
+	enum ScheduleMode
+	{
+		SCHEDULE_STATIC, //schedule(static), one chunk for each thread, for POIs of similar cost
+		SCHEDULE_DYNAMIC //schedule(dynamic), an idle thread takes the next chunk, for POIs of varied cost, e.g. in masked regions
+	};
+
+	//number of successive POIs in a chunk. in static mode the queue is split evenly among the threads,
+	//in dynamic mode the given chunk size is used, or one eighth of the even share if it is 0
+	int getScheduleChunk(ScheduleMode schedule_mode, int chunk_size, int queue_length);
+
+	//scheduling of the modules processing POI queues, e.g. DIC, DVC and Strain
+	class PoiSchedule
+	{
+	public:
+		ScheduleMode schedule_mode = SCHEDULE_STATIC; //scheduling of POIs in compute(std::vector<...>&)
+		int schedule_chunk = 0; //chunk size in dynamic mode, 0 for automatic
+
+		void setSchedule(ScheduleMode schedule_mode, int chunk_size = 0);
+	};
+
+	//the loops over a POI queue are declared with "#pragma omp parallel for schedule(runtime)", a ScheduleScope
+	//created before a loop sets its schedule in the calling thread, and the previous one is restored when the scope
+	//is left. OpenMP 2.0 (e.g. MSVC) can not set the schedule at run time, the loops follow the environment
+	//variable OMP_SCHEDULE there, which is static by default
+	class ScheduleScope
+	{
+	public:
+		ScheduleScope(ScheduleMode schedule_mode, int chunk_size, int queue_length);
+		ScheduleScope(const ScheduleScope&) = delete;
+		ScheduleScope& operator=(const ScheduleScope&) = delete;
+		~ScheduleScope();
+
+	private:
+		int previous_kind;
+		int previous_chunk;
+	};
+
+}//namespace opencorr
+
+#endif //_SCHEDULE_H_
@@ -0,0 +1,214 @@
+/*
+ * This file is part of OpenCorr, an open source C++ library for
+ * study and development of 2D, 3D/stereo and volumetric
+ * digital image correlation.
+ *
+ * Copyright (C) 2021-2024, Zhenyu Jiang <zhenyujiang@scut.edu.cn>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one from http://mozilla.org/MPL/2.0/.
+ *
+ * More information about OpenCorr can be found at https://www.opencorr.org/
+ */
+
+
+#include "oc_sequence.h"
+
+namespace opencorr
+{
+	SequenceRunner2D::SequenceRunner2D(int subset_radius_x, int subset_radius_y, float conv_criterion, float stop_condition, int thread_number)
+		: zncc_threshold(0.9f), update_interval(0), memory_budget(0),
+		ref_img(nullptr), updated_ref(nullptr), ref_changed(false), frame_counter(0)
+	{
+		this->subset_radius_x = subset_radius_x;
+		this->subset_radius_y = subset_radius_y;
+		this->thread_number = thread_number;
+
+		fftcc = new FFTCC2D(subset_radius_x, subset_radius_y, thread_number);
+		icgn = new ICGN2D1(subset_radius_x, subset_radius_y, conv_criterion, stop_condition, thread_number);
+	}
+
+	SequenceRunner2D::~SequenceRunner2D()
+	{
+		delete fftcc;
+		delete icgn;
+		delete updated_ref;
+	}
+
+	void SequenceRunner2D::setIteration(float conv_criterion, float stop_condition)
+	{
+		icgn->setIteration(conv_criterion, stop_condition);
+	}
+
+	void SequenceRunner2D::setThreshold(float zncc_threshold)
+	{
+		this->zncc_threshold = zncc_threshold;
+	}
+
+	void SequenceRunner2D::setUpdateInterval(int update_interval)
+	{
+		this->update_interval = update_interval;
+	}
+
+	void SequenceRunner2D::setMemoryBudget(size_t memory_budget)
+	{
+		this->memory_budget = memory_budget;
+	}
+
+	void SequenceRunner2D::setReference(Image2D& ref_img, std::vector<POI2D>& poi_queue)
+	{
+		this->ref_img = &ref_img;
+		ref_changed = true;
+		frame_counter = 0;
+
+		work_queue = poi_queue;
+		base_queue = poi_queue;
+		for (auto& poi : base_queue)
+		{
+			poi.clear();
+		}
+	}
+
+	void SequenceRunner2D::accumulate(POI2D& base_poi, POI2D& work_poi, POI2D& total_poi)
+	{
+		//offset of the POI from its location in current reference, which is rounded to the nearest pixel
+		float dx = base_poi.x + base_poi.deformation.u - work_poi.x;
+		float dy = base_poi.y + base_poi.deformation.v - work_poi.y;
+
+		float u = work_poi.deformation.u + work_poi.deformation.ux * dx + work_poi.deformation.uy * dy;
+		float v = work_poi.deformation.v + work_poi.deformation.vx * dx + work_poi.deformation.vy * dy;
+
+		//displacement gradients are combined as F = F_increment * F_base, where F = I + displacement gradient
+		float ux = base_poi.deformation.ux, uy = base_poi.deformation.uy;
+		float vx = base_poi.deformation.vx, vy = base_poi.deformation.vy;
+		float dux = work_poi.deformation.ux, duy = work_poi.deformation.uy;
+		float dvx = work_poi.deformation.vx, dvy = work_poi.deformation.vy;
+
+		total_poi.deformation.u = base_poi.deformation.u + u;
+		total_poi.deformation.ux = ux + dux + dux * ux + duy * vx;
+		total_poi.deformation.uy = uy + duy + dux * uy + duy * vy;
+		total_poi.deformation.v = base_poi.deformation.v + v;
+		total_poi.deformation.vx = vx + dvx + dvx * ux + dvy * vx;
+		total_poi.deformation.vy = vy + dvy + dvx * uy + dvy * vy;
+
+		total_poi.result = work_poi.result;
+		total_poi.result.u0 += base_poi.deformation.u;
+		total_poi.result.v0 += base_poi.deformation.v;
+	}
+
+	void SequenceRunner2D::updateReference(Image2D& tar_img, std::vector<POI2D>& poi_queue)
+	{
+		//keep a copy of the frame, as the image of target may be overwritten by the next frame
+		if (updated_ref == nullptr || updated_ref->width != tar_img.width || updated_ref->height != tar_img.height)
+		{
+			delete updated_ref;
+			updated_ref = new Image2D(tar_img.width, tar_img.height);
+		}
+		updated_ref->eg_mat = tar_img.eg_mat;
+		updated_ref->file_path = tar_img.file_path;
+
+		ref_img = updated_ref;
+		ref_changed = true;
+		frame_counter = 0;
+
+		base_queue = poi_queue;
+
+		int queue_length = (int)work_queue.size();
+		for (int i = 0; i < queue_length; i++)
+		{
+			POI2D* base_poi = &base_queue[i];
+			POI2D* work_poi = &work_queue[i];
+
+			//POIs lost at the update of reference are not tracked any more
+			if (base_poi->result.zncc < 0)
+			{
+				work_poi->result.zncc = -1;
+				continue;
+			}
+
+			//locate the POI at the nearest pixel in new reference, its ZNCC is kept to skip FFTCC in the next frame
+			work_poi->x = round(base_poi->x + base_poi->deformation.u);
+			work_poi->y = round(base_poi->y + base_poi->deformation.v);
+			std::fill(std::begin(work_poi->deformation.p), std::end(work_poi->deformation.p), 0.f);
+		}
+	}
+
+	void SequenceRunner2D::compute(Image2D& tar_img, std::vector<POI2D>& poi_queue)
+	{
+		int queue_length = (int)work_queue.size();
+
+		//collect the POIs not tracked well in the last frame, their initial guess is estimated again using FFTCC
+		std::vector<int> lost_idx;
+		for (int i = 0; i < queue_length; i++)
+		{
+			POI2D* work_poi = &work_queue[i];
+			if (base_queue[i].result.zncc < 0 || work_poi->result.zncc >= zncc_threshold)
+			{
+				continue;
+			}
+
+			//the last displacement is used as the center of search unless the POI is invalid
+			if (work_poi->result.zncc < 0)
+			{
+				work_poi->deformation.u = 0.f;
+				work_poi->deformation.v = 0.f;
+			}
+			work_poi->deformation.ux = 0.f;
+			work_poi->deformation.uy = 0.f;
+			work_poi->deformation.vx = 0.f;
+			work_poi->deformation.vy = 0.f;
+			lost_idx.push_back(i);
+		}
+
+		fftcc->setImages(*ref_img, tar_img);
+		int lost_number = (int)lost_idx.size();
+#pragma omp parallel for
+		for (int i = 0; i < lost_number; i++)
+		{
+			POI2D* poi = &work_queue[lost_idx[i]];
+
+			//FFTCC reads the subsets without bounds check, thus check them here,
+			//the last displacement is rounded to the integer shift of target subset as done in FFTCC
+			int x_min = (int)poi->x - subset_radius_x;
+			int y_min = (int)poi->y - subset_radius_y;
+			int x_max = (int)poi->x + subset_radius_x;
+			int y_max = (int)poi->y + subset_radius_y;
+			int u = (int)round(poi->deformation.u);
+			int v = (int)round(poi->deformation.v);
+			if (x_min < 0 || y_min < 0 || x_max > ref_img->width - 1 || y_max > ref_img->height - 1
+				|| x_min + u < 0 || y_min + v < 0 || x_max + u > tar_img.width - 1 || y_max + v > tar_img.height - 1)
+			{
+				poi->result.zncc = -1;
+				continue;
+			}
+
+			fftcc->compute(poi);
+		}
+
+		//the data of reference are prepared only when it changes, the objects in ICGN are reused for each frame
+		icgn->setImages(*ref_img, tar_img);
+		if (ref_changed)
+		{
+			icgn->prepareRef();
+			icgn->precomputeReference(work_queue, memory_budget);
+			ref_changed = false;
+		}
+		icgn->prepareTar();
+		icgn->compute(work_queue);
+
+		//deformation w.r.t. the first reference
+		poi_queue = base_queue;
+		for (int i = 0; i < queue_length; i++)
+		{
+			accumulate(base_queue[i], work_queue[i], poi_queue[i]);
+		}
+
+		frame_counter++;
+		if (update_interval > 0 && frame_counter >= update_interval)
+		{
+			updateReference(tar_img, poi_queue);
+		}
+	}
+
+}//namespace opencorr
@@ -0,0 +1,78 @@
+/*
+ * This file is part of OpenCorr, an open source C++ library for
+ * study and development of 2D, 3D/stereo and volumetric
+ * digital image correlation.
+ *
+ * Copyright (C) 2021-2024, Zhenyu Jiang <zhenyujiang@scut.edu.cn>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one from http://mozilla.org/MPL/2.0/.
+ *
+ * More information about OpenCorr can be found at https://www.opencorr.org/
+ */
+
+
+#pragma once
+
+#ifndef _SEQUENCE_H_
+#define _SEQUENCE_H_
+
+#include <vector>
+
+#include "oc_fftcc.h"
+#include "oc_icgn.h"
+#include "oc_image.h"
+#include "oc_poi.h"
+#include "oc_point.h"
+
+namespace opencorr
+{
+	//processing of an image sequence, the deformation obtained in a frame serves as initial guess for the next one,
+	//FFTCC is called only for the POIs not tracked well in the last frame
+	class SequenceRunner2D
+	{
+	private:
+		FFTCC2D* fftcc; //estimation of initial guess for the POIs lost in the last frame
+		ICGN2D1* icgn; //registration of POIs, keeps its gradient and interpolation objects through the sequence
+
+		int subset_radius_x, subset_radius_y;
+		int thread_number;
+
+		float zncc_threshold; //POIs with lower ZNCC in the last frame are estimated again using FFTCC
+		int update_interval; //reference image is updated every update_interval frames, 0 for a fixed reference
+		size_t memory_budget; //memory budget (in bytes) for caching the reference data of POIs in ICGN
+
+		Image2D* ref_img; //current reference image
+		Image2D* updated_ref; //copy of the frame taken as updated reference
+		bool ref_changed; //flag of new reference, whose data are prepared in the next frame
+		int frame_counter; //number of frames processed since the last update of reference
+
+		std::vector<POI2D> base_queue; //POIs at their initial locations, with deformation accumulated till the last update of reference
+		std::vector<POI2D> work_queue; //POIs located in current reference, with deformation w.r.t. current reference
+
+		//combine the deformation accumulated till the last update of reference with the increment w.r.t. current reference
+		void accumulate(POI2D& base_poi, POI2D& work_poi, POI2D& total_poi);
+
+		//locate the POIs in the frame taken as new reference
+		void updateReference(Image2D& tar_img, std::vector<POI2D>& poi_queue);
+
+	public:
+		SequenceRunner2D(int subset_radius_x, int subset_radius_y, float conv_criterion, float stop_condition, int thread_number);
+		~SequenceRunner2D();
+
+		void setIteration(float conv_criterion, float stop_condition);
+		void setThreshold(float zncc_threshold);
+		void setUpdateInterval(int update_interval);
+		void setMemoryBudget(size_t memory_budget);
+
+		//start a sequence with the reference image and POIs in it, the deformation of POIs is taken as initial guess for the first frame
+		void setReference(Image2D& ref_img, std::vector<POI2D>& poi_queue);
+
+		//process the next frame, poi_queue receives the POIs at their initial locations and the deformation w.r.t. the first reference
+		void compute(Image2D& tar_img, std::vector<POI2D>& poi_queue);
+	};
+
+}//namespace opencorr
+
+#endif //_SEQUENCE_H_
@@ -12,10 +12,17 @@
  * More information about OpenCorr can be found at https://www.opencorr.org/
  */
 
+#include <algorithm>
+#include <nanoflann.hpp>
+
 #include "oc_sift.h"
 
 namespace opencorr
 {
+	static const int MATCHING_BLOCK1 = 64; //number of descriptor1 in a block of brute force search
+	static const int MATCHING_BLOCK2 = 512; //number of descriptor2 in a block of brute force search
+	static const int PCA_SAMPLE_NUMBER = 4096; //maximum number of descriptors used to estimate the principal components
+
 	//SIFT 2D
 	SIFT2D::SIFT2D()
 	{
@@ -132,6 +139,7 @@ namespace opencorr
 	}
 
 
+	const int SIFT3D::DESCRIPTOR_LENGTH;
 
 	SIFT3D::SIFT3D()
 	{
@@ -150,6 +158,12 @@ namespace opencorr
 		physical_unit[0] = 1.f;
 		physical_unit[1] = 1.f;
 		physical_unit[2] = 1.f;
+
+		concurrent_extraction = false;
+
+		matching_method = MATCHING_BRUTEFORCE;
+		reduced_dimension = 16;
+		candidate_number = 32;
 	}
 
 	SIFT3D::~SIFT3D() {}
@@ -183,6 +197,26 @@ namespace opencorr
 		return matching_ratio;
 	}
 
+	bool SIFT3D::getConcurrentExtraction() const
+	{
+		return concurrent_extraction;
+	}
+
+	DescriptorMatching SIFT3D::getMatchingMethod() const
+	{
+		return matching_method;
+	}
+
+	int SIFT3D::getReducedDimension() const
+	{
+		return reduced_dimension;
+	}
+
+	int SIFT3D::getCandidateNumber() const
+	{
+		return candidate_number;
+	}
+
 	void SIFT3D::setSiftConfig(Sift3dConfig sift_config)
 	{
 		this->sift_config = sift_config;
@@ -200,6 +234,22 @@ namespace opencorr
 		this->matching_ratio = matching_ratio;
 	}
 
+	void SIFT3D::setConcurrentExtraction(bool concurrent_extraction)
+	{
+		this->concurrent_extraction = concurrent_extraction;
+	}
+
+	void SIFT3D::setMatchingMethod(DescriptorMatching matching_method)
+	{
+		this->matching_method = matching_method;
+	}
+
+	void SIFT3D::setKdTreeSearch(int reduced_dimension, int candidate_number)
+	{
+		this->reduced_dimension = reduced_dimension > 0 ? reduced_dimension : 1;
+		this->candidate_number = candidate_number > 2 ? candidate_number : 2;
+	}
+
 	void SIFT3D::prepare()
 	{
 		//initialize icosahedron
@@ -228,50 +278,46 @@ namespace opencorr
 	void SIFT3D::compute()
 	{
 		//initialization
-		std::vector<Layer3D> gaussian_pyramid, dog_pyramid;
 		std::vector<Keypoint3D> ref_kp, tar_kp;
-		int ref_amount, tar_amount; //amount of extracted kp
-
-		//CAUTION: omp parallel for has been employed in the following functions,
-		//no need to run these functions in parallel using omp parallel sections
+		float** ref_descriptor = nullptr;
+		float** tar_descriptor = nullptr;
 
+		if (concurrent_extraction)
+		{
+			//the two pipelines share the CPU threads, the omp parallel for nested in them needs a second active level
+			int max_levels = omp_get_max_active_levels();
+			omp_set_max_active_levels(max_levels > 2 ? max_levels : 2);
+			int nested_threads = omp_get_max_threads() / 2;
+			nested_threads = nested_threads > 1 ? nested_threads : 1;
 
-		//extract features from the reference image
-		createGaussianPyramid(ref_img, gaussian_pyramid);
-		createDogPyramid(gaussian_pyramid, dog_pyramid);
-		detectExtrema(dog_pyramid, ref_kp);
-
-		assignOrientation(ref_kp, gaussian_pyramid);
+#pragma omp parallel sections num_threads(2)
+			{
+#pragma omp section
+				{
+					omp_set_num_threads(nested_threads);
+					ref_descriptor = extractFeatures(ref_img, ref_kp);
+				}
+#pragma omp section
+				{
+					omp_set_num_threads(nested_threads);
+					tar_descriptor = extractFeatures(tar_img, tar_kp);
+				}
+			}
 
-		//construct descriptors
-		ref_amount = (int)ref_kp.size();
-		float** ref_descriptor = new2D(ref_amount, 768);
-		constructDescriptor(ref_kp, gaussian_pyramid, ref_descriptor);
+			omp_set_max_active_levels(max_levels);
+		}
+		else
+		{
+			//CAUTION: omp parallel for has been employed in the functions of pipeline,
+			//the images are processed one by one to keep only one pyramid in memory
+			ref_descriptor = extractFeatures(ref_img, ref_kp);
+			tar_descriptor = extractFeatures(tar_img, tar_kp);
+		}
+		sift_config.n_octave = getOctaveNumber(tar_img);
 
 		std::cout << ref_kp.size() << " features are extracted from the reference image." << std::endl;
-
-		//clear the data in pyramids
-		clearPyramid(gaussian_pyramid);
-		clearPyramid(dog_pyramid);
-
-		//extract features from the target image
-		createGaussianPyramid(tar_img, gaussian_pyramid);
-		createDogPyramid(gaussian_pyramid, dog_pyramid);
-		detectExtrema(dog_pyramid, tar_kp);
-
-		assignOrientation(tar_kp, gaussian_pyramid);
-
-		//construct descriptors
-		tar_amount = (int)tar_kp.size();
-		float** tar_descriptor = new2D(tar_amount, 768);
-		constructDescriptor(tar_kp, gaussian_pyramid, tar_descriptor);
-
 		std::cout << tar_kp.size() << " features are extracted from the target image." << std::endl;
 
-		//clear pyramids and release memory
-		clearPyramid(gaussian_pyramid);
-		clearPyramid(dog_pyramid);
-
 		//monodirectional matching, but many-to-one correspondences are eliminated through reverse matching
 		monodirectionalMatch(ref_kp, ref_descriptor, tar_kp, tar_descriptor, ref_matched_kp, tar_matched_kp);
 
@@ -283,6 +329,102 @@ namespace opencorr
 		delete2D(tar_descriptor);
 	}
 
+	float** SIFT3D::extractFeatures(Image3D* vol_img, std::vector<Keypoint3D>& kp_queue)
+	{
+		//the pyramids are streamed layer by layer, only the layers needed by the current step are kept in memory
+		std::vector<Layer3D> gaussian_pyramid, dog_pyramid;
+		setGaussianPyramid(vol_img, gaussian_pyramid);
+
+		int gaussian_per_octave = sift_config.n_octave_layers + 3;
+		int dog_per_octave = sift_config.n_octave_layers + 2;
+		int n_octave = (int)gaussian_pyramid.size() / gaussian_per_octave;
+		dog_pyramid.resize(n_octave * dog_per_octave);
+
+		std::vector<float**> layer_descriptor;
+		std::vector<int> layer_kp_amount;
+
+		for (int m = 0; m < n_octave; m++)
+		{
+			int g_start = m * gaussian_per_octave;
+			int d_start = m * dog_per_octave;
+
+			for (int n = 0; n < gaussian_per_octave; n++)
+			{
+				//the bottom layer of the other octaves is downsampled in the previous octave
+				if (m == 0 || n > 0)
+				{
+					createGaussianLayer(vol_img, gaussian_pyramid, g_start + n);
+				}
+
+				//downsample the bottom layer of the next octave, then its source can be released with the other layers
+				if (n == sift_config.n_octave_layers && m < n_octave - 1)
+				{
+					createGaussianLayer(vol_img, gaussian_pyramid, g_start + gaussian_per_octave);
+				}
+
+				if (n > 0)
+				{
+					createDogLayer(gaussian_pyramid, dog_pyramid, d_start + n - 1);
+				}
+
+				//DoG layer n - 2 is ready for extrema detection when the layer above it is created
+				int q = n - 2;
+				if (q < 1)
+				{
+					continue;
+				}
+
+				std::vector<Keypoint3D> layer_kp;
+				detectExtrema(dog_pyramid, d_start + q, layer_kp);
+
+				//orientation and descriptor of keypoints are computed in the Gaussian layer at the same position
+				assignOrientation(layer_kp, gaussian_pyramid);
+				if (!layer_kp.empty())
+				{
+					float** descriptor = new2D((int)layer_kp.size(), DESCRIPTOR_LENGTH);
+					constructDescriptor(layer_kp, gaussian_pyramid, descriptor);
+
+					kp_queue.insert(kp_queue.end(), layer_kp.begin(), layer_kp.end());
+					layer_descriptor.push_back(descriptor);
+					layer_kp_amount.push_back((int)layer_kp.size());
+				}
+
+				//release the layers not needed by the following detection
+				gaussian_pyramid[g_start + q - 1].vol_mat.release();
+				gaussian_pyramid[g_start + q].vol_mat.release();
+				dog_pyramid[d_start + q - 1].vol_mat.release();
+			}
+
+			//release the rest layers of current octave
+			for (int n = 0; n < gaussian_per_octave; n++)
+			{
+				gaussian_pyramid[g_start + n].vol_mat.release();
+			}
+			for (int n = 0; n < dog_per_octave; n++)
+			{
+				dog_pyramid[d_start + n].vol_mat.release();
+			}
+		}
+
+		clearPyramid(gaussian_pyramid);
+		clearPyramid(dog_pyramid);
+
+		//gather the descriptors of all layers
+		float** descriptor = new2D((int)kp_queue.size(), DESCRIPTOR_LENGTH);
+		int kp_counter = 0;
+		int layer_number = (int)layer_descriptor.size();
+		for (int i = 0; i < layer_number; i++)
+		{
+			for (int j = 0; j < layer_kp_amount[i]; j++)
+			{
+				std::copy(layer_descriptor[i][j], layer_descriptor[i][j] + DESCRIPTOR_LENGTH, descriptor[kp_counter++]);
+			}
+			delete2D(layer_descriptor[i]);
+		}
+
+		return descriptor;
+	}
+
 	void SIFT3D::clear()
 	{
 		std::vector<Point3D>().swap(ref_matched_kp);
@@ -353,7 +495,7 @@ namespace opencorr
 		}
 	}
 
-	void SIFT3D::gaussianBlur(float*** src_img, float*** dst_img, int* dim_xyz, float* unit_xyz, float sigma)
+	void SIFT3D::gaussianBlur(Volume3D& src_img, Volume3D& dst_img, int* dim_xyz, float* unit_xyz, float sigma)
 	{
 		//determine the dimension with maximum physical unit
 		float unit_max = unit_xyz[0] > unit_xyz[1] ? unit_xyz[0] : unit_xyz[1];
@@ -390,7 +532,7 @@ namespace opencorr
 		}
 
 		//create an intermediate matrix for 3D convolution
-		float*** conv_buffer = new3D(dim_xyz[2], dim_xyz[1], dim_xyz[0]);
+		Volume3D conv_buffer(dim_xyz[0], dim_xyz[1], dim_xyz[2]);
 
 		//convolution along x-axis
 #pragma omp parallel for
@@ -531,13 +673,13 @@ namespace opencorr
 		}
 
 		//release memory
-		delete3D(conv_buffer);
+		conv_buffer.release();
 		delete[] kernel_x;
 		delete[] kernel_y;
 		delete[] kernel_z;
 	}
 
-	void SIFT3D::downSampling(float*** src_img, float*** dst_img, int* dst_dim_xyz)
+	void SIFT3D::downSampling(Volume3D& src_img, Volume3D& dst_img, int* dst_dim_xyz)
 	{
 #pragma omp parallel for
 		for (int i = 0; i < dst_dim_xyz[2]; i++)
@@ -557,10 +699,7 @@ namespace opencorr
 		int layer_number = (int)pyramid.size();
 		for (int i = 0; i < layer_number; i++)
 		{
-			if (pyramid[i].vol_mat != nullptr)
-			{
-				delete3D(pyramid[i].vol_mat);
-			}
+			pyramid[i].vol_mat.release();
 
 		}
 
@@ -614,67 +753,221 @@ namespace opencorr
 	}
 
 	int SIFT3D::bruteforceMatch(std::vector<Keypoint3D>& kp1, float** descriptor1, std::vector<Keypoint3D>& kp2, float** descriptor2, int* matched_idx)
+	{
+		return ratioTestMatch(kp1, descriptor1, kp2, descriptor2, matched_idx);
+	}
+
+	int SIFT3D::ratioTestMatch(std::vector<Keypoint3D>& kp1, float** descriptor1, std::vector<Keypoint3D>& kp2, float** descriptor2, int* matched_idx)
 	{
 		int kp1_amount = (int)kp1.size();
 		int kp2_amount = (int)kp2.size();
 		float matching_ratio_square = matching_ratio * matching_ratio;
 		int match_counter = 0;
 
-		//match each kp1 with all kp2
-#pragma omp parallel for reduction (+:match_counter)
+		//search the shortest distance and the second shortest distance for each kp1
+		std::vector<int> nearest_idx((size_t)kp1_amount * 2);
+		std::vector<float> nearest_distance((size_t)kp1_amount * 2);
+		searchDescriptors(descriptor1, kp1_amount, descriptor2, kp2_amount, nearest_idx.data(), nearest_distance.data());
+
+		//check if the matching ratio is satisfied
 		for (int i = 0; i < kp1_amount; i++)
 		{
-			//create two arrays for ratio check
-			int candidate_idx[2] = { -1,-1 };//[0]: the shortest, [1]: the second shortest,
-			float candidate_distance[2] = { FLT_MAX,FLT_MAX }; //[0]: the shortest, [1]: the second shortest
+			if (nearest_distance[2 * i] < matching_ratio_square * nearest_distance[2 * i + 1])
+			{
+				matched_idx[i] = nearest_idx[2 * i];
+				match_counter++;
+			}
+		}
+
+		return match_counter;
+	}
+
+	//keep the index and squared distance of the shortest one in [0] and the second shortest one in [1]
+	static inline void updateNearest(int idx, float squared_distance, int* candidate_idx, float* candidate_distance)
+	{
+		if (squared_distance < candidate_distance[0])
+		{
+			candidate_idx[1] = candidate_idx[0];
+			candidate_distance[1] = candidate_distance[0];
+			candidate_idx[0] = idx;
+			candidate_distance[0] = squared_distance;
+		}
+		else if (squared_distance < candidate_distance[1])
+		{
+			candidate_idx[1] = idx;
+			candidate_distance[1] = squared_distance;
+		}
+	}
+
+	void SIFT3D::searchDescriptors(float** descriptor1, int amount1, float** descriptor2, int amount2, int* nearest_idx, float* nearest_distance)
+	{
+		//a kd-tree does not pay off when all the descriptors are checked as candidates
+		if (matching_method == MATCHING_KDTREE && amount2 > candidate_number)
+		{
+			kdtreeSearch(descriptor1, amount1, descriptor2, amount2, nearest_idx, nearest_distance);
+		}
+		else
+		{
+			bruteforceSearch(descriptor1, amount1, descriptor2, amount2, nearest_idx, nearest_distance);
+		}
+	}
 
-			for (int j = 0; j < kp2_amount; j++)
+	void SIFT3D::bruteforceSearch(float** descriptor1, int amount1, float** descriptor2, int amount2, int* nearest_idx, float* nearest_distance)
+	{
+		//squared norms of descriptor2, shared by all the blocks of descriptor1
+		std::vector<float> squared_norm2(amount2);
+#pragma omp parallel for
+		for (int j = 0; j < amount2; j++)
+		{
+			float squared_norm = 0.f;
+#pragma omp simd reduction(+:squared_norm)
+			for (int k = 0; k < DESCRIPTOR_LENGTH; k++)
 			{
-				//calculate squared Euclidean distance between kp1 and kp2
-				float squared_distance = 0;
-				for (int k = 0; k < 768; k++)
-				{
-					float component_difference = descriptor1[i][k] - descriptor2[j][k];
-					squared_distance += component_difference * component_difference;
-				}
+				squared_norm += descriptor2[j][k] * descriptor2[j][k];
+			}
+			squared_norm2[j] = squared_norm;
+		}
+
+		//squared distance |d1 - d2|^2 = |d1|^2 + |d2|^2 - 2 * d1 * d2, where the inner products of two blocks are one matrix product
+		int block_number1 = (amount1 + MATCHING_BLOCK1 - 1) / MATCHING_BLOCK1;
+#pragma omp parallel for schedule(dynamic)
+		for (int b = 0; b < block_number1; b++)
+		{
+			int start1 = b * MATCHING_BLOCK1;
+			int length1 = amount1 - start1 < MATCHING_BLOCK1 ? amount1 - start1 : MATCHING_BLOCK1;
+
+			RowMatrixXf block1(length1, DESCRIPTOR_LENGTH);
+			RowMatrixXf block2(MATCHING_BLOCK2, DESCRIPTOR_LENGTH);
+			RowMatrixXf inner_product(length1, MATCHING_BLOCK2);
+			std::vector<float> squared_norm1(length1);
+
+			for (int i = 0; i < length1; i++)
+			{
+				int idx1 = start1 + i;
+				block1.row(i) = Eigen::Map<Eigen::RowVectorXf>(descriptor1[idx1], DESCRIPTOR_LENGTH);
+				squared_norm1[i] = block1.row(i).squaredNorm();
+
+				nearest_idx[2 * idx1] = -1;
+				nearest_idx[2 * idx1 + 1] = -1;
+				nearest_distance[2 * idx1] = FLT_MAX;
+				nearest_distance[2 * idx1 + 1] = FLT_MAX;
+			}
 
-				//store the information of kp with the shortest distance or the second shortest distance
-				if (squared_distance < candidate_distance[0])
+			for (int start2 = 0; start2 < amount2; start2 += MATCHING_BLOCK2)
+			{
+				int length2 = amount2 - start2 < MATCHING_BLOCK2 ? amount2 - start2 : MATCHING_BLOCK2;
+				for (int j = 0; j < length2; j++)
 				{
-					candidate_idx[1] = candidate_idx[0];
-					candidate_distance[1] = candidate_distance[0];
-					candidate_idx[0] = j;
-					candidate_distance[0] = squared_distance;
+					block2.row(j) = Eigen::Map<Eigen::RowVectorXf>(descriptor2[start2 + j], DESCRIPTOR_LENGTH);
 				}
-				else if (squared_distance < candidate_distance[1])
+				inner_product.leftCols(length2).noalias() = block1 * block2.topRows(length2).transpose();
+
+				for (int i = 0; i < length1; i++)
 				{
-					candidate_idx[1] = j;
-					candidate_distance[1] = squared_distance;
+					int idx1 = start1 + i;
+					for (int j = 0; j < length2; j++)
+					{
+						float squared_distance = squared_norm1[i] + squared_norm2[start2 + j] - 2.f * inner_product(i, j);
+						squared_distance = squared_distance > 0.f ? squared_distance : 0.f; //rounding error of very close descriptors
+						updateNearest(start2 + j, squared_distance, &nearest_idx[2 * idx1], &nearest_distance[2 * idx1]);
+					}
 				}
 			}
+		}
+	}
 
-			//check if the matching ratio is satisfied
-			if (candidate_distance[0] < matching_ratio_square * candidate_distance[1])
+	void SIFT3D::kdtreeSearch(float** descriptor1, int amount1, float** descriptor2, int amount2, int* nearest_idx, float* nearest_distance)
+	{
+		int dimension = reduced_dimension;
+		if (dimension > DESCRIPTOR_LENGTH)
+		{
+			dimension = DESCRIPTOR_LENGTH;
+		}
+		int search_k = candidate_number < amount2 ? candidate_number : amount2;
+
+		//principal components of descriptor2, estimated using the descriptors evenly sampled from the queue
+		int sample_number = amount2 < PCA_SAMPLE_NUMBER ? amount2 : PCA_SAMPLE_NUMBER;
+		RowMatrixXf sample(sample_number, DESCRIPTOR_LENGTH);
+		for (int i = 0; i < sample_number; i++)
+		{
+			int sample_idx = (int)((long long)i * amount2 / sample_number);
+			sample.row(i) = Eigen::Map<Eigen::RowVectorXf>(descriptor2[sample_idx], DESCRIPTOR_LENGTH);
+		}
+		Eigen::RowVectorXf mean = sample.colwise().mean();
+		sample.rowwise() -= mean;
+
+		Eigen::MatrixXf covariance = Eigen::MatrixXf::Zero(DESCRIPTOR_LENGTH, DESCRIPTOR_LENGTH);
+		covariance.selfadjointView<Eigen::Lower>().rankUpdate(sample.transpose());
+		Eigen::SelfAdjointEigenSolver<Eigen::MatrixXf> eigen_solver(covariance);
+		Eigen::MatrixXf basis = eigen_solver.eigenvectors().rightCols(dimension); //eigenvalues are in ascending order
+
+		//project descriptor2 onto the principal components and construct the kd-tree
+		RowMatrixXf reduced2(amount2, dimension);
+#pragma omp parallel for
+		for (int j = 0; j < amount2; j++)
+		{
+			reduced2.row(j).noalias() = (Eigen::Map<Eigen::RowVectorXf>(descriptor2[j], DESCRIPTOR_LENGTH) - mean) * basis;
+		}
+
+		DescriptorCloud descriptor_cloud;
+		descriptor_cloud.data = reduced2.data();
+		descriptor_cloud.amount = amount2;
+		descriptor_cloud.dimension = dimension;
+
+		using kdTree = nanoflann::KDTreeSingleIndexAdaptor<nanoflann::L2_Simple_Adaptor<float, DescriptorCloud>, DescriptorCloud, -1>;
+		kdTree kdt_index(dimension, descriptor_cloud, { 10 /* max leaf */ });
+
+#pragma omp parallel
+		{
+			Eigen::RowVectorXf reduced1(dimension);
+			std::vector<uint32_t> candidate_idx(search_k);
+			std::vector<float> candidate_distance(search_k);
+
+#pragma omp for schedule(dynamic, 64)
+			for (int i = 0; i < amount1; i++)
 			{
-				matched_idx[i] = candidate_idx[0];
-				match_counter++;
+				nearest_idx[2 * i] = -1;
+				nearest_idx[2 * i + 1] = -1;
+				nearest_distance[2 * i] = FLT_MAX;
+				nearest_distance[2 * i + 1] = FLT_MAX;
+
+				reduced1.noalias() = (Eigen::Map<Eigen::RowVectorXf>(descriptor1[i], DESCRIPTOR_LENGTH) - mean) * basis;
+				int found_number = (int)kdt_index.knnSearch(reduced1.data(), search_k, candidate_idx.data(), candidate_distance.data());
+
+				//check the candidates with full descriptors, in the order of index as brute force search does
+				std::sort(candidate_idx.begin(), candidate_idx.begin() + found_number);
+				for (int c = 0; c < found_number; c++)
+				{
+					int j = (int)candidate_idx[c];
+					float squared_distance = 0.f;
+#pragma omp simd reduction(+:squared_distance)
+					for (int k = 0; k < DESCRIPTOR_LENGTH; k++)
+					{
+						float component_difference = descriptor1[i][k] - descriptor2[j][k];
+						squared_distance += component_difference * component_difference;
+					}
+					updateNearest(j, squared_distance, &nearest_idx[2 * i], &nearest_distance[2 * i]);
+				}
 			}
 		}
-
-		return match_counter;
 	}
 
-	void SIFT3D::createGaussianPyramid(Image3D* vol_img, std::vector<Layer3D>& gaussian_pyramid)
+	int SIFT3D::getOctaveNumber(Image3D* vol_img) const
 	{
 		//determine the minimum dimension of the input image
 		int dim_min = vol_img->dim_x < vol_img->dim_y ? vol_img->dim_x : vol_img->dim_y;
 		dim_min = dim_min < vol_img->dim_z ? dim_min : vol_img->dim_z;
 
-		//set the octave and height of pyramid
-		sift_config.n_octave = floor(log2((float)dim_min) - log2((float)sift_config.min_dimension)) + 1;
-		sift_config.n_octave = sift_config.n_octave > 0 ? sift_config.n_octave : 1;
+		int n_octave = floor(log2((float)dim_min) - log2((float)sift_config.min_dimension)) + 1;
+		return n_octave > 0 ? n_octave : 1;
+	}
+
+	void SIFT3D::setGaussianPyramid(Image3D* vol_img, std::vector<Layer3D>& gaussian_pyramid)
+	{
+		//set the octave and height of pyramid, the octave number is kept local since the pyramids of two images may be created at the same time
+		int n_octave = getOctaveNumber(vol_img);
 		int layer_per_octave = sift_config.n_octave_layers + 3; //no local extrema search in the bottom layer and the top layer in each octave of DoG pyramid
-		int layer_number = sift_config.n_octave * layer_per_octave; //overall number of layers in a pyramid
+		int layer_number = n_octave * layer_per_octave; //overall number of layers in a pyramid
 		gaussian_pyramid.resize(layer_number);
 
 		//set the bottom layer
@@ -695,7 +988,6 @@ namespace opencorr
 		gaussian_pyramid[0].octave = 0;
 		gaussian_pyramid[0].scale = 1.f / kappa * sift_config.sigma_base;
 		gaussian_pyramid[0].sigma = sqrt(gaussian_pyramid[0].scale * gaussian_pyramid[0].scale - sift_config.sigma_source * sift_config.sigma_source);
-		gaussian_pyramid[0].vol_mat = new3D(z_length, y_length, x_length);
 
 		//set the other layers
 		for (int i = 1; i < layer_number; i++)
@@ -725,116 +1017,175 @@ namespace opencorr
 			gaussian_pyramid[i].unit_xyz[0] = x_unit;
 			gaussian_pyramid[i].unit_xyz[1] = y_unit;
 			gaussian_pyramid[i].unit_xyz[2] = z_unit;
+		}
+	}
+
+	void SIFT3D::createGaussianLayer(Image3D* vol_img, std::vector<Layer3D>& gaussian_pyramid, int layer_idx)
+	{
+		int layer_per_octave = sift_config.n_octave_layers + 3;
+		Layer3D& current_layer = gaussian_pyramid[layer_idx];
+		current_layer.vol_mat.allocate(current_layer.dim_xyz[0], current_layer.dim_xyz[1], current_layer.dim_xyz[2]);
 
-			gaussian_pyramid[i].vol_mat = new3D(z_length, y_length, x_length);
+		//fill the layer with blurred image
+		if (layer_idx == 0) //bottom layer
+		{
+			gaussianBlur(vol_img->vol_mat, current_layer.vol_mat, current_layer.dim_xyz, current_layer.unit_xyz, current_layer.sigma);
+		}
+		else if (layer_idx % layer_per_octave == 0) //bottom layer in current octave
+		{
+			downSampling(gaussian_pyramid[layer_idx - 3].vol_mat, current_layer.vol_mat, current_layer.dim_xyz);
+		}
+		else
+		{
+			gaussianBlur(gaussian_pyramid[layer_idx - 1].vol_mat, current_layer.vol_mat, current_layer.dim_xyz, current_layer.unit_xyz, current_layer.sigma);
 		}
+	}
 
-		//fill each layer with blurred image
-		gaussianBlur(vol_img->vol_mat, gaussian_pyramid[0].vol_mat, gaussian_pyramid[0].dim_xyz, gaussian_pyramid[0].unit_xyz, gaussian_pyramid[0].sigma); //bottom layer
-		for (int i = 1; i < layer_number; i++)
+	void SIFT3D::createGaussianPyramid(Image3D* vol_img, std::vector<Layer3D>& gaussian_pyramid)
+	{
+		setGaussianPyramid(vol_img, gaussian_pyramid);
+
+		int layer_number = (int)gaussian_pyramid.size();
+		for (int i = 0; i < layer_number; i++)
 		{
-			if (i % layer_per_octave == 0)
-			{
-				downSampling(gaussian_pyramid[i - 3].vol_mat, gaussian_pyramid[i].vol_mat, gaussian_pyramid[i].dim_xyz); //bottom layer in current octave
-			}
-			else
-			{
-				gaussianBlur(gaussian_pyramid[i - 1].vol_mat, gaussian_pyramid[i].vol_mat, gaussian_pyramid[i].dim_xyz, gaussian_pyramid[i].unit_xyz, gaussian_pyramid[i].sigma);
-			}
+			createGaussianLayer(vol_img, gaussian_pyramid, i);
 		}
 	}
 
 	void SIFT3D::createDogPyramid(std::vector<Layer3D>& gaussian_pyramid, std::vector<Layer3D>& dog_pyramid)
 	{
 		int layer_per_octave = sift_config.n_octave_layers + 2; //number of layers in each octave
-		dog_pyramid.resize(sift_config.n_octave * layer_per_octave);
+		int n_octave = (int)gaussian_pyramid.size() / (sift_config.n_octave_layers + 3);
+		dog_pyramid.resize(n_octave * layer_per_octave);
+
+		int layer_number = (int)dog_pyramid.size();
+		for (int i = 0; i < layer_number; i++)
+		{
+			createDogLayer(gaussian_pyramid, dog_pyramid, i);
+		}
+	}
+
+	void SIFT3D::createDogLayer(std::vector<Layer3D>& gaussian_pyramid, std::vector<Layer3D>& dog_pyramid, int layer_idx)
+	{
+		int layer_per_octave = sift_config.n_octave_layers + 2; //number of layers in each octave
+		int m = layer_idx / layer_per_octave;
+		int n = layer_idx % layer_per_octave;
+		int g_idx = m * (sift_config.n_octave_layers + 3) + n;
+
+		Layer3D& current_layer = dog_pyramid[layer_idx];
+		current_layer.dim_xyz[0] = gaussian_pyramid[g_idx].dim_xyz[0];
+		current_layer.dim_xyz[1] = gaussian_pyramid[g_idx].dim_xyz[1];
+		current_layer.dim_xyz[2] = gaussian_pyramid[g_idx].dim_xyz[2];
+		current_layer.unit_xyz[0] = gaussian_pyramid[g_idx].unit_xyz[0];
+		current_layer.unit_xyz[1] = gaussian_pyramid[g_idx].unit_xyz[1];
+		current_layer.unit_xyz[2] = gaussian_pyramid[g_idx].unit_xyz[2];
+		current_layer.octave = m;
+		current_layer.scale = gaussian_pyramid[g_idx].scale;
+		current_layer.vol_mat.allocate(current_layer.dim_xyz[0], current_layer.dim_xyz[1], current_layer.dim_xyz[2]);
+
+		//maximum absolute DoG value of each slice
+		std::vector<float> slice_max_abs(current_layer.dim_xyz[2], -1.f);
 
 #pragma omp parallel for
-		for (int m = 0; m < sift_config.n_octave; m++)
+		for (int i = 0; i < current_layer.dim_xyz[2]; i++)
 		{
-			for (int n = 0; n < layer_per_octave; n++)
+			for (int j = 0; j < current_layer.dim_xyz[1]; j++)
 			{
-				int g_idx = m * (sift_config.n_octave_layers + 3) + n;
-				int d_idx = m * layer_per_octave + n;
-				dog_pyramid[d_idx].dim_xyz[0] = gaussian_pyramid[g_idx].dim_xyz[0];
-				dog_pyramid[d_idx].dim_xyz[1] = gaussian_pyramid[g_idx].dim_xyz[1];
-				dog_pyramid[d_idx].dim_xyz[2] = gaussian_pyramid[g_idx].dim_xyz[2];
-				dog_pyramid[d_idx].unit_xyz[0] = gaussian_pyramid[g_idx].unit_xyz[0];
-				dog_pyramid[d_idx].unit_xyz[1] = gaussian_pyramid[g_idx].unit_xyz[1];
-				dog_pyramid[d_idx].unit_xyz[2] = gaussian_pyramid[g_idx].unit_xyz[2];
-				dog_pyramid[d_idx].octave = m;
-				dog_pyramid[d_idx].scale = gaussian_pyramid[g_idx].scale;
-				dog_pyramid[d_idx].vol_mat = new3D(dog_pyramid[d_idx].dim_xyz[2], dog_pyramid[d_idx].dim_xyz[1], dog_pyramid[d_idx].dim_xyz[0]);
-				dog_pyramid[d_idx].max_abs = -1.f;
-
-				for (int i = 0; i < dog_pyramid[d_idx].dim_xyz[2]; i++)
+				for (int k = 0; k < current_layer.dim_xyz[0]; k++)
 				{
-					for (int j = 0; j < dog_pyramid[d_idx].dim_xyz[1]; j++)
-					{
-						for (int k = 0; k < dog_pyramid[d_idx].dim_xyz[0]; k++)
-						{
-							dog_pyramid[d_idx].vol_mat[i][j][k] = gaussian_pyramid[g_idx + 1].vol_mat[i][j][k] - gaussian_pyramid[g_idx].vol_mat[i][j][k];
-							float dog_abs = fabs(dog_pyramid[d_idx].vol_mat[i][j][k]);
-							dog_pyramid[d_idx].max_abs = dog_pyramid[d_idx].max_abs < dog_abs ? dog_abs : dog_pyramid[d_idx].max_abs;
-						}
-					}
+					current_layer.vol_mat[i][j][k] = gaussian_pyramid[g_idx + 1].vol_mat[i][j][k] - gaussian_pyramid[g_idx].vol_mat[i][j][k];
+					float dog_abs = fabs(current_layer.vol_mat[i][j][k]);
+					slice_max_abs[i] = slice_max_abs[i] < dog_abs ? dog_abs : slice_max_abs[i];
 				}
 			}
 		}
+
+		current_layer.max_abs = -1.f;
+		for (int i = 0; i < current_layer.dim_xyz[2]; i++)
+		{
+			current_layer.max_abs = current_layer.max_abs < slice_max_abs[i] ? slice_max_abs[i] : current_layer.max_abs;
+		}
 	}
 
 	void SIFT3D::detectExtrema(std::vector<Layer3D>& dog_pyramid, std::vector<Keypoint3D>& kp_queue)
 	{
-		for (int m = 0; m < sift_config.n_octave; m++)
+		int layer_per_octave = sift_config.n_octave_layers + 2;
+		int n_octave = (int)dog_pyramid.size() / layer_per_octave;
+
+		//skip the bottom layer and the top layer in each octave
+		for (int m = 0; m < n_octave; m++)
 		{
-			//skip the bottom layer and the top layer
 			for (int n = 1; n < (sift_config.n_octave_layers + 1); n++)
 			{
-				int layer_idx = m * (sift_config.n_octave_layers + 2) + n;
-				for (int i = IMG_BORDER; i < dog_pyramid[layer_idx].dim_xyz[2] - IMG_BORDER; i++)
+				detectExtrema(dog_pyramid, m * layer_per_octave + n, kp_queue);
+			}
+		}
+	}
+
+	void SIFT3D::detectExtrema(std::vector<Layer3D>& dog_pyramid, int layer_idx, std::vector<Keypoint3D>& kp_queue)
+	{
+		int layer_per_octave = sift_config.n_octave_layers + 2;
+		int slice_number = dog_pyramid[layer_idx].dim_xyz[2] - 2 * IMG_BORDER;
+		slice_number = slice_number > 0 ? slice_number : 0;
+
+		//each slice collects its keypoints in its own queue
+		std::vector<std::vector<Keypoint3D>> slice_kp(slice_number);
+
+#pragma omp parallel for schedule(dynamic)
+		for (int s = 0; s < slice_number; s++)
+		{
+			int i = s + IMG_BORDER;
+			Volume3D& dog_mat = dog_pyramid[layer_idx].vol_mat;
+			Volume3D& dog_mat_below = dog_pyramid[layer_idx - 1].vol_mat;
+			Volume3D& dog_mat_above = dog_pyramid[layer_idx + 1].vol_mat;
+			float dog_threshold = sift_config.alpha * dog_pyramid[layer_idx].max_abs;
+
+			for (int j = IMG_BORDER; j < dog_pyramid[layer_idx].dim_xyz[1] - IMG_BORDER; j++)
+			{
+				for (int k = IMG_BORDER; k < dog_pyramid[layer_idx].dim_xyz[0] - IMG_BORDER; k++)
 				{
-					for (int j = IMG_BORDER; j < dog_pyramid[layer_idx].dim_xyz[1] - IMG_BORDER; j++)
+					float dog_value = dog_mat[i][j][k];
+
+					//check if the DoG value is large enough
+					if (fabs(dog_value) >= dog_threshold)
 					{
-						for (int k = IMG_BORDER; k < dog_pyramid[layer_idx].dim_xyz[0] - IMG_BORDER; k++)
+						//check if the DoG value at current position is greater or less than all the eight neighbors
+						if ((dog_value > dog_mat[i - 1][j][k]
+							&& dog_value > dog_mat[i + 1][j][k]
+							&& dog_value > dog_mat[i][j - 1][k]
+							&& dog_value > dog_mat[i][j + 1][k]
+							&& dog_value > dog_mat[i][j][k - 1]
+							&& dog_value > dog_mat[i][j][k + 1]
+							&& dog_value > dog_mat_below[i][j][k]
+							&& dog_value > dog_mat_above[i][j][k])
+							|| (dog_value < dog_mat[i - 1][j][k]
+								&& dog_value < dog_mat[i + 1][j][k]
+								&& dog_value < dog_mat[i][j - 1][k]
+								&& dog_value < dog_mat[i][j + 1][k]
+								&& dog_value < dog_mat[i][j][k - 1]
+								&& dog_value < dog_mat[i][j][k + 1]
+								&& dog_value < dog_mat_below[i][j][k]
+								&& dog_value < dog_mat_above[i][j][k]))
 						{
-							float dog_value = dog_pyramid[layer_idx].vol_mat[i][j][k];
-
-							//check if the DoG value is large enough
-							if (fabs(dog_value) >= sift_config.alpha * dog_pyramid[layer_idx].max_abs)
-							{
-								//check if the DoG value at current position is greater or less than all the eight neighbors
-								if ((dog_value > dog_pyramid[layer_idx].vol_mat[i - 1][j][k]
-									&& dog_value > dog_pyramid[layer_idx].vol_mat[i + 1][j][k]
-									&& dog_value > dog_pyramid[layer_idx].vol_mat[i][j - 1][k]
-									&& dog_value > dog_pyramid[layer_idx].vol_mat[i][j + 1][k]
-									&& dog_value > dog_pyramid[layer_idx].vol_mat[i][j][k - 1]
-									&& dog_value > dog_pyramid[layer_idx].vol_mat[i][j][k + 1]
-									&& dog_value > dog_pyramid[layer_idx - 1].vol_mat[i][j][k]
-									&& dog_value > dog_pyramid[layer_idx + 1].vol_mat[i][j][k])
-									|| (dog_value < dog_pyramid[layer_idx].vol_mat[i - 1][j][k]
-										&& dog_value < dog_pyramid[layer_idx].vol_mat[i + 1][j][k]
-										&& dog_value < dog_pyramid[layer_idx].vol_mat[i][j - 1][k]
-										&& dog_value < dog_pyramid[layer_idx].vol_mat[i][j + 1][k]
-										&& dog_value < dog_pyramid[layer_idx].vol_mat[i][j][k - 1]
-										&& dog_value < dog_pyramid[layer_idx].vol_mat[i][j][k + 1]
-										&& dog_value < dog_pyramid[layer_idx - 1].vol_mat[i][j][k]
-										&& dog_value < dog_pyramid[layer_idx + 1].vol_mat[i][j][k]))
-								{
-									Keypoint3D keypoint_candidate;
-									keypoint_candidate.coor_layer.x = k;
-									keypoint_candidate.coor_layer.y = j;
-									keypoint_candidate.coor_layer.z = i;
-									keypoint_candidate.layer = n; //position of layer in its octave
-									keypoint_candidate.octave = m;
-									keypoint_candidate.scale = dog_pyramid[layer_idx].scale;
-									kp_queue.push_back(keypoint_candidate);
-								}
-							}
+							Keypoint3D keypoint_candidate;
+							keypoint_candidate.coor_layer.x = k;
+							keypoint_candidate.coor_layer.y = j;
+							keypoint_candidate.coor_layer.z = i;
+							keypoint_candidate.layer = layer_idx % layer_per_octave; //position of layer in its octave
+							keypoint_candidate.octave = layer_idx / layer_per_octave;
+							keypoint_candidate.scale = dog_pyramid[layer_idx].scale;
+							slice_kp[s].push_back(keypoint_candidate);
 						}
 					}
 				}
 			}
 		}
+
+		//merge the queues in the order of slices, which keeps the order of keypoints in a serial scan
+		for (int s = 0; s < slice_number; s++)
+		{
+			kp_queue.insert(kp_queue.end(), slice_kp[s].begin(), slice_kp[s].end());
+		}
 	}
 
 	void SIFT3D::assignOrientation(std::vector<Keypoint3D>& kp_queue, std::vector<Layer3D>& gaussian_pyramid)
@@ -1252,44 +1603,19 @@ namespace opencorr
 		std::vector<KeypointChecker> kp_matches(kp1_amount, kp_chk);
 
 		//match each reference keypoint with target keypoints
+		std::vector<int> nearest_idx((size_t)kp1_amount * 2);
+		std::vector<float> nearest_distance((size_t)kp1_amount * 2);
+		searchDescriptors(descriptor1, kp1_amount, descriptor2, kp2_amount, nearest_idx.data(), nearest_distance.data());
+
 #pragma omp parallel for
 		for (int i = 0; i < kp1_amount; i++)
 		{
-			//create two arrays for ratio check
-			int candidate_idx[2] = { -1,-1 };//[0]: the shortest, [1]: the second shortest,
-			float candidate_distance[2] = { FLT_MAX,FLT_MAX }; //[0]: the shortest, [1]: the second shortest
-
-			for (int j = 0; j < kp2_amount; j++)
-			{
-				//calculate squared Euclidean distance between kp1 and kp2
-				float squared_distance = 0;
-				for (int k = 0; k < 768; k++)
-				{
-					float component_difference = descriptor1[i][k] - descriptor2[j][k];
-					squared_distance += component_difference * component_difference;
-				}
-
-				//store the information of kp with the shortest distance or the second shortest distance
-				if (squared_distance < candidate_distance[0])
-				{
-					candidate_idx[1] = candidate_idx[0];
-					candidate_distance[1] = candidate_distance[0];
-					candidate_idx[0] = j;
-					candidate_distance[0] = squared_distance;
-				}
-				else if (squared_distance < candidate_distance[1])
-				{
-					candidate_idx[1] = j;
-					candidate_distance[1] = squared_distance;
-				}
-			}
-
 			//check if the matching ratio is satisfied
-			if (candidate_distance[0] < matching_ratio_square * candidate_distance[1])
+			if (nearest_distance[2 * i] < matching_ratio_square * nearest_distance[2 * i + 1])
 			{
 				kp_matches[i].ref_idx = i;
-				kp_matches[i].tar_idx = candidate_idx[0];
-				kp_matches[i].dist = candidate_distance[0];
+				kp_matches[i].tar_idx = nearest_idx[2 * i];
+				kp_matches[i].dist = nearest_distance[2 * i];
 			}
 		}
 
@@ -1412,14 +1738,14 @@ namespace opencorr
 		int kp1_amount = (int)kp1.size();
 		int kp2_amount = (int)kp2.size();
 
-		//match the keypoints in the two images, using brute force search, reject the keypoints with eta >= matching_ratio
+		//match the keypoints in the two images, using the set matching method, reject the keypoints with eta >= matching_ratio
 		int* r2t_idx = new int[kp1_amount]; //index of matched tar_kp
-		std::fill(&r2t_idx[0], &r2t_idx[0] + kp1_amount - 1, -1); //initialze the array of index
-		int r2t_number = bruteforceMatch(kp1, descriptor1, kp2, descriptor2, r2t_idx); //ref->tar
+		std::fill(&r2t_idx[0], &r2t_idx[0] + kp1_amount, -1); //initialze the array of index
+		int r2t_number = ratioTestMatch(kp1, descriptor1, kp2, descriptor2, r2t_idx); //ref->tar
 
 		int* t2r_idx = new int[kp2_amount]; //index of matched ref_kp
-		std::fill(&t2r_idx[0], &t2r_idx[0] + kp2_amount - 1, -1); //initialze the array of index
-		int t2r_number = bruteforceMatch(kp2, descriptor2, kp1, descriptor1, t2r_idx); //tar->ref
+		std::fill(&t2r_idx[0], &t2r_idx[0] + kp2_amount, -1); //initialze the array of index
+		int t2r_number = ratioTestMatch(kp2, descriptor2, kp1, descriptor1, t2r_idx); //tar->ref
 
 		//bidirectional check
 #pragma omp parallel for
@@ -84,7 +84,7 @@ namespace opencorr
 
 	struct Layer3D
 	{
-		float*** vol_mat;
+		Volume3D vol_mat;
 		int dim_xyz[3]; //{ dim_x, dim_y, dim_z }
 		float unit_xyz[3]; //{ unit_x, unit_y, unit_z }
 		int octave;
@@ -132,6 +132,41 @@ namespace opencorr
 		float dist;
 	};
 
+	enum DescriptorMatching
+	{
+		MATCHING_BRUTEFORCE, //exhaustive search, descriptors are compared block by block
+		MATCHING_KDTREE //approximate search in a kd-tree of descriptors reduced by PCA, the candidates are checked with full descriptors
+	};
+
+	//descriptors reduced by PCA, stored row by row and accessed as the dataset of nanoflann
+	struct DescriptorCloud
+	{
+		using coord_t = float;
+
+		const float* data = nullptr;
+		int amount = 0; //number of descriptors
+		int dimension = 0; //number of components in a reduced descriptor
+
+		//return the number of descriptors
+		inline size_t kdtree_get_point_count() const
+		{
+			return (size_t)amount;
+		}
+
+		//return the dim'th component of the idx'th descriptor
+		inline float kdtree_get_pt(const size_t idx, const size_t dim) const
+		{
+			return data[idx * dimension + dim];
+		}
+
+		//optional bounding-box computation
+		template <class BBOX>
+		bool kdtree_get_bbox(BBOX& /* bb */) const
+		{
+			return false;
+		}
+	};
+
 	class SIFT3D : public Feature3D
 	{
 	private:
@@ -141,8 +176,14 @@ namespace opencorr
 		Sift3dConfig sift_config;
 		float matching_ratio; //ratio of the shortest distance to the second shortest distance
 		float physical_unit[3]; //physical unit per image voxel
+		bool concurrent_extraction; //extract the features of ref image and tar image at the same time, with two pyramids in memory
+		DescriptorMatching matching_method; //search of the two nearest descriptors for ratio test
+		int reduced_dimension; //number of principal components kept in the kd-tree
+		int candidate_number; //number of candidates taken from the kd-tree and checked with full descriptors
 
 	public:
+		static const int DESCRIPTOR_LENGTH = 768; //number of components in a descriptor
+
 		std::vector<Point3D> ref_matched_kp; //matched keypoints in ref image
 		std::vector<Point3D> tar_matched_kp; //matched keypoints in tar image
 
@@ -152,9 +193,16 @@ namespace opencorr
 		Sift3dConfig getSiftConfig() const;
 		float getPhysicalUnit(int dim) const; //dim = 0,1,2 means x,y,z respectively
 		float getMatchingRatio() const;
+		bool getConcurrentExtraction() const;
+		DescriptorMatching getMatchingMethod() const;
+		int getReducedDimension() const;
+		int getCandidateNumber() const;
 		void setSiftConfig(Sift3dConfig sift_config);
 		void setPhysicalUnit(float unit_x, float unit_y, float unit_z);
 		void setMatchingRatio(float matching_ratio);
+		void setConcurrentExtraction(bool concurrent_extraction);
+		void setMatchingMethod(DescriptorMatching matching_method);
+		void setKdTreeSearch(int reduced_dimension, int candidate_number);
 
 		void prepare();
 		void compute();
@@ -162,17 +210,31 @@ namespace opencorr
 		void clear();
 
 		void initializeIcosahedron(TriangleTile* icosahedron);
-		void gaussianBlur(float*** src_img, float*** dst_img, int* dim_xyz, float* unit_xyz, float sigma); //dim_xyz[] = { x, y, z }
-		void downSampling(float*** src_img, float*** dst_img, int* dst_dim_xyz); //dim_xyz[] = { x, y, z }
+		void gaussianBlur(Volume3D& src_img, Volume3D& dst_img, int* dim_xyz, float* unit_xyz, float sigma); //dim_xyz[] = { x, y, z }
+		void downSampling(Volume3D& src_img, Volume3D& dst_img, int* dst_dim_xyz); //dim_xyz[] = { x, y, z }
 		void clearPyramid(std::vector<Layer3D>& pyramid);
 		int cartisan2Barycentric(Point3D& cart_coor, Point3D& bary_coor, TriangleTile& triangle); //convert the Cartisian coordinates of intersection point to barycentric coordinate system in regular triangle
-		int bruteforceMatch(std::vector<Keypoint3D>& kp1, float** descriptor1, std::vector<Keypoint3D>& kp2, float** descriptor2, int* matched_idx);
+		int getOctaveNumber(Image3D* vol_img) const; //number of octaves in the pyramid of an image
+		int ratioTestMatch(std::vector<Keypoint3D>& kp1, float** descriptor1, std::vector<Keypoint3D>& kp2, float** descriptor2, int* matched_idx); //ratio test, the nearest descriptors are searched using the set matching method
+		int bruteforceMatch(std::vector<Keypoint3D>& kp1, float** descriptor1, std::vector<Keypoint3D>& kp2, float** descriptor2, int* matched_idx); //deprecated, kept for compatibility, calls ratioTestMatch
+
+		//two nearest descriptors in descriptor2 for each one in descriptor1, stored in nearest_idx[2 * i] and nearest_idx[2 * i + 1] with their squared distances
+		void searchDescriptors(float** descriptor1, int amount1, float** descriptor2, int amount2, int* nearest_idx, float* nearest_distance);
+		void bruteforceSearch(float** descriptor1, int amount1, float** descriptor2, int amount2, int* nearest_idx, float* nearest_distance);
+		void kdtreeSearch(float** descriptor1, int amount1, float** descriptor2, int amount2, int* nearest_idx, float* nearest_distance);
 
 		void createGaussianPyramid(Image3D* vol_img, std::vector<Layer3D>& pyramid);
 		void createDogPyramid(std::vector<Layer3D>& gaussian_pyramid, std::vector<Layer3D>& dog_pyramid);
 		void detectExtrema(std::vector<Layer3D>& dog_pyramid, std::vector<Keypoint3D>& kp_queue);
+
+		//the pyramids can also be processed layer by layer, with only a few layers allocated at a time
+		void setGaussianPyramid(Image3D* vol_img, std::vector<Layer3D>& gaussian_pyramid); //set the parameters of all the layers without allocating their volumes
+		void createGaussianLayer(Image3D* vol_img, std::vector<Layer3D>& gaussian_pyramid, int layer_idx); //the layer below it (or three layers below for the bottom of an octave) must be allocated
+		void createDogLayer(std::vector<Layer3D>& gaussian_pyramid, std::vector<Layer3D>& dog_pyramid, int layer_idx); //the two Gaussian layers involved must be allocated
+		void detectExtrema(std::vector<Layer3D>& dog_pyramid, int layer_idx, std::vector<Keypoint3D>& kp_queue); //the layer and its two adjacent layers must be allocated
 		void assignOrientation(std::vector<Keypoint3D>& kp_queue, std::vector<Layer3D>& gaussian_pyramid);
 		void constructDescriptor(std::vector<Keypoint3D>& kp_queue, std::vector<Layer3D>& gaussian_pyramid, float** descriptor);
+		float** extractFeatures(Image3D* vol_img, std::vector<Keypoint3D>& kp_queue); //the returned descriptors are released by caller using delete2D()
 		void monodirectionalMatch(std::vector<Keypoint3D>& kp1, float** descriptor1, std::vector<Keypoint3D>& kp2, float** descriptor2,
 			std::vector<Point3D>& matched_kp1, std::vector<Point3D>& matched_kp2); //monodirectional matching, but many-to-one correspondences are eliminated through reverse matching
 		void bidirectionalMatch(std::vector<Keypoint3D>& kp1, float** descriptor1, std::vector<Keypoint3D>& kp2, float** descriptor2,
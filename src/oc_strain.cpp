@@ -12,20 +12,13 @@
  * More information about OpenCorr can be found at https://www.opencorr.org/
  */
 
+#include <algorithm>
+#include <cmath>
+
 #include "oc_strain.h"
 
 namespace opencorr
 {
-	NearestNeighbor* Strain::getInstance(int tid)
-	{
-		if (tid >= (int)instance_pool.size())
-		{
-			throw std::string("CPU thread ID over limit");
-		}
-
-		return instance_pool[tid];
-	}
-
 	Strain::Strain(float subregion_radius, int min_neighbor_num, int thread_number)
 	{
 		setSubregionRadius(subregion_radius);
@@ -34,22 +27,15 @@ namespace opencorr
 		setZnccThreshold(0.9f);
 		setDescription(1);
 		setApproximation(1);
+		setLatticeIndexing(true);
 
 		this->thread_number = thread_number;
-		for (int i = 0; i < thread_number; i++)
-		{
-			NearestNeighbor* instance = new NearestNeighbor();
-			instance_pool.push_back(instance);
-		}
+		neighbor_search = new NearestNeighbor();
 	}
 
 	Strain::~Strain()
 	{
-		for (auto& instance : instance_pool)
-		{
-			delete instance;
-		}
-		instance_pool.clear();
+		delete neighbor_search;
 	}
 
 	float Strain::getSubregionRadius() const
@@ -92,6 +78,207 @@ namespace opencorr
 		this->approximation = approximation;
 	}
 
+	void Strain::setLatticeIndexing(bool lattice_indexing)
+	{
+		this->lattice_indexing = lattice_indexing;
+	}
+
+	void Strain::setLattice(std::vector<Point3D>& pt_queue, int dimension)
+	{
+		lattice = StrainLattice();
+		int queue_length = (int)pt_queue.size();
+		if (!lattice_indexing || queue_length == 0)
+		{
+			return;
+		}
+
+		//the distinct coordinates along each axis should be evenly spaced
+		int dim[3] = { 1, 1, 1 };
+		float origin[3] = { 0.f, 0.f, 0.f };
+		float spacing[3] = { 1.f, 1.f, 1.f };
+		std::vector<float> coor(queue_length);
+		for (int d = 0; d < dimension; d++)
+		{
+			for (int i = 0; i < queue_length; i++)
+			{
+				coor[i] = d == 0 ? pt_queue[i].x : (d == 1 ? pt_queue[i].y : pt_queue[i].z);
+			}
+			std::sort(coor.begin(), coor.end());
+			int distinct_number = (int)(std::unique(coor.begin(), coor.end()) - coor.begin());
+
+			dim[d] = distinct_number;
+			origin[d] = coor[0];
+			spacing[d] = distinct_number > 1 ? (coor[distinct_number - 1] - coor[0]) / (distinct_number - 1) : 1.f;
+			for (int i = 0; i < distinct_number; i++)
+			{
+				if (fabs(coor[i] - (origin[d] + i * spacing[d])) > 0.001f * spacing[d])
+				{
+					return;
+				}
+			}
+		}
+
+		//each node should be taken by exactly one POI
+		if ((long long)dim[0] * dim[1] * dim[2] != queue_length)
+		{
+			return;
+		}
+		lattice.node_poi.assign(queue_length, -1);
+		lattice.poi_node.resize(queue_length);
+		for (int i = 0; i < queue_length; i++)
+		{
+			int ix = (int)round((pt_queue[i].x - origin[0]) / spacing[0]);
+			int iy = dimension > 1 ? (int)round((pt_queue[i].y - origin[1]) / spacing[1]) : 0;
+			int iz = dimension > 2 ? (int)round((pt_queue[i].z - origin[2]) / spacing[2]) : 0;
+			int node = (iz * dim[1] + iy) * dim[0] + ix;
+			if (lattice.node_poi[node] != -1)
+			{
+				lattice = StrainLattice();
+				return;
+			}
+			lattice.node_poi[node] = i;
+			lattice.poi_node[i] = node;
+		}
+
+		//the neighbors are the nodes in subregion, the same as the ones returned by radius search in kd-tree
+		float squared_radius = subregion_radius * subregion_radius;
+		for (int d = 0; d < 3; d++)
+		{
+			lattice.reach[d] = d < dimension ? (int)floor(subregion_radius / spacing[d]) : 0;
+		}
+		for (int oz = -lattice.reach[2]; oz <= lattice.reach[2]; oz++)
+		{
+			for (int oy = -lattice.reach[1]; oy <= lattice.reach[1]; oy++)
+			{
+				for (int ox = -lattice.reach[0]; ox <= lattice.reach[0]; ox++)
+				{
+					float dx = ox * spacing[0];
+					float dy = oy * spacing[1];
+					float dz = oz * spacing[2];
+					if (dx * dx + dy * dy + dz * dz < squared_radius)
+					{
+						lattice.stencil_x.push_back(ox);
+						lattice.stencil_y.push_back(oy);
+						lattice.stencil_z.push_back(oz);
+						lattice.stencil_node.push_back((oz * dim[1] + oy) * dim[0] + ox);
+					}
+				}
+			}
+		}
+
+		//leave the POIs to kNN search if the subregion does not hold enough nodes
+		int stencil_size = (int)lattice.stencil_node.size();
+		if (stencil_size < min_neighbor_num || stencil_size < dimension + 1)
+		{
+			lattice = StrainLattice();
+			return;
+		}
+
+		//pseudo-inverse of the coefficient matrix used in the fitting of displacement field
+		Eigen::MatrixXf coefficient_matrix(stencil_size, dimension + 1);
+		for (int i = 0; i < stencil_size; i++)
+		{
+			coefficient_matrix(i, 0) = 1.f;
+			coefficient_matrix(i, 1) = lattice.stencil_x[i] * spacing[0];
+			if (dimension > 1)
+			{
+				coefficient_matrix(i, 2) = lattice.stencil_y[i] * spacing[1];
+			}
+			if (dimension > 2)
+			{
+				coefficient_matrix(i, 3) = lattice.stencil_z[i] * spacing[2];
+			}
+		}
+		Eigen::MatrixXf pseudo_inverse = coefficient_matrix.colPivHouseholderQr().solve(Eigen::MatrixXf::Identity(stencil_size, stencil_size));
+
+		lattice.weight_x.resize(stencil_size);
+		lattice.weight_y.resize(stencil_size, 0.f);
+		lattice.weight_z.resize(stencil_size, 0.f);
+		for (int i = 0; i < stencil_size; i++)
+		{
+			lattice.weight_x[i] = pseudo_inverse(1, i);
+			if (dimension > 1)
+			{
+				lattice.weight_y[i] = pseudo_inverse(2, i);
+			}
+			if (dimension > 2)
+			{
+				lattice.weight_z[i] = pseudo_inverse(3, i);
+			}
+		}
+
+		lattice.dim[0] = dim[0];
+		lattice.dim[1] = dim[1];
+		lattice.dim[2] = dim[2];
+	}
+
+	bool Strain::isLatticeInterior(int poi_idx, std::vector<char>& poi_valid)
+	{
+		int node = lattice.poi_node[poi_idx];
+		int ix = node % lattice.dim[0];
+		int iy = (node / lattice.dim[0]) % lattice.dim[1];
+		int iz = node / (lattice.dim[0] * lattice.dim[1]);
+		if (ix < lattice.reach[0] || ix >= lattice.dim[0] - lattice.reach[0]
+			|| iy < lattice.reach[1] || iy >= lattice.dim[1] - lattice.reach[1]
+			|| iz < lattice.reach[2] || iz >= lattice.dim[2] - lattice.reach[2])
+		{
+			return false;
+		}
+
+		int stencil_size = (int)lattice.stencil_node.size();
+		for (int i = 0; i < stencil_size; i++)
+		{
+			if (!poi_valid[lattice.node_poi[node + lattice.stencil_node[i]]])
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	void Strain::assignStrain(StrainVector2D& strain, float ux, float uy, float vx, float vy)
+	{
+		if (approximation == 1)
+		{
+			//calculate the Cauchy strain and save them for output
+			strain.exx = ux;
+			strain.eyy = vy;
+			strain.exy = 0.5f * (uy + vx);
+		}
+		if (approximation == 2)
+		{
+			//calculate the Green strain and save them for output
+			strain.exx = ux + 0.5f * (ux * ux + vx * vx);
+			strain.eyy = vy + 0.5f * (uy * uy + vy * vy);
+			strain.exy = 0.5f * (uy + vx + uy * ux + vy * vx);
+		}
+	}
+
+	void Strain::assignStrain(StrainVector3D& strain, float ux, float uy, float uz, float vx, float vy, float vz, float wx, float wy, float wz)
+	{
+		if (approximation == 1)
+		{
+			//calculate the Cauchy strain and save them for output
+			strain.exx = ux;
+			strain.eyy = vy;
+			strain.ezz = wz;
+			strain.exy = 0.5f * (uy + vx);
+			strain.eyz = 0.5f * (vz + wy);
+			strain.ezx = 0.5f * (wx + uz);
+		}
+		if (approximation == 2)
+		{
+			//calculate the Green strain and save them for output
+			strain.exx = ux + 0.5f * (ux * ux + vx * vx + wx * wx);
+			strain.eyy = vy + 0.5f * (uy * uy + vy * vy + wy * wy);
+			strain.ezz = wz + 0.5f * (uz * uz + vz * vz + wz * wz);
+			strain.exy = 0.5f * (uy + vx + uy * ux + vy * vx + wy * wx);
+			strain.eyz = 0.5f * (vz + wy + uz * uy + vz * vy + wz * wy);
+			strain.ezx = 0.5f * (wx + uz + ux * uz + vx * vz + wx * wz);
+		}
+	}
+
 	void Strain::prepare(std::vector<POI2D>& poi_queue)
 	{
 		int queue_size = (int)poi_queue.size();
@@ -104,14 +291,17 @@ namespace opencorr
 			pt_queue[i].y = poi_queue[i].y;
 		}
 
-#pragma omp parallel for
-		for (int i = 0; i < thread_number; i++)
+		neighbor_search->assignPoints(pt_queue);
+		neighbor_search->setSearchRadius(subregion_radius);
+		neighbor_search->setSearchK(min_neighbor_num);
+		neighbor_search->constructKdTree();
+
+		std::vector<Point3D> lattice_queue(queue_size);
+		for (int i = 0; i < queue_size; i++)
 		{
-			instance_pool[i]->assignPoints(pt_queue);
-			instance_pool[i]->setSearchRadius(subregion_radius);
-			instance_pool[i]->setSearchK(min_neighbor_num);
-			instance_pool[i]->constructKdTree();
+			lattice_queue[i] = Point3D(poi_queue[i].x, poi_queue[i].y, 0.f);
 		}
+		setLattice(lattice_queue, 2);
 	}
 
 	void Strain::prepare(std::vector<POI2DS>& poi_queue)
@@ -126,14 +316,13 @@ namespace opencorr
 			pt_queue[i].y = poi_queue[i].y;
 		}
 
-#pragma omp parallel for
-		for (int i = 0; i < thread_number; i++)
-		{
-			instance_pool[i]->assignPoints(pt_queue);
-			instance_pool[i]->setSearchRadius(subregion_radius);
-			instance_pool[i]->setSearchK(min_neighbor_num);
-			instance_pool[i]->constructKdTree();
-		}
+		neighbor_search->assignPoints(pt_queue);
+		neighbor_search->setSearchRadius(subregion_radius);
+		neighbor_search->setSearchK(min_neighbor_num);
+		neighbor_search->constructKdTree();
+
+		//the fitting is based on the reconstructed coordinates, which do not form a lattice
+		lattice = StrainLattice();
 	}
 
 	void Strain::prepare(std::vector<POI3D>& poi_queue)
@@ -149,433 +338,305 @@ namespace opencorr
 			pt_queue[i].z = poi_queue[i].z;
 		}
 
-#pragma omp parallel for
-		for (int i = 0; i < thread_number; i++)
-		{
-			instance_pool[i]->assignPoints(pt_queue);
-			instance_pool[i]->setSearchRadius(subregion_radius);
-			instance_pool[i]->setSearchK(min_neighbor_num);
-			instance_pool[i]->constructKdTree();
-		}
+		neighbor_search->assignPoints(pt_queue);
+		neighbor_search->setSearchRadius(subregion_radius);
+		neighbor_search->setSearchK(min_neighbor_num);
+		neighbor_search->constructKdTree();
+
+		setLattice(pt_queue, 3);
 	}
 
-	void Strain::compute(POI2D* poi, std::vector<POI2D>& poi_queue)
+	bool Strain::isAvailable(POI2D& poi) const
 	{
-		//get instance of NearestNeighbor according to thread id
-		NearestNeighbor* neighbor_search = getInstance(omp_get_thread_num());
+		return poi.result.zncc >= zncc_threshold;
+	}
 
-		//3D point for approximation of nearest neighbors
-		Point3D current_point(poi->x, poi->y, 0.f);
+	bool Strain::isAvailable(POI2DS& poi) const
+	{
+		return poi.result.r1r2_zncc >= zncc_threshold
+			&& poi.result.r1t1_zncc >= zncc_threshold
+			&& poi.result.r1t2_zncc >= zncc_threshold;
+	}
+
+	bool Strain::isAvailable(POI3D& poi) const
+	{
+		return poi.result.zncc >= zncc_threshold;
+	}
 
-		//POI queue for displacment field fitting
-		std::vector<POI2D> pois_fit;
+	template <class PoiType>
+	int Strain::getNeighbors(Point3D location, std::vector<PoiType>& poi_queue, StrainScratch& scratch)
+	{
+		scratch.neighbor_idx.clear();
 
 		//search the neighbor POIs in a subregion of given radius
-		std::vector<nanoflann::ResultItem<uint32_t, float>> current_matches;
-		int neighbor_num = neighbor_search->radiusSearch(current_point, current_matches);
+		int neighbor_num = neighbor_search->radiusSearch(location, scratch.matches);
 		if (neighbor_num >= min_neighbor_num)
 		{
 			for (int i = 0; i < neighbor_num; i++)
 			{
-				if (poi_queue[current_matches[i].first].result.zncc >= zncc_threshold)
+				if (isAvailable(poi_queue[scratch.matches[i].first]))
 				{
-					pois_fit.push_back(poi_queue[current_matches[i].first]);
+					scratch.neighbor_idx.push_back((int)scratch.matches[i].first);
 				}
 			}
 		}
-		else //try KNN search if the obtained neighbor POIs are not enough
+		if ((int)scratch.neighbor_idx.size() >= min_neighbor_num)
 		{
-			std::vector<POI2D>().swap(pois_fit);
+			return (int)scratch.neighbor_idx.size();
+		}
 
-			std::vector<uint32_t> k_neighbors_idx;
-			std::vector<float> squared_distance;
-			neighbor_num = neighbor_search->knnSearch(current_point, k_neighbors_idx, squared_distance);
+		//take all the available POIs in the subregion, topped up with the nearest available ones out of it until
+		//there are enough for fitting. the search is enlarged until it reaches out of the subregion and finds enough
+		//POIs, or covers the whole queue
+		int queue_size = (int)poi_queue.size();
+		float squared_radius = subregion_radius * subregion_radius;
+		int search_k = min_neighbor_num;
+		while (true)
+		{
+			search_k = std::min(search_k, queue_size);
+			neighbor_num = neighbor_search->knnSearch(location, search_k, scratch.knn_idx, scratch.knn_distance);
 
+			scratch.neighbor_idx.clear();
 			for (int i = 0; i < neighbor_num; i++)
 			{
-				if (poi_queue[k_neighbors_idx[i]].result.zncc >= zncc_threshold)
+				if (scratch.knn_distance[i] >= squared_radius && (int)scratch.neighbor_idx.size() >= min_neighbor_num)
 				{
-					pois_fit.push_back(poi_queue[k_neighbors_idx[i]]);
+					break;
+				}
+				if (isAvailable(poi_queue[scratch.knn_idx[i]]))
+				{
+					scratch.neighbor_idx.push_back((int)scratch.knn_idx[i]);
 				}
-			}
-		}
-		neighbor_num = (int)pois_fit.size();
-
-		//use brutal force search in case of insufficient neighbor POIs for fitting
-		if (neighbor_num < min_neighbor_num)
-		{
-			std::vector<POI2D>().swap(pois_fit);
-			std::vector<PointIndex> pois_sorted_index;
-
-			//sort the poi queue in a descending order of distance to the POI
-			int queue_size = (int)poi_queue.size();
-			for (int i = 0; i < queue_size; i++)
-			{
-				Point2D distance = poi_queue[i] - (Point2D)*poi;
-				PointIndex current_poi_idx;
-				current_poi_idx.poi_idx = i;
-				current_poi_idx.distance = distance.vectorNorm();
-				pois_sorted_index.push_back(current_poi_idx);
 			}
 
-			std::sort(pois_sorted_index.begin(), pois_sorted_index.end(), sortByDistance);
-
-			//pick the neighbor POIs for facet fitting
-			int i = 0;
-			while (i < queue_size && (pois_sorted_index[i].distance < subregion_radius || pois_fit.size() < min_neighbor_num))
+			bool out_of_subregion = (neighbor_num > 0 && scratch.knn_distance[neighbor_num - 1] >= squared_radius);
+			if ((out_of_subregion && (int)scratch.neighbor_idx.size() >= min_neighbor_num) || search_k >= queue_size)
 			{
-				if (poi_queue[pois_sorted_index[i].poi_idx].result.zncc >= zncc_threshold)
-				{
-					pois_fit.push_back(poi_queue[pois_sorted_index[i].poi_idx]);
-				}
-				i++;
+				break;
 			}
+			search_k *= 2;
 		}
-		neighbor_num = (int)pois_fit.size();
 
-		//create matrices of displacments
-		Eigen::VectorXf u_vector(neighbor_num);
-		Eigen::VectorXf v_vector(neighbor_num);
+		return (int)scratch.neighbor_idx.size();
+	}
 
-		//construct coefficient matrix
-		Eigen::MatrixXf coefficient_matrix = Eigen::MatrixXf::Zero(neighbor_num, 3);
+	void Strain::compute(POI2D* poi, std::vector<POI2D>& poi_queue, StrainScratch& scratch)
+	{
+		int neighbor_num = getNeighbors(Point3D(poi->x, poi->y, 0.f), poi_queue, scratch);
 
-		//fill coefficient matrix, u_vector and v_vector
+		//normal equations of the fitting of u and v, the two share the same coefficient matrix
+		Eigen::Matrix3d normal_matrix = Eigen::Matrix3d::Zero();
+		Eigen::Matrix<double, 3, 2> normal_vector = Eigen::Matrix<double, 3, 2>::Zero();
 		for (int i = 0; i < neighbor_num; i++)
 		{
-			coefficient_matrix(i, 0) = 1.f;
-			coefficient_matrix(i, 1) = pois_fit[i].x - poi->x;
-			coefficient_matrix(i, 2) = pois_fit[i].y - poi->y;
-
-			u_vector(i) = pois_fit[i].deformation.u;
-			v_vector(i) = pois_fit[i].deformation.v;
+			POI2D* neighbor_poi = &poi_queue[scratch.neighbor_idx[i]];
+			Eigen::Vector3d coefficient(1., neighbor_poi->x - poi->x, neighbor_poi->y - poi->y);
+			normal_matrix.noalias() += coefficient * coefficient.transpose();
+			normal_vector.col(0) += coefficient * neighbor_poi->deformation.u;
+			normal_vector.col(1) += coefficient * neighbor_poi->deformation.v;
 		}
 
 		//solve the equations to obtain gradients of u and v
-		Eigen::VectorXf u_gradient = coefficient_matrix.colPivHouseholderQr().solve(u_vector);
-		Eigen::VectorXf v_gradient = coefficient_matrix.colPivHouseholderQr().solve(v_vector);
-		float ux = u_gradient(1, 0);
-		float uy = u_gradient(2, 0);
-		float vx = v_gradient(1, 0);
-		float vy = v_gradient(2, 0);
+		Eigen::Matrix<double, 3, 2> gradient = normal_matrix.colPivHouseholderQr().solve(normal_vector);
+		float ux = (float)gradient(1, 0);
+		float uy = (float)gradient(2, 0);
+		float vx = (float)gradient(1, 1);
+		float vy = (float)gradient(2, 1);
 
-		if (approximation == 1)
-		{
-			//calculate the Cauchy strain and save them for output
-			poi->strain.exx = ux;
-			poi->strain.eyy = vy;
-			poi->strain.exy = 0.5f * (uy + vx);
-		}
-		if (approximation == 2)
-		{
-			//calculate the Green strain and save them for output
-			poi->strain.exx = ux + 0.5f * (ux * ux + vx * vx);
-			poi->strain.eyy = vy + 0.5f * (uy * uy + vy * vy);
-			poi->strain.exy = 0.5f * (uy + vx + uy * ux + vy * vx);
-		}
+		assignStrain(poi->strain, ux, uy, vx, vy);
 	}
 
-	void Strain::compute(std::vector<POI2D>& poi_queue)
+	void Strain::compute(POI2D* poi, std::vector<POI2D>& poi_queue)
 	{
-		int queue_length = (int)poi_queue.size();
-#pragma omp parallel for
-		for (int i = 0; i < queue_length; i++)
-		{
-			compute(&poi_queue[i], poi_queue);
-		}
+		StrainScratch scratch;
+		compute(poi, poi_queue, scratch);
 	}
 
-	void Strain::compute(POI2DS* poi, std::vector<POI2DS>& poi_queue)
+	void Strain::compute(std::vector<POI2D>& poi_queue)
 	{
-		//get instance of NearestNeighbor according to thread id
-		NearestNeighbor* neighbor_search = getInstance(omp_get_thread_num());
-
-		//3D point for approximation of nearest neighbors
-		Point3D current_point(poi->x, poi->y, 0.f);
-
-		//POI queue for displacment field fitting
-		std::vector<POI2DS> pois_fit;
+		int queue_length = (int)poi_queue.size();
 
-		//search the neighbor keypoints in a subregion of given radius
-		std::vector<nanoflann::ResultItem<uint32_t, float>> current_matches;
-		int neighbor_num = neighbor_search->radiusSearch(current_point, current_matches);
-		if (neighbor_num >= min_neighbor_num)
+		//the lattice detected in prepare() is used only if it is built for the same queue
+		bool on_lattice = lattice_indexing && lattice.dim[0] > 0 && (int)lattice.poi_node.size() == queue_length;
+		std::vector<char> poi_valid(on_lattice ? queue_length : 0);
+		for (int i = 0; i < (int)poi_valid.size(); i++)
 		{
-			for (int i = 0; i < neighbor_num; i++)
-			{
-				if (poi_queue[current_matches[i].first].result.r1r2_zncc >= zncc_threshold
-					&& poi_queue[current_matches[i].first].result.r1t1_zncc >= zncc_threshold
-					&& poi_queue[current_matches[i].first].result.r1t2_zncc >= zncc_threshold)
-				{
-					pois_fit.push_back(poi_queue[current_matches[i].first]);
-				}
-			}
+			poi_valid[i] = isAvailable(poi_queue[i]);
 		}
-		else //try KNN search if the obtained neighbor POIs are not enough
-		{
-			std::vector<POI2DS>().swap(pois_fit);
 
-			std::vector<uint32_t> k_neighbors_idx;
-			std::vector<float> squared_distance;
-			neighbor_num = neighbor_search->knnSearch(current_point, k_neighbors_idx, squared_distance);
+		ScheduleScope schedule_scope(schedule_mode, schedule_chunk, queue_length);
+#pragma omp parallel
+		{
+			StrainScratch scratch;
 
-			for (int i = 0; i < neighbor_num; i++)
+#pragma omp for schedule(runtime)
+			for (int i = 0; i < queue_length; i++)
 			{
-				if (poi_queue[current_matches[i].first].result.r1r2_zncc >= zncc_threshold
-					&& poi_queue[current_matches[i].first].result.r1t1_zncc >= zncc_threshold
-					&& poi_queue[current_matches[i].first].result.r1t2_zncc >= zncc_threshold)
+				//the gradients of interior POIs are weighted sums of displacements on the lattice
+				if (on_lattice && isLatticeInterior(i, poi_valid))
 				{
-					pois_fit.push_back(poi_queue[k_neighbors_idx[i]]);
+					int node = lattice.poi_node[i];
+					int stencil_size = (int)lattice.stencil_node.size();
+					float ux = 0.f, uy = 0.f, vx = 0.f, vy = 0.f;
+					for (int j = 0; j < stencil_size; j++)
+					{
+						POI2D* neighbor_poi = &poi_queue[lattice.node_poi[node + lattice.stencil_node[j]]];
+						ux += lattice.weight_x[j] * neighbor_poi->deformation.u;
+						uy += lattice.weight_y[j] * neighbor_poi->deformation.u;
+						vx += lattice.weight_x[j] * neighbor_poi->deformation.v;
+						vy += lattice.weight_y[j] * neighbor_poi->deformation.v;
+					}
+					assignStrain(poi_queue[i].strain, ux, uy, vx, vy);
 				}
-			}
-		}
-		neighbor_num = (int)pois_fit.size();
-
-		//use brutal force search in case of insufficient neighbor POIs for fitting
-		if (neighbor_num < min_neighbor_num)
-		{
-			std::vector<POI2DS>().swap(pois_fit);
-			std::vector<PointIndex> pois_sorted_index;
-
-			//sort the poi queue in a descending order of distance to the POI
-			int queue_size = (int)poi_queue.size();
-			for (int i = 0; i < queue_size; i++)
-			{
-				Point2D distance = poi_queue[i] - (Point2D)*poi;
-				PointIndex current_poi_idx;
-				current_poi_idx.poi_idx = i;
-				current_poi_idx.distance = distance.vectorNorm();
-				pois_sorted_index.push_back(current_poi_idx);
-			}
-
-			std::sort(pois_sorted_index.begin(), pois_sorted_index.end(), sortByDistance);
-
-			//pick the neighbor POIs for facet fitting
-			int i = 0;
-			while (i < queue_size && (pois_sorted_index[i].distance < subregion_radius || pois_fit.size() < min_neighbor_num))
-			{
-				if (poi_queue[pois_sorted_index[i].poi_idx].result.r1r2_zncc >= zncc_threshold
-					&& poi_queue[pois_sorted_index[i].poi_idx].result.r1t1_zncc >= zncc_threshold
-					&& poi_queue[pois_sorted_index[i].poi_idx].result.r1t2_zncc >= zncc_threshold)
+				else
 				{
-					pois_fit.push_back(poi_queue[pois_sorted_index[i].poi_idx]);
+					compute(&poi_queue[i], poi_queue, scratch);
 				}
-				i++;
 			}
 		}
-		neighbor_num = (int)pois_fit.size();
-
-		//create matrices of displacments
-		Eigen::VectorXf u_vector(neighbor_num);
-		Eigen::VectorXf v_vector(neighbor_num);
-		Eigen::VectorXf w_vector(neighbor_num);
+	}
 
-		//construct coefficient matrix
-		Eigen::MatrixXf coefficient_matrix = Eigen::MatrixXf::Zero(neighbor_num, 4);
+	void Strain::compute(POI2DS* poi, std::vector<POI2DS>& poi_queue, StrainScratch& scratch)
+	{
+		int neighbor_num = getNeighbors(Point3D(poi->x, poi->y, 0.f), poi_queue, scratch);
 
-		//fill coefficient matrix, u_vector, v_vector, and w_vector
+		//normal equations of the fitting of u, v and w in the reconstructed space
+		Eigen::Matrix4d normal_matrix = Eigen::Matrix4d::Zero();
+		Eigen::Matrix<double, 4, 3> normal_vector = Eigen::Matrix<double, 4, 3>::Zero();
 		for (int i = 0; i < neighbor_num; i++)
 		{
-			Point3D current_pt_3d = pois_fit[i].ref_coor - poi->ref_coor;
-			coefficient_matrix(i, 0) = 1.f;
-			coefficient_matrix(i, 1) = current_pt_3d.x;
-			coefficient_matrix(i, 2) = current_pt_3d.y;
-			coefficient_matrix(i, 3) = current_pt_3d.z;
-
-			u_vector(i) = pois_fit[i].deformation.u;
-			v_vector(i) = pois_fit[i].deformation.v;
-			w_vector(i) = pois_fit[i].deformation.w;
+			POI2DS* neighbor_poi = &poi_queue[scratch.neighbor_idx[i]];
+			Point3D offset = neighbor_poi->ref_coor - poi->ref_coor;
+			Eigen::Vector4d coefficient(1., offset.x, offset.y, offset.z);
+			normal_matrix.noalias() += coefficient * coefficient.transpose();
+			normal_vector.col(0) += coefficient * neighbor_poi->deformation.u;
+			normal_vector.col(1) += coefficient * neighbor_poi->deformation.v;
+			normal_vector.col(2) += coefficient * neighbor_poi->deformation.w;
 		}
 
 		//solve the equations to obtain gradients of u, v, and w
-		Eigen::VectorXf u_gradient = coefficient_matrix.colPivHouseholderQr().solve(u_vector);
-		Eigen::VectorXf v_gradient = coefficient_matrix.colPivHouseholderQr().solve(v_vector);
-		Eigen::VectorXf w_gradient = coefficient_matrix.colPivHouseholderQr().solve(w_vector);
-		float ux = u_gradient(1, 0);
-		float uy = u_gradient(2, 0);
-		float uz = u_gradient(3, 0);
-		float vx = v_gradient(1, 0);
-		float vy = v_gradient(2, 0);
-		float vz = v_gradient(3, 0);
-		float wx = w_gradient(1, 0);
-		float wy = w_gradient(2, 0);
-		float wz = w_gradient(3, 0);
-
-		if (approximation == 1)
-		{
-			//calculate the Cauchy strain and save them for output
-			poi->strain.exx = ux;
-			poi->strain.eyy = vy;
-			poi->strain.ezz = wz;
-			poi->strain.exy = 0.5f * (uy + vx);
-			poi->strain.eyz = 0.5f * (vz + wy);
-			poi->strain.ezx = 0.5f * (wx + uz);
-		}
-		if (approximation == 2)
-		{
-			poi->strain.exx = ux + 0.5f * (ux * ux + vx * vx + wx * wx);
-			poi->strain.eyy = vy + 0.5f * (uy * uy + vy * vy + wy * wy);
-			poi->strain.ezz = wz + 0.5f * (uz * uz + vz * vz + wz * wz);
-			poi->strain.exy = 0.5f * (uy + vx + uy * ux + vy * vx + wy * wx);
-			poi->strain.eyz = 0.5f * (vz + wy + uz * uy + vz * vy + wz * wy);
-			poi->strain.ezx = 0.5f * (wx + uz + ux * uz + vx * vz + wx * wz);
-		}
+		Eigen::Matrix<double, 4, 3> gradient = normal_matrix.colPivHouseholderQr().solve(normal_vector);
+		float ux = (float)gradient(1, 0);
+		float uy = (float)gradient(2, 0);
+		float uz = (float)gradient(3, 0);
+		float vx = (float)gradient(1, 1);
+		float vy = (float)gradient(2, 1);
+		float vz = (float)gradient(3, 1);
+		float wx = (float)gradient(1, 2);
+		float wy = (float)gradient(2, 2);
+		float wz = (float)gradient(3, 2);
+
+		assignStrain(poi->strain, ux, uy, uz, vx, vy, vz, wx, wy, wz);
 	}
 
-	void Strain::compute(std::vector<POI2DS>& poi_queue)
+	void Strain::compute(POI2DS* poi, std::vector<POI2DS>& poi_queue)
 	{
-		int queue_length = (int)poi_queue.size();
-#pragma omp parallel for
-		for (int i = 0; i < queue_length; i++)
-		{
-			compute(&poi_queue[i], poi_queue);
-		}
+		StrainScratch scratch;
+		compute(poi, poi_queue, scratch);
 	}
 
-	void Strain::compute(POI3D* poi, std::vector<POI3D>& poi_queue)
+	void Strain::compute(std::vector<POI2DS>& poi_queue)
 	{
-		//get instance of NearestNeighbor according to thread id
-		NearestNeighbor* neighbor_search = getInstance(omp_get_thread_num());
-
-		//3D point for approximation of nearest neighbors
-		Point3D current_point(poi->x, poi->y, poi->z);
-
-		//POI queue for displacment field fitting
-		std::vector<POI3D> pois_fit;
-
-		//search the neighbor keypoints in a subregion of given radius
-		std::vector<nanoflann::ResultItem<uint32_t, float>> current_matches;
-		int neighbor_num = neighbor_search->radiusSearch(current_point, current_matches);
-		if (neighbor_num >= min_neighbor_num)
-		{
-			for (int i = 0; i < neighbor_num; i++)
-			{
-				if (poi_queue[current_matches[i].first].result.zncc >= zncc_threshold)
-				{
-					pois_fit.push_back(poi_queue[current_matches[i].first]);
-				}
-			}
-		}
-		else //try KNN search if the obtained neighbor POIs are not enough
-		{
-			std::vector<POI3D>().swap(pois_fit);
-
-			std::vector<uint32_t> k_neighbors_idx;
-			std::vector<float> squared_distance;
-			neighbor_num = neighbor_search->knnSearch(current_point, k_neighbors_idx, squared_distance);
-
-			for (int i = 0; i < neighbor_num; i++)
-			{
-				if (poi_queue[k_neighbors_idx[i]].result.zncc >= zncc_threshold)
-				{
-					pois_fit.push_back(poi_queue[k_neighbors_idx[i]]);
-				}
-			}
-		}
-		neighbor_num = (int)pois_fit.size();
+		int queue_length = (int)poi_queue.size();
 
-		//use brutal force search in case of insufficient neighbor POIs for fitting
-		if (neighbor_num < min_neighbor_num)
+		ScheduleScope schedule_scope(schedule_mode, schedule_chunk, queue_length);
+#pragma omp parallel
 		{
-			std::vector<POI3D>().swap(pois_fit);
-			std::vector<PointIndex> pois_sorted_index;
-
-			//sort the poi queue in a descendent order of distance to the POI
-			int queue_size = (int)poi_queue.size();
-			for (int i = 0; i < queue_size; i++)
-			{
-				Point3D distance = poi_queue[i] - (Point3D)*poi;
-				PointIndex current_poi_idx;
-				current_poi_idx.poi_idx = i;
-				current_poi_idx.distance = distance.vectorNorm();
-				pois_sorted_index.push_back(current_poi_idx);
-			}
+			StrainScratch scratch;
 
-			std::sort(pois_sorted_index.begin(), pois_sorted_index.end(), sortByDistance);
-
-			//pick the neighbor POIs for facet fitting
-			int i = 0;
-			while (i < queue_size && (pois_sorted_index[i].distance < subregion_radius || pois_fit.size() <= min_neighbor_num))
+#pragma omp for schedule(runtime)
+			for (int i = 0; i < queue_length; i++)
 			{
-				if (poi_queue[pois_sorted_index[i].poi_idx].result.zncc >= zncc_threshold)
-				{
-					pois_fit.push_back(poi_queue[pois_sorted_index[i].poi_idx]);
-				}
-				i++;
+				compute(&poi_queue[i], poi_queue, scratch);
 			}
 		}
-		neighbor_num = (int)pois_fit.size();
-
-		//create matrices of displacments
-		Eigen::VectorXf u_vector(neighbor_num);
-		Eigen::VectorXf v_vector(neighbor_num);
-		Eigen::VectorXf w_vector(neighbor_num);
+	}
 
-		//construct coefficient matrix
-		Eigen::MatrixXf coefficient_matrix = Eigen::MatrixXf::Zero(neighbor_num, 4);
+	void Strain::compute(POI3D* poi, std::vector<POI3D>& poi_queue, StrainScratch& scratch)
+	{
+		int neighbor_num = getNeighbors(Point3D(poi->x, poi->y, poi->z), poi_queue, scratch);
 
-		//fill coefficient matrix, u_vector, v_vector, and w_vector
+		//normal equations of the fitting of u, v and w, the three share the same coefficient matrix
+		Eigen::Matrix4d normal_matrix = Eigen::Matrix4d::Zero();
+		Eigen::Matrix<double, 4, 3> normal_vector = Eigen::Matrix<double, 4, 3>::Zero();
 		for (int i = 0; i < neighbor_num; i++)
 		{
-			coefficient_matrix(i, 0) = 1.f;
-			coefficient_matrix(i, 1) = pois_fit[i].x - poi->x;
-			coefficient_matrix(i, 2) = pois_fit[i].y - poi->y;
-			coefficient_matrix(i, 3) = pois_fit[i].z - poi->z;
-
-			u_vector(i) = pois_fit[i].deformation.u;
-			v_vector(i) = pois_fit[i].deformation.v;
-			w_vector(i) = pois_fit[i].deformation.w;
+			POI3D* neighbor_poi = &poi_queue[scratch.neighbor_idx[i]];
+			Eigen::Vector4d coefficient(1., neighbor_poi->x - poi->x, neighbor_poi->y - poi->y, neighbor_poi->z - poi->z);
+			normal_matrix.noalias() += coefficient * coefficient.transpose();
+			normal_vector.col(0) += coefficient * neighbor_poi->deformation.u;
+			normal_vector.col(1) += coefficient * neighbor_poi->deformation.v;
+			normal_vector.col(2) += coefficient * neighbor_poi->deformation.w;
 		}
 
 		//solve the equations to obtain gradients of u, v, and w
-		Eigen::VectorXf u_gradient = coefficient_matrix.colPivHouseholderQr().solve(u_vector);
-		Eigen::VectorXf v_gradient = coefficient_matrix.colPivHouseholderQr().solve(v_vector);
-		Eigen::VectorXf w_gradient = coefficient_matrix.colPivHouseholderQr().solve(w_vector);
-		float ux = u_gradient(1, 0);
-		float uy = u_gradient(2, 0);
-		float uz = u_gradient(3, 0);
-		float vx = v_gradient(1, 0);
-		float vy = v_gradient(2, 0);
-		float vz = v_gradient(3, 0);
-		float wx = w_gradient(1, 0);
-		float wy = w_gradient(2, 0);
-		float wz = w_gradient(3, 0);
+		Eigen::Matrix<double, 4, 3> gradient = normal_matrix.colPivHouseholderQr().solve(normal_vector);
+		float ux = (float)gradient(1, 0);
+		float uy = (float)gradient(2, 0);
+		float uz = (float)gradient(3, 0);
+		float vx = (float)gradient(1, 1);
+		float vy = (float)gradient(2, 1);
+		float vz = (float)gradient(3, 1);
+		float wx = (float)gradient(1, 2);
+		float wy = (float)gradient(2, 2);
+		float wz = (float)gradient(3, 2);
+
+		assignStrain(poi->strain, ux, uy, uz, vx, vy, vz, wx, wy, wz);
+	}
 
-		if (approximation == 1)
-		{
-			//calculate the Cauchy strain and save them for output
-			poi->strain.exx = ux;
-			poi->strain.eyy = vy;
-			poi->strain.ezz = wz;
-			poi->strain.exy = 0.5f * (uy + vx);
-			poi->strain.eyz = 0.5f * (vz + wy);
-			poi->strain.ezx = 0.5f * (wx + uz);
-		}
-		if (approximation == 2)
-		{
-			poi->strain.exx = ux + 0.5f * (ux * ux + vx * vx + wx * wx);
-			poi->strain.eyy = vy + 0.5f * (uy * uy + vy * vy + wy * wy);
-			poi->strain.ezz = wz + 0.5f * (uz * uz + vz * vz + wz * wz);
-			poi->strain.exy = 0.5f * (uy + vx + uy * ux + vy * vx + wy * wx);
-			poi->strain.eyz = 0.5f * (vz + wy + uz * uy + vz * vy + wz * wy);
-			poi->strain.ezx = 0.5f * (wx + uz + ux * uz + vx * vz + wx * wz);
-		}
+	void Strain::compute(POI3D* poi, std::vector<POI3D>& poi_queue)
+	{
+		StrainScratch scratch;
+		compute(poi, poi_queue, scratch);
 	}
 
 	void Strain::compute(std::vector<POI3D>& poi_queue)
 	{
 		int queue_length = (int)poi_queue.size();
-#pragma omp parallel for
-		for (int i = 0; i < queue_length; i++)
+
+		//the lattice detected in prepare() is used only if it is built for the same queue
+		bool on_lattice = lattice_indexing && lattice.dim[0] > 0 && (int)lattice.poi_node.size() == queue_length;
+		std::vector<char> poi_valid(on_lattice ? queue_length : 0);
+		for (int i = 0; i < (int)poi_valid.size(); i++)
 		{
-			compute(&poi_queue[i], poi_queue);
+			poi_valid[i] = isAvailable(poi_queue[i]);
 		}
-	}
 
+		ScheduleScope schedule_scope(schedule_mode, schedule_chunk, queue_length);
+#pragma omp parallel
+		{
+			StrainScratch scratch;
 
-	bool sortByDistance(const PointIndex& p1, const PointIndex& p2)
-	{
-		return p1.distance < p2.distance;
+#pragma omp for schedule(runtime)
+			for (int i = 0; i < queue_length; i++)
+			{
+				//the gradients of interior POIs are weighted sums of displacements on the lattice
+				if (on_lattice && isLatticeInterior(i, poi_valid))
+				{
+					int node = lattice.poi_node[i];
+					int stencil_size = (int)lattice.stencil_node.size();
+					float ux = 0.f, uy = 0.f, uz = 0.f, vx = 0.f, vy = 0.f, vz = 0.f, wx = 0.f, wy = 0.f, wz = 0.f;
+					for (int j = 0; j < stencil_size; j++)
+					{
+						POI3D* neighbor_poi = &poi_queue[lattice.node_poi[node + lattice.stencil_node[j]]];
+						ux += lattice.weight_x[j] * neighbor_poi->deformation.u;
+						uy += lattice.weight_y[j] * neighbor_poi->deformation.u;
+						uz += lattice.weight_z[j] * neighbor_poi->deformation.u;
+						vx += lattice.weight_x[j] * neighbor_poi->deformation.v;
+						vy += lattice.weight_y[j] * neighbor_poi->deformation.v;
+						vz += lattice.weight_z[j] * neighbor_poi->deformation.v;
+						wx += lattice.weight_x[j] * neighbor_poi->deformation.w;
+						wy += lattice.weight_y[j] * neighbor_poi->deformation.w;
+						wz += lattice.weight_z[j] * neighbor_poi->deformation.w;
+					}
+					assignStrain(poi_queue[i].strain, ux, uy, uz, vx, vy, vz, wx, wy, wz);
+				}
+				else
+				{
+					compute(&poi_queue[i], poi_queue, scratch);
+				}
+			}
+		}
 	}
 
 }//namespace opencorr
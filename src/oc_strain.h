@@ -17,25 +17,61 @@
 #ifndef _STRAIN_H_
 #define _STRAIN_H_
 
+#include <vector>
+
 #include "oc_array.h"
 #include "oc_nearest_neighbor.h"
 #include "oc_poi.h"
 #include "oc_point.h"
+#include "oc_schedule.h"
 
 namespace opencorr
 {
-	struct PointIndex //structure for brute force search
+	//buffers of neighbor search, reused by the POIs processed in one CPU thread
+	struct StrainScratch
+	{
+		std::vector<nanoflann::ResultItem<uint32_t, float>> matches; //results of radius search
+		std::vector<uint32_t> knn_idx; //results of kNN search
+		std::vector<float> knn_distance; //squared distances of kNN search
+		std::vector<int> neighbor_idx; //indices of the neighbor POIs used in fitting
+	};
+
+	//regular lattice formed by the POIs, the neighbors in subregion of an interior node share the same fitting weights
+	struct StrainLattice
 	{
-		int poi_idx; //index the poi queue
-		float distance; //Euclidean distance to the processed POI
+		int dim[3] = { 0, 0, 0 }; //number of nodes along x, y and z, 0 if the POIs do not form a lattice
+		int reach[3] = { 0, 0, 0 }; //maximum offset of neighbors along x, y and z, in nodes
+		std::vector<int> node_poi; //index of POI on each node, x varies fastest
+		std::vector<int> poi_node; //index of node of each POI
+		std::vector<int> stencil_x, stencil_y, stencil_z; //offsets of the neighbors in subregion, in nodes
+		std::vector<int> stencil_node; //offsets of the neighbors in the array of nodes
+		std::vector<float> weight_x, weight_y, weight_z; //rows of the pseudo-inverse of coefficient matrix, i.e. the weights for gradients
 	};
 
 	//calculation of Green-Lagrangian strain
-	class Strain
+	class Strain : public PoiSchedule
 	{
 	private:
-		std::vector<NearestNeighbor*> instance_pool;
-		NearestNeighbor* getInstance(int tid);
+		NearestNeighbor* neighbor_search; //kd-tree shared by all the CPU threads
+
+		void setLattice(std::vector<Point3D>& pt_queue, int dimension); //detect the lattice of POIs and compute the shared fitting weights
+		bool isLatticeInterior(int poi_idx, std::vector<char>& poi_valid); //all the neighbors in the subregion are on the lattice and valid
+
+		void assignStrain(StrainVector2D& strain, float ux, float uy, float vx, float vy);
+		void assignStrain(StrainVector3D& strain, float ux, float uy, float uz, float vx, float vy, float vz, float wx, float wy, float wz);
+
+		bool isAvailable(POI2D& poi) const; //ZNCC of POI is above the threshold
+		bool isAvailable(POI2DS& poi) const;
+		bool isAvailable(POI3D& poi) const;
+
+		//collect the indices of available POIs in subregion, or the nearest ones if they are not enough for fitting
+		template <class PoiType>
+		int getNeighbors(Point3D location, std::vector<PoiType>& poi_queue, StrainScratch& scratch);
+
+		//fit the displacement field around a POI by least squares, using the buffers of the calling thread
+		void compute(POI2D* poi, std::vector<POI2D>& poi_queue, StrainScratch& scratch);
+		void compute(POI2DS* poi, std::vector<POI2DS>& poi_queue, StrainScratch& scratch);
+		void compute(POI3D* poi, std::vector<POI3D>& poi_queue, StrainScratch& scratch);
 
 	protected:
 		float subregion_radius; //radius of subregion
@@ -44,6 +80,8 @@ namespace opencorr
 		int description; //description of strain, 1 for Lagranian and 2 for Eulerian
 		int approximation; //approximation of strain, 1 for Cauchy strain and 2 for Green strain
 		int thread_number; //CPU thread number
+		bool lattice_indexing; //gather neighbors by index arithmetic when the POIs form a regular lattice
+		StrainLattice lattice; //lattice detected in prepare()
 
 	public:
 
@@ -59,6 +97,7 @@ namespace opencorr
 		void setZnccThreshold(float zncc_threshold);
 		void setDescription(int description); //"1" for Lagrangian, "2" for Eulerian
 		void setApproximation(int approximation); //"1" for Cauchy strain, "2" for Green strain
+		void setLatticeIndexing(bool lattice_indexing);
 
 		void prepare(std::vector<POI2D>& poi_queue);
 		void prepare(std::vector<POI2DS>& poi_queue);
@@ -73,9 +112,6 @@ namespace opencorr
 		void compute(std::vector<POI3D>& poi_queue);
 	};
 
-
-	bool sortByDistance(const PointIndex& p1, const PointIndex& p2);
-
 }//namespace opencorr
 
 #endif //_STRAIN_H_
\ No newline at end of file
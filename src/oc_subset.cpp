@@ -59,11 +59,6 @@ namespace opencorr
 			std::cerr << "Too small radius:" << radius_x << ", " << radius_y << ", " << radius_z << std::endl;
 		}
 
-		if (vol_mat != nullptr)
-		{
-			delete3D(vol_mat);
-		}
-
 		this->center = center;
 		this->radius_x = radius_x;
 		this->radius_y = radius_y;
@@ -73,27 +68,28 @@ namespace opencorr
 		dim_z = radius_z * 2 + 1;
 		size = dim_z * dim_y * dim_x;
 
-		vol_mat = new3D(dim_z, dim_y, dim_x);
+		vol_mat.allocate(dim_x, dim_y, dim_z);
 	}
 
 	Subset3D::~Subset3D()
 	{
-		if (vol_mat != nullptr)
-		{
-			delete3D(vol_mat);
-		}
+		vol_mat.release();
 	}
 
 	void Subset3D::fill(Image3D* image)
 	{
 		Point3D start_point(center.x - radius_x, center.y - radius_y, center.z - radius_z);
+		int x_start = int(start_point.x);
 		for (int i = 0; i < dim_z; i++)
 		{
 			for (int j = 0; j < dim_y; j++)
 			{
+				//copy a row of subset from a row of image
+				float* subset_row = vol_mat.row(i, j);
+				const float* image_row = image->vol_mat.row(int(start_point.z + i), int(start_point.y + j)) + x_start;
 				for (int k = 0; k < dim_x; k++)
 				{
-					vol_mat[i][j][k] = image->vol_mat[int(start_point.z + i)][int(start_point.y + j)][int(start_point.x + k)];
+					subset_row[k] = image_row[k];
 				}
 			}
 		}
@@ -101,32 +97,23 @@ namespace opencorr
 
 	float Subset3D::zeroMeanNorm()
 	{
+		//the voxels of subset are contiguous, thus processed as a 1D array
+		float* voxel = vol_mat.data;
+
 		//calculate the mean of gray-scale values
 		float mean_value = 0;
-		for (int i = 0; i < dim_z; i++)
+		for (int i = 0; i < size; i++)
 		{
-			for (int j = 0; j < dim_y; j++)
-			{
-				for (int k = 0; k < dim_x; k++)
-				{
-					mean_value += vol_mat[i][j][k];
-				}
-			}
+			mean_value += voxel[i];
 		}
 		mean_value /= size;
 
 		//make the distribution of gray-scale values zero-mean
 		float subset_sum = 0;
-		for (int i = 0; i < dim_z; i++)
+		for (int i = 0; i < size; i++)
 		{
-			for (int j = 0; j < dim_y; j++)
-			{
-				for (int k = 0; k < dim_x; k++)
-				{
-					vol_mat[i][j][k] -= mean_value;
-					subset_sum += (vol_mat[i][j][k] * vol_mat[i][j][k]);
-				}
-			}
+			voxel[i] -= mean_value;
+			subset_sum += (voxel[i] * voxel[i]);
 		}
 
 		return sqrt(subset_sum);
@@ -48,7 +48,7 @@ namespace opencorr
 		int dim_x, dim_y, dim_z;
 		int size;
 
-		float*** vol_mat = nullptr;
+		Volume3D vol_mat; //contiguous, voxel (x, y, z) is accessed as vol_mat[z][y][x]
 
 		Subset3D(Point3D center, int radius_x, int radius_y, int radius_z);
 		~Subset3D();
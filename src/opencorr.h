@@ -18,6 +18,7 @@
 #define _OPENCORR_
 
 #include "oc_array.h"
+#include "oc_brick.h"
 #include "oc_calibration.h"
 #include "oc_cubic_bspline.h"
 #include "oc_deformation.h"
@@ -34,7 +35,11 @@
 #include "oc_nearest_neighbor.h"
 #include "oc_nr.h"
 #include "oc_poi.h"
+#include "oc_poi_field.h"
 #include "oc_point.h"
+#include "oc_rgdic.h"
+#include "oc_schedule.h"
+#include "oc_sequence.h"
 #include "oc_sift.h"
 #include "oc_stereovision.h"
 #include "oc_strain.h"